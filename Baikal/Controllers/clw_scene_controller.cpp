@@ -14,10 +14,25 @@
 #include "Utils/cl_inputmap_generator.h"
 #include "Utils/cl_program_manager.h"
 #include "Utils/cl_uberv2_generator.h"
+#include "Utils/half.h"
+#include "Utils/block_compression.h"
+#include "Utils/aligned_memory.h"
+#include "Utils/mipmap.h"
+#include "Utils/normal_map.h"
+#include "Utils/vertex_compression.h"
+#include "math/mathutils.h"
 
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <future>
 #include <memory>
+#include <set>
+#include <thread>
 #include <stack>
 #include <vector>
 #include <array>
@@ -26,11 +41,6 @@ using namespace RadeonRays;
 
 namespace Baikal
 {
-    static std::size_t align16(std::size_t value)
-    {
-        return (value + 0xF) / 0x10 * 0x10;
-    }
-
     static CameraType GetCameraType(Camera& camera)
     {
         auto perspective = dynamic_cast<PerspectiveCamera*>(&camera);
@@ -50,13 +60,190 @@ namespace Baikal
         return CameraType::kPerspective;
     }
 
+    // Compression flags actually used for the mesh: 16-bit indices are only
+    // possible if all vertex indices fit into 16 bits.
+    static std::uint32_t GetMeshCompression(Mesh const& mesh, std::uint32_t compression)
+    {
+        compression &= ~ClwScene::kShortIndices;
+
+        if ((compression & ClwScene::kCompressedIndices) && CanUseShortIndices(mesh.GetNumVertices()))
+        {
+            compression |= ClwScene::kShortIndices;
+        }
+
+        return compression;
+    }
+
+    // Reserve index range for the mesh and return its start. Units are ints for plain
+    // index buffer or 16-bit words if indices are compressed (32-bit indices are word aligned then).
+    static std::size_t ReserveIndices(Mesh const& mesh, std::uint32_t mesh_compression, std::size_t& num_index_units)
+    {
+        auto num_indices = mesh.GetNumIndices();
+
+        if ((mesh_compression & ClwScene::kCompressedIndices) && !(mesh_compression & ClwScene::kShortIndices))
+        {
+            num_index_units = (num_index_units + 1) & ~std::size_t(1);
+            num_indices *= 2;
+        }
+
+        auto start = num_index_units;
+        num_index_units += num_indices;
+        return start;
+    }
+
+    static std::size_t GetPositionSize(std::uint32_t compression)
+    {
+        return (compression & ClwScene::kCompressedPositions) ? 3 * sizeof(std::uint16_t) : sizeof(float3);
+    }
+
+    static std::size_t GetNormalSize(std::uint32_t compression)
+    {
+        return (compression & ClwScene::kCompressedNormals) ? sizeof(std::uint32_t) : sizeof(float3);
+    }
+
+    static std::size_t GetUVSize(std::uint32_t compression)
+    {
+        return (compression & ClwScene::kCompressedUVs) ? 2 * sizeof(std::uint16_t) : sizeof(float2);
+    }
+
+    static std::size_t GetIndexUnitSize(std::uint32_t compression)
+    {
+        return (compression & ClwScene::kCompressedIndices) ? sizeof(std::uint16_t) : sizeof(int);
+    }
+
+    // Only normal mapped materials need tangent frames
+    static bool NeedsTangents(int material_layers)
+    {
+        return (material_layers & UberV2Material::Layers::kShadingNormalLayer) != 0;
+    }
+
+    // Write mesh vertex attributes and indices into mapped buffers at the specified
+    // element offsets and fill shape layout fields, start_tangent is -1 for no tangents.
+    static void WriteMeshGeometry(Mesh const& mesh, std::uint32_t compression,
+                                  char* vertices, char* normals, char* uvs, char* tangents, char* indices,
+                                  std::size_t start_vertex, std::size_t start_normal, std::size_t start_uv, std::size_t start_index,
+                                  int start_tangent, ClwScene::Shape& shape)
+    {
+        auto mesh_compression = GetMeshCompression(mesh, compression);
+
+        shape.compression = static_cast<int>(mesh_compression);
+        shape.startvtx = static_cast<int>(start_vertex);
+        shape.startidx = static_cast<int>(start_index);
+        shape.starttangent = start_tangent;
+        shape.position_offset = float3(0.f, 0.f, 0.f);
+        shape.position_scale = float3(1.f, 1.f, 1.f);
+
+        auto mesh_vertex_array = mesh.GetVertices();
+        auto mesh_num_vertices = mesh.GetNumVertices();
+
+        if (mesh_compression & ClwScene::kCompressedPositions)
+        {
+            auto bounds = mesh.GetLocalAABB();
+            auto extents = bounds.pmax - bounds.pmin;
+
+            shape.position_offset = bounds.pmin;
+            shape.position_scale = extents * (1.f / 65535.f);
+
+            auto positions = reinterpret_cast<std::uint16_t*>(vertices) + 3 * start_vertex;
+            for (std::size_t i = 0; i < mesh_num_vertices; ++i)
+            {
+                QuantizePosition(mesh_vertex_array[i], bounds.pmin, extents, positions + 3 * i);
+            }
+        }
+        else
+        {
+            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, reinterpret_cast<float3*>(vertices) + start_vertex);
+        }
+
+        auto mesh_normal_array = mesh.GetNormals();
+        auto mesh_num_normals = mesh.GetNumNormals();
+
+        if (mesh_compression & ClwScene::kCompressedNormals)
+        {
+            auto packed = reinterpret_cast<std::uint32_t*>(normals) + start_normal;
+            std::transform(mesh_normal_array, mesh_normal_array + mesh_num_normals, packed, EncodeOctahedralNormal);
+        }
+        else
+        {
+            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, reinterpret_cast<float3*>(normals) + start_normal);
+        }
+
+        auto mesh_uv_array = mesh.GetUVs();
+        auto mesh_num_uvs = mesh.GetNumUVs();
+
+        if (mesh_compression & ClwScene::kCompressedUVs)
+        {
+            auto packed = reinterpret_cast<std::uint16_t*>(uvs) + 2 * start_uv;
+            for (std::size_t i = 0; i < mesh_num_uvs; ++i)
+            {
+                packed[2 * i] = half(mesh_uv_array[i].x).bits();
+                packed[2 * i + 1] = half(mesh_uv_array[i].y).bits();
+            }
+        }
+        else
+        {
+            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, reinterpret_cast<float2*>(uvs) + start_uv);
+        }
+
+        // Generate tangent frames if the mesh does not provide them
+        if (start_tangent >= 0)
+        {
+            auto packed_tangents = reinterpret_cast<std::uint32_t*>(tangents) + start_tangent;
+
+            if (mesh.GetNumTangents() == mesh_num_vertices)
+            {
+                std::transform(mesh.GetTangents(), mesh.GetTangents() + mesh_num_vertices, packed_tangents, EncodeTangent);
+            }
+            else
+            {
+                auto mesh_tangents = ComputeTangents(mesh);
+                std::transform(mesh_tangents.cbegin(), mesh_tangents.cend(), packed_tangents, EncodeTangent);
+            }
+        }
+
+        auto mesh_index_array = mesh.GetIndices();
+        auto mesh_num_indices = mesh.GetNumIndices();
+
+        if (mesh_compression & ClwScene::kShortIndices)
+        {
+            EncodeShortIndices(mesh_index_array, mesh_num_indices, reinterpret_cast<std::uint16_t*>(indices) + start_index);
+        }
+        else
+        {
+            // start_index is in 16-bit words for compressed index stream
+            auto offset = start_index * GetIndexUnitSize(mesh_compression);
+            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, reinterpret_cast<std::uint32_t*>(indices + offset));
+        }
+    }
+
 
     ClwSceneController::ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api, const CLProgramManager *program_manager)
     : m_context(context)
     , m_api(api)
     , m_default_material(UberV2Material::Create())
     , m_program_manager(program_manager)
+    , m_geometry_compression(ClwScene::kCompressedNone)
+    , m_use_host_ptr(true)
+    , m_texture_backend(TextureBackend::kBuffer)
+    , m_image_support(true)
+    , m_acceleration_build_time(0.f)
     {
+        // Scene buffers can alias host memory only if every device in the context is a CPU
+        for (auto i = 0u; i < m_context.GetDeviceCount(); ++i)
+        {
+            m_use_host_ptr = m_use_host_ptr && m_context.GetDevice(i).GetType() == CL_DEVICE_TYPE_CPU;
+
+            cl_bool image_support = CL_FALSE;
+            clGetDeviceInfo(m_context.GetDevice(i).GetID(), CL_DEVICE_IMAGE_SUPPORT, sizeof(image_support), &image_support, nullptr);
+            m_image_support = m_image_support && image_support == CL_TRUE;
+        }
+
+        // Releasing scene graph copies which can be reloaded stays opt-in, see SetHostDataRelease
+        if (m_use_host_ptr)
+        {
+            LogInfo("Using zero-copy host memory for scene buffers\n");
+        }
+
         auto acc_type = "fatbvh";
         auto builder_type = "sah";
         LogInfo("Configuring acceleration structure: ", acc_type, " with ", builder_type, " builder\n");
@@ -75,16 +262,125 @@ namespace Baikal
         return m_default_material;
     }
 
+    void ClwSceneController::SetGeometryCompression(std::uint32_t compression)
+    {
+        m_geometry_compression = compression & (ClwScene::kCompressedPositions | ClwScene::kCompressedNormals |
+            ClwScene::kCompressedUVs | ClwScene::kCompressedIndices);
+    }
+
+    std::uint32_t ClwSceneController::GetGeometryCompression() const
+    {
+        return m_geometry_compression;
+    }
+
+    void ClwSceneController::SetTextureBackend(TextureBackend backend)
+    {
+        if (backend == TextureBackend::kImages && !m_image_support)
+        {
+            LogInfo("Device does not support images, using texture buffer\n");
+            backend = TextureBackend::kBuffer;
+        }
+
+        m_texture_backend = backend;
+    }
+
+    TextureBackend ClwSceneController::GetTextureBackend() const
+    {
+        return m_texture_backend;
+    }
+
+    template <typename T>
+    void ClwSceneController::CreateSceneBuffer(std::size_t count, CLWBuffer<T>& buffer, std::shared_ptr<void>& storage) const
+    {
+        // Previous buffer aliases the storage being replaced, make sure device is done with it
+        // and release the buffer before its host memory goes away
+        if (storage)
+        {
+            m_context.Finish(0);
+        }
+
+        buffer = CLWBuffer<T>();
+        storage.reset();
+
+        if (!m_use_host_ptr || count == 0)
+        {
+            buffer = m_context.CreateBuffer<T>(count, CL_MEM_READ_ONLY);
+            return;
+        }
+
+        // Runtimes only avoid copies for page aligned host pointers
+        auto page_size = GetPageSize();
+        auto size = count * sizeof(T);
+        auto new_storage = AllocateAligned((size + page_size - 1) / page_size * page_size, page_size);
+
+        cl_int status = CL_SUCCESS;
+        cl_mem host_buffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, size, new_storage.get(), &status);
+
+        if (status != CL_SUCCESS)
+        {
+            throw std::runtime_error("ClwSceneController: failed to create host memory buffer");
+        }
+
+        storage = new_storage;
+        buffer = CLWBuffer<T>::CreateFromClBuffer(host_buffer);
+    }
+
+    std::shared_ptr<_cl_mem> ClwSceneController::CreateTextureImage(int image, int width, int height, int layers) const
+    {
+        cl_image_format format;
+        format.image_channel_order = CL_RGBA;
+
+        switch (image)
+        {
+            case ClwScene::kTextureImageHalf: format.image_channel_data_type = CL_HALF_FLOAT; break;
+            case ClwScene::kTextureImageFloat: format.image_channel_data_type = CL_FLOAT; break;
+            default: format.image_channel_data_type = CL_UNORM_INT8; break;
+        }
+
+        cl_image_desc desc = {};
+        desc.image_type = CL_MEM_OBJECT_IMAGE2D_ARRAY;
+        desc.image_width = width;
+        desc.image_height = height;
+        desc.image_array_size = layers;
+
+        cl_int status = CL_SUCCESS;
+        cl_mem result = clCreateImage(m_context, CL_MEM_READ_ONLY, &format, &desc, nullptr, &status);
+
+        if (status != CL_SUCCESS)
+        {
+            throw std::runtime_error("ClwSceneController: failed to create " + std::to_string(width) + "x" +
+                std::to_string(height) + "x" + std::to_string(layers) + " texture image array");
+        }
+
+        return std::shared_ptr<_cl_mem>(result, clReleaseMemObject);
+    }
+
     ClwSceneController::~ClwSceneController()
     {
+        // Async compile worker calls into this object
+        CancelAsyncCompile();
+    }
+
+    void ClwSceneController::ReleaseCompiledScene(ClwScene& scene) const
+    {
+        for (auto& shape : scene.isect_shapes)
+        {
+            m_api->DetachShape(shape);
+            m_api->DeleteShape(shape);
+        }
+
+        scene.isect_shapes.clear();
+        scene.visible_shapes.clear();
     }
 
-    static void SplitMeshesAndInstances(Iterator& shape_iter, std::set<Mesh::Ptr>& meshes, std::set<Instance::Ptr>& instances, std::set<Mesh::Ptr>& excluded_meshes)
+    static void SplitMeshesAndInstances(Iterator& shape_iter, GeometryDuplicates const& duplicates, std::set<Mesh::Ptr>& meshes,
+        std::set<Instance::Ptr>& instances, std::set<Mesh::Ptr>& excluded_meshes, std::set<Mesh::Ptr>& duplicate_meshes)
     {
         // Clear all sets
         meshes.clear();
         instances.clear();
         excluded_meshes.clear();
+        duplicate_meshes.clear();
 
         // Prepare instance check lambda
         auto is_instance = [](Shape::Ptr shape)
@@ -121,14 +417,31 @@ namespace Baikal
                 excluded_meshes.emplace(base_mesh);
             }
         }
+
+        // Duplicate meshes go after instances and are compiled as instances of their bases
+        for (auto& duplicate : duplicates)
+        {
+            if (meshes.count(duplicate.first) && meshes.count(duplicate.second.base))
+            {
+                meshes.erase(duplicate.first);
+                duplicate_meshes.emplace(duplicate.first);
+            }
+        }
+    }
+
+    // Transform of the instance a duplicate mesh is compiled into
+    static matrix GetDuplicateTransform(GeometryDuplicates const& duplicates, Mesh::Ptr const& mesh)
+    {
+        return mesh->GetTransform() * translation(duplicates.at(mesh).offset);
     }
 
-    static std::size_t GetShapeIdx(Iterator& shape_iter, Shape::Ptr shape)
+    static std::size_t GetShapeIdx(Iterator& shape_iter, GeometryDuplicates const& duplicates, Shape::Ptr shape)
     {
         std::set<Mesh::Ptr> meshes;
         std::set<Mesh::Ptr> excluded_meshes;
         std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(shape_iter, meshes, instances, excluded_meshes);
+        std::set<Mesh::Ptr> duplicate_meshes;
+        SplitMeshesAndInstances(shape_iter, duplicates, meshes, instances, excluded_meshes, duplicate_meshes);
 
         std::size_t idx = 0;
         for (auto& i : meshes)
@@ -161,6 +474,16 @@ namespace Baikal
             ++idx;
         }
 
+        for (auto& i : duplicate_meshes)
+        {
+            if (i == shape)
+            {
+                return idx;
+            }
+
+            ++idx;
+        }
+
         return -1;
     }
 
@@ -194,7 +517,9 @@ namespace Baikal
         // but references by at least one instance.
         std::set<Mesh::Ptr> excluded_meshes;
         std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+        // Duplicates of other meshes, compiled as their instances
+        std::set<Mesh::Ptr> duplicate_meshes;
+        SplitMeshesAndInstances(*shape_iter, out.geometry_duplicates, meshes, instances, excluded_meshes, duplicate_meshes);
 
         // Keep shape->rr shape association for
         // instance base shape lookup.
@@ -276,6 +601,19 @@ namespace Baikal
             out.isect_shapes.push_back(shape);
             out.visible_shapes.push_back(shape);
         }
+
+        // Handle duplicate meshes
+        for (auto& iter : duplicate_meshes)
+        {
+            auto rr_mesh = rr_shapes[out.geometry_duplicates.at(iter).base];
+            auto shape = m_api->CreateInstance(rr_mesh);
+
+            auto transform = GetDuplicateTransform(out.geometry_duplicates, iter);
+            shape->SetTransform(transform, inverse(transform));
+            shape->SetId(id++);
+            out.isect_shapes.push_back(shape);
+            out.visible_shapes.push_back(shape);
+        }
     }
 
     void ClwSceneController::UpdateIntersectorTransforms(Scene1 const& scene, ClwScene& out) const
@@ -294,7 +632,9 @@ namespace Baikal
         // but references by at least one instance.
         std::set<Mesh::Ptr> excluded_meshes;
         std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+        // Duplicates of other meshes, compiled as their instances
+        std::set<Mesh::Ptr> duplicate_meshes;
+        SplitMeshesAndInstances(*shape_iter, out.geometry_duplicates, meshes, instances, excluded_meshes, duplicate_meshes);
 
         auto rr_iter = out.isect_shapes.begin();
 
@@ -326,7 +666,20 @@ namespace Baikal
             ++rr_iter;
         }
 
+        // Handle duplicate meshes
+        for (auto& iter : duplicate_meshes)
+        {
+            auto transform = GetDuplicateTransform(out.geometry_duplicates, iter);
+            (*rr_iter)->SetTransform(transform, inverse(transform));
+            ++rr_iter;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
         m_api->Commit();
+        auto delta = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        m_acceleration_build_time = delta / 1000.f;
+        LogInfo("Acceleration structure built in ", delta / 1000, " ms\n");
     }
 
     void ClwSceneController::UpdateCamera(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& vol_collector, ClwScene& out) const
@@ -379,14 +732,19 @@ namespace Baikal
         std::size_t num_vertices = 0;
         std::size_t num_normals = 0;
         std::size_t num_uvs = 0;
-        std::size_t num_indices = 0;
+        std::size_t num_tangents = 0;
+        // Ints or 16-bit words depending on index compression
+        std::size_t num_index_units = 0;
 
         std::size_t num_vertices_written = 0;
         std::size_t num_normals_written = 0;
         std::size_t num_uvs_written = 0;
-        std::size_t num_indices_written = 0;
+        std::size_t num_tangents_written = 0;
+        std::size_t num_index_units_written = 0;
         std::size_t num_shapes_written = 0;
 
+        auto compression = m_geometry_compression;
+
         auto shape_iter = scene.CreateShapeIterator();
 
         // Sort shapes into meshes and instances sets.
@@ -395,7 +753,9 @@ namespace Baikal
         // but are references by at least one instance.
         std::set<Mesh::Ptr> excluded_meshes;
         std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+        // Duplicates of other meshes, compiled as their instances
+        std::set<Mesh::Ptr> duplicate_meshes;
+        SplitMeshesAndInstances(*shape_iter, out.geometry_duplicates, meshes, instances, excluded_meshes, duplicate_meshes);
 
         // Calculate GPU array sizes. Do that only for meshes,
         // since instances do not occupy space in vertex buffers.
@@ -407,7 +767,7 @@ namespace Baikal
             num_vertices += mesh->GetNumVertices();
             num_normals += mesh->GetNumNormals();
             num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
+            ReserveIndices(*mesh, GetMeshCompression(*mesh, compression), num_index_units);
         }
 
         // Excluded meshes still occupy space in vertex buffers.
@@ -418,38 +778,78 @@ namespace Baikal
             num_vertices += mesh->GetNumVertices();
             num_normals += mesh->GetNumNormals();
             num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
+            ReserveIndices(*mesh, GetMeshCompression(*mesh, compression), num_index_units);
+        }
+
+        // Tangent frames are stored for geometry rendered with normal mapped materials only,
+        // instances and duplicates use tangents of their base meshes
+        std::set<Mesh::Ptr> tangent_meshes;
+
+        for (auto& iter : meshes)
+        {
+            if (NeedsTangents(GetMaterialLayers(iter->GetMaterial())))
+            {
+                tangent_meshes.insert(iter);
+            }
         }
 
-        // Instances only occupy material IDs space.
         for (auto& iter : instances)
         {
-            auto instance = iter;
-            auto mesh = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
+            if (NeedsTangents(GetMaterialLayers(iter->GetMaterial())))
+            {
+                tangent_meshes.insert(std::static_pointer_cast<Mesh>(iter->GetBaseShape()));
+            }
+        }
+
+        for (auto& iter : duplicate_meshes)
+        {
+            if (NeedsTangents(GetMaterialLayers(iter->GetMaterial())))
+            {
+                tangent_meshes.insert(out.geometry_duplicates.at(iter).base);
+            }
+        }
+
+        for (auto& iter : tangent_meshes)
+        {
+            num_tangents += iter->GetNumVertices();
         }
 
+        auto vertex_bytes = num_vertices * GetPositionSize(compression);
+        auto normal_bytes = num_normals * GetNormalSize(compression);
+        auto uv_bytes = num_uvs * GetUVSize(compression);
+        auto tangent_bytes = num_tangents * sizeof(std::uint32_t);
+        auto index_bytes = num_index_units * GetIndexUnitSize(compression);
+
+        LogInfo("Geometry size: ", (vertex_bytes + normal_bytes + uv_bytes + tangent_bytes + index_bytes) / 1024, " KB (uncompressed ",
+            (num_vertices * sizeof(float3) + num_normals * sizeof(float3) + num_uvs * sizeof(float2)) / 1024, " KB + indices)\n");
+
         LogInfo("Creating vertex buffer...\n");
         // Create CL arrays
-        out.vertices = m_context.CreateBuffer<float3>(num_vertices, CL_MEM_READ_ONLY);
+        CreateSceneBuffer<char>(vertex_bytes, out.vertices, out.vertices_storage);
 
         LogInfo("Creating normal buffer...\n");
-        out.normals = m_context.CreateBuffer<float3>(num_normals, CL_MEM_READ_ONLY);
+        CreateSceneBuffer<char>(normal_bytes, out.normals, out.normals_storage);
 
         LogInfo("Creating UV buffer...\n");
-        out.uvs = m_context.CreateBuffer<float2>(num_uvs, CL_MEM_READ_ONLY);
+        CreateSceneBuffer<char>(uv_bytes, out.uvs, out.uvs_storage);
+
+        LogInfo("Creating tangent buffer...\n");
+        // Kernels still need a valid buffer without any tangents
+        CreateSceneBuffer<char>(std::max<std::size_t>(tangent_bytes, sizeof(std::uint32_t)), out.tangents, out.tangents_storage);
 
         LogInfo("Creating index buffer...\n");
-        out.indices = m_context.CreateBuffer<int>(num_indices, CL_MEM_READ_ONLY);
+        CreateSceneBuffer<char>(index_bytes, out.indices, out.indices_storage);
 
         // Total number of entries in shapes GPU array
-        auto num_shapes = meshes.size() + excluded_meshes.size() + instances.size();
+        auto num_shapes = meshes.size() + excluded_meshes.size() + instances.size() + duplicate_meshes.size();
         out.shapes = m_context.CreateBuffer<ClwScene::Shape>(num_shapes, CL_MEM_READ_ONLY);
         out.shapes_additional = m_context.CreateBuffer<ClwScene::ShapeAdditionalData>(num_shapes, CL_MEM_READ_ONLY);
 
-        float3* vertices = nullptr;
-        float3* normals = nullptr;
-        float2* uvs = nullptr;
-        int* indices = nullptr;
+        char* vertices = nullptr;
+        char* normals = nullptr;
+        char* uvs = nullptr;
+        char* tangents = nullptr;
+        char* indices = nullptr;
         ClwScene::Shape* shapes = nullptr;
         ClwScene::ShapeAdditionalData* shapes_additional = nullptr;
 
@@ -458,6 +858,7 @@ namespace Baikal
         m_context.MapBuffer(0, out.vertices, CL_MAP_WRITE, &vertices);
         m_context.MapBuffer(0, out.normals, CL_MAP_WRITE, &normals);
         m_context.MapBuffer(0, out.uvs, CL_MAP_WRITE, &uvs);
+        m_context.MapBuffer(0, out.tangents, CL_MAP_WRITE, &tangents);
         m_context.MapBuffer(0, out.indices, CL_MAP_WRITE, &indices);
         m_context.MapBuffer(0, out.shapes, CL_MAP_WRITE, &shapes).Wait();
         m_context.MapBuffer(0, out.shapes_additional, CL_MAP_WRITE, &shapes_additional).Wait();
@@ -473,27 +874,11 @@ namespace Baikal
         {
             auto mesh = iter;
 
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
-
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
-
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
-
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
-
             // Prepare shape descriptor
             ClwScene::Shape shape;
 
             shape.id = iter->GetId();
 
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
-
             auto transform = mesh->GetTransform();
             shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
             shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
@@ -502,24 +887,23 @@ namespace Baikal
 
             shape.linearvelocity = float3(0.0f, 0.f, 0.f);
             shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            shape.material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
+            shape.material.offset = GetMaterialIndex(out, mesh->GetMaterial());
             shape.material.layers = GetMaterialLayers(mesh->GetMaterial());
 
             shape.volume_idx = GetVolumeIndex(vol_collector, mesh->GetVolumeMaterial());
 
-            shape_data[mesh] = shape;
-
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
+            auto start_index = ReserveIndices(*mesh, GetMeshCompression(*mesh, compression), num_index_units_written);
+            auto start_tangent = tangent_meshes.count(mesh) ? static_cast<int>(num_tangents_written) : -1;
 
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
+            WriteMeshGeometry(*mesh, compression, vertices, normals, uvs, tangents, indices,
+                num_vertices_written, num_normals_written, num_uvs_written, start_index, start_tangent, shape);
 
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
+            num_vertices_written += mesh->GetNumVertices();
+            num_normals_written += mesh->GetNumNormals();
+            num_uvs_written += mesh->GetNumUVs();
+            num_tangents_written += start_tangent >= 0 ? mesh->GetNumVertices() : 0;
 
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
+            shape_data[mesh] = shape;
 
             shapes[num_shapes_written] = shape;
 
@@ -534,27 +918,11 @@ namespace Baikal
         {
             auto mesh = iter;
 
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
-
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
-
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
-
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
-
             // Prepare shape descriptor
             ClwScene::Shape shape;
 
             shape.id = mesh->GetId();
 
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
-
             auto transform = mesh->GetTransform();
             shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
             shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
@@ -563,24 +931,23 @@ namespace Baikal
 
             shape.linearvelocity = float3(0.0f, 0.f, 0.f);
             shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            shape.material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
+            shape.material.offset = GetMaterialIndex(out, mesh->GetMaterial());
             shape.material.layers = GetMaterialLayers(mesh->GetMaterial());
 
             shape.volume_idx = GetVolumeIndex(vol_collector, mesh->GetVolumeMaterial());
 
-            shape_data[mesh] = shape;
+            auto start_index = ReserveIndices(*mesh, GetMeshCompression(*mesh, compression), num_index_units_written);
+            auto start_tangent = tangent_meshes.count(mesh) ? static_cast<int>(num_tangents_written) : -1;
 
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
+            WriteMeshGeometry(*mesh, compression, vertices, normals, uvs, tangents, indices,
+                num_vertices_written, num_normals_written, num_uvs_written, start_index, start_tangent, shape);
 
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
+            num_vertices_written += mesh->GetNumVertices();
+            num_normals_written += mesh->GetNumNormals();
+            num_uvs_written += mesh->GetNumUVs();
+            num_tangents_written += start_tangent >= 0 ? mesh->GetNumVertices() : 0;
 
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
-
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
+            shape_data[mesh] = shape;
 
             shapes[num_shapes_written] = shape;
 
@@ -611,8 +978,8 @@ namespace Baikal
 
             shape.linearvelocity = float3(0.0f, 0.f, 0.f);
             shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            shape.material.offset = GetMaterialIndex(mat_collector, instance->GetMaterial());
-            shape.material.layers = std::static_pointer_cast<UberV2Material>(instance->GetMaterial())->GetLayers();
+            shape.material.offset = GetMaterialIndex(out, instance->GetMaterial());
+            shape.material.layers = GetMaterialLayers(instance->GetMaterial());
 
             shape.volume_idx = GetVolumeIndex(vol_collector, instance->GetVolumeMaterial());
 
@@ -623,10 +990,40 @@ namespace Baikal
             shapes_additional[num_shapes_written++] = shape_additional;
         }
 
+        // Duplicate meshes reference geometry of their bases like instances do
+        for (auto& iter : duplicate_meshes)
+        {
+            auto mesh = iter;
+            auto transform = GetDuplicateTransform(out.geometry_duplicates, mesh);
+
+            ClwScene::Shape shape = shape_data[out.geometry_duplicates.at(mesh).base];
+
+            shape.id = mesh->GetId();
+
+            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
+            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
+            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
+            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+
+            shape.linearvelocity = float3(0.0f, 0.f, 0.f);
+            shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
+            shape.material.offset = GetMaterialIndex(out, mesh->GetMaterial());
+            shape.material.layers = GetMaterialLayers(mesh->GetMaterial());
+
+            shape.volume_idx = GetVolumeIndex(vol_collector, mesh->GetVolumeMaterial());
+
+            shapes[num_shapes_written] = shape;
+
+            ClwScene::ShapeAdditionalData shape_additional;
+            shape_additional.group_id = mesh->GetGroupId();
+            shapes_additional[num_shapes_written++] = shape_additional;
+        }
+
         LogInfo("Unmapping buffers...\n");
         m_context.UnmapBuffer(0, out.vertices, vertices);
         m_context.UnmapBuffer(0, out.normals, normals);
         m_context.UnmapBuffer(0, out.uvs, uvs);
+        m_context.UnmapBuffer(0, out.tangents, tangents);
         m_context.UnmapBuffer(0, out.indices, indices);
         m_context.UnmapBuffer(0, out.shapes, shapes).Wait();
         m_context.UnmapBuffer(0, out.shapes_additional, shapes_additional).Wait();
@@ -635,7 +1032,12 @@ namespace Baikal
 
         UpdateIntersector(scene, out);
 
-        ReloadIntersector(scene, out);
+        // Intersector is in use by the renderer during async compile,
+        // it is reloaded when compiled scene is swapped in
+        if (!IsBackgroundCompile())
+        {
+            ReloadIntersector(scene, out);
+        }
     }
 
     void ClwSceneController::UpdateShapeProperties(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& volume_collector, ClwScene& out) const
@@ -648,7 +1050,9 @@ namespace Baikal
         // but are references by at least one instance.
         std::set<Mesh::Ptr> excluded_meshes;
         std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+        // Duplicates of other meshes, compiled as their instances
+        std::set<Mesh::Ptr> duplicate_meshes;
+        SplitMeshesAndInstances(*shape_iter, out.geometry_duplicates, meshes, instances, excluded_meshes, duplicate_meshes);
 
         ClwScene::Shape* shapes = nullptr;
         ClwScene::ShapeAdditionalData* shapes_additional = nullptr;
@@ -659,6 +1063,7 @@ namespace Baikal
 
         auto current_shape = shapes;
         auto current_shape_additional = shapes_additional;
+        bool missing_tangents = false;
         for (auto& iter : meshes)
         {
             auto mesh = iter;
@@ -668,9 +1073,11 @@ namespace Baikal
             current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
             current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
             current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
-            current_shape->material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
+            current_shape->material.offset = GetMaterialIndex(out, mesh->GetMaterial());
             current_shape->material.layers = GetMaterialLayers(mesh->GetMaterial());
 
+            missing_tangents |= current_shape->starttangent < 0 && NeedsTangents(current_shape->material.layers);
+
             current_shape->volume_idx = GetVolumeIndex(volume_collector, mesh->GetVolumeMaterial());
 
             current_shape->id = iter->GetId();
@@ -691,7 +1098,7 @@ namespace Baikal
             current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
             current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
             current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
-            current_shape->material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
+            current_shape->material.offset = GetMaterialIndex(out, mesh->GetMaterial());
             current_shape->material.layers = GetMaterialLayers(mesh->GetMaterial());
 
             current_shape->volume_idx = GetVolumeIndex(volume_collector, mesh->GetVolumeMaterial());
@@ -714,9 +1121,11 @@ namespace Baikal
             current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
             current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
             current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
-            current_shape->material.offset = GetMaterialIndex(mat_collector, instance->GetMaterial());
+            current_shape->material.offset = GetMaterialIndex(out, instance->GetMaterial());
             current_shape->material.layers = GetMaterialLayers(std::static_pointer_cast<UberV2Material>(instance->GetMaterial()));
 
+            missing_tangents |= current_shape->starttangent < 0 && NeedsTangents(current_shape->material.layers);
+
             current_shape->volume_idx = GetVolumeIndex(volume_collector, instance->GetVolumeMaterial());
 
             current_shape->id = iter->GetId();
@@ -726,15 +1135,60 @@ namespace Baikal
             ++current_shape_additional;
         }
 
+        // Handle duplicate meshes
+        for (auto& iter : duplicate_meshes)
+        {
+            auto mesh = iter;
+            auto transform = GetDuplicateTransform(out.geometry_duplicates, mesh);
+
+            current_shape->transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
+            current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
+            current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
+            current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            current_shape->material.offset = GetMaterialIndex(out, mesh->GetMaterial());
+            current_shape->material.layers = GetMaterialLayers(mesh->GetMaterial());
+
+            missing_tangents |= current_shape->starttangent < 0 && NeedsTangents(current_shape->material.layers);
+
+            current_shape->volume_idx = GetVolumeIndex(volume_collector, mesh->GetVolumeMaterial());
+
+            current_shape->id = mesh->GetId();
+            current_shape_additional->group_id = mesh->GetGroupId();
+
+            ++current_shape;
+            ++current_shape_additional;
+        }
+
         m_context.UnmapBuffer(0, out.shapes, shapes).Wait();
         m_context.UnmapBuffer(0, out.shapes_additional, shapes_additional).Wait();
+
+        // Normal mapped material has been assigned to geometry compiled without tangent frames
+        if (missing_tangents)
+        {
+            UpdateShapes(scene, mat_collector, tex_collector, volume_collector, out);
+        }
     }
 
     void ClwSceneController::UpdateCurrentScene(Scene1 const& scene, ClwScene& out) const
     {
+        InstallHeaders(out);
         ReloadIntersector(scene, out);
     }
 
+    void ClwSceneController::InstallHeaders(ClwScene const& scene) const
+    {
+        // Program manager skips headers which did not change
+        if (!scene.uberv2_source.empty())
+        {
+            m_program_manager->AddHeader("uberv2_generated.cl", scene.uberv2_source);
+        }
+
+        if (!scene.inputmaps_source.empty())
+        {
+            m_program_manager->AddHeader("inputmaps.cl", scene.inputmaps_source);
+        }
+    }
+
     void ClwSceneController::UpdateMaterials(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
     {
         // Get new buffer size
@@ -742,10 +1196,35 @@ namespace Baikal
         mat_buffer.reserve(1024 * 1024); //Reserv 1M of ints for material buffer.
 
         // Cleanup material mapping
-        m_materialid_to_offset.clear();
+        out.material_offsets.clear();
 
         CLUberV2Generator uberv2_generator;
 
+        out.features &= ~ClwScene::kFeatureShadingNormals;
+
+        // Materials reference input maps by slot, slots follow id order of the
+        // input maps used, so they only change together with the input map set
+        {
+            std::set<std::uint32_t> input_map_ids;
+
+            auto mat_iter = mat_collector.CreateIterator();
+            for (; mat_iter->IsValid(); mat_iter->Next())
+            {
+                auto input_map_iter = mat_iter->ItemAs<Material>()->CreateInputMapsIterator();
+                for (; input_map_iter->IsValid(); input_map_iter->Next())
+                {
+                    input_map_ids.insert(input_map_iter->ItemAs<InputMap>()->GetId());
+                }
+            }
+
+            out.input_map_slots.clear();
+            for (auto id : input_map_ids)
+            {
+                auto slot = static_cast<std::int32_t>(out.input_map_slots.size());
+                out.input_map_slots[id] = slot;
+            }
+        }
+
         // Serialize materials
         {
             // Update material bundle first to be able to track differences
@@ -757,15 +1236,26 @@ namespace Baikal
             // Iterate and serialize
             for (; mat_iter->IsValid(); mat_iter->Next())
             {
-                WriteMaterial(*mat_iter->ItemAs<Material>(), mat_collector, tex_collector, mat_buffer);
+                out.material_offsets[mat_iter->ItemAs<Material>()->GetId()] = static_cast<std::int32_t>(mat_buffer.size());
+                WriteMaterial(*mat_iter->ItemAs<Material>(), mat_collector, tex_collector, out.input_map_slots, mat_buffer);
+
+                auto uberv2_material = mat_iter->ItemAs<UberV2Material>();
+                uberv2_generator.AddMaterial(uberv2_material);
 
-                uberv2_generator.AddMaterial(mat_iter->ItemAs<UberV2Material>());
+                if (uberv2_material->GetLayers() & UberV2Material::Layers::kShadingNormalLayer)
+                {
+                    out.features |= ClwScene::kFeatureShadingNormals;
+                }
             }
 
         }
 
-        std::string uberv2_source = uberv2_generator.BuildSource();
-        m_program_manager->AddHeader("uberv2_generated.cl", uberv2_source);
+        // Background compile keeps generated source in the back scene, it is installed at swap
+        out.uberv2_source = uberv2_generator.BuildSource();
+        if (!IsBackgroundCompile())
+        {
+            InstallHeaders(out);
+        }
 
 
         // Recreate material buffer if it needs resize
@@ -789,7 +1279,11 @@ namespace Baikal
     void ClwSceneController::UpdateVolumes(Scene1 const& scene, Collector& volume_collector, Collector& tex_collector, ClwScene& out) const
     {
         if (!volume_collector.GetNumItems())
+        {
+            out.num_volumes = 0;
+            out.features &= ~ClwScene::kFeatureVolumes;
             return;
+        }
 
         // Get new buffer size
         std::size_t vol_buffer_size = volume_collector.GetNumItems();
@@ -823,6 +1317,7 @@ namespace Baikal
 
         // Update number of volumes
         out.num_volumes = static_cast<int>(num_volumes_copied);
+        out.features |= ClwScene::kFeatureVolumes;
     }
 
     void ClwSceneController::ReloadIntersector(Scene1 const& scene, ClwScene& inout) const
@@ -843,10 +1338,19 @@ namespace Baikal
         std::size_t tex_buffer_size = tex_collector.GetNumItems();
         std::size_t tex_data_buffer_size = 0;
 
+        // Drop previous image arrays, they are recreated below if the backend is used
+        out.texture_backend = TextureBackend::kBuffer;
+
+        for (auto& image : out.texture_images)
+        {
+            image.reset();
+        }
+
         if (tex_buffer_size == 0)
         {
             out.textures = m_context.CreateBuffer<ClwScene::Texture>(1, CL_MEM_READ_ONLY);
             out.texturedata = m_context.CreateBuffer<char>(1, CL_MEM_READ_ONLY);
+            out.texture_data_offsets.clear();
             return;
         }
 
@@ -869,26 +1373,68 @@ namespace Baikal
         // Create material iterator
         std::unique_ptr<Iterator> tex_iter(tex_collector.CreateIterator());
 
+        // Image arrays are sized to hold the largest finest level of their textures
+        auto use_images = m_texture_backend == TextureBackend::kImages;
+        std::array<int, ClwScene::kTextureImageCount> image_width = {};
+        std::array<int, ClwScene::kTextureImageCount> image_height = {};
+        std::array<int, ClwScene::kTextureImageCount> image_layers = {};
+        std::vector<int> tex_layers;
+
         // Iterate and serialize
         for (; tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
+            auto header = textures + num_textures_written;
+
+            WriteTexture(*tex, tex_data_buffer_size, header);
 
-            WriteTexture(*tex, tex_data_buffer_size, textures + num_textures_written);
+            if (use_images)
+            {
+                header->layer = image_layers[header->image]++;
+                image_width[header->image] = std::max(image_width[header->image], header->w);
+                image_height[header->image] = std::max(image_height[header->image], header->h);
+                tex_layers.push_back(header->layer);
+            }
 
             ++num_textures_written;
 
-            tex_data_buffer_size += align16(tex->GetSizeInBytes());
+            tex_data_buffer_size += GetMipChainSize(*tex);
         }
 
         // Unmap material buffer
         m_context.UnmapBuffer(0, out.textures, textures);
 
+        if (use_images)
+        {
+            try
+            {
+                // Kernels need all arrays bound, unused ones get a single texel
+                for (auto i = 0; i < ClwScene::kTextureImageCount; ++i)
+                {
+                    out.texture_images[i] = CreateTextureImage(i, std::max(image_width[i], 1),
+                        std::max(image_height[i], 1), std::max(image_layers[i], 1));
+                }
+
+                out.texture_backend = TextureBackend::kImages;
+            }
+            catch (std::runtime_error const& e)
+            {
+                LogInfo(e.what(), ", using texture buffer\n");
+                use_images = false;
+
+                for (auto& image : out.texture_images)
+                {
+                    image.reset();
+                }
+            }
+        }
+
         // Recreate material buffer if it needs resize
         if (tex_data_buffer_size > out.texturedata.GetElementCount())
         {
             // Create material buffer
-            out.texturedata = m_context.CreateBuffer<char>(tex_data_buffer_size, CL_MEM_READ_ONLY);
+            CreateSceneBuffer<char>(tex_data_buffer_size, out.texturedata, out.texturedata_storage);
+            out.texture_data_offsets.clear();
         }
 
         char* data = nullptr;
@@ -899,18 +1445,96 @@ namespace Baikal
         // Map GPU materials buffer
         m_context.MapBuffer(0, out.texturedata, CL_MAP_WRITE, &data).Wait();
 
-        // Write texture data for all textures
+        // Gather data offsets, textures are written in parallel since mip generation is costly
+        std::vector<std::pair<Texture const*, std::size_t>> tex_offsets;
+        // Mapping keeps buffer contents, so clean textures uploaded at the same offset are not rewritten
+        std::vector<bool> tex_uploaded;
+        std::map<std::uint32_t, std::size_t> data_offsets;
+        tex_offsets.reserve(tex_buffer_size);
+        tex_uploaded.reserve(tex_buffer_size);
+
         for (; tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
 
-            WriteTextureData(*tex, data + num_bytes_written);
+            auto iter = out.texture_data_offsets.find(tex->GetId());
+            tex_uploaded.push_back(!tex->IsDirty() && iter != out.texture_data_offsets.cend() && iter->second == num_bytes_written);
+            tex_offsets.emplace_back(tex.get(), num_bytes_written);
+            data_offsets[tex->GetId()] = num_bytes_written;
+
+            num_bytes_written += GetMipChainSize(*tex);
+        }
+
+        // Forget previous placement until the upload succeeds
+        out.texture_data_offsets.clear();
+
+        std::atomic<std::size_t> next_texture(0);
+        auto write_textures = [&]()
+        {
+            for (auto i = next_texture++; i < tex_offsets.size(); i = next_texture++)
+            {
+                try
+                {
+                    if (!tex_uploaded[i])
+                    {
+                        WriteTextureData(*tex_offsets[i].first, data + tex_offsets[i].second);
+                    }
+
+                    if (use_images)
+                    {
+                        WriteTextureImage(*tex_offsets[i].first, tex_layers[i], out);
+                    }
+                }
+                catch (...)
+                {
+                    // Stop other workers, the upload has failed anyway
+                    next_texture = tex_offsets.size();
+                    throw;
+                }
+            }
+        };
+
+        auto num_workers = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), tex_offsets.size());
+        std::vector<std::future<void>> workers;
+
+        for (std::size_t i = 1; i < num_workers; ++i)
+        {
+            workers.push_back(std::async(std::launch::async, write_textures));
+        }
+
+        // Buffer must be unmapped even if writing fails, so wait for all workers first
+        std::exception_ptr error;
+
+        try
+        {
+            write_textures();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
 
-            num_bytes_written += align16(tex->GetSizeInBytes());
+        for (auto& worker : workers)
+        {
+            try
+            {
+                worker.get();
+            }
+            catch (...)
+            {
+                error = error ? error : std::current_exception();
+            }
         }
 
         // Unmap material buffer
         m_context.UnmapBuffer(0, out.texturedata, data);
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+
+        out.texture_data_offsets = std::move(data_offsets);
     }
 
 #ifndef NDEBUG
@@ -928,14 +1552,13 @@ namespace Baikal
     }
 #endif
 
-    void ClwSceneController::WriteMaterial(Material const& material, Collector& mat_collector, Collector& tex_collector, std::vector<std::int32_t> &material_data) const
+    void ClwSceneController::WriteMaterial(Material const& material, Collector& mat_collector, Collector& tex_collector,
+        std::map<std::uint32_t, std::int32_t> const& input_map_slots, std::vector<std::int32_t> &material_data) const
     {
         assert(GetMaterialType(material) == ClwScene::Bxdf::kUberV2);
         const UberV2Material &uber_material = static_cast<const UberV2Material&>(material);
 
         std::uint32_t layers = uber_material.GetLayers();
-        
-        m_materialid_to_offset[material.GetId()] = static_cast<int>(material_data.size());
 
         // Pack material parameters
         std::int32_t params = 0;
@@ -1009,7 +1632,8 @@ namespace Baikal
                 {
                     auto value = material.GetInputValue(layer_param);
                     assert(value.type == Material::InputType::kInputMap);
-                    material_data.push_back(value.input_map_value ? value.input_map_value->GetId() : -1);
+                    auto slot = value.input_map_value ? input_map_slots.find(value.input_map_value->GetId()) : input_map_slots.end();
+                    material_data.push_back(slot != input_map_slots.end() ? slot->second : -1);
                 }
             }
         }
@@ -1041,7 +1665,7 @@ namespace Baikal
         }
     }
 
-    void ClwSceneController::WriteLight(Scene1 const& scene, Light const& light, Collector& tex_collector, void* data) const
+    void ClwSceneController::WriteLight(Scene1 const& scene, GeometryDuplicates const& duplicates, Light const& light, Collector& tex_collector, void* data) const
     {
         auto clw_light = reinterpret_cast<ClwScene::Light*>(data);
 
@@ -1102,7 +1726,7 @@ namespace Baikal
 
                 auto shape_iter = scene.CreateShapeIterator();
 
-                auto idx = GetShapeIdx(*shape_iter, shape);
+                auto idx = GetShapeIdx(*shape_iter, duplicates, shape);
 
                 clw_light->id = shape->GetId();
                 clw_light->shapeidx = static_cast<int>(idx);
@@ -1139,6 +1763,7 @@ namespace Baikal
 
         // Disable IBL by default
         out.envmapidx = -1;
+        out.features &= ~(ClwScene::kFeatureEnvironmentLight | ClwScene::kFeatureAreaLights | ClwScene::kFeatureAnalyticLights);
 
         // Allocate intermediate storage for lights power distribution
         std::vector<float> light_power(num_lights);
@@ -1149,7 +1774,14 @@ namespace Baikal
             for (; light_iter->IsValid(); light_iter->Next())
             {
                 auto light = light_iter->ItemAs<Light>();
-                WriteLight(scene, *light, tex_collector, lights + num_lights_written);
+                WriteLight(scene, out.geometry_duplicates, *light, tex_collector, lights + num_lights_written);
+
+                switch (GetLightType(*light))
+                {
+                    case ClwScene::kIbl: out.features |= ClwScene::kFeatureEnvironmentLight; break;
+                    case ClwScene::kArea: out.features |= ClwScene::kFeatureAreaLights; break;
+                    default: out.features |= ClwScene::kFeatureAnalyticLights; break;
+                }
 
 
                 // Find and update IBL idx
@@ -1210,10 +1842,47 @@ namespace Baikal
             case Texture::Format::kRgba8: return ClwScene::TextureFormat::RGBA8;
             case Texture::Format::kRgba16: return ClwScene::TextureFormat::RGBA16;
             case Texture::Format::kRgba32: return ClwScene::TextureFormat::RGBA32;
+            case Texture::Format::kR8: return ClwScene::TextureFormat::R8;
+            case Texture::Format::kRG8: return ClwScene::TextureFormat::RG8;
+            case Texture::Format::kR16F: return ClwScene::TextureFormat::R16F;
+            case Texture::Format::kR32F: return ClwScene::TextureFormat::R32F;
+            case Texture::Format::kBC1: return ClwScene::TextureFormat::BC1;
+            case Texture::Format::kBC4: return ClwScene::TextureFormat::BC4;
+            case Texture::Format::kBC5: return ClwScene::TextureFormat::BC5;
+            case Texture::Format::kBC6H: return ClwScene::TextureFormat::BC6H;
+            case Texture::Format::kBC7: return ClwScene::TextureFormat::BC7;
             default: return ClwScene::TextureFormat::RGBA8;
         }
     }
 
+    // Image array keeping the finest level of texture format
+    static ClwScene::TextureImage GetTextureImage(Texture::Format format)
+    {
+        switch (format)
+        {
+            case Texture::Format::kRgba16:
+            case Texture::Format::kR16F:
+                return ClwScene::kTextureImageHalf;
+            case Texture::Format::kRgba32:
+            case Texture::Format::kR32F:
+            case Texture::Format::kBC6H:
+                return ClwScene::kTextureImageFloat;
+            default:
+                return ClwScene::kTextureImageUnorm;
+        }
+    }
+
+    // Convert texel layout into ClwScene:: types
+    static ClwScene::TextureLayout GetClwTextureLayout(Texture::Layout layout)
+    {
+        switch (layout)
+        {
+            case Texture::Layout::kTiled: return ClwScene::TextureLayout::kLayoutTiled;
+            case Texture::Layout::kMorton: return ClwScene::TextureLayout::kLayoutMorton;
+            default: return ClwScene::TextureLayout::kLayoutLinear;
+        }
+    }
+
     void ClwSceneController::WriteTexture(Texture const& texture, std::size_t data_offset, void* data) const
     {
         auto clw_texture = reinterpret_cast<ClwScene::Texture*>(data);
@@ -1225,13 +1894,100 @@ namespace Baikal
         clw_texture->d = dim.z;
         clw_texture->fmt = GetTextureFormat(texture);
         clw_texture->dataoffset = static_cast<int>(data_offset);
+        clw_texture->levels = static_cast<int>(GetMipLevelCount(texture));
+        clw_texture->layout = GetClwTextureLayout(GetTextureLayout(texture));
+        clw_texture->image = GetTextureImage(texture.GetFormat());
+        clw_texture->layer = 0;
     }
 
     void ClwSceneController::WriteTextureData(Texture const& texture, void* data) const
     {
-        auto begin = texture.GetData();
-        auto end = begin + texture.GetSizeInBytes();
-        std::copy(begin, end, static_cast<char*>(data));
+        // Texels are reordered according to GetTextureLayout()
+        WriteMipChain(texture, static_cast<char*>(data));
+    }
+
+    // Replicate single channel as (r, r, r, r) and two channels as (r, g, 0, 1) like texture.cl does
+    template <typename T>
+    static void ExpandToRgba(T const* src, std::size_t num_texels, int num_channels, T zero, T one, T* dst)
+    {
+        for (std::size_t i = 0; i < num_texels; ++i)
+        {
+            if (num_channels == 1)
+            {
+                dst[4 * i] = dst[4 * i + 1] = dst[4 * i + 2] = dst[4 * i + 3] = src[i];
+            }
+            else
+            {
+                dst[4 * i] = src[2 * i];
+                dst[4 * i + 1] = src[2 * i + 1];
+                dst[4 * i + 2] = zero;
+                dst[4 * i + 3] = one;
+            }
+        }
+    }
+
+    void ClwSceneController::WriteTextureImage(Texture const& texture, int layer, ClwScene const& scene) const
+    {
+        auto format = texture.GetFormat();
+        auto image = GetTextureImage(format);
+        auto dim = texture.GetSize();
+        auto num_texels = static_cast<std::size_t>(dim.x) * dim.y;
+        auto src = texture.GetData();
+
+        std::size_t texel_size = image == ClwScene::kTextureImageFloat ? 16 : (image == ClwScene::kTextureImageHalf ? 8 : 4);
+        std::vector<char> texels(num_texels * texel_size);
+
+        switch (format)
+        {
+            case Texture::Format::kRgba8:
+            case Texture::Format::kRgba16:
+            case Texture::Format::kRgba32:
+                std::memcpy(texels.data(), src, texels.size());
+                break;
+            case Texture::Format::kR8:
+            case Texture::Format::kRG8:
+                ExpandToRgba<std::uint8_t>(reinterpret_cast<std::uint8_t const*>(src), num_texels,
+                    Texture::GetChannelCount(format), 0, 255, reinterpret_cast<std::uint8_t*>(texels.data()));
+                break;
+            case Texture::Format::kR16F:
+                ExpandToRgba<std::uint16_t>(reinterpret_cast<std::uint16_t const*>(src), num_texels,
+                    1, 0, half(1.f).bits(), reinterpret_cast<std::uint16_t*>(texels.data()));
+                break;
+            case Texture::Format::kR32F:
+                ExpandToRgba<float>(reinterpret_cast<float const*>(src), num_texels,
+                    1, 0.f, 1.f, reinterpret_cast<float*>(texels.data()));
+                break;
+            default:
+            {
+                // Block compressed textures are decoded, BC6H goes into float array
+                auto decoded = DecodeImage(format, src, dim.x, dim.y);
+
+                if (image == ClwScene::kTextureImageFloat)
+                {
+                    std::memcpy(texels.data(), decoded.data(), texels.size());
+                }
+                else
+                {
+                    for (std::size_t i = 0; i < 4 * num_texels; ++i)
+                    {
+                        auto value = std::min(std::max(decoded[i], 0.f), 1.f);
+                        texels[i] = static_cast<char>(static_cast<std::uint8_t>(value * 255.f + 0.5f));
+                    }
+                }
+                break;
+            }
+        }
+
+        std::size_t origin[3] = { 0, 0, static_cast<std::size_t>(layer) };
+        std::size_t region[3] = { static_cast<std::size_t>(dim.x), static_cast<std::size_t>(dim.y), 1 };
+
+        cl_int status = clEnqueueWriteImage(m_context.GetCommandQueue(0), scene.texture_images[image].get(), CL_TRUE,
+            origin, region, 0, 0, texels.data(), 0, nullptr, nullptr);
+
+        if (status != CL_SUCCESS)
+        {
+            throw std::runtime_error("ClwSceneController: failed to write texture image");
+        }
     }
 
     void ClwSceneController::WriteVolume(VolumeMaterial const& volume, Collector& tex_collector, void* data) const
@@ -1273,10 +2029,10 @@ namespace Baikal
         return texture ? collector.GetItemIndex(texture) : (-1);
     }
 
-    int ClwSceneController::GetMaterialIndex(Collector const& collector, Material::Ptr material) const
+    int ClwSceneController::GetMaterialIndex(ClwScene const& scene, Material::Ptr material) const
     {
         auto m = material ? material : m_default_material;
-        return ResolveMaterialPtr(m);
+        return ResolveMaterialPtr(scene, m);
     }
 
     int ClwSceneController::GetVolumeIndex(Collector const& collector, VolumeMaterial::Ptr volume) const
@@ -1293,20 +2049,99 @@ namespace Baikal
     void Baikal::ClwSceneController::UpdateInputMaps(const Baikal::Scene1& scene, Baikal::Collector& input_map_collector, Collector& input_map_leafs_collector, ClwScene& out) const
     {
         CLInputMapGenerator generator;
-        generator.Generate(input_map_collector, input_map_leafs_collector);
-        std::string source = generator.GetGeneratedSource();
-        m_program_manager->AddHeader("inputmaps.cl", source);
+        generator.Generate(input_map_collector, true);
+        out.inputmaps_source = generator.GetGeneratedSource();
+        if (!IsBackgroundCompile())
+        {
+            InstallHeaders(out);
+        }
+
+        auto const& instances = generator.GetInstances();
+        auto const& folded_constants = generator.GetFoldedConstants();
+
+        // Table layout: header per slot, then leaf indices of every slot,
+        // then constants folded by the generator, then leafs
+        std::size_t table_size = out.input_map_slots.size() + folded_constants.size();
+        for (auto const& instance : instances)
+        {
+            table_size += instance.second.leafs.size();
+        }
+
+        out.input_map_table.assign(table_size, std::array<std::int32_t, 4>());
+        auto table = reinterpret_cast<ClwScene::InputMapData*>(out.input_map_table.data());
+
+        // Folded values depend on scene constants, they are rewritten on every update
+        std::map<InputMap::Ptr, int> folded_indices;
+        std::size_t folded_offset = table_size - folded_constants.size();
+        for (auto const& constant : folded_constants)
+        {
+            auto& data = table[folded_offset];
+            data.float_value.value = std::static_pointer_cast<InputMap_ConstantFloat3>(constant)->GetValue();
+            data.int_values.type = ClwScene::InputMapDataType::kFloat3;
+            folded_indices[constant] = static_cast<int>(folded_offset++);
+        }
+
+        std::size_t params = out.input_map_slots.size();
+        for (auto const& slot : out.input_map_slots)
+        {
+            auto it = instances.find(slot.first);
+            if (it == instances.end())
+            {
+                continue;
+            }
+
+            auto& header = table[slot.second].header;
+            header.params = static_cast<int>(params);
+            header.signature = static_cast<int>(it->second.signature);
+
+            for (auto const& leaf : it->second.leafs)
+            {
+                auto folded = folded_indices.find(leaf);
+                table[params++].int_values.idx = folded != folded_indices.end() ? folded->second :
+                    static_cast<int>(table_size + input_map_leafs_collector.GetItemIndex(leaf));
+            }
+        }
+
+        UploadInputMapData(out);
+
+        out.input_map_bundle.reset(input_map_collector.CreateBundle());
+
+        // Generated headers are complete now (materials are updated first),
+        // build dependent programs in parallel before the first frame needs them
+        m_program_manager->CompileAllAsync();
     }
 
     void Baikal::ClwSceneController::UpdateLeafsData(Scene1 const& scene, Collector& input_map_leafs_collector, Collector& tex_collector, ClwScene& out) const
+    {
+        static_assert(sizeof(ClwScene::InputMapData) == sizeof(std::array<std::int32_t, 4>), "Unexpected InputMapData size");
+
+        out.input_map_leafs.resize(input_map_leafs_collector.GetNumItems());
+
+        // Update input map leafs bundle to be able to track differences
+        out.input_map_leafs_bundle.reset(input_map_leafs_collector.CreateBundle());
+
+        // leaf iterator
+        auto iter = input_map_leafs_collector.CreateIterator();
+        std::size_t num_inputmap_leafs_written = 0;
+
+        // Iterate and serialize
+        for (; iter->IsValid(); iter->Next())
+        {
+            WriteInputMapLeaf(*iter->ItemAs<InputMap>(), tex_collector, out.input_map_leafs[num_inputmap_leafs_written].data());
+            ++num_inputmap_leafs_written;
+        }
+
+        UploadInputMapData(out);
+    }
+
+    void Baikal::ClwSceneController::UploadInputMapData(ClwScene& out) const
     {
         // Get new buffer size
-        std::size_t buffer_size = input_map_leafs_collector.GetNumItems();
+        std::size_t buffer_size = out.input_map_table.size() + out.input_map_leafs.size();
 
-        // Recreate input map leafs buffer if it needs resize
+        // Recreate input map buffer if it needs resize
         if (buffer_size > out.input_map_data.GetElementCount())
         {
-            // Create material buffer
             out.input_map_data = m_context.CreateBuffer<ClwScene::InputMapData>(buffer_size, CL_MEM_READ_ONLY);
         }
 
@@ -1317,19 +2152,8 @@ namespace Baikal
             // Map GPU input map buffer
             m_context.MapBuffer(0, out.input_map_data, CL_MAP_WRITE, &input_map_data).Wait();
 
-            // Update input map leafs bundle to be able to track differences
-            out.input_map_leafs_bundle.reset(input_map_leafs_collector.CreateBundle());
-
-            // leaf iterator
-            auto iter = input_map_leafs_collector.CreateIterator();
-            std::size_t num_inputmap_leafs_written = 0;
-
-            // Iterate and serialize
-            for (; iter->IsValid(); iter->Next())
-            {
-                WriteInputMapLeaf(*iter->ItemAs<InputMap>(), tex_collector, input_map_data + num_inputmap_leafs_written);
-                ++num_inputmap_leafs_written;
-            }
+            std::memcpy(input_map_data, out.input_map_table.data(), out.input_map_table.size() * sizeof(ClwScene::InputMapData));
+            std::memcpy(input_map_data + out.input_map_table.size(), out.input_map_leafs.data(), out.input_map_leafs.size() * sizeof(ClwScene::InputMapData));
 
             //Unmap buffer
             m_context.UnmapBuffer(0, out.input_map_data, input_map_data);
@@ -1384,10 +2208,10 @@ namespace Baikal
         }
     }
 
-    std::int32_t ClwSceneController::ResolveMaterialPtr(Material::Ptr material) const
+    std::int32_t ClwSceneController::ResolveMaterialPtr(ClwScene const& scene, Material::Ptr material) const
     {
-        auto it = m_materialid_to_offset.find(material->GetId());
-        return (it == m_materialid_to_offset.end()) ? -1 : it->second;
+        auto it = scene.material_offsets.find(material->GetId());
+        return (it == scene.material_offsets.end()) ? -1 : it->second;
     }
 
     int ClwSceneController::GetMaterialLayers(Material::Ptr material) const
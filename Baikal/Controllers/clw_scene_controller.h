@@ -65,9 +65,24 @@ namespace Baikal
         // Get underlying intersection API.
         RadeonRays::IntersectionApi* GetIntersectionApi() { return  m_api; }
 
+        // Set vertex attribute compression (combination of ClwScene::GeometryCompression flags).
+        // Takes effect on the next shape update, 16-bit indices are used for meshes with less than 64K vertices.
+        void SetGeometryCompression(std::uint32_t compression);
+        std::uint32_t GetGeometryCompression() const;
+
+        // Set texture fetch path. Image arrays fall back to buffers if any device lacks image support.
+        // Takes effect on the next texture update.
+        void SetTextureBackend(TextureBackend backend);
+        TextureBackend GetTextureBackend() const;
+
+        // Milliseconds the last acceleration structure build took, to compare against deduplicated scenes
+        float GetAccelerationBuildTime() const { return m_acceleration_build_time; }
+
     protected:
         // Clear intersector and load meshes into it.
         void ReloadIntersector(Scene1 const& scene, ClwScene& inout) const;
+        // Install generated kernel headers of the scene into program manager
+        void InstallHeaders(ClwScene const& scene) const;
 
     public:
         // Update camera data only.
@@ -94,35 +109,50 @@ namespace Baikal
         void UpdateVolumes(Scene1 const& scene, Collector& volume_collector, Collector& tex_collector, ClwScene& out) const override;
         // If scene attributes changed
         void UpdateSceneAttributes(Scene1 const& scene, Collector& tex_collector, ClwScene& out) const override;
+        // Delete intersector shapes of replaced scene
+        void ReleaseCompiledScene(ClwScene& scene) const override;
 
         // Update intersection API
         void UpdateIntersector(Scene1 const& scene, ClwScene& out) const;
         void UpdateIntersectorTransforms(Scene1 const& scene, ClwScene& out) const;
         // Write out single material at data pointer.
         // Collectors are required to convert texture and material pointers into indices.
-        void WriteMaterial(Material const& material, Collector& mat_collector, Collector& tex_collector, std::vector<std::int32_t> &material_data) const;
+        // Input maps are written as slots, see UpdateInputMaps.
+        void WriteMaterial(Material const& material, Collector& mat_collector, Collector& tex_collector,
+            std::map<std::uint32_t, std::int32_t> const& input_map_slots, std::vector<std::int32_t> &material_data) const;
         // Write out single light at data pointer.
         // Collector is required to convert texture pointers into indices.
-        void WriteLight(Scene1 const& scene, Light const& light, Collector& tex_collector, void* data) const;
+        void WriteLight(Scene1 const& scene, GeometryDuplicates const& duplicates, Light const& light, Collector& tex_collector, void* data) const;
         // Write out single texture header at data pointer.
         // Header requires texture data offset, so it is passed in.
         void WriteTexture(Texture const& texture, std::size_t data_offset, void* data) const;
-        // Write out texture data at data pointer.
+        // Write out texture data with its mip chain at data pointer.
         void WriteTextureData(Texture const& texture, void* data) const;
         // Write single volume at data pointer
         void WriteVolume(VolumeMaterial const& volume, Collector& tex_collector, void* data) const;
         // Write single input map leaf at data pointer
         // Collectore is required to convert texture pointers into indices.
         void WriteInputMapLeaf(InputMap const& leaf, Collector& tex_collector, void* data) const;
+        // Upload input map table and leafs of the scene into input_map_data
+        void UploadInputMapData(ClwScene& out) const;
 
         // Resolves host material pointer to device offset
-        std::int32_t ResolveMaterialPtr(Material::Ptr material) const;
+        std::int32_t ResolveMaterialPtr(ClwScene const& scene, Material::Ptr material) const;
 
     private:
-        int GetMaterialIndex(Collector const& collector, Material::Ptr material) const;
+        int GetMaterialIndex(ClwScene const& scene, Material::Ptr material) const;
         int GetTextureIndex(Collector const& collector, Texture::Ptr material) const;
         int GetVolumeIndex(Collector const& collector, VolumeMaterial::Ptr volume) const;
         int GetMaterialLayers(Material::Ptr material) const;
+        // (Re)create read only scene buffer, previous buffer is released before its storage. If device
+        // shares memory with host the buffer is created with CL_MEM_USE_HOST_PTR over page aligned
+        // allocation returned in storage, so mapping it is free and no device side copy exists.
+        template <typename T>
+        void CreateSceneBuffer(std::size_t count, CLWBuffer<T>& buffer, std::shared_ptr<void>& storage) const;
+        // Create RGBA image array of TextureImage type
+        std::shared_ptr<_cl_mem> CreateTextureImage(int image, int width, int height, int layers) const;
+        // Write finest level of a texture into layer of its image array
+        void WriteTextureImage(Texture const& texture, int layer, ClwScene const& scene) const;
 
         // Context
         CLWContext m_context;
@@ -132,7 +162,15 @@ namespace Baikal
         Material::Ptr m_default_material;
         // CL Program manager
         const CLProgramManager *m_program_manager;
-        // Material to device material map
-        mutable std::unordered_map<std::uint32_t, std::int32_t> m_materialid_to_offset;
+        // Geometry compression flags
+        std::uint32_t m_geometry_compression;
+        // Device shares memory with host, use zero-copy scene buffers and release host data after upload
+        bool m_use_host_ptr;
+        // Texture fetch path
+        TextureBackend m_texture_backend;
+        // All devices support images
+        bool m_image_support;
+        // Duration of the last intersector commit in ms
+        mutable std::atomic<float> m_acceleration_build_time;
     };
 }
@@ -31,9 +31,14 @@
 #include "SceneGraph/Collector/collector.h"
 #include "SceneGraph/material.h"
 #include "SceneGraph/scene1.h"
+#include "Utils/geometry_dedup.h"
 
+#include <atomic>
+#include <future>
 #include <memory>
 #include <map>
+#include <utility>
+#include <vector>
 
 namespace Baikal
 {
@@ -63,8 +68,32 @@ namespace Baikal
 
         CompiledScene& GetCachedScene(Scene1::Ptr scene) const;
 
+        // Compile the scene into a back buffer on a worker thread if geometry or textures changed,
+        // other edits are compiled right away. Previously compiled version is returned by
+        // CompileScene() and can be rendered until the new one is swapped in. The worker reads
+        // the scene graph without copying it, so until the swap objects must not be detached or
+        // destroyed and mesh and texture data must not be changed. Camera, light and material
+        // edits made meanwhile stay dirty and are compiled by the next call.
+        void CompileSceneAsync(Scene1::Ptr scene) const;
+        // Frame boundary: make the result of finished async compile current and drop dirty
+        // state it compiled. CompileScene() does that automatically. Returns true if
+        // compiled scene has been replaced.
+        bool SwapCompiledScene(bool wait) const;
+
         static void ResetId();
 
+        // Compile duplicate meshes as instances of a single copy (off by default),
+        // the scene graph itself is left untouched
+        void SetGeometryDeduplication(bool enable) { m_dedup_geometry = enable; }
+        bool GetGeometryDeduplication() const { return m_dedup_geometry; }
+        // Results of the last deduplication pass run by the controller
+        GeometryDedupStats GetGeometryDedupStats() const { return m_dedup_stats; }
+
+        // Drop host copies of mesh and texture data after successful compile (off by default).
+        // Only objects with reload callback are affected, data is reloaded when needed again.
+        void SetHostDataRelease(bool enable) { m_release_host_data = enable; }
+        bool GetHostDataRelease() const { return m_release_host_data; }
+
     protected:
         // Recompile the scene from scratch, i.e. not loading from cache.
         // All the buffers are recreated and reloaded.
@@ -72,6 +101,19 @@ namespace Baikal
                            Collector& vol_collector, Collector& input_maps_collector,
                            Collector& input_map_leafs_collector, CompiledScene& out) const;
 
+        // Collect materials, textures, volumes and input maps of the scene
+        void CollectSceneObjects(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector,
+                                 Collector& vol_collector, Collector& input_maps_collector,
+                                 Collector& input_map_leafs_collector) const;
+        // Drop dirty flags after successful compile
+        void FinalizeCompile(Scene1 const& scene) const;
+        // Release host copies of uploaded mesh and texture data
+        void ReleaseHostData(Scene1 const& scene, Collector& tex_collector) const;
+        // Wait for async compile and free its result without swapping it in. Derived
+        // controllers call it from destructor since the worker calls into them.
+        void CancelAsyncCompile() const;
+        // Check if called from async compile worker thread
+        bool IsBackgroundCompile() const { return m_background_compile; }
         // set dirty flag to false for camera object
         void DropCameraDirty(Scene1 const& scene) const;
         // set dirty flag to false for iterator
@@ -101,6 +143,8 @@ namespace Baikal
         virtual void UpdateVolumes(Scene1 const& scene, Collector& volume_collector, Collector& tex_collector, CompiledScene& out) const = 0;
         // If scene attributes changed
         virtual void UpdateSceneAttributes(Scene1 const& scene, Collector& tex_collector, CompiledScene& out) const = 0;
+        // Free resources of compiled scene replaced by async compile
+        virtual void ReleaseCompiledScene(CompiledScene& scene) const {}
 
 
     private:
@@ -116,6 +160,31 @@ namespace Baikal
 
         // Scene controller id
         std::uint32_t m_id;
+        // Run geometry deduplication on shape changes
+        bool m_dedup_geometry;
+        mutable GeometryDedupStats m_dedup_stats;
+        // Release host data after compile
+        bool m_release_host_data;
+
+        // Compile running on a worker thread
+        struct AsyncCompile
+        {
+            Scene1::Ptr scene;
+            // Collected on the rendering thread before the worker is started
+            Collector material_collector;
+            Collector volume_collector;
+            Collector texture_collector;
+            Collector input_maps_collector;
+            Collector input_map_leafs_collector;
+            GeometryDuplicates geometry_duplicates;
+            // Change counts of the scene and its objects the worker started from
+            std::uint32_t scene_change_count;
+            std::vector<std::pair<SceneObject::Ptr, std::uint32_t>> objects;
+            std::future<std::unique_ptr<CompiledScene>> result;
+        };
+
+        mutable std::unique_ptr<AsyncCompile> m_async_compile;
+        mutable std::atomic<bool> m_background_compile;
     };
 }
 
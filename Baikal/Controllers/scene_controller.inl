@@ -7,8 +7,11 @@
 #include "SceneGraph/Collector/collector.h"
 #include "SceneGraph/iterator.h"
 #include "SceneGraph/uberv2material.h"
+#include "Utils/geometry_dedup.h"
+#include "Utils/log.h"
 
 #include <chrono>
+#include <future>
 #include <memory>
 #include <stack>
 #include <vector>
@@ -23,6 +26,9 @@ namespace Baikal
     template <typename CompiledScene>
     SceneController<CompiledScene>::SceneController()
         : m_id(GetNextControllerId())
+        , m_dedup_geometry(false)
+        , m_release_host_data(false)
+        , m_background_compile(false)
     {
     }
 
@@ -51,8 +57,447 @@ namespace Baikal
         Scene1::Ptr scene
     ) const {
 
+        // Background compile is in flight: keep rendering previous version
+        // until it is done, then swap it in and catch up with newer edits.
+        if (m_async_compile)
+        {
+            if (m_async_compile->scene == scene && !SwapCompiledScene(false))
+            {
+                return GetCachedScene(scene);
+            }
+
+            SwapCompiledScene(true);
+        }
+
         scene->Acquire(m_id);
 
+        // Find duplicate geometry before shapes are compiled, so duplicates never reach GPU buffers
+        bool find_duplicates = m_dedup_geometry &&
+            (m_scene_cache.find(scene) == m_scene_cache.cend() || (scene->GetDirtyFlags() & Scene1::kShapes));
+
+        GeometryDuplicates duplicates;
+        if (find_duplicates)
+        {
+            duplicates = FindDuplicateGeometry(*scene, m_dedup_stats);
+        }
+
+        CollectSceneObjects(*scene, m_material_collector, m_texture_collector, m_volume_collector,
+                            m_input_maps_collector, m_input_map_leafs_collector);
+
+        // Try to find scene in cache first
+        auto iter = m_scene_cache.find(scene);
+
+        if (iter == m_scene_cache.cend())
+        {
+            // If not found create scene entry in cache
+            auto res = m_scene_cache.emplace(std::make_pair(scene, CompiledScene()));
+            res.first->second.geometry_duplicates = std::move(duplicates);
+
+            // Recompile all the stuff into cached scene
+            RecompileFull(*scene, m_material_collector, m_texture_collector, m_volume_collector,
+                          m_input_maps_collector, m_input_map_leafs_collector, res.first->second);
+
+            DropCameraDirty(*scene);
+            DropDirty(*scene->CreateLightIterator());
+            DropDirty(*scene->CreateShapeIterator());
+
+            // Set scene as current
+            m_current_scene = scene;
+
+            FinalizeCompile(*scene);
+
+            // Return the scene
+            scene->Release();
+            return res.first->second;
+        }
+        else
+        {
+            // Exctract cached scene entry
+            auto& out = iter->second;
+            auto dirty = scene->GetDirtyFlags();
+
+            if (find_duplicates)
+            {
+                out.geometry_duplicates = std::move(duplicates);
+            }
+
+            bool should_update_materials = !out.material_bundle ||
+                m_material_collector.NeedsUpdate(out.material_bundle.get(),
+                                                 [](SceneObject::Ptr ptr)->bool
+            {
+                auto mat = std::static_pointer_cast<Material>(ptr);
+                return mat->IsDirty();
+            });
+
+            bool should_update_volumes = !out.volume_bundle ||
+                m_volume_collector.NeedsUpdate(out.volume_bundle.get(),
+                                               [](SceneObject::Ptr ptr)->bool
+            {
+                auto volume = std::static_pointer_cast<VolumeMaterial>(ptr);
+                return volume->IsDirty();
+            });
+
+            bool should_update_textures = m_texture_collector.GetNumItems() > 0 && (
+                !out.texture_bundle ||
+                m_texture_collector.NeedsUpdate(out.texture_bundle.get(), [](SceneObject::Ptr ptr) {
+                auto tex = std::static_pointer_cast<Texture>(ptr);
+                return tex->IsDirty(); }));
+
+            bool should_update_leafs_data = (m_input_map_leafs_collector.GetNumItems() > 0) && (
+                !out.input_map_leafs_bundle ||
+                m_input_map_leafs_collector.NeedsUpdate(out.input_map_leafs_bundle.get(), [](SceneObject::Ptr ptr)
+                {
+                    return ptr->IsDirty();
+                }));
+
+            bool should_update_input_maps = (m_input_maps_collector.GetNumItems() > 0) && (
+                !out.input_map_bundle ||
+                m_input_maps_collector.NeedsUpdate(out.input_map_bundle.get(), [](SceneObject::Ptr ptr)
+                {
+                    return ptr->IsDirty();
+                }));
+
+            // Check if we have valid camera
+            auto camera = scene->GetCamera();
+
+            if (!camera)
+            {
+                throw std::runtime_error("No camera in the scene");
+            }
+
+            // Check if camera parameters have been changed
+            auto camera_changed = camera->IsDirty();
+
+            // Update camera if needed
+            if (dirty & Scene1::kCamera || camera_changed)
+            {
+                UpdateCamera(*scene, m_material_collector, m_texture_collector, m_volume_collector, out);
+                DropCameraDirty(*scene);
+            }
+
+            // If materials need an update, do it.
+            // We are passing material dirty state detection function in there.
+            // We update materials before lights and shapes since they depends on it.
+            if (should_update_materials)
+            {
+                UpdateMaterials(*scene, m_material_collector, m_texture_collector, out);
+            }
+
+            {
+                // Check if we have lights in the scene
+                auto light_iter = scene->CreateLightIterator();
+
+                if (!light_iter->IsValid())
+                {
+                    throw std::runtime_error("No lights in the scene");
+                }
+
+
+                // Check if light parameters have been changed
+                bool lights_changed = false;
+
+                for (; light_iter->IsValid(); light_iter->Next())
+                {
+                    auto light = light_iter->ItemAs<Light>();
+
+                    if (light->IsDirty())
+                    {
+                        lights_changed = true;
+                        break;
+                    }
+                }
+
+
+                // Update lights if needed
+                if (dirty & Scene1::kLights || lights_changed ||
+                    should_update_textures || should_update_materials)
+                {
+                    UpdateLights(*scene, m_material_collector, m_texture_collector, out);
+                    light_iter->Reset();
+                    DropDirty(*light_iter);
+                }
+            }
+
+            {
+                // Check if we have shapes in the scene
+                auto shape_iter = scene->CreateShapeIterator();
+
+                if (!shape_iter->IsValid())
+                {
+                    throw std::runtime_error("No shapes in the scene");
+                }
+
+                // Check if shape parameters have been changed
+                bool shapes_changed = false;
+
+                for (; shape_iter->IsValid(); shape_iter->Next())
+                {
+                    auto shape = shape_iter->ItemAs<Shape>();
+
+                    if (shape->IsDirty())
+                    {
+                        shapes_changed = true;
+                        break;
+                    }
+                }
+
+                // Update shapes if needed
+                if (dirty & Scene1::kShapes)
+                {
+                    UpdateShapes(*scene, m_material_collector, m_texture_collector, m_volume_collector, out);
+                    shape_iter->Reset();
+                    DropDirty(*shape_iter);
+                }
+                else if (shapes_changed)
+                {
+                    UpdateShapeProperties(*scene, m_material_collector, m_texture_collector, m_volume_collector, out);
+                }
+            }
+
+            // If textures need an update, do it.
+            if (should_update_textures)
+            {
+                UpdateTextures(*scene, m_material_collector, m_texture_collector, out);
+            }
+
+            // If volumes need an update, do it.
+            if (should_update_volumes)
+            {
+                UpdateVolumes(*scene, m_volume_collector, m_texture_collector, out);
+            }
+
+            if (should_update_leafs_data)
+            {
+                UpdateLeafsData(*scene, m_input_map_leafs_collector, m_texture_collector, out);
+            }
+
+            if (should_update_input_maps)
+            {
+                UpdateInputMaps(*scene, m_input_maps_collector, m_input_map_leafs_collector, out);
+            }
+
+            // Set current scene
+            if (m_current_scene != scene)
+            {
+                m_current_scene = scene;
+
+                UpdateCurrentScene(*scene, out);
+            }
+
+            // If background image need an update, do it.
+            if ((scene->GetDirtyFlags() & Scene1::kBackground) == Scene1::kBackground)
+            {
+                UpdateSceneAttributes(*scene, m_texture_collector, out);
+            }
+
+            FinalizeCompile(*scene);
+
+            // Return the scene
+            scene->Release();
+            return out;
+        }
+    }
+
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::CompileSceneAsync(Scene1::Ptr scene) const
+    {
+        // Only one compile can be in flight, edits made meanwhile
+        // stay dirty and are compiled once it is swapped in
+        if (m_async_compile && !SwapCompiledScene(false))
+        {
+            return;
+        }
+
+        // Nothing to render meanwhile, compile synchronously
+        if (m_scene_cache.find(scene) == m_scene_cache.cend())
+        {
+            CompileScene(scene);
+            return;
+        }
+
+        std::unique_ptr<AsyncCompile> async(new AsyncCompile());
+        async->scene = scene;
+
+        // Scene graph is changed and collected on this thread, the worker only reads it
+        scene->Acquire(m_id);
+
+        auto dirty = scene->GetDirtyFlags();
+
+        if (m_dedup_geometry && (dirty & Scene1::kShapes))
+        {
+            async->geometry_duplicates = FindDuplicateGeometry(*scene, m_dedup_stats);
+        }
+        else
+        {
+            async->geometry_duplicates = GetCachedScene(scene).geometry_duplicates;
+        }
+
+        CollectSceneObjects(*scene, async->material_collector, async->texture_collector, async->volume_collector,
+                            async->input_maps_collector, async->input_map_leafs_collector);
+
+        // Only geometry and texture uploads are worth compiling from scratch
+        // in background, other edits are cheap to apply to the current scene
+        bool textures_changed = false;
+
+        for (std::unique_ptr<Iterator> tex_iter(async->texture_collector.CreateIterator()); tex_iter->IsValid(); tex_iter->Next())
+        {
+            textures_changed = textures_changed || tex_iter->ItemAs<SceneObject>()->IsDirty();
+        }
+
+        if (!(dirty & Scene1::kShapes) && !textures_changed)
+        {
+            scene->Release();
+            CompileScene(scene);
+            return;
+        }
+
+        // Remember what the worker compiles, so that only this state is dropped at swap
+        auto snapshot = [&async](Iterator& iter)
+        {
+            for (; iter.IsValid(); iter.Next())
+            {
+                auto object = iter.ItemAs<SceneObject>();
+                async->objects.emplace_back(object, object->GetChangeCount());
+            }
+        };
+
+        async->scene_change_count = scene->GetChangeCount();
+
+        if (auto camera = scene->GetCamera())
+        {
+            async->objects.emplace_back(camera, camera->GetChangeCount());
+        }
+
+        snapshot(*scene->CreateLightIterator());
+        snapshot(*scene->CreateShapeIterator());
+        snapshot(*async->material_collector.CreateIterator());
+        snapshot(*async->volume_collector.CreateIterator());
+        snapshot(*async->texture_collector.CreateIterator());
+        snapshot(*async->input_maps_collector.CreateIterator());
+        snapshot(*async->input_map_leafs_collector.CreateIterator());
+
+        scene->Release();
+
+        auto job = async.get();
+        job->result = std::async(std::launch::async, [this, job]()
+        {
+            job->scene->Acquire(m_id);
+
+            // Back buffer is compiled from scratch, so it does not share
+            // any buffers the renderer might be using at the moment
+            std::unique_ptr<CompiledScene> back(new CompiledScene());
+            back->geometry_duplicates = std::move(job->geometry_duplicates);
+
+            m_background_compile = true;
+
+            try
+            {
+                RecompileFull(*job->scene, job->material_collector, job->texture_collector, job->volume_collector,
+                              job->input_maps_collector, job->input_map_leafs_collector, *back);
+            }
+            catch (...)
+            {
+                m_background_compile = false;
+                job->scene->Release();
+                throw;
+            }
+
+            m_background_compile = false;
+            job->scene->Release();
+            return back;
+        });
+
+        m_async_compile = std::move(async);
+    }
+
+    template <typename CompiledScene>
+    inline
+    bool SceneController<CompiledScene>::SwapCompiledScene(bool wait) const
+    {
+        if (!m_async_compile)
+        {
+            return false;
+        }
+
+        if (!wait && m_async_compile->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return false;
+        }
+
+        std::unique_ptr<AsyncCompile> async(std::move(m_async_compile));
+        auto scene = async->scene;
+
+        // Rethrows compilation errors, dirty state is kept then
+        auto back = async->result.get();
+
+        auto& front = m_scene_cache[scene];
+        std::swap(front, *back);
+
+        // Device side state which can't be double buffered (e.g. intersector)
+        // is switched here, on the rendering thread
+        m_current_scene = scene;
+        UpdateCurrentScene(*scene, front);
+
+        scene->Acquire(m_id);
+
+        // Objects changed since the worker started stay dirty. Flags are dropped
+        // object by object, composite input maps would clear their children otherwise.
+        if (scene->GetChangeCount() == async->scene_change_count)
+        {
+            scene->ClearDirtyFlags();
+        }
+
+        for (auto& object : async->objects)
+        {
+            if (object.first->GetChangeCount() == object.second)
+            {
+                object.first->SceneObject::SetDirty(false);
+            }
+        }
+
+        if (m_release_host_data)
+        {
+            ReleaseHostData(*scene, async->texture_collector);
+        }
+
+        scene->Release();
+
+        ReleaseCompiledScene(*back);
+        return true;
+    }
+
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::CancelAsyncCompile() const
+    {
+        if (!m_async_compile)
+        {
+            return;
+        }
+
+        std::unique_ptr<AsyncCompile> async(std::move(m_async_compile));
+
+        try
+        {
+            auto back = async->result.get();
+            ReleaseCompiledScene(*back);
+        }
+        catch (std::exception& e)
+        {
+            LogInfo("Async scene compile failed: ", e.what(), "\n");
+        }
+        catch (...)
+        {
+            LogInfo("Async scene compile failed\n");
+        }
+    }
+
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::CollectSceneObjects(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector,
+        Collector& vol_collector, Collector& input_maps_collector, Collector& input_map_leafs_collector) const
+    {
         // The overall approach is:
         // 1) Check if materials have changed, update collector if yes
         // 2) Check if textures have changed, update collector if yes
@@ -64,19 +509,19 @@ namespace Baikal
         // updating necessary parts.
 
         // We need to make sure collectors are empty before proceeding
-        m_material_collector.Clear();
-        m_texture_collector.Clear();
-        m_volume_collector.Clear();
-        m_input_maps_collector.Clear();
-        m_input_map_leafs_collector.Clear();
+        mat_collector.Clear();
+        tex_collector.Clear();
+        vol_collector.Clear();
+        input_maps_collector.Clear();
+        input_map_leafs_collector.Clear();
 
         // Create shape and light iterators
-        auto shape_iter = scene->CreateShapeIterator();
-        auto light_iter = scene->CreateLightIterator();
+        auto shape_iter = scene.CreateShapeIterator();
+        auto light_iter = scene.CreateLightIterator();
 
         auto default_material = GetDefaultMaterial();
         // Collect materials from shapes first
-        m_material_collector.Collect(*shape_iter,
+        mat_collector.Collect(*shape_iter,
                               // This function adds all materials to resulting map
                               // recursively via Material dependency API
                               [default_material](SceneObject::Ptr item) ->
@@ -127,12 +572,12 @@ namespace Baikal
                               });
 
         // Commit stuff (we can iterate over it after commit has happened)
-        m_material_collector.Commit();
+        mat_collector.Commit();
 
         // set iterator position at begin
         shape_iter->Reset();
         // Collect volume materials from shapes first
-        m_volume_collector.Collect(*shape_iter,
+        vol_collector.Collect(*shape_iter,
                                     [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
                                     {
                                         // Resulting material set
@@ -149,14 +594,14 @@ namespace Baikal
                                     });
 
         // Commit stuff
-        m_volume_collector.Commit();
+        vol_collector.Commit();
 
         // Now we need to collect textures from our materials
         // Create material iterator
-        auto mat_iter = m_material_collector.CreateIterator();
+        auto mat_iter = mat_collector.CreateIterator();
 
         // Collect textures from materials
-        m_texture_collector.Collect(*mat_iter,
+        tex_collector.Collect(*mat_iter,
                                     [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
                               {
                                   // Texture set
@@ -179,10 +624,10 @@ namespace Baikal
 
         // Now we need to collect textures from volumes
         // Create volume iterator
-        auto vol_iter = m_volume_collector.CreateIterator();
+        auto vol_iter = vol_collector.CreateIterator();
 
         // Collect textures from materials
-        m_texture_collector.Collect(*vol_iter,
+        tex_collector.Collect(*vol_iter,
             [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
         {
             // Texture set
@@ -204,7 +649,7 @@ namespace Baikal
         });
 
         // Collect textures from lights
-        m_texture_collector.Collect(*light_iter,
+        tex_collector.Collect(*light_iter,
                                     [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
                               {
                                   // Resulting set
@@ -226,7 +671,7 @@ namespace Baikal
                               });
 
         mat_iter->Reset();
-        m_input_maps_collector.Collect(*mat_iter,
+        input_maps_collector.Collect(*mat_iter,
                                 [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
                                 {
                                     // Texture set
@@ -246,10 +691,10 @@ namespace Baikal
                                     // Return resulting set
                                     return input_maps;
                                 });
-        m_input_maps_collector.Commit();
+        input_maps_collector.Commit();
 
         mat_iter->Reset();
-        m_input_map_leafs_collector.Collect(*mat_iter,
+        input_map_leafs_collector.Collect(*mat_iter,
                                 [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
                                 {
                                     // Texture set
@@ -269,266 +714,84 @@ namespace Baikal
                                     // Return resulting set
                                     return input_maps;
                                 });
-        m_input_map_leafs_collector.Commit();
+        input_map_leafs_collector.Commit();
 
 
         // Add background texture from scene into texture collector
-        auto background_texture = scene->GetBackgroundImage();
+        auto background_texture = scene.GetBackgroundImage();
         if (background_texture)
-            m_texture_collector.Collect(background_texture);
+            tex_collector.Collect(background_texture);
 
         // Commit textures
-        m_texture_collector.Commit();
+        tex_collector.Commit();
+    }
 
-        // Try to find scene in cache first
-        auto iter = m_scene_cache.find(scene);
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::FinalizeCompile(Scene1 const& scene) const
+    {
+        // Drop all dirty flags for the scene
+        scene.ClearDirtyFlags();
 
-        if (iter == m_scene_cache.cend())
+        // Drop dirty flags for materials
+        m_material_collector.Finalize([](SceneObject::Ptr item)
         {
-            // If not found create scene entry in cache
-            auto res = m_scene_cache.emplace(std::make_pair(scene, CompiledScene()));
-
-            // Recompile all the stuff into cached scene
-            RecompileFull(*scene, m_material_collector, m_texture_collector, m_volume_collector,
-                          m_input_maps_collector, m_input_map_leafs_collector, res.first->second);
-
-            // Set scene as current
-            m_current_scene = scene;
-
-            // Drop all dirty flags for the scene
-            scene->ClearDirtyFlags();
-
-            // Drop dirty flags for materials
-            m_material_collector.Finalize([](SceneObject::Ptr item)
-            {
-                auto material = std::static_pointer_cast<Material>(item);
-                material->SetDirty(false);
-            });
-
-            m_volume_collector.Finalize([](SceneObject::Ptr item)
-            {
-                auto volume = std::static_pointer_cast<VolumeMaterial>(item);
-                volume->SetDirty(false);
-            });
-
-            // It will mark entire hierarchy as not dirty
-            m_input_maps_collector.Finalize([](SceneObject::Ptr item)
-            {
-                auto input_map = std::static_pointer_cast<InputMap>(item);
-                input_map->SetDirty(false);
-            });
+            auto material = std::static_pointer_cast<Material>(item);
+            material->SetDirty(false);
+        });
 
-            // Return the scene
-            scene->Release();
-            return res.first->second;
-        }
-        else
+        m_texture_collector.Finalize([](SceneObject::Ptr item)
         {
-            // Exctract cached scene entry
-            auto& out = iter->second;
-            auto dirty = scene->GetDirtyFlags();
-
-            bool should_update_materials = !out.material_bundle ||
-                m_material_collector.NeedsUpdate(out.material_bundle.get(),
-                                                 [](SceneObject::Ptr ptr)->bool
-            {
-                auto mat = std::static_pointer_cast<Material>(ptr);
-                return mat->IsDirty();
-            });
-
-            bool should_update_volumes = !out.volume_bundle ||
-                m_volume_collector.NeedsUpdate(out.volume_bundle.get(),
-                                               [](SceneObject::Ptr ptr)->bool
-            {
-                auto volume = std::static_pointer_cast<VolumeMaterial>(ptr);
-                return volume->IsDirty();
-            });
-
-            bool should_update_textures = m_texture_collector.GetNumItems() > 0 && (
-                !out.texture_bundle ||
-                m_texture_collector.NeedsUpdate(out.texture_bundle.get(), [](SceneObject::Ptr ptr) {
-                auto tex = std::static_pointer_cast<Texture>(ptr);
-                return tex->IsDirty(); }));
-
-            bool should_update_leafs_data = (m_input_map_leafs_collector.GetNumItems() > 0) && (
-                !out.input_map_leafs_bundle ||
-                m_input_map_leafs_collector.NeedsUpdate(out.input_map_leafs_bundle.get(), [](SceneObject::Ptr ptr)
-                {
-                    return ptr->IsDirty();
-                }));
-
-            bool should_update_input_maps = (m_input_maps_collector.GetNumItems() > 0) && (
-                !out.input_map_bundle ||
-                m_input_maps_collector.NeedsUpdate(out.input_map_bundle.get(), [](SceneObject::Ptr ptr)
-                {
-                    return ptr->IsDirty();
-                }));
-
-            // Check if we have valid camera
-            auto camera = scene->GetCamera();
-
-            if (!camera)
-            {
-                throw std::runtime_error("No camera in the scene");
-            }
-
-            // Check if camera parameters have been changed
-            auto camera_changed = camera->IsDirty();
-
-            // Update camera if needed
-            if (dirty & Scene1::kCamera || camera_changed)
-            {
-                UpdateCamera(*scene, m_material_collector, m_texture_collector, m_volume_collector, out);
-                DropCameraDirty(*scene);
-            }
-
-            // If materials need an update, do it.
-            // We are passing material dirty state detection function in there.
-            // We update materials before lights and shapes since they depends on it.
-            if (should_update_materials)
-            {
-                UpdateMaterials(*scene, m_material_collector, m_texture_collector, out);
-            }
-
-            {
-                // Check if we have lights in the scene
-                auto light_iter = scene->CreateLightIterator();
-
-                if (!light_iter->IsValid())
-                {
-                    throw std::runtime_error("No lights in the scene");
-                }
-
-
-                // Check if light parameters have been changed
-                bool lights_changed = false;
-
-                for (; light_iter->IsValid(); light_iter->Next())
-                {
-                    auto light = light_iter->ItemAs<Light>();
-
-                    if (light->IsDirty())
-                    {
-                        lights_changed = true;
-                        break;
-                    }
-                }
-
-
-                // Update lights if needed
-                if (dirty & Scene1::kLights || lights_changed ||
-                    should_update_textures || should_update_materials)
-                {
-                    UpdateLights(*scene, m_material_collector, m_texture_collector, out);
-                    light_iter->Reset();
-                    DropDirty(*light_iter);
-                }
-            }
-
-            {
-                // Check if we have shapes in the scene
-                auto shape_iter = scene->CreateShapeIterator();
-
-                if (!shape_iter->IsValid())
-                {
-                    throw std::runtime_error("No shapes in the scene");
-                }
-
-                // Check if shape parameters have been changed
-                bool shapes_changed = false;
-
-                for (; shape_iter->IsValid(); shape_iter->Next())
-                {
-                    auto shape = shape_iter->ItemAs<Shape>();
-
-                    if (shape->IsDirty())
-                    {
-                        shapes_changed = true;
-                        break;
-                    }
-                }
+            auto tex = std::static_pointer_cast<Texture>(item);
+            tex->SetDirty(false);
+        });
 
-                // Update shapes if needed
-                if (dirty & Scene1::kShapes)
-                {
-                    UpdateShapes(*scene, m_material_collector, m_texture_collector, m_volume_collector, out);
-                    shape_iter->Reset();
-                    DropDirty(*shape_iter);
-                }
-                else if (shapes_changed)
-                {
-                    UpdateShapeProperties(*scene, m_material_collector, m_texture_collector, m_volume_collector, out);
-                }
-            }
+        m_volume_collector.Finalize([](SceneObject::Ptr item)
+        {
+            auto volume = std::static_pointer_cast<VolumeMaterial>(item);
+            volume->SetDirty(false);
+        });
 
-            // If textures need an update, do it.
-            if (should_update_textures)
-            {
-                UpdateTextures(*scene, m_material_collector, m_texture_collector, out);
-            }
+        // It will mark entire hierarchy as not dirty
+        m_input_maps_collector.Finalize([](SceneObject::Ptr item)
+        {
+            auto input_map = std::static_pointer_cast<InputMap>(item);
+            input_map->SetDirty(false);
+        });
 
-            // If volumes need an update, do it.
-            if (should_update_volumes)
-            {
-                UpdateVolumes(*scene, m_volume_collector, m_texture_collector, out);
-            }
+        if (m_release_host_data)
+        {
+            ReleaseHostData(scene, m_texture_collector);
+        }
+    }
 
-            if (should_update_leafs_data)
-            {
-                UpdateLeafsData(*scene, m_input_map_leafs_collector, m_texture_collector, out);
-            }
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::ReleaseHostData(Scene1 const& scene, Collector& tex_collector) const
+    {
+        auto shape_iter = scene.CreateShapeIterator();
 
-            if (should_update_input_maps)
-            {
-                UpdateInputMaps(*scene, m_input_maps_collector, m_input_map_leafs_collector, out);
-            }
+        for (; shape_iter->IsValid(); shape_iter->Next())
+        {
+            auto shape = shape_iter->ItemAs<Shape>();
 
-            // Set current scene
-            if (m_current_scene != scene)
+            // Instance base meshes might not be attached to the scene
+            if (auto instance = std::dynamic_pointer_cast<Instance>(shape))
             {
-                m_current_scene = scene;
-
-                UpdateCurrentScene(*scene, out);
+                shape = instance->GetBaseShape();
             }
 
-            // If background image need an update, do it.
-            if ((scene->GetDirtyFlags() & Scene1::kBackground) == Scene1::kBackground)
+            if (auto mesh = std::dynamic_pointer_cast<Mesh>(shape))
             {
-                UpdateSceneAttributes(*scene, m_texture_collector, out);
+                mesh->ReleaseData();
             }
+        }
 
-            // Make sure to clear dirty flags
-            scene->ClearDirtyFlags();
-
-            // Clear material dirty flags
-            m_material_collector.Finalize([](SceneObject::Ptr item)
-            {
-                auto material = std::static_pointer_cast<Material>(item);
-                material->SetDirty(false);
-            });
-
-            m_texture_collector.Finalize([](SceneObject::Ptr item)
-            {
-                auto tex = std::static_pointer_cast<Texture>(item);
-                tex->SetDirty(false);
-            });
-
-            m_volume_collector.Finalize([](SceneObject::Ptr item)
-            {
-                auto volume = std::static_pointer_cast<VolumeMaterial>(item);
-                volume->SetDirty(false);
-            });
-
-            // It will mark entire hierarchy as not dirty
-            m_input_maps_collector.Finalize([](SceneObject::Ptr item)
-            {
-                auto input_map = std::static_pointer_cast<InputMap>(item);
-                input_map->SetDirty(false);
-            });
+        std::unique_ptr<Iterator> tex_iter(tex_collector.CreateIterator());
 
-            // Return the scene
-            scene->Release();
-            return out;
+        for (; tex_iter->IsValid(); tex_iter->Next())
+        {
+            tex_iter->ItemAs<Texture>()->ReleaseData();
         }
     }
 
@@ -538,25 +801,20 @@ namespace Baikal
         Scene1 const& scene, Collector& m_material_collector, Collector& m_texture_collector, Collector& vol_collector,
         Collector& input_maps_collector, Collector& input_map_leafs_collector, CompiledScene& out) const
     {
-        UpdateCamera(scene, m_material_collector, m_texture_collector, m_volume_collector, out);
-        DropCameraDirty(scene);
+        UpdateCamera(scene, m_material_collector, m_texture_collector, vol_collector, out);
 
         //Lights and Shapes depends on Materials
         UpdateMaterials(scene, m_material_collector, m_texture_collector, out);
 
         UpdateLights(scene, m_material_collector, m_texture_collector, out);
-        auto light_iterator = scene.CreateLightIterator();
-        DropDirty(*light_iterator);
 
         UpdateShapes(scene, m_material_collector, m_texture_collector, vol_collector, out);
-        auto shape_iterator = scene.CreateShapeIterator();
-        DropDirty(*shape_iterator);
 
         UpdateTextures(scene, m_material_collector, m_texture_collector, out);
 
-        UpdateLeafsData(scene, m_input_map_leafs_collector, m_texture_collector, out);
+        UpdateLeafsData(scene, input_map_leafs_collector, m_texture_collector, out);
 
-        UpdateInputMaps(scene, m_input_maps_collector, m_input_map_leafs_collector, out);
+        UpdateInputMaps(scene, input_maps_collector, input_map_leafs_collector, out);
 
         UpdateVolumes(scene, vol_collector, m_texture_collector, out);
 
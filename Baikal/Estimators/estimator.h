@@ -24,6 +24,7 @@ THE SOFTWARE.
 #include "radeon_rays.h"
 #include "SceneGraph/clwscene.h"
 #include "Utils/clw_class.h"
+#include "Utils/cl_profiler.h"
 
 #include "CLW.h"
 
@@ -78,6 +79,7 @@ namespace Baikal
             : m_intersector(api)
             , m_max_bounces(5u)
             , m_max_shadow_ray_transmission_steps(2u)
+            , m_profiler(nullptr)
         {
         }
 
@@ -289,13 +291,38 @@ namespace Baikal
             return m_max_shadow_ray_transmission_steps;
         }
 
+        /**
+        \brief Set profiler recording kernel and intersector times, nullptr disables recording.
+
+        \param profiler Profiler owned by the caller
+        */
+        void SetProfiler(CLProfiler* profiler) {
+            m_profiler = profiler;
+        }
+
+        /**
+        \brief Get profiler, can be nullptr.
+        */
+        CLProfiler* GetProfiler() const {
+            return m_profiler;
+        }
+
         Estimator(Estimator const&) = delete;
         Estimator& operator = (Estimator const&) = delete;
 
+    protected:
+        // Record kernel launch if a profiler is set
+        void RecordKernel(char const* name, int bounce, CLWEvent const& event) const {
+            if (m_profiler) {
+                m_profiler->Record(name, bounce, event);
+            }
+        }
+
     private:
         std::shared_ptr<RadeonRays::IntersectionApi> m_intersector;
         std::uint32_t m_max_bounces;
         std::uint32_t m_max_shadow_ray_transmission_steps;
+        CLProfiler* m_profiler;
         std::array<CLWBuffer<float3>, 
             static_cast<size_t>(IntermediateValue::kMax)> m_intermediate_value;
     };
@@ -22,7 +22,7 @@ namespace Baikal
         int volume;
         int flags;
         int extra0;
-        int extra1;
+        float cone_width;
     };
 
     struct PathTracingEstimator::RenderData
@@ -181,11 +181,16 @@ namespace Baikal
         MissedPrimaryRaysHandler missedPrimaryRaysHandler
     )
     {
+        std::string build_options = scene.GetTextureBuildOptions() + scene.GetFeatureBuildOptions();
+
         if (atomic_update)
         {
-            SetDefaultBuildOptions(" -D BAIKAL_ATOMIC_RESOLVE ");
+            build_options.append(" -D BAIKAL_ATOMIC_RESOLVE ");
         }
 
+        SetDefaultBuildOptions(build_options);
+        m_uberv2_kernels.SetDefaultBuildOptions(scene.GetTextureBuildOptions() + scene.GetFeatureBuildOptions());
+
         auto has_visibility_buffer = HasIntermediateValueBuffer(IntermediateValue::kVisibility);
         auto visibility_buffer = GetIntermediateValueBuffer(IntermediateValue::kVisibility);
 
@@ -210,13 +215,16 @@ namespace Baikal
             );
 
             // Intersect ray batch
-            GetIntersector()->QueryIntersection(
-                m_render_data->fr_rays[pass & 0x1],
-                m_render_data->fr_hitcount, (std::uint32_t)num_estimates,
-                m_render_data->fr_intersections,
-                nullptr,
-                nullptr
-            );
+            {
+                CLProfiler::Scope profile(GetProfiler(), "QueryIntersection", pass);
+                GetIntersector()->QueryIntersection(
+                    m_render_data->fr_rays[pass & 0x1],
+                    m_render_data->fr_hitcount, (std::uint32_t)num_estimates,
+                    m_render_data->fr_intersections,
+                    nullptr,
+                    nullptr
+                );
+            }
 
 
             // Apply scattering only if we have volumes
@@ -244,14 +252,17 @@ namespace Baikal
             }
 
             // Compact batch
-            m_render_data->pp.Compact(
-                0,
-                m_render_data->hits,
-                m_render_data->iota,
-                m_render_data->compacted_indices,
-                (std::uint32_t)num_estimates,
-                m_render_data->hitcount
-            );
+            {
+                CLProfiler::Scope profile(GetProfiler(), "Compact", pass);
+                m_render_data->pp.Compact(
+                    0,
+                    m_render_data->hits,
+                    m_render_data->iota,
+                    m_render_data->compacted_indices,
+                    (std::uint32_t)num_estimates,
+                    m_render_data->hitcount
+                );
+            }
 
             // Advance indices to keep pixel indices up to date
             RestorePixelIndices(pass, num_estimates);
@@ -287,26 +298,32 @@ namespace Baikal
                 for (auto i = 0u; i < GetMaxShadowRayTransmissionSteps(); ++i)
                 {
                     // Intersect ray batch
-                    GetIntersector()->QueryIntersection(m_render_data->fr_shadowrays,
-                                                        m_render_data->fr_hitcount,
-                                                        (std::uint32_t)num_estimates,
-                                                        m_render_data->fr_intersections,
-                                                        nullptr,
-                                                        nullptr);
+                    {
+                        CLProfiler::Scope profile(GetProfiler(), "QueryIntersectionTransmission", pass);
+                        GetIntersector()->QueryIntersection(m_render_data->fr_shadowrays,
+                                                            m_render_data->fr_hitcount,
+                                                            (std::uint32_t)num_estimates,
+                                                            m_render_data->fr_intersections,
+                                                            nullptr,
+                                                            nullptr);
+                    }
 
                     ApplyVolumeTransmission(scene, pass, num_estimates, output, use_output_indices);
                 }
             }
 
             // Intersect shadow rays
-            GetIntersector()->QueryOcclusion(
-                m_render_data->fr_shadowrays,
-                m_render_data->fr_hitcount,
-                (std::uint32_t)num_estimates,
-                m_render_data->fr_shadowhits,
-                nullptr,
-                nullptr
-            );
+            {
+                CLProfiler::Scope profile(GetProfiler(), "QueryOcclusion", pass);
+                GetIntersector()->QueryOcclusion(
+                    m_render_data->fr_shadowrays,
+                    m_render_data->fr_hitcount,
+                    (std::uint32_t)num_estimates,
+                    m_render_data->fr_shadowhits,
+                    nullptr,
+                    nullptr
+                );
+            }
 
             // Gather light samples and account for visibility
             GatherLightSamples(scene, pass, num_estimates, output, use_output_indices);
@@ -342,7 +359,7 @@ namespace Baikal
         init_kernel.SetArg(argc++, m_render_data->paths);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, init_kernel);
+            RecordKernel("InitPathData", CLProfiler::kNoBounce, Launch1D(init_kernel, size));
         }
     }
 
@@ -370,11 +387,11 @@ namespace Baikal
         shadekernel.SetArg(argc++, scene.vertices);
         shadekernel.SetArg(argc++, scene.normals);
         shadekernel.SetArg(argc++, scene.uvs);
+        shadekernel.SetArg(argc++, scene.tangents);
         shadekernel.SetArg(argc++, scene.indices);
         shadekernel.SetArg(argc++, scene.shapes);
         shadekernel.SetArg(argc++, scene.material_attributes);
-        shadekernel.SetArg(argc++, scene.textures);
-        shadekernel.SetArg(argc++, scene.texturedata);
+        scene.SetTextureArgs(shadekernel, argc);
         shadekernel.SetArg(argc++, scene.envmapidx);
         shadekernel.SetArg(argc++, scene.lights);
         shadekernel.SetArg(argc++, scene.light_distributions);
@@ -394,7 +411,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel);
+            RecordKernel("ShadeSurfaceUberV2", pass, Launch1D(shadekernel, size));
         }
     }
 
@@ -422,11 +439,11 @@ namespace Baikal
         shadekernel.SetArg(argc++, scene.vertices);
         shadekernel.SetArg(argc++, scene.normals);
         shadekernel.SetArg(argc++, scene.uvs);
+        shadekernel.SetArg(argc++, scene.tangents);
         shadekernel.SetArg(argc++, scene.indices);
         shadekernel.SetArg(argc++, scene.shapes);
         shadekernel.SetArg(argc++, scene.material_attributes);
-        shadekernel.SetArg(argc++, scene.textures);
-        shadekernel.SetArg(argc++, scene.texturedata);
+        scene.SetTextureArgs(shadekernel, argc);
         shadekernel.SetArg(argc++, scene.envmapidx);
         shadekernel.SetArg(argc++, scene.lights);
         shadekernel.SetArg(argc++, scene.light_distributions);
@@ -446,7 +463,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel);
+            RecordKernel("ShadeVolumeUberV2", pass, Launch1D(shadekernel, size));
         }
     }
 
@@ -470,8 +487,7 @@ namespace Baikal
         sample_kernel.SetArg(argc++, output_indices);
         sample_kernel.SetArg(argc++, m_render_data->hitcount);
         sample_kernel.SetArg(argc++, scene.volumes);
-        sample_kernel.SetArg(argc++, scene.textures);
-        sample_kernel.SetArg(argc++, scene.texturedata);
+        scene.SetTextureArgs(sample_kernel, argc);
         sample_kernel.SetArg(argc++, rand_uint());
         sample_kernel.SetArg(argc++, m_render_data->random);
         sample_kernel.SetArg(argc++, m_render_data->sobolmat);
@@ -483,7 +499,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, sample_kernel);
+            RecordKernel("SampleVolume", pass, Launch1D(sample_kernel, size));
         }
     }
 
@@ -509,14 +525,13 @@ namespace Baikal
         misskernel.SetArg(argc++, (cl_int)size);
         misskernel.SetArg(argc++, scene.lights);
         misskernel.SetArg(argc++, scene.envmapidx);
-        misskernel.SetArg(argc++, scene.textures);
-        misskernel.SetArg(argc++, scene.texturedata);
+        scene.SetTextureArgs(misskernel, argc);
         misskernel.SetArg(argc++, m_render_data->paths);
         misskernel.SetArg(argc++, scene.volumes);
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            RecordKernel("ShadeBackgroundEnvMap", pass, Launch1D(misskernel, size));
         }
     }
 
@@ -545,7 +560,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            RecordKernel("GatherLightSamples", pass, Launch1D(gatherkernel, size));
         }
     }
 
@@ -573,6 +588,7 @@ namespace Baikal
         volumekernel.SetArg(argc++, scene.vertices);
         volumekernel.SetArg(argc++, scene.normals);
         volumekernel.SetArg(argc++, scene.uvs);
+        volumekernel.SetArg(argc++, scene.tangents);
         volumekernel.SetArg(argc++, scene.indices);
         volumekernel.SetArg(argc++, scene.shapes);
         volumekernel.SetArg(argc++, scene.material_attributes);
@@ -584,7 +600,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, volumekernel);
+            RecordKernel("ApplyVolumeTransmissionUberV2", pass, Launch1D(volumekernel, size));
         }
     }
 
@@ -611,7 +627,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            RecordKernel("GatherVisibility", pass, Launch1D(gatherkernel, size));
         }
     }
 
@@ -638,7 +654,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            RecordKernel("GatherOpacity", pass, Launch1D(gatherkernel, size));
         }
     }
 
@@ -656,7 +672,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel);
+            RecordKernel("RestorePixelIndices", pass, Launch1D(restorekernel, size));
         }
     }
 
@@ -672,7 +688,7 @@ namespace Baikal
         restorekernel.SetArg(argc++, m_render_data->hits);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel);
+            RecordKernel("FilterPathStream", pass, Launch1D(restorekernel, size));
         }
     }
 
@@ -698,14 +714,13 @@ namespace Baikal
         misskernel.SetArg(argc++, scene.light_distributions);
         misskernel.SetArg(argc++, scene.num_lights);
         misskernel.SetArg(argc++, scene.envmapidx);
-        misskernel.SetArg(argc++, scene.textures);
-        misskernel.SetArg(argc++, scene.texturedata);
+        scene.SetTextureArgs(misskernel, argc);
         misskernel.SetArg(argc++, m_render_data->paths);
         misskernel.SetArg(argc++, scene.volumes);
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            RecordKernel("ShadeMiss", pass, Launch1D(misskernel, size));
         }
     }
 
@@ -758,6 +773,8 @@ namespace Baikal
         std::size_t num_estimates
     )
     {
+        CLProfiler::Scope profile(GetProfiler(), "QueryIntersection");
+
         // Intersect ray batch
         GetIntersector()->QueryIntersection(
             m_render_data->fr_rays[0],
@@ -912,7 +929,7 @@ namespace Baikal
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            RecordKernel("AdvanceIterationCount", pass, Launch1D(misskernel, size));
         }
     }
 }
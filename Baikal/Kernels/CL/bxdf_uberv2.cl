@@ -66,14 +66,42 @@ void UberV2_ApplyShadingNormal(
     UberV2ShaderData const* shader_data
 )
 {
+#ifndef BAIKAL_NO_SHADING_NORMALS
     const int layers = dg->mat.layers;
 
     if ((layers & kShadingNormalLayer) == kShadingNormalLayer)
     {
-        dg->n = normalize(shader_data->shading_normal.z * dg->n + shader_data->shading_normal.x * dg->dpdu + shader_data->shading_normal.y * dg->dpdv);
+        // Tangent space normals are unit length facing outwards, reconstructing Z
+        // lets two channel normal maps (RG8, BC5) be used
+        float2 xy = shader_data->shading_normal.xy;
+        float z = native_sqrt(max(0.f, 1.f - dot(xy, xy)));
+
+        dg->n = normalize(z * dg->n + xy.x * dg->dpdu + xy.y * dg->dpdv);
         dg->dpdv = normalize(cross(dg->n, dg->dpdu));
         dg->dpdu = normalize(cross(dg->dpdv, dg->n));
     }
+#endif
+}
+
+// Roughness of the layer sampled by GetMaterialBxDFType, diffuse is treated as fully rough
+float UberV2_GetSampledRoughness(
+    // Geometry
+    DifferentialGeometry const* dg,
+    // Prepared UberV2 shader inputs
+    UberV2ShaderData const* shader_data
+)
+{
+    switch (Bxdf_UberV2_GetSampledComponent(dg))
+    {
+    case kBxdfUberV2SampleReflection:
+        return shader_data->reflection_roughness;
+    case kBxdfUberV2SampleRefraction:
+        return shader_data->refraction_roughness;
+    case kBxdfUberV2SampleDiffuse:
+        return 1.f;
+    default:
+        return 0.f;
+    }
 }
 
 #endif
@@ -58,6 +58,8 @@ KERNEL void FillAOVsUberV2(
     GLOBAL float3 const* restrict normals,
     // UVs
     GLOBAL float2 const* restrict uvs,
+    // Packed tangent frames
+    GLOBAL uint const* restrict tangents,
     // Indices
     GLOBAL int const* restrict indices,
     // Shapes
@@ -159,6 +161,7 @@ KERNEL void FillAOVsUberV2(
         vertices,
         normals,
         uvs,
+        tangents,
         indices,
         shapes,
         material_attributes,
@@ -220,6 +223,7 @@ KERNEL void FillAOVsUberV2(
             // Fill surface data
             DifferentialGeometry diffgeo;
             Scene_FillDifferentialGeometry(&scene, &isect, &diffgeo);
+            DifferentialGeometry_SetHitPosition(&diffgeo, &scene, &isect, rays[global_id].o.xyz, rays[global_id].d.xyz);
 
             if (world_position_enabled)
             {
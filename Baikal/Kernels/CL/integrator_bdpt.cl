@@ -54,6 +54,8 @@ KERNEL void GenerateLightVertices(
     GLOBAL float3 const* restrict normals,
     // UVs
     GLOBAL float2 const* restrict uvs,
+    // Packed tangent frames
+    GLOBAL uint const* restrict tangents,
     // Indices
     GLOBAL int const* restrict indices,
     // Shapes
@@ -91,6 +93,7 @@ KERNEL void GenerateLightVertices(
         vertices,
         normals,
         uvs,
+        tangents,
         indices,
         shapes,
         material_ids,
@@ -174,6 +177,7 @@ KERNEL void GenerateLightVertices(
         my_path->volume = -1;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
     }
 }
 
@@ -194,6 +198,8 @@ KERNEL void SampleSurface(
     GLOBAL float3 const* normals,
     // UVs
     GLOBAL float2 const* uvs,
+    // Packed tangent frames
+    GLOBAL uint const* tangents,
     // Indices
     GLOBAL int const* indices,
     // Shapes
@@ -238,6 +244,7 @@ KERNEL void SampleSurface(
             vertices,
             normals,
             uvs,
+            tangents,
             indices,
             shapes,
             material_ids,
@@ -276,6 +283,7 @@ KERNEL void SampleSurface(
             // Fill surface data
             DifferentialGeometry diffgeo;
             Scene_FillDifferentialGeometry(&scene, &isect, &diffgeo);
+            DifferentialGeometry_SetHitPosition(&diffgeo, &scene, &isect, rays[hit_idx].o.xyz, rays[hit_idx].d.xyz);
             diffgeo.transfer_mode = transfer_mode; 
 
             // Check if we are hitting from the inside
@@ -413,6 +421,7 @@ KERNEL void SampleSurface(
         GLOBAL float3 const* restrict vertices,
         GLOBAL float3 const* restrict normals,
         GLOBAL float2 const* restrict uvs,
+        GLOBAL uint const* restrict tangents,
         GLOBAL int const* restrict indices,
         GLOBAL Shape const* restrict shapes,
         GLOBAL int const* restrict materialids,
@@ -465,6 +474,7 @@ KERNEL void SampleSurface(
                 vertices,
                 normals,
                 uvs,
+                tangents,
                 indices,
                 shapes,
                 materialids,
@@ -598,6 +598,9 @@ float SpotLight_GetPdf(// Emissive object
  Dispatch calls
  */
 
+// Light dispatch below skips types the scene does not contain when built
+// with BAIKAL_NO_ENVIRONMENT_LIGHT, BAIKAL_NO_AREA_LIGHTS or BAIKAL_NO_ANALYTIC_LIGHTS
+
 /// Get intensity for a given direction
 float3 Light_GetLe(// Light index
                    int idx,
@@ -619,16 +622,22 @@ float3 Light_GetLe(// Light index
 
     switch(light.type)
     {
+#ifndef BAIKAL_NO_ENVIRONMENT_LIGHT
         case kIbl:
             return EnvironmentLight_GetLe(&light, scene, dg, bxdf_flags, interaction_type, wo, TEXTURE_ARGS);
+#endif
+#ifndef BAIKAL_NO_AREA_LIGHTS
         case kArea:
             return AreaLight_GetLe(&light, scene, dg, wo, TEXTURE_ARGS);
+#endif
+#ifndef BAIKAL_NO_ANALYTIC_LIGHTS
         case kDirectional:
             return DirectionalLight_GetLe(&light, scene, dg, wo, TEXTURE_ARGS);
         case kPoint:
             return PointLight_GetLe(&light, scene, dg, wo, TEXTURE_ARGS);
         case kSpot:
             return SpotLight_GetLe(&light, scene, dg, wo, TEXTURE_ARGS);
+#endif
     }
 
     return make_float3(0.f, 0.f, 0.f);
@@ -658,16 +667,22 @@ float3 Light_Sample(// Light index
 
     switch(light.type)
     {
+#ifndef BAIKAL_NO_ENVIRONMENT_LIGHT
         case kIbl:
             return EnvironmentLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, bxdf_flags, interaction_type, wo, pdf);
+#endif
+#ifndef BAIKAL_NO_AREA_LIGHTS
         case kArea:
             return AreaLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
+#endif
+#ifndef BAIKAL_NO_ANALYTIC_LIGHTS
         case kDirectional:
             return DirectionalLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
         case kPoint:
             return PointLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
         case kSpot:
             return SpotLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
+#endif
     }
 
     *pdf = 0.f;
@@ -695,16 +710,22 @@ float Light_GetPdf(// Light index
 
     switch(light.type)
     {
+#ifndef BAIKAL_NO_ENVIRONMENT_LIGHT
         case kIbl:
             return EnvironmentLight_GetPdf(&light, scene, dg, bxdf_flags, interaction_type, wo, TEXTURE_ARGS);
+#endif
+#ifndef BAIKAL_NO_AREA_LIGHTS
         case kArea:
             return AreaLight_GetPdf(&light, scene, dg, wo, TEXTURE_ARGS);
+#endif
+#ifndef BAIKAL_NO_ANALYTIC_LIGHTS
         case kDirectional:
             return DirectionalLight_GetPdf(&light, scene, dg, wo, TEXTURE_ARGS);
         case kPoint:
             return PointLight_GetPdf(&light, scene, dg, wo, TEXTURE_ARGS);
         case kSpot:
             return SpotLight_GetPdf(&light, scene, dg, wo, TEXTURE_ARGS);
+#endif
     }
 
     return 0.f;
@@ -734,10 +755,14 @@ float3 Light_SampleVertex(
 
     switch (light.type)
     {
+#ifndef BAIKAL_NO_AREA_LIGHTS
         case kArea:
             return AreaLight_SampleVertex(&light, scene, TEXTURE_ARGS, sample0, sample1, p, n, wo, pdf);
+#endif
+#ifndef BAIKAL_NO_ANALYTIC_LIGHTS
         case kPoint:
             return PointLight_SampleVertex(&light, scene, TEXTURE_ARGS, sample0, sample1, p, n, wo, pdf);
+#endif
     }
 
     *pdf = 0.f;
@@ -747,9 +772,13 @@ float3 Light_SampleVertex(
 /// Check if the light is singular
 bool Light_IsSingular(__global Light const* light)
 {
+#ifdef BAIKAL_NO_ANALYTIC_LIGHTS
+    return false;
+#else
     return light->type == kPoint ||
         light->type == kSpot ||
         light->type == kDirectional;
+#endif
 }
 
 #endif // LIGHT_CLnv
@@ -118,7 +118,8 @@ void PerspectiveCamera_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Extra y carries ray cone spread angle of a pixel
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (camera->focal_length * output_height)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -214,7 +215,7 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (camera->focal_length * output_height)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -331,6 +332,7 @@ void PerspectiveCamera_GenerateVertices(
         my_path->volume = -1;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
     }
 }
 
@@ -452,6 +454,7 @@ void PerspectiveCameraDof_GenerateVertices(
         my_path->volume = -1;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
     }
 }
 
@@ -854,7 +857,8 @@ void  OrthographicCamera_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Parallel rays, cone does not spread
+        Ray_SetExtra(my_ray, make_float2(1.f, 0.f));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
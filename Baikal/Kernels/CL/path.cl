@@ -32,7 +32,8 @@ typedef struct _Path
     int volume;
     int flags;
     int active;
-    int extra1;
+    // Ray cone width at the last hit
+    float cone_width;
 } Path;
 
 typedef enum _PathFlags
@@ -124,6 +125,28 @@ INLINE void Path_AddContribution(__global Path* path, __global float3* output, i
     output[idx] += Path_GetThroughput(path) * val;
 }
 
+INLINE float Path_GetConeWidth(__global Path const* path)
+{
+    return path->cone_width;
+}
+
+// Grow ray cone width by the distance travelled with given spread angle
+INLINE float Path_PropagateCone(__global Path* path, float spread, float distance)
+{
+    path->cone_width += spread * distance;
+    return path->cone_width;
+}
+
+// Spread angle added per bounce by a fully rough BxDF
+#define CONE_SPREAD_PER_ROUGHNESS 0.25f
+
+// Spread angle of the cone after scattering, non-singular BxDFs widen it
+// by a bounded angle proportional to roughness of the sampled lobe
+INLINE float Path_GetScatteredConeSpread(float spread, float roughness, bool singular)
+{
+    return singular ? spread : spread + clamp(roughness, 0.f, 1.f) * CONE_SPREAD_PER_ROUGHNESS;
+}
+
 INLINE bool Path_IsSpecular(__global Path const* path)
 {
     int flags = Path_GetBxdfFlags(path);
@@ -57,6 +57,7 @@ void InitPathData(
         my_path->volume = world_volume_idx;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
     }
 }
 
@@ -57,6 +57,8 @@ KERNEL void ShadeVolumeUberV2(
     GLOBAL float3 const* restrict normals,
     // UVs
     GLOBAL float2 const* restrict uvs,
+    // Packed tangent frames
+    GLOBAL uint const* restrict tangents,
     // Indices
     GLOBAL int const* restrict indices,
     // Shapes
@@ -105,6 +107,7 @@ KERNEL void ShadeVolumeUberV2(
         vertices,
         normals,
         uvs,
+        tangents,
         indices,
         shapes,
         material_attributes,
@@ -244,6 +247,8 @@ KERNEL void ShadeSurfaceUberV2(
     GLOBAL float3 const* restrict normals,
     // UVs
     GLOBAL float2 const* restrict uvs,
+    // Packed tangent frames
+    GLOBAL uint const* restrict tangents,
     // Indices
     GLOBAL int const* restrict indices,
     // Shapes
@@ -292,6 +297,7 @@ KERNEL void ShadeSurfaceUberV2(
         vertices,
         normals,
         uvs,
+        tangents,
         indices,
         shapes,
         material_attributes,
@@ -337,11 +343,17 @@ KERNEL void ShadeSurfaceUberV2(
         // Fill surface data
         DifferentialGeometry diffgeo;
         Scene_FillDifferentialGeometry(&scene, &isect, &diffgeo);
+        DifferentialGeometry_SetHitPosition(&diffgeo, &scene, &isect, rays[hit_idx].o.xyz, rays[hit_idx].d.xyz);
 
         // Check if we are hitting from the inside
         float ngdotwi = dot(diffgeo.ng, wi);
         bool backfacing = ngdotwi < 0.f;
 
+        // Propagate ray cone to the hit point to select texture LOD
+        float cone_spread = Ray_GetExtra(&rays[hit_idx]).y;
+        float cone_width = Path_PropagateCone(path, cone_spread, isect.uvwt.w);
+        DifferentialGeometry_SetConeFootprint(&diffgeo, cone_width, fabs(ngdotwi));
+
         // Select BxDF
         UberV2ShaderData uber_shader_data;
         UberV2PrepareInputs(&diffgeo, input_map_values, material_attributes, TEXTURE_ARGS, &uber_shader_data);
@@ -496,8 +508,10 @@ KERNEL void ShadeSurfaceUberV2(
             int indirect_ray_mask = VISIBILITY_MASK_BOUNCE(bounce + 1);
 
             Ray_Init(indirect_rays + global_id, indirect_ray_o, indirect_ray_dir, CRAZY_HIGH_DISTANCE, 0.f, indirect_ray_mask);
-            Ray_SetExtra(indirect_rays + global_id, make_float2(Bxdf_IsSingular(&diffgeo) ? 0.f : bxdf_pdf, 0.f));
+            bool singular = Bxdf_IsSingular(&diffgeo);
+            Ray_SetExtra(indirect_rays + global_id, make_float2(singular ? 0.f : bxdf_pdf, Path_GetScatteredConeSpread(cone_spread, UberV2_GetSampledRoughness(&diffgeo, &uber_shader_data), singular)));
 
+#ifndef BAIKAL_NO_VOLUMES
             if (Bxdf_IsBtdf(&diffgeo))
             {
                 if (backfacing)
@@ -509,6 +523,7 @@ KERNEL void ShadeSurfaceUberV2(
                     Path_SetVolumeIdx(path, Scene_GetVolumeIndex(&scene, isect.shapeid - 1));
                 }
             }
+#endif
         }
         else
         {
@@ -539,6 +554,8 @@ KERNEL void ApplyVolumeTransmissionUberV2(
     GLOBAL float3 const* restrict normals,
     // UVs
     GLOBAL float2 const* restrict uvs,
+    // Packed tangent frames
+    GLOBAL uint const* restrict tangents,
     // Indices
     GLOBAL int const* restrict indices,
     // Shapes
@@ -571,6 +588,7 @@ KERNEL void ApplyVolumeTransmissionUberV2(
                 vertices,
                 normals,
                 uvs,
+                tangents,
                 indices,
                 shapes,
                 material_attributes,
@@ -77,6 +77,22 @@ typedef struct
     int padding;
 } Material;
 
+// Vertex attribute and index layouts used by a shape
+enum GeometryCompression
+{
+    kCompressedNone = 0x0,
+    // 3x16-bit positions quantized to shape bounds
+    kCompressedPositions = 0x1,
+    // 2x16-bit octahedral normals
+    kCompressedNormals = 0x2,
+    // Half precision UVs
+    kCompressedUVs = 0x4,
+    // Index buffer is a 16-bit word stream
+    kCompressedIndices = 0x8,
+    // Shape indices are 16-bit (valid with kCompressedIndices only)
+    kShortIndices = 0x10
+};
+
 // Shape description
 typedef struct
 {
@@ -95,6 +111,14 @@ typedef struct
     // Transform in row major format
     matrix4x4 transform;
     Material material;
+    // Dequantization of compressed positions: p = position_offset + position_scale * q
+    float3 position_offset;
+    float3 position_scale;
+    // Combination of GeometryCompression flags
+    int compression;
+    // Start of tangent frames, -1 if the shape has none
+    int starttangent;
+    int padding[2];
 } Shape;
 
 typedef struct
@@ -125,6 +149,13 @@ typedef struct _InputMapData
             int placeholder[2];
             int type; //We can use it since float3 is actually float4
         } int_values;
+        // Per input map entry, selects generated function and its leaf indices
+        struct
+        {
+            int params;
+            int signature;
+            int padding[2];
+        } header;
     };
 } InputMapData;
 
@@ -215,7 +246,39 @@ enum TextureFormat
     UNKNOWN,
     RGBA8,
     RGBA16,
-    RGBA32
+    RGBA32,
+    R8,
+    RG8,
+    R16F,
+    R32F,
+    BC1,
+    BC4,
+    BC5,
+    BC6H,
+    BC7
+};
+
+/// Texel order of texture levels in the pool
+enum TextureLayout
+{
+    // Row major
+    kLayoutLinear,
+    // Row major 4x4 texel tiles
+    kLayoutTiled,
+    // Morton order inside row major 8x8 texel tiles
+    kLayoutMorton
+};
+
+/// Image array holding the finest level of a texture (BAIKAL_TEXTURE_IMAGES)
+enum TextureImage
+{
+    // RGBA 8-bit normalized, also keeps LDR single channel and decoded BC textures
+    kTextureImageUnorm,
+    // RGBA half float
+    kTextureImageHalf,
+    // RGBA float
+    kTextureImageFloat,
+    kTextureImageCount
 };
 
 /// Texture description
@@ -230,7 +293,13 @@ struct _Texture
     int dataoffset;
     // Format
     int fmt;
-    int extra;
+    // Number of mip levels
+    int levels;
+    // Texel layout
+    int layout;
+    // Image array and layer of the finest level
+    int image;
+    int layer;
 } Texture;
 
 // Hit data
@@ -255,7 +324,10 @@ typedef struct _DifferentialGeometry
     Material mat;
     float  area;
     int transfer_mode;
-    int padding[2];
+    // Half of log2 of UV to world space area ratio of the triangle
+    float uv_lod_bias;
+    // Texture LOD (log2 of sample footprint size in UV space)
+    float lod;
 } DifferentialGeometry;
 
 
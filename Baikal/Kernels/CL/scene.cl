@@ -34,6 +34,8 @@ typedef struct
     GLOBAL float3 const* restrict normals;
     // UVs
     GLOBAL float2 const* restrict uvs;
+    // Packed tangent frames
+    GLOBAL uint const* restrict tangents;
     // Indices
     GLOBAL int const* restrict indices;
     // Shapes
@@ -52,6 +54,85 @@ typedef struct
     GLOBAL int const* restrict light_distribution;
 } Scene;
 
+// Texture LOD selecting the finest mip level
+#define TEXTURE_LOD_FINEST (-128.f)
+
+// Decode octahedral normal packed into two 16-bit snorm values
+INLINE float3 DecodeOctahedralNormal(uint packed)
+{
+    float2 e = (float2)((short)(packed & 0xffff), (short)(packed >> 16)) / 32767.f;
+    float3 n = (float3)(e.x, e.y, 1.f - fabs(e.x) - fabs(e.y));
+    float t = max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return normalize(n);
+}
+
+// Decode tangent frame packed as octahedral direction, lowest bit of the second
+// component keeps bitangent sign (MikkTSpace convention, bitangent = sign * cross(n, t))
+INLINE float3 DecodeTangent(uint packed, float* sign)
+{
+    *sign = (packed & 0x10000) ? -1.f : 1.f;
+    return DecodeOctahedralNormal(packed);
+}
+
+// Fetch i-th index of the shape, index buffer layout depends on shape compression flags
+INLINE int Scene_FetchIndex(Scene const* scene, Shape const* shape, int i)
+{
+    if (shape->compression & kCompressedIndices)
+    {
+        // Index buffer is a stream of 16-bit words, startidx is in words
+        GLOBAL ushort const* indices = (GLOBAL ushort const*)scene->indices + shape->startidx;
+        return (shape->compression & kShortIndices) ? indices[i] : ((GLOBAL int const*)indices)[i];
+    }
+
+    return scene->indices[shape->startidx + i];
+}
+
+// Fetch object space position of the shape vertex
+INLINE float3 Scene_FetchPosition(Scene const* scene, Shape const* shape, int i)
+{
+    if (shape->compression & kCompressedPositions)
+    {
+        // Positions are quantized to 16 bits relative to shape bounds
+        GLOBAL ushort const* positions = (GLOBAL ushort const*)scene->vertices;
+        float3 q = convert_float3(vload3(shape->startvtx + i, positions));
+        return shape->position_offset + q * shape->position_scale;
+    }
+
+    return scene->vertices[shape->startvtx + i];
+}
+
+// Fetch object space normal of the shape vertex
+INLINE float3 Scene_FetchNormal(Scene const* scene, Shape const* shape, int i)
+{
+    if (shape->compression & kCompressedNormals)
+    {
+        GLOBAL uint const* normals = (GLOBAL uint const*)scene->normals;
+        return DecodeOctahedralNormal(normals[shape->startvtx + i]);
+    }
+
+    return scene->normals[shape->startvtx + i];
+}
+
+// Fetch texture coordinates of the shape vertex
+INLINE float2 Scene_FetchUV(Scene const* scene, Shape const* shape, int i)
+{
+    if (shape->compression & kCompressedUVs)
+    {
+        GLOBAL half const* uvs = (GLOBAL half const*)scene->uvs;
+        return vload_half2(shape->startvtx + i, uvs);
+    }
+
+    return scene->uvs[shape->startvtx + i];
+}
+
+// Fetch object space tangent of the shape vertex
+INLINE float3 Scene_FetchTangent(Scene const* scene, Shape const* shape, int i, float* sign)
+{
+    return DecodeTangent(scene->tangents[shape->starttangent + i], sign);
+}
+
 // Get triangle vertices given scene, shape index and prim index
 INLINE void Scene_GetTriangleVertices(Scene const* scene, int shape_idx, int prim_idx, float3* v0, float3* v1, float3* v2)
 {
@@ -59,14 +140,14 @@ INLINE void Scene_GetTriangleVertices(Scene const* scene, int shape_idx, int pri
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int i0 = Scene_FetchIndex(scene, &shape, 3 * prim_idx);
+    int i1 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 1);
+    int i2 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 2);
 
     // Fetch positions and transform to world space
-    *v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    *v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    *v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    *v0 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i0));
+    *v1 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i1));
+    *v2 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i2));
 }
 
 // Get triangle uvs given scene, shape index and prim index
@@ -76,14 +157,14 @@ INLINE void Scene_GetTriangleUVs(Scene const* scene, int shape_idx, int prim_idx
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int i0 = Scene_FetchIndex(scene, &shape, 3 * prim_idx);
+    int i1 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 1);
+    int i2 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 2);
 
     // Fetch positions and transform to world space
-    *uv0 = scene->uvs[shape.startvtx + i0];
-    *uv1 = scene->uvs[shape.startvtx + i1];
-    *uv2 = scene->uvs[shape.startvtx + i2];
+    *uv0 = Scene_FetchUV(scene, &shape, i0);
+    *uv1 = Scene_FetchUV(scene, &shape, i1);
+    *uv2 = Scene_FetchUV(scene, &shape, i2);
 }
 
 
@@ -94,24 +175,24 @@ INLINE void Scene_InterpolateAttributes(Scene const* scene, int shape_idx, int p
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int i0 = Scene_FetchIndex(scene, &shape, 3 * prim_idx);
+    int i1 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 1);
+    int i2 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 2);
 
     // Fetch normals
-    float3 n0 = scene->normals[shape.startvtx + i0];
-    float3 n1 = scene->normals[shape.startvtx + i1];
-    float3 n2 = scene->normals[shape.startvtx + i2];
+    float3 n0 = Scene_FetchNormal(scene, &shape, i0);
+    float3 n1 = Scene_FetchNormal(scene, &shape, i1);
+    float3 n2 = Scene_FetchNormal(scene, &shape, i2);
 
     // Fetch positions and transform to world space
-    float3 v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    float3 v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    float3 v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    float3 v0 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i0));
+    float3 v1 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i1));
+    float3 v2 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i2));
 
     // Fetch UVs
-    float2 uv0 = scene->uvs[shape.startvtx + i0];
-    float2 uv1 = scene->uvs[shape.startvtx + i1];
-    float2 uv2 = scene->uvs[shape.startvtx + i2];
+    float2 uv0 = Scene_FetchUV(scene, &shape, i0);
+    float2 uv1 = Scene_FetchUV(scene, &shape, i1);
+    float2 uv2 = Scene_FetchUV(scene, &shape, i2);
 
     // Calculate barycentric position and normal
     *p = (1.f - barycentrics.x - barycentrics.y) * v0 + barycentrics.x * v1 + barycentrics.y * v2;
@@ -120,6 +201,25 @@ INLINE void Scene_InterpolateAttributes(Scene const* scene, int shape_idx, int p
     *area = 0.5f * length(cross(v2 - v0, v1 - v0));
 }
 
+// Interpolate tangent, bitangent sign is taken from the first vertex of the triangle
+INLINE float3 Scene_InterpolateTangent(Scene const* scene, int shape_idx, int prim_idx, float2 barycentrics, float* sign)
+{
+    // Extract shape data
+    Shape shape = scene->shapes[shape_idx];
+
+    // Fetch indices starting from startidx and offset by prim_idx
+    int i0 = Scene_FetchIndex(scene, &shape, 3 * prim_idx);
+    int i1 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 1);
+    int i2 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 2);
+
+    float sign1, sign2;
+    float3 t0 = Scene_FetchTangent(scene, &shape, i0, sign);
+    float3 t1 = Scene_FetchTangent(scene, &shape, i1, &sign1);
+    float3 t2 = Scene_FetchTangent(scene, &shape, i2, &sign2);
+
+    return matrix_mul_vector3(shape.transform, (1.f - barycentrics.x - barycentrics.y) * t0 + barycentrics.x * t1 + barycentrics.y * t2);
+}
+
 // Interpolate position, normal and uv
 INLINE void Scene_InterpolateVertices(Scene const* scene, int shape_idx, int prim_idx, float2 barycentrics, float3* p)
 {
@@ -127,14 +227,14 @@ INLINE void Scene_InterpolateVertices(Scene const* scene, int shape_idx, int pri
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int i0 = Scene_FetchIndex(scene, &shape, 3 * prim_idx);
+    int i1 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 1);
+    int i2 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 2);
 
     // Fetch positions and transform to world space
-    float3 v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    float3 v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    float3 v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    float3 v0 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i0));
+    float3 v1 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i1));
+    float3 v2 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i2));
 
     // Calculate barycentric position and normal
     *p = (1.f - barycentrics.x - barycentrics.y) * v0 + barycentrics.x * v1 + barycentrics.y * v2;
@@ -151,14 +251,14 @@ INLINE void Scene_InterpolateVerticesFromIntersection(Scene const* scene, Inters
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int i0 = Scene_FetchIndex(scene, &shape, 3 * prim_idx);
+    int i1 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 1);
+    int i2 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 2);
 
     // Fetch positions and transform to world space
-    float3 v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    float3 v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    float3 v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    float3 v0 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i0));
+    float3 v1 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i1));
+    float3 v2 = matrix_mul_point3(shape.transform, Scene_FetchPosition(scene, &shape, i2));
 
     // Calculate barycentric position and normal
     *p = (1.f - barycentrics.x - barycentrics.y) * v0 + barycentrics.x * v1 + barycentrics.y * v2;
@@ -175,14 +275,14 @@ INLINE void Scene_InterpolateNormalsFromIntersection(Scene const* scene, Interse
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int i0 = Scene_FetchIndex(scene, &shape, 3 * prim_idx);
+    int i1 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 1);
+    int i2 = Scene_FetchIndex(scene, &shape, 3 * prim_idx + 2);
 
     // Fetch normals
-    float3 n0 = scene->normals[shape.startvtx + i0];
-    float3 n1 = scene->normals[shape.startvtx + i1];
-    float3 n2 = scene->normals[shape.startvtx + i2];
+    float3 n0 = Scene_FetchNormal(scene, &shape, i0);
+    float3 n1 = Scene_FetchNormal(scene, &shape, i1);
+    float3 n2 = Scene_FetchNormal(scene, &shape, i2);
 
     // Calculate barycentric position and normal
     *n = normalize(matrix_mul_vector3(shape.transform, (1.f - barycentrics.x - barycentrics.y) * n0 + barycentrics.x * n1 + barycentrics.y * n2));
@@ -257,25 +357,47 @@ void Scene_FillDifferentialGeometry(// Scene
     float3 dp2 = v1 - v2;
     float det = du1 * dv2 - dv1 * du2;
 
-    if (0 && det != 0.f)
+    // Texture footprint is unknown until a ray cone is applied
+    float world_area2 = length(cross(dp1, dp2));
+    diffgeo->uv_lod_bias = (det != 0.f && world_area2 > 0.f) ? 0.5f * native_log2(fabs(det) / world_area2) : TEXTURE_LOD_FINEST;
+    diffgeo->lod = TEXTURE_LOD_FINEST;
+
+    // Tangent frames are precomputed per vertex for normal mapped shapes,
+    // only reorthogonalize against interpolated normal
+    float sign = 1.f;
+    float3 t = 0.f;
+
+    if (shape.starttangent >= 0)
     {
-        float invdet = 1.f / det;
-        diffgeo->dpdu = normalize( (dv2 * dp1 - dv1 * dp2) * invdet );
-        diffgeo->dpdv = normalize( (-du2 * dp1 + du1 * dp2) * invdet );
-        diffgeo->dpdu -= dot(diffgeo->n, diffgeo->dpdu) * diffgeo->n;
-        diffgeo->dpdu = normalize(diffgeo->dpdu);
-        
-        diffgeo->dpdv -= dot(diffgeo->n, diffgeo->dpdv) * diffgeo->n;
-        diffgeo->dpdv -= dot(diffgeo->dpdu, diffgeo->dpdv) * diffgeo->dpdu;
-        diffgeo->dpdv = normalize(diffgeo->dpdv);
+        t = Scene_InterpolateTangent(scene, shape_idx, prim_idx, barycentrics, &sign);
+        t -= dot(diffgeo->n, t) * diffgeo->n;
     }
-    else
+
+    diffgeo->dpdu = dot(t, t) > 0.f ? normalize(t) : normalize(GetOrthoVector(diffgeo->n));
+    diffgeo->dpdv = sign * cross(diffgeo->n, diffgeo->dpdu);
+}
+
+// Intersector works with float positions, so with quantized shading positions the interpolated
+// point can lie up to a quantization step off the surface that was hit. Take the point along the
+// ray instead, so spawned rays do not start behind the surface.
+INLINE void DifferentialGeometry_SetHitPosition(DifferentialGeometry* diffgeo, Scene const* scene,
+    Intersection const* isect, float3 ray_o, float3 ray_d)
+{
+    if (scene->shapes[isect->shapeid - 1].compression & kCompressedPositions)
     {
-        diffgeo->dpdu = normalize(GetOrthoVector(diffgeo->n));
-        diffgeo->dpdv = normalize(cross(diffgeo->n, diffgeo->dpdu));
+        diffgeo->p = ray_o + ray_d * isect->uvwt.w;
     }
 }
 
+// Select texture LOD for a ray cone of given width hitting the surface at cos_theta,
+// see Akenine-Moller et al. "Texture Level of Detail Strategies for Real-Time Ray Tracing"
+INLINE void DifferentialGeometry_SetConeFootprint(DifferentialGeometry* diffgeo, float cone_width, float cos_theta)
+{
+    if (cone_width > 0.f && diffgeo->uv_lod_bias > TEXTURE_LOD_FINEST)
+    {
+        diffgeo->lod = diffgeo->uv_lod_bias + native_log2(cone_width / max(cos_theta, 1e-3f));
+    }
+}
 
 // Calculate tangent transform matrices inside differential geometry
 INLINE void DifferentialGeometry_CalculateTangentTransforms(DifferentialGeometry* diffgeo)
@@ -25,25 +25,152 @@ THE SOFTWARE.
 
 #include <../Baikal/Kernels/CL/payload.cl>
 #include <../Baikal/Kernels/CL/utils.cl>
+#include <../Baikal/Kernels/CL/texture_bc.cl>
 
 
+/// Finest levels are also bound as image arrays, one per TextureImage
+#ifdef BAIKAL_TEXTURE_IMAGES
+#define TEXTURE_IMAGE_ARG_LIST , __read_only image2d_array_t teximages_unorm, __read_only image2d_array_t teximages_half, __read_only image2d_array_t teximages_float
+#define TEXTURE_IMAGE_ARGS , teximages_unorm, teximages_half, teximages_float
+#else
+#define TEXTURE_IMAGE_ARG_LIST
+#define TEXTURE_IMAGE_ARGS
+#endif
+
 /// To simplify a bit
-#define TEXTURE_ARG_LIST __global Texture const* textures, __global char const* texturedata
-#define TEXTURE_ARG_LIST_IDX(x) int x, __global Texture const* textures, __global char const* texturedata
-#define TEXTURE_ARGS textures, texturedata
-#define TEXTURE_ARGS_IDX(x) x, textures, texturedata
+#define TEXTURE_ARG_LIST __global Texture const* textures, __global char const* texturedata TEXTURE_IMAGE_ARG_LIST
+#define TEXTURE_ARG_LIST_IDX(x) int x, __global Texture const* textures, __global char const* texturedata TEXTURE_IMAGE_ARG_LIST
+#define TEXTURE_ARGS textures, texturedata TEXTURE_IMAGE_ARGS
+#define TEXTURE_ARGS_IDX(x) x, textures, texturedata TEXTURE_IMAGE_ARGS
 
-/// Sample 2D texture
-inline
-float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+/// Size of a single texel in bytes
+INLINE int Texture_GetTexelSize(int fmt)
+{
+    switch (fmt)
+    {
+        case RGBA32: return 16;
+        case RGBA16: return 8;
+        case R8: return 1;
+        case RG8: return 2;
+        case R16F: return 2;
+        case R32F: return 4;
+        default: return 4;
+    }
+}
+
+/// Level dimension padded to whole tiles
+INLINE int Texture_GetPaddedSize(int layout, int size)
+{
+    switch (layout)
+    {
+        case kLayoutTiled: return (size + 3) & ~3;
+        case kLayoutMorton: return (size + 7) & ~7;
+        default: return size;
+    }
+}
+
+/// Spread 3 low bits of the value to even bit positions
+INLINE int Texture_SpreadBits(int value)
+{
+    value = (value | (value << 2)) & 0x33;
+    return (value | (value << 1)) & 0x55;
+}
+
+/// Index of texel (x, y) in the level
+INLINE int Texture_GetTexelIndex(int layout, int width, int x, int y)
+{
+    switch (layout)
+    {
+        case kLayoutTiled:
+        {
+            int tile = (y >> 2) * ((width + 3) >> 2) + (x >> 2);
+            return (tile << 4) + ((y & 3) << 2) + (x & 3);
+        }
+        case kLayoutMorton:
+        {
+            int tile = (y >> 3) * ((width + 7) >> 3) + (x >> 3);
+            return (tile << 6) + (Texture_SpreadBits(x & 7) | (Texture_SpreadBits(y & 7) << 1));
+        }
+        default:
+            return width * y + x;
+    }
+}
+
+/// Size of a mip level in the pool, levels are 16 bytes aligned
+INLINE int Texture_GetLevelSize(int fmt, int layout, int width, int height)
+{
+    switch (fmt)
+    {
+        case BC1:
+        case BC4:
+        case BC5:
+        case BC6H:
+        case BC7:
+            return (((width + 3) >> 2) * ((height + 3) >> 2) * TextureBC_GetBlockSize(fmt) + 15) & ~15;
+        default:
+            return (Texture_GetPaddedSize(layout, width) * Texture_GetPaddedSize(layout, height) * Texture_GetTexelSize(fmt) + 15) & ~15;
+    }
+}
+
+/// Find the origin of mip level data in the pool and its dimensions
+INLINE __global char const* Texture_GetLevelData(__global Texture const* texture, __global char const* texturedata, int level, int* width, int* height)
 {
-    // Get width and height
-    int width = textures[texidx].w;
-    int height = textures[texidx].h;
+    int w = texture->w;
+    int h = texture->h;
+    int offset = texture->dataoffset;
 
-    // Find the origin of the data in the pool
-    __global char const* mydata = texturedata + textures[texidx].dataoffset;
+    // Levels are stored one after another starting from the finest one
+    for (int i = 0; i < level; ++i)
+    {
+        offset += Texture_GetLevelSize(texture->fmt, texture->layout, w, h);
+        w = max(w >> 1, 1);
+        h = max(h >> 1, 1);
+    }
+
+    *width = w;
+    *height = h;
+    return texturedata + offset;
+}
 
+/// Fetch single texel and convert it to float
+INLINE float4 TextureData_Fetch(__global char const* mydata, int fmt, int layout, int width, int x, int y)
+{
+    int idx = Texture_GetTexelIndex(layout, width, x, y);
+
+    switch (fmt)
+    {
+        case RGBA32:
+            return *((__global float4 const*)mydata + idx);
+        case RGBA16:
+            return vload_half4(idx, (__global half const*)mydata);
+        case RGBA8:
+            return convert_float4(*((__global uchar4 const*)mydata + idx)) / 255.f;
+        // Single channel formats are replicated the same way RGBA expansion on load used to do
+        case R8:
+            return (float4)(*((__global uchar const*)mydata + idx) / 255.f);
+        case RG8:
+        {
+            float2 rg = convert_float2(*((__global uchar2 const*)mydata + idx)) / 255.f;
+            return make_float4(rg.x, rg.y, 0.f, 1.f);
+        }
+        case R16F:
+            return (float4)(vload_half(idx, (__global half const*)mydata));
+        case R32F:
+            return (float4)(*((__global float const*)mydata + idx));
+        case BC1:
+        case BC4:
+        case BC5:
+        case BC6H:
+        case BC7:
+            return TextureBC_Fetch(mydata, fmt, width, x, y);
+        default:
+            return make_float4(0.f, 0.f, 0.f, 0.f);
+    }
+}
+
+/// Wrap UV into [0,1] and flip Y axis
+INLINE float2 Texture_WrapUV(float2 uv)
+{
     // Handle UV wrap
     // TODO: need UV mode support
     uv -= floor(uv);
@@ -52,73 +179,138 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
     // it is needed as textures are loaded with Y axis going top to down
     // and our axis goes from down to top
     uv.y = 1.f - uv.y;
+    return uv;
+}
+
+/// Select fractional mip level for given UV space footprint
+INLINE float Texture_SelectLevel(__global Texture const* texture, float lod)
+{
+    // lod is log2 of footprint size in UV space, convert it to texels of the largest dimension
+    float level = lod + native_log2((float)max(texture->w, texture->h));
+    return clamp(level, 0.f, (float)(texture->levels - 1));
+}
+
+/// Bilinear sample of a single mip level using wrapped UV
+INLINE float4 Texture_SampleLevel(float2 uv, int level, __global Texture const* texture, __global char const* texturedata)
+{
+    // Get width and height of the level and find its origin in the pool
+    int width, height;
+    __global char const* mydata = Texture_GetLevelData(texture, texturedata, level, &width, &height);
 
     // Calculate integer coordinates
     int x0 = clamp((int)floor(uv.x * width), 0, width - 1);
     int y0 = clamp((int)floor(uv.y * height), 0, height - 1);
 
-    // Calculate samples for linear filtering
-    int x1 = clamp(x0 + 1, 0,  width - 1);
-    int y1 = clamp(y0 + 1, 0, height - 1);
+    // Calculate samples for linear filtering, UV is wrapped so the filter wraps as well
+    int x1 = x0 + 1 < width ? x0 + 1 : 0;
+    int y1 = y0 + 1 < height ? y0 + 1 : 0;
 
     // Calculate weights for linear filtering
     float wx = uv.x * width - floor(uv.x * width);
     float wy = uv.y * height - floor(uv.y * height);
 
-    switch (textures[texidx].fmt)
+    // Get 4 values for linear filtering
+    int fmt = texture->fmt;
+    int layout = texture->layout;
+    float4 val00 = TextureData_Fetch(mydata, fmt, layout, width, x0, y0);
+    float4 val01 = TextureData_Fetch(mydata, fmt, layout, width, x1, y0);
+    float4 val10 = TextureData_Fetch(mydata, fmt, layout, width, x0, y1);
+    float4 val11 = TextureData_Fetch(mydata, fmt, layout, width, x1, y1);
+
+    // Filter and return the result
+    return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
+}
+
+#ifdef BAIKAL_TEXTURE_IMAGES
+/// Read texture image at unnormalized coordinates
+INLINE float4 Texture_ReadImage(__global Texture const* texture, sampler_t sampler, float4 coord TEXTURE_IMAGE_ARG_LIST)
+{
+    switch (texture->image)
     {
-        case RGBA32:
-        {
-            __global float4 const* mydataf = (__global float4 const*)mydata;
+        case kTextureImageHalf: return read_imagef(teximages_half, sampler, coord);
+        case kTextureImageFloat: return read_imagef(teximages_float, sampler, coord);
+        default: return read_imagef(teximages_unorm, sampler, coord);
+    }
+}
 
-            // Get 4 values for linear filtering
-            float4 val00 = *(mydataf + width * y0 + x0);
-            float4 val01 = *(mydataf + width * y0 + x1);
-            float4 val10 = *(mydataf + width * y1 + x0);
-            float4 val11 = *(mydataf + width * y1 + x1);
+/// Bilinear sample of the finest level using texture units, same footprint as Texture_SampleLevel
+INLINE float4 Texture_SampleImage(float2 uv, __global Texture const* texture TEXTURE_IMAGE_ARG_LIST)
+{
+    int width = texture->w;
+    int height = texture->h;
+    float layer = (float)texture->layer;
 
-            // Filter and return the result
-            return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
-        }
+    float2 xy = uv * make_float2((float)width, (float)height);
+    int x0 = clamp((int)floor(xy.x), 0, width - 1);
+    int y0 = clamp((int)floor(xy.y), 0, height - 1);
 
-        case RGBA16:
-        {
-            __global half const* mydatah = (__global half const*)mydata;
+    // Texel centers are at half integers, shift by half a texel to filter between texels x0 and x0 + 1
+    if (x0 + 1 < width && y0 + 1 < height)
+    {
+        const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+        return Texture_ReadImage(texture, sampler, (float4)(xy.x + 0.5f, xy.y + 0.5f, layer, 0.f) TEXTURE_IMAGE_ARGS);
+    }
 
-            // Get 4 values
-            float4 val00 = vload_half4(width * y0 + x0, mydatah);
-            float4 val01 = vload_half4(width * y0 + x1, mydatah);
-            float4 val10 = vload_half4(width * y1 + x0, mydatah);
-            float4 val11 = vload_half4(width * y1 + x1, mydatah);
+    // Layers are padded to the largest texture in the array, so hardware wrapping would read
+    // the padding: filter across the last row or column manually
+    const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+    float x0c = x0 + 0.5f;
+    float y0c = y0 + 0.5f;
+    float x1c = (x0 + 1 < width ? x0 + 1 : 0) + 0.5f;
+    float y1c = (y0 + 1 < height ? y0 + 1 : 0) + 0.5f;
 
-            // Filter and return the result
-            return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
-        }
+    float wx = xy.x - floor(xy.x);
+    float wy = xy.y - floor(xy.y);
 
-        case RGBA8:
-        {
-            __global uchar4 const* mydatac = (__global uchar4 const*)mydata;
+    float4 val00 = Texture_ReadImage(texture, sampler, (float4)(x0c, y0c, layer, 0.f) TEXTURE_IMAGE_ARGS);
+    float4 val01 = Texture_ReadImage(texture, sampler, (float4)(x1c, y0c, layer, 0.f) TEXTURE_IMAGE_ARGS);
+    float4 val10 = Texture_ReadImage(texture, sampler, (float4)(x0c, y1c, layer, 0.f) TEXTURE_IMAGE_ARGS);
+    float4 val11 = Texture_ReadImage(texture, sampler, (float4)(x1c, y1c, layer, 0.f) TEXTURE_IMAGE_ARGS);
 
-            // Get 4 values and convert to float
-            uchar4 valu00 = *(mydatac + width * y0 + x0);
-            uchar4 valu01 = *(mydatac + width * y0 + x1);
-            uchar4 valu10 = *(mydatac + width * y1 + x0);
-            uchar4 valu11 = *(mydatac + width * y1 + x1);
+    return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
+}
+#endif
 
-            float4 val00 = make_float4((float)valu00.x / 255.f, (float)valu00.y / 255.f, (float)valu00.z / 255.f, (float)valu00.w / 255.f);
-            float4 val01 = make_float4((float)valu01.x / 255.f, (float)valu01.y / 255.f, (float)valu01.z / 255.f, (float)valu01.w / 255.f);
-            float4 val10 = make_float4((float)valu10.x / 255.f, (float)valu10.y / 255.f, (float)valu10.z / 255.f, (float)valu10.w / 255.f);
-            float4 val11 = make_float4((float)valu11.x / 255.f, (float)valu11.y / 255.f, (float)valu11.z / 255.f, (float)valu11.w / 255.f);
+/// Sample 2D texture with trilinear filtering,
+/// lod is log2 of the sample footprint size in UV space
+inline
+float4 Texture_Sample2DLod(float2 uv, float lod, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    __global Texture const* texture = textures + texidx;
 
-            // Filter and return the result
-            return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
-        }
+    uv = Texture_WrapUV(uv);
 
-        default:
-        {
-            return make_float4(0.f, 0.f, 0.f, 0.f);
-        }
+    float level = Texture_SelectLevel(texture, lod);
+    int level0 = (int)level;
+    float wl = level - level0;
+
+#ifdef BAIKAL_TEXTURE_IMAGES
+    // Images hold the finest level only
+    float4 val0 = level0 == 0 ?
+        Texture_SampleImage(uv, texture TEXTURE_IMAGE_ARGS) :
+        Texture_SampleLevel(uv, level0, texture, texturedata);
+#else
+    float4 val0 = Texture_SampleLevel(uv, level0, texture, texturedata);
+#endif
+
+    if (wl > 0.f)
+    {
+        float4 val1 = Texture_SampleLevel(uv, level0 + 1, texture, texturedata);
+        return lerp(val0, val1, wl);
     }
+
+    return val0;
+}
+
+/// Sample 2D texture from the finest level
+inline
+float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+{
+#ifdef BAIKAL_TEXTURE_IMAGES
+    return Texture_SampleImage(Texture_WrapUV(uv), textures + texidx TEXTURE_IMAGE_ARGS);
+#else
+    return Texture_SampleLevel(Texture_WrapUV(uv), 0, textures + texidx, texturedata);
+#endif
 }
 
 /// Sample lattitue-longitude environment map using 3d vector
@@ -204,172 +396,96 @@ float Texture_GetValue1f(
     return v;
 }
 
-inline float3 TextureData_SampleNormalFromBump_uchar4(__global uchar4 const* mydatac, int width, int height, int t0, int s0)
+/// Calculate normal from bump map heights around the texel using Sobel filter
+INLINE float3 TextureData_SampleNormalFromBump(__global char const* mydata, int fmt, int layout, int width, int height, int t0, int s0)
 {
-	int t0minus = clamp(t0 - 1, 0, height - 1);
-	int t0plus = clamp(t0 + 1, 0, height - 1);
-	int s0minus = clamp(s0 - 1, 0, width - 1);
-	int s0plus = clamp(s0 + 1, 0, width - 1);
-
-	const uchar utex00 = (*(mydatac + width * t0minus + s0minus)).x;
-	const uchar utex10 = (*(mydatac + width * t0minus + (s0))).x;
-	const uchar utex20 = (*(mydatac + width * t0minus + s0plus)).x;
-
-	const uchar utex01 = (*(mydatac + width * (t0)+s0minus)).x;
-	const uchar utex21 = (*(mydatac + width * (t0)+(s0 + 1))).x;
+    // Neighbours wrap around like the filter taps
+    int t0minus = t0 > 0 ? t0 - 1 : height - 1;
+    int t0plus = t0 + 1 < height ? t0 + 1 : 0;
+    int s0minus = s0 > 0 ? s0 - 1 : width - 1;
+    int s0plus = s0 + 1 < width ? s0 + 1 : 0;
 
-	const uchar utex02 = (*(mydatac + width * t0plus + s0minus)).x;
-	const uchar utex12 = (*(mydatac + width * t0plus + (s0))).x;
-	const uchar utex22 = (*(mydatac + width * t0plus + s0plus)).x;
+    const float tex00 = TextureData_Fetch(mydata, fmt, layout, width, s0minus, t0minus).x;
+    const float tex10 = TextureData_Fetch(mydata, fmt, layout, width, s0, t0minus).x;
+    const float tex20 = TextureData_Fetch(mydata, fmt, layout, width, s0plus, t0minus).x;
 
-	const float tex00 = (float)utex00 / 255.f;
-	const float tex10 = (float)utex10 / 255.f;
-	const float tex20 = (float)utex20 / 255.f;
+    const float tex01 = TextureData_Fetch(mydata, fmt, layout, width, s0minus, t0).x;
+    const float tex21 = TextureData_Fetch(mydata, fmt, layout, width, s0plus, t0).x;
 
-	const float tex01 = (float)utex01 / 255.f;
-	const float tex21 = (float)utex21 / 255.f;
+    const float tex02 = TextureData_Fetch(mydata, fmt, layout, width, s0minus, t0plus).x;
+    const float tex12 = TextureData_Fetch(mydata, fmt, layout, width, s0, t0plus).x;
+    const float tex22 = TextureData_Fetch(mydata, fmt, layout, width, s0plus, t0plus).x;
 
-	const float tex02 = (float)utex02 / 255.f;
-	const float tex12 = (float)utex12 / 255.f;
-	const float tex22 = (float)utex22 / 255.f;
+    const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
+    const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
+    const float3 n = make_float3(Gx, Gy, 1.f);
 
-	const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
-	const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
-	const float3 n = make_float3(Gx, Gy, 1.f);
-
-	return n;
+    return n;
 }
 
-inline float3 TextureData_SampleNormalFromBump_half4(__global half const* mydatah, int width, int height, int t0, int s0)
+/// Bilinearly interpolated unnormalized bump normal of a single mip level using wrapped UV
+INLINE float3 Texture_SampleBumpLevel(float2 uv, int level, __global Texture const* texture, __global char const* texturedata)
 {
-	int t0minus = clamp(t0 - 1, 0, height - 1);
-	int t0plus = clamp(t0 + 1, 0, height - 1);
-	int s0minus = clamp(s0 - 1, 0, width - 1);
-	int s0plus = clamp(s0 + 1, 0, width - 1);
-
-	const float tex00 = vload_half4(width * t0minus + s0minus, mydatah).x;
-	const float tex10 = vload_half4(width * t0minus + (s0), mydatah).x;
-	const float tex20 = vload_half4(width * t0minus + s0plus, mydatah).x;
-
-	const float tex01 = vload_half4(width * (t0)+s0minus, mydatah).x;
-	const float tex21 = vload_half4(width * (t0)+s0plus, mydatah).x;
-
-	const float tex02 = vload_half4(width * t0plus + s0minus, mydatah).x;
-	const float tex12 = vload_half4(width * t0plus + (s0), mydatah).x;
-	const float tex22 = vload_half4(width * t0plus + s0plus, mydatah).x;
-
-	const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
-	const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
-	const float3 n = make_float3(Gx, Gy, 1.f);
-
-	return n;
-}
+    // Get width and height of the level and find its origin in the pool
+    int width, height;
+    __global char const* mydata = Texture_GetLevelData(texture, texturedata, level, &width, &height);
 
-inline float3 TextureData_SampleNormalFromBump_float4(__global float4 const* mydataf, int width, int height, int t0, int s0)
-{
-	int t0minus = clamp(t0 - 1, 0, height - 1);
-	int t0plus = clamp(t0 + 1, 0, height - 1);
-	int s0minus = clamp(s0 - 1, 0, width - 1);
-	int s0plus = clamp(s0 + 1, 0, width - 1);
+    // Calculate integer coordinates
+    int s0 = clamp((int)floor(uv.x * width), 0, width - 1);
+    int t0 = clamp((int)floor(uv.y * height), 0, height - 1);
 
-	const float tex00 = (*(mydataf + width * t0minus + s0minus)).x;
-	const float tex10 = (*(mydataf + width * t0minus + (s0))).x;
-	const float tex20 = (*(mydataf + width * t0minus + s0plus)).x;
+    // Calculate samples for linear filtering, UV is wrapped so the filter wraps as well
+    int s1 = s0 + 1 < width ? s0 + 1 : 0;
+    int t1 = t0 + 1 < height ? t0 + 1 : 0;
 
-	const float tex01 = (*(mydataf + width * (t0)+s0minus)).x;
-	const float tex21 = (*(mydataf + width * (t0)+s0plus)).x;
+    // Calculate weights for linear filtering
+    float wx = uv.x * width - floor(uv.x * width);
+    float wy = uv.y * height - floor(uv.y * height);
 
-	const float tex02 = (*(mydataf + width * t0plus + s0minus)).x;
-	const float tex12 = (*(mydataf + width * t0plus + (s0))).x;
-	const float tex22 = (*(mydataf + width * t0plus + s0plus)).x;
+    int fmt = texture->fmt;
+    int layout = texture->layout;
+    float3 n00 = TextureData_SampleNormalFromBump(mydata, fmt, layout, width, height, t0, s0);
+    float3 n01 = TextureData_SampleNormalFromBump(mydata, fmt, layout, width, height, t0, s1);
+    float3 n10 = TextureData_SampleNormalFromBump(mydata, fmt, layout, width, height, t1, s0);
+    float3 n11 = TextureData_SampleNormalFromBump(mydata, fmt, layout, width, height, t1, s1);
 
-	const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
-	const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
-	const float3 n = make_float3(Gx, Gy, 1.f);
+    float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
 
-	return n;
+    // Height differences are taken over texels of the level,
+    // scale them to keep the slope of the finest level
+    n.xy *= (float)width / texture->w;
+    return n;
 }
 
-/// Sample 2D texture
+/// Sample normal from bump map with trilinear filtering,
+/// lod is log2 of the sample footprint size in UV space
 inline
-float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+float3 Texture_SampleBumpLod(float2 uv, float lod, TEXTURE_ARG_LIST_IDX(texidx))
 {
-    // Get width and height
-    int width = textures[texidx].w;
-    int height = textures[texidx].h;
+    __global Texture const* texture = textures + texidx;
 
-    // Find the origin of the data in the pool
-    __global char const* mydata = texturedata + textures[texidx].dataoffset;
+    uv = Texture_WrapUV(uv);
 
-    // Handle UV wrap
-    // TODO: need UV mode support
-    uv -= floor(uv);
-
-    // Reverse Y:
-    // it is needed as textures are loaded with Y axis going top to down
-    // and our axis goes from down to top
-    uv.y = 1.f - uv.y;
-
-    // Calculate integer coordinates
-    int s0 = clamp((int)floor(uv.x * width), 0, width - 1);
-    int t0 = clamp((int)floor(uv.y * height), 0, height - 1);
+    float level = Texture_SelectLevel(texture, lod);
+    int level0 = (int)level;
+    float wl = level - level0;
 
-	int s1 = clamp(s0 + 1, 0, width - 1);
-	int t1 = clamp(t0 + 1, 0, height - 1);
+    float3 n = Texture_SampleBumpLevel(uv, level0, texture, texturedata);
 
-	// Calculate weights for linear filtering
-	float wx = uv.x * width - floor(uv.x * width);
-	float wy = uv.y * height - floor(uv.y * height);
-
-    switch (textures[texidx].fmt)
-    {
-    case RGBA32:
+    if (wl > 0.f)
     {
-        __global float3 const* mydataf = (__global float3 const*)mydata;
-
-		float3 n00 = TextureData_SampleNormalFromBump_float4(mydataf, width, height, t0, s0);
-		float3 n01 = TextureData_SampleNormalFromBump_float4(mydataf, width, height, t0, s1);
-		float3 n10 = TextureData_SampleNormalFromBump_float4(mydataf, width, height, t1, s0);
-		float3 n11 = TextureData_SampleNormalFromBump_float4(mydataf, width, height, t1, s1);
-
-		float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
-
-		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
+        n = lerp3(n, Texture_SampleBumpLevel(uv, level0 + 1, texture, texturedata), wl);
     }
 
-    case RGBA16:
-    {
-        __global half const* mydatah = (__global half const*)mydata;
-
-		float3 n00 = TextureData_SampleNormalFromBump_half4(mydatah, width, height, t0, s0);
-		float3 n01 = TextureData_SampleNormalFromBump_half4(mydatah, width, height, t0, s1);
-		float3 n10 = TextureData_SampleNormalFromBump_half4(mydatah, width, height, t1, s0);
-		float3 n11 = TextureData_SampleNormalFromBump_half4(mydatah, width, height, t1, s1);
-
-		float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
-
-		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
-    }
-
-    case RGBA8:
-    {
-        __global uchar4 const* mydatac = (__global uchar4 const*)mydata;
-
-		float3 n00 = TextureData_SampleNormalFromBump_uchar4(mydatac, width, height, t0, s0);
-		float3 n01 = TextureData_SampleNormalFromBump_uchar4(mydatac, width, height, t0, s1);
-		float3 n10 = TextureData_SampleNormalFromBump_uchar4(mydatac, width, height, t1, s0);
-		float3 n11 = TextureData_SampleNormalFromBump_uchar4(mydatac, width, height, t1, s1);
-
-		float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
-
-		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
-    }
+    return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
+}
 
-    default:
-    {
-        return make_float3(0.f, 0.f, 0.f);
-    }
-    }
+/// Sample normal from bump map using the finest level
+inline
+float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    float3 n = Texture_SampleBumpLevel(Texture_WrapUV(uv), 0, textures + texidx, texturedata);
+    return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
 }
 
 
@@ -0,0 +1,502 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#ifndef TEXTURE_BC_CL
+#define TEXTURE_BC_CL
+
+
+#include <../Baikal/Kernels/CL/payload.cl>
+
+
+/// Block compressed texture decoding. Blocks are decoded per texel on fetch,
+/// tables and bit layouts match Baikal/Utils/block_compression.cpp
+
+/// BC7 two subset partitions, bit i is the subset of texel i
+__constant ushort kBC_Partitions2[64] =
+{
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+    0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+    0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+    0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+    0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+};
+
+/// BC7 three subset partitions, 2 bits per texel
+__constant uint kBC_Partitions3[64] =
+{
+    0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+    0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+    0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+    0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+    0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+    0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+    0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+    0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+};
+
+/// Anchor texels of the second subset for two subsets
+__constant uchar kBC_Anchors2[64] =
+{
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+    15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+    6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+};
+
+/// Anchor texels of the second and third subsets for three subsets
+__constant uchar kBC_Anchors31[64] =
+{
+    3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+    3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+    8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+    3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+};
+
+__constant uchar kBC_Anchors32[64] =
+{
+    15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+    15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+    15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+    15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+};
+
+__constant uchar kBC_Weights2[4] = { 0, 21, 43, 64 };
+__constant uchar kBC_Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+__constant uchar kBC_Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+/// BC6H modes: code, transformed, two regions, endpoint bits, delta bits for r, g, b
+__constant uchar kBC6H_Modes[14 * 7] =
+{
+    0x00, 1, 1, 10, 5, 5, 5,
+    0x01, 1, 1, 7, 6, 6, 6,
+    0x02, 1, 1, 11, 5, 4, 4,
+    0x06, 1, 1, 11, 4, 5, 4,
+    0x0A, 1, 1, 11, 4, 4, 5,
+    0x0E, 1, 1, 9, 5, 5, 5,
+    0x12, 1, 1, 8, 6, 5, 5,
+    0x16, 1, 1, 8, 5, 6, 5,
+    0x1A, 1, 1, 8, 5, 5, 6,
+    0x1E, 0, 1, 6, 6, 6, 6,
+    0x03, 0, 0, 10, 10, 10, 10,
+    0x07, 1, 0, 11, 9, 9, 9,
+    0x0B, 1, 0, 12, 8, 8, 8,
+    0x0F, 1, 0, 16, 4, 4, 4
+};
+
+/// BC6H field layout following the mode bits: (field, shift, count) triples,
+/// 24 per mode, fields are RW GW BW RX GX BX RY GY BY RZ GZ BZ D
+__constant uchar kBC6H_Layout[14 * 24 * 3] =
+{
+    // Mode 1
+    7, 4, 1, 8, 4, 1, 11, 4, 1, 0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 5, 10, 4, 1, 7, 0, 4, 4, 0, 5, 11, 0, 1, 10, 0, 4, 5, 0, 5, 11, 1, 1, 8, 0, 4, 6, 0, 5, 11, 2, 1, 9, 0, 5, 11, 3, 1, 12, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 2
+    7, 5, 1, 10, 4, 1, 10, 5, 1, 0, 0, 7, 11, 0, 1, 11, 1, 1, 8, 4, 1, 1, 0, 7, 8, 5, 1, 11, 2, 1, 7, 4, 1, 2, 0, 7, 11, 3, 1, 11, 5, 1, 11, 4, 1, 3, 0, 6, 7, 0, 4, 4, 0, 6, 10, 0, 4, 5, 0, 6, 8, 0, 4, 6, 0, 6, 9, 0, 6, 12, 0, 5,
+    // Mode 3
+    0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 5, 0, 10, 1, 7, 0, 4, 4, 0, 4, 1, 10, 1, 11, 0, 1, 10, 0, 4, 5, 0, 4, 2, 10, 1, 11, 1, 1, 8, 0, 4, 6, 0, 5, 11, 2, 1, 9, 0, 5, 11, 3, 1, 12, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 4
+    0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 4, 0, 10, 1, 10, 4, 1, 7, 0, 4, 4, 0, 5, 1, 10, 1, 10, 0, 4, 5, 0, 4, 2, 10, 1, 11, 1, 1, 8, 0, 4, 6, 0, 4, 11, 0, 1, 11, 2, 1, 9, 0, 4, 7, 4, 1, 11, 3, 1, 12, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 5
+    0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 4, 0, 10, 1, 8, 4, 1, 7, 0, 4, 4, 0, 4, 1, 10, 1, 11, 0, 1, 10, 0, 4, 5, 0, 5, 2, 10, 1, 8, 0, 4, 6, 0, 4, 11, 1, 1, 11, 2, 1, 9, 0, 4, 11, 4, 1, 11, 3, 1, 12, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 6
+    0, 0, 9, 8, 4, 1, 1, 0, 9, 7, 4, 1, 2, 0, 9, 11, 4, 1, 3, 0, 5, 10, 4, 1, 7, 0, 4, 4, 0, 5, 11, 0, 1, 10, 0, 4, 5, 0, 5, 11, 1, 1, 8, 0, 4, 6, 0, 5, 11, 2, 1, 9, 0, 5, 11, 3, 1, 12, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 7
+    0, 0, 8, 10, 4, 1, 8, 4, 1, 1, 0, 8, 11, 2, 1, 7, 4, 1, 2, 0, 8, 11, 3, 1, 11, 4, 1, 3, 0, 6, 7, 0, 4, 4, 0, 5, 11, 0, 1, 10, 0, 4, 5, 0, 5, 11, 1, 1, 8, 0, 4, 6, 0, 6, 9, 0, 6, 12, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 8
+    0, 0, 8, 11, 0, 1, 8, 4, 1, 1, 0, 8, 7, 5, 1, 7, 4, 1, 2, 0, 8, 10, 5, 1, 11, 4, 1, 3, 0, 5, 10, 4, 1, 7, 0, 4, 4, 0, 6, 10, 0, 4, 5, 0, 5, 11, 1, 1, 8, 0, 4, 6, 0, 5, 11, 2, 1, 9, 0, 5, 11, 3, 1, 12, 0, 5, 0, 0, 0, 0, 0, 0,
+    // Mode 9
+    0, 0, 8, 11, 1, 1, 8, 4, 1, 1, 0, 8, 8, 5, 1, 7, 4, 1, 2, 0, 8, 11, 5, 1, 11, 4, 1, 3, 0, 5, 10, 4, 1, 7, 0, 4, 4, 0, 5, 11, 0, 1, 10, 0, 4, 5, 0, 6, 8, 0, 4, 6, 0, 5, 11, 2, 1, 9, 0, 5, 11, 3, 1, 12, 0, 5, 0, 0, 0, 0, 0, 0,
+    // Mode 10
+    0, 0, 6, 10, 4, 1, 11, 0, 1, 11, 1, 1, 8, 4, 1, 1, 0, 6, 7, 5, 1, 8, 5, 1, 11, 2, 1, 7, 4, 1, 2, 0, 6, 10, 5, 1, 11, 3, 1, 11, 5, 1, 11, 4, 1, 3, 0, 6, 7, 0, 4, 4, 0, 6, 10, 0, 4, 5, 0, 6, 8, 0, 4, 6, 0, 6, 9, 0, 6, 12, 0, 5,
+    // Mode 11
+    0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 10, 4, 0, 10, 5, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 12
+    0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 9, 0, 10, 1, 4, 0, 9, 1, 10, 1, 5, 0, 9, 2, 10, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 13
+    0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 8, 0, 11, 1, 0, 10, 1, 4, 0, 8, 1, 11, 1, 1, 10, 1, 5, 0, 8, 2, 11, 1, 2, 10, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // Mode 14
+    0, 0, 10, 1, 0, 10, 2, 0, 10, 3, 0, 4, 0, 15, 1, 0, 14, 1, 0, 13, 1, 0, 12, 1, 0, 11, 1, 0, 10, 1, 4, 0, 4, 1, 15, 1, 1, 14, 1, 1, 13, 1, 1, 12, 1, 1, 11, 1, 1, 10, 1, 5, 0, 4, 2, 15, 1, 2, 14, 1, 2, 13, 1, 2, 12, 1, 2, 11, 1, 2, 10, 1
+};
+
+/// BC7 modes: subsets, partition bits, rotation bits, index selection bits,
+/// color bits, alpha bits, endpoint p-bits, shared p-bits, index bits, secondary index bits
+__constant uchar kBC7_Modes[8 * 10] =
+{
+    3, 4, 0, 0, 4, 0, 1, 0, 3, 0,
+    2, 6, 0, 0, 6, 0, 0, 1, 3, 0,
+    3, 6, 0, 0, 5, 0, 0, 0, 2, 0,
+    2, 6, 0, 0, 7, 0, 1, 0, 2, 0,
+    1, 0, 2, 1, 5, 6, 0, 0, 2, 3,
+    1, 0, 2, 0, 7, 8, 0, 0, 2, 2,
+    1, 0, 0, 0, 7, 7, 1, 0, 4, 0,
+    2, 6, 0, 0, 5, 5, 1, 0, 2, 0
+};
+
+/// Size of a 4x4 block in bytes
+INLINE int TextureBC_GetBlockSize(int fmt)
+{
+    return (fmt == BC1 || fmt == BC4) ? 8 : 16;
+}
+
+/// Read count bits starting from offset, bits go from LSB of the first word
+INLINE uint TextureBC_GetBits(uint4 block, int offset, int count)
+{
+    uint words[5] = { block.x, block.y, block.z, block.w, 0 };
+    int word = offset >> 5;
+    ulong bits = ((ulong)words[word + 1] << 32) | words[word];
+    return (uint)(bits >> (offset & 31)) & ((1u << count) - 1);
+}
+
+INLINE int TextureBC_GetWeight(int bits, int index)
+{
+    switch (bits)
+    {
+        case 2: return kBC_Weights2[index];
+        case 3: return kBC_Weights3[index];
+        default: return kBC_Weights4[index];
+    }
+}
+
+INLINE float3 TextureBC_DecodeColor565(uint color)
+{
+    uint r = (color >> 11) & 0x1F;
+    uint g = (color >> 5) & 0x3F;
+    uint b = color & 0x1F;
+    return make_float3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)) / 255.f;
+}
+
+INLINE float4 TextureBC_DecodeBC1(uint2 block, int texel)
+{
+    uint c0 = block.x & 0xFFFF;
+    uint c1 = block.x >> 16;
+    int index = (block.y >> (2 * texel)) & 3;
+
+    float3 e0 = TextureBC_DecodeColor565(c0);
+    float3 e1 = TextureBC_DecodeColor565(c1);
+
+    switch (index)
+    {
+        case 0: return make_float4(e0.x, e0.y, e0.z, 1.f);
+        case 1: return make_float4(e1.x, e1.y, e1.z, 1.f);
+        case 2:
+        {
+            float3 c = c0 > c1 ? (2.f * e0 + e1) / 3.f : 0.5f * (e0 + e1);
+            return make_float4(c.x, c.y, c.z, 1.f);
+        }
+        default:
+        {
+            if (c0 > c1)
+            {
+                float3 c = (e0 + 2.f * e1) / 3.f;
+                return make_float4(c.x, c.y, c.z, 1.f);
+            }
+
+            // Transparent black
+            return make_float4(0.f, 0.f, 0.f, 0.f);
+        }
+    }
+}
+
+INLINE float TextureBC_DecodeBC4(uint2 block, int texel)
+{
+    int r0 = block.x & 0xFF;
+    int r1 = (block.x >> 8) & 0xFF;
+
+    ulong indices = ((((ulong)block.y) << 32) | block.x) >> 16;
+    int index = (int)(indices >> (3 * texel)) & 7;
+
+    if (index < 2)
+        return (index == 0 ? r0 : r1) / 255.f;
+
+    if (r0 > r1)
+        return (r0 * (8 - index) + r1 * (index - 1)) / (7.f * 255.f);
+
+    if (index < 6)
+        return (r0 * (6 - index) + r1 * (index - 1)) / (5.f * 255.f);
+
+    return index == 6 ? 0.f : 1.f;
+}
+
+/// Two channels, expanded like RG8: normal maps reconstruct Z themselves
+INLINE float4 TextureBC_DecodeBC5(uint4 block, int texel)
+{
+    float r = TextureBC_DecodeBC4(block.xy, texel);
+    float g = TextureBC_DecodeBC4(block.zw, texel);
+
+    return make_float4(r, g, 0.f, 1.f);
+}
+
+INLINE int TextureBC_SignExtend(int value, int bits)
+{
+    int shift = 32 - bits;
+    return (value << shift) >> shift;
+}
+
+INLINE int TextureBC_UnquantizeBC6H(int value, int bits)
+{
+    if (bits >= 15) return value;
+    if (value == 0) return 0;
+    if (value == (1 << bits) - 1) return 0xFFFF;
+    return ((value << 16) + 0x8000) >> bits;
+}
+
+/// Unsigned BC6H (BC6H_UF16)
+INLINE float4 TextureBC_DecodeBC6H(uint4 block, int texel)
+{
+    uint code = TextureBC_GetBits(block, 0, 2);
+    int offset = 2;
+
+    if (code > 1)
+    {
+        code |= TextureBC_GetBits(block, 2, 3) << 2;
+        offset = 5;
+    }
+
+    int mode = 0;
+    while (mode < 14 && kBC6H_Modes[7 * mode] != code)
+        ++mode;
+
+    // Reserved modes
+    if (mode == 14)
+        return make_float4(0.f, 0.f, 0.f, 1.f);
+
+    __constant uchar* info = kBC6H_Modes + 7 * mode;
+    bool transformed = info[1];
+    bool two_regions = info[2];
+    int endpoint_bits = info[3];
+
+    int fields[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    __constant uchar* layout = kBC6H_Layout + 72 * mode;
+
+    for (int i = 0; i < 24 && layout[3 * i + 2]; ++i)
+    {
+        int count = layout[3 * i + 2];
+        fields[layout[3 * i]] |= TextureBC_GetBits(block, offset, count) << layout[3 * i + 1];
+        offset += count;
+    }
+
+    int partition = fields[12];
+    int region = two_regions ? (kBC_Partitions2[partition] >> texel) & 1 : 0;
+
+    // Index of the texel, anchor texels have one bit less
+    int index_bits = two_regions ? 3 : 4;
+    int anchor = two_regions ? kBC_Anchors2[partition] : 0;
+    int index_offset = (two_regions ? 82 : 65) + texel * index_bits - (texel > 0 ? 1 : 0) - (two_regions && texel > anchor ? 1 : 0);
+    int index_count = (texel == 0 || (two_regions && texel == anchor)) ? index_bits - 1 : index_bits;
+    int weight = TextureBC_GetWeight(index_bits, TextureBC_GetBits(block, index_offset, index_count));
+
+    int mask = (1 << endpoint_bits) - 1;
+    float4 result = make_float4(0.f, 0.f, 0.f, 1.f);
+    float rgb[3];
+
+    for (int c = 0; c < 3; ++c)
+    {
+        int e0 = region ? fields[6 + c] : fields[c];
+        int e1 = region ? fields[9 + c] : fields[3 + c];
+
+        if (transformed)
+        {
+            int delta_bits = info[4 + c];
+            if (region)
+                e0 = (fields[c] + TextureBC_SignExtend(e0, delta_bits)) & mask;
+            e1 = (fields[c] + TextureBC_SignExtend(e1, delta_bits)) & mask;
+        }
+
+        e0 = TextureBC_UnquantizeBC6H(e0, endpoint_bits);
+        e1 = TextureBC_UnquantizeBC6H(e1, endpoint_bits);
+
+        int value = (e0 * (64 - weight) + e1 * weight + 32) >> 6;
+        ushort bits = (ushort)((value * 31) >> 6);
+        rgb[c] = vload_half(0, (half const*)&bits);
+    }
+
+    result.x = rgb[0];
+    result.y = rgb[1];
+    result.z = rgb[2];
+    return result;
+}
+
+INLINE int TextureBC_ExpandBC7(int value, int bits)
+{
+    value <<= (8 - bits);
+    return value | (value >> bits);
+}
+
+INLINE float4 TextureBC_DecodeBC7(uint4 block, int texel)
+{
+    int mode = 0;
+    while (mode < 8 && !(block.x & (1u << mode)))
+        ++mode;
+
+    // Reserved mode
+    if (mode == 8)
+        return make_float4(0.f, 0.f, 0.f, 0.f);
+
+    __constant uchar* info = kBC7_Modes + 10 * mode;
+    int num_subsets = info[0];
+    int color_bits = info[4];
+    int alpha_bits = info[5];
+    int index_bits = info[8];
+    int index_bits2 = info[9];
+
+    int offset = mode + 1;
+    int partition = TextureBC_GetBits(block, offset, info[1]);
+    offset += info[1];
+    int rotation = TextureBC_GetBits(block, offset, info[2]);
+    offset += info[2];
+    int index_selection = TextureBC_GetBits(block, offset, info[3]);
+    offset += info[3];
+
+    // Subset and anchors of the texel
+    int subset = 0;
+    int anchor2 = 16;
+    int anchor3 = 16;
+
+    if (num_subsets == 2)
+    {
+        subset = (kBC_Partitions2[partition] >> texel) & 1;
+        anchor2 = kBC_Anchors2[partition];
+    }
+    else if (num_subsets == 3)
+    {
+        subset = (kBC_Partitions3[partition] >> (2 * texel)) & 3;
+        anchor2 = kBC_Anchors31[partition];
+        anchor3 = kBC_Anchors32[partition];
+    }
+
+    int num_endpoints = 2 * num_subsets;
+    int endpoints_offset = offset;
+    int pbits_offset = endpoints_offset + num_endpoints * (3 * color_bits + alpha_bits);
+    int num_pbits = info[6] ? num_endpoints : (info[7] ? num_subsets : 0);
+    int indices_offset = pbits_offset + num_pbits;
+
+    // Endpoints of the texel subset
+    int e0[4];
+    int e1[4];
+    int e = 2 * subset;
+
+    for (int c = 0; c < 3; ++c)
+    {
+        e0[c] = TextureBC_GetBits(block, endpoints_offset + (c * num_endpoints + e) * color_bits, color_bits);
+        e1[c] = TextureBC_GetBits(block, endpoints_offset + (c * num_endpoints + e + 1) * color_bits, color_bits);
+    }
+
+    int alpha_offset = endpoints_offset + 3 * num_endpoints * color_bits;
+    e0[3] = TextureBC_GetBits(block, alpha_offset + e * alpha_bits, alpha_bits);
+    e1[3] = TextureBC_GetBits(block, alpha_offset + (e + 1) * alpha_bits, alpha_bits);
+
+    if (num_pbits)
+    {
+        int p0 = TextureBC_GetBits(block, pbits_offset + (info[6] ? e : subset), 1);
+        int p1 = TextureBC_GetBits(block, pbits_offset + (info[6] ? e + 1 : subset), 1);
+
+        for (int c = 0; c < 4; ++c)
+        {
+            e0[c] = (e0[c] << 1) | p0;
+            e1[c] = (e1[c] << 1) | p1;
+        }
+
+        ++color_bits;
+        if (alpha_bits) ++alpha_bits;
+    }
+
+    for (int c = 0; c < 3; ++c)
+    {
+        e0[c] = TextureBC_ExpandBC7(e0[c], color_bits);
+        e1[c] = TextureBC_ExpandBC7(e1[c], color_bits);
+    }
+
+    e0[3] = alpha_bits ? TextureBC_ExpandBC7(e0[3], alpha_bits) : 255;
+    e1[3] = alpha_bits ? TextureBC_ExpandBC7(e1[3], alpha_bits) : 255;
+
+    // Primary indices, every anchor texel before this one has one bit less
+    int num_anchors_before = (texel > 0 ? 1 : 0) + (anchor2 < texel ? 1 : 0) + (anchor3 < texel ? 1 : 0);
+    bool is_anchor = texel == 0 || texel == anchor2 || texel == anchor3;
+    int index = TextureBC_GetBits(block, indices_offset + texel * index_bits - num_anchors_before, is_anchor ? index_bits - 1 : index_bits);
+
+    int color_weight = TextureBC_GetWeight(index_bits, index);
+    int alpha_weight = color_weight;
+
+    if (index_bits2)
+    {
+        int indices2_offset = indices_offset + 16 * index_bits - num_subsets;
+        int index2 = TextureBC_GetBits(block, indices2_offset + texel * index_bits2 - (texel > 0 ? 1 : 0), texel == 0 ? index_bits2 - 1 : index_bits2);
+        int weight2 = TextureBC_GetWeight(index_bits2, index2);
+
+        if (index_selection)
+        {
+            alpha_weight = color_weight;
+            color_weight = weight2;
+        }
+        else
+        {
+            alpha_weight = weight2;
+        }
+    }
+
+    int rgba[4];
+    for (int c = 0; c < 3; ++c)
+    {
+        rgba[c] = (e0[c] * (64 - color_weight) + e1[c] * color_weight + 32) >> 6;
+    }
+
+    rgba[3] = (e0[3] * (64 - alpha_weight) + e1[3] * alpha_weight + 32) >> 6;
+
+    if (rotation)
+    {
+        int tmp = rgba[3];
+        rgba[3] = rgba[rotation - 1];
+        rgba[rotation - 1] = tmp;
+    }
+
+    return make_float4(rgba[0], rgba[1], rgba[2], rgba[3]) / 255.f;
+}
+
+/// Fetch texel (x, y) from block compressed level data
+INLINE float4 TextureBC_Fetch(__global char const* mydata, int fmt, int width, int x, int y)
+{
+    int block_size = TextureBC_GetBlockSize(fmt);
+    int block_idx = (y >> 2) * ((width + 3) >> 2) + (x >> 2);
+    int texel = ((y & 3) << 2) + (x & 3);
+
+    __global uint const* block = (__global uint const*)(mydata + block_idx * block_size);
+
+    switch (fmt)
+    {
+        case BC1:
+            return TextureBC_DecodeBC1(vload2(0, block), texel);
+        case BC4:
+            // Replicated like R8
+            return (float4)(TextureBC_DecodeBC4(vload2(0, block), texel));
+        case BC5:
+            return TextureBC_DecodeBC5(vload4(0, block), texel);
+        case BC6H:
+            return TextureBC_DecodeBC6H(vload4(0, block), texel);
+        case BC7:
+            return TextureBC_DecodeBC7(vload4(0, block), texel);
+        default:
+            return make_float4(0.f, 0.f, 0.f, 0.f);
+    }
+}
+
+#endif // TEXTURE_BC_CL
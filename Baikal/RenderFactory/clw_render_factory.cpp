@@ -14,7 +14,7 @@
 
 namespace Baikal
 {
-    ClwRenderFactory::ClwRenderFactory(CLWContext context, std::string const& cache_path)
+    ClwRenderFactory::ClwRenderFactory(CLWContext context, std::string const& cache_path, std::string const& bundle_path)
     : m_context(context)
     , m_cache_path(cache_path)
     , m_program_manager(cache_path)
@@ -28,6 +28,7 @@ namespace Baikal
     )
     
     {
+        m_program_manager.SetProgramBundle(bundle_path);
     }
 
     // Create a renderer of specified type
@@ -79,4 +80,10 @@ namespace Baikal
     {
         return std::make_unique<ClwSceneController>(m_context, m_intersector.get(), &m_program_manager);
     }
+
+    void ClwRenderFactory::WarmUp() const
+    {
+        // Futures are not needed, GetProgram waits for builds in flight
+        m_program_manager.CompileAllAsync();
+    }
 }
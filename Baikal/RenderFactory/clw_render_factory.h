@@ -45,7 +45,8 @@ namespace Baikal
     class ClwRenderFactory : public RenderFactory<ClwScene>
     {
     public:
-        ClwRenderFactory(CLWContext context, std::string const& cache_path="");
+        // Programs are cached in cache_path, precompiled ones are loaded from bundle_path first
+        ClwRenderFactory(CLWContext context, std::string const& cache_path="", std::string const& bundle_path="");
 
         // Create a renderer of specified type
         std::unique_ptr<Renderer> 
@@ -59,6 +60,8 @@ namespace Baikal
 
         std::unique_ptr<SceneController<ClwScene>>
             CreateSceneController() const override;
+        // Compile programs of created objects on the program manager thread pool
+        void WarmUp() const override;
 
     private:
         CLWContext m_context;
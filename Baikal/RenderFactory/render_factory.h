@@ -69,6 +69,10 @@ namespace Baikal
         virtual
         std::unique_ptr<SceneController<Scene>> CreateSceneController() const = 0;
 
+        // Start compiling kernels of created objects in background
+        virtual
+        void WarmUp() const {}
+
         RenderFactory(RenderFactory<Scene> const&) = delete;
         RenderFactory const& operator = (RenderFactory<Scene> const&) = delete;
     };
@@ -64,8 +64,10 @@ namespace Baikal
 #else
         , m_uberv2_kernels(context, program_manager, "../Baikal/Kernels/CL/fill_aovs_uberv2.cl", "")
 #endif
+        , m_profiler(context)
     {
         m_estimator->SetWorkBufferSize(kTileSizeX * kTileSizeY);
+        m_estimator->SetProfiler(&m_profiler);
     }
 
     void MonteCarloRenderer::Clear(RadeonRays::float3 const& val, Output& output) const
@@ -105,6 +107,9 @@ namespace Baikal
         }
 
         ++m_sample_counter;
+
+        // Collect finished commands without waiting, so pending events do not pile up
+        m_profiler.Update();
     }
 
     // Render the scene into the output
@@ -189,10 +194,10 @@ namespace Baikal
 
         // Run shading kernel
         {
-            size_t gs[] = { static_cast<size_t>((tile_size.x + 15) / 16 * 16), static_cast<size_t>((tile_size.y + 15) / 16 * 16) };
+            size_t gs[] = { static_cast<size_t>(tile_size.x), static_cast<size_t>(tile_size.y) };
             size_t ls[] = { 16, 16 };
 
-            GetContext().Launch2D(0, gs, ls, generate_kernel);
+            m_profiler.Record("GenerateTileDomain", CLProfiler::kNoBounce, Launch2D(generate_kernel, gs, ls));
         }
     }
 
@@ -268,7 +273,7 @@ namespace Baikal
         // Intersect ray batch
         m_estimator->TraceFirstHit(scene, num_rays);
 
-        CLWKernel fill_kernel = m_uberv2_kernels.GetKernel("FillAOVsUberV2");
+        CLWKernel fill_kernel = m_uberv2_kernels.GetKernel("FillAOVsUberV2", scene.GetTextureBuildOptions());
 
         auto argc = 0U;
         fill_kernel.SetArg(argc++, m_estimator->GetRayBuffer());
@@ -278,12 +283,12 @@ namespace Baikal
         fill_kernel.SetArg(argc++, scene.vertices);
         fill_kernel.SetArg(argc++, scene.normals);
         fill_kernel.SetArg(argc++, scene.uvs);
+        fill_kernel.SetArg(argc++, scene.tangents);
         fill_kernel.SetArg(argc++, scene.indices);
         fill_kernel.SetArg(argc++, scene.shapes);
         fill_kernel.SetArg(argc++, scene.shapes_additional);
         fill_kernel.SetArg(argc++, scene.material_attributes);
-        fill_kernel.SetArg(argc++, scene.textures);
-        fill_kernel.SetArg(argc++, scene.texturedata);
+        scene.SetTextureArgs(fill_kernel, argc);
         fill_kernel.SetArg(argc++, scene.envmapidx);
         fill_kernel.SetArg(argc++, scene.background_idx);
         fill_kernel.SetArg(argc++, output_size.x);
@@ -315,7 +320,7 @@ namespace Baikal
         // Run AOV kernel
         {
             int globalsize = tile_size.x * tile_size.y;
-            GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, fill_kernel);
+            m_profiler.Record("FillAOVsUberV2", CLProfiler::kNoBounce, Launch1D(fill_kernel, globalsize));
         }
     }
     
@@ -360,7 +365,7 @@ namespace Baikal
 
         {
             int globalsize = tile_size.x * tile_size.y;
-            GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, genkernel);
+            m_profiler.Record(kernel_name.c_str(), CLProfiler::kNoBounce, Launch1D(genkernel, globalsize));
         }
     }
 
@@ -397,12 +402,32 @@ namespace Baikal
         m_estimator->SetMaxBounces(max_bounces);
     }
 
+    void MonteCarloRenderer::SetProfilingEnabled(bool enabled)
+    {
+        m_profiler.SetEnabled(enabled);
+    }
+
+    std::vector<CLProfiler::Statistics> MonteCarloRenderer::GetKernelStatistics(bool wait)
+    {
+        return m_profiler.GetStatistics(wait);
+    }
+
+    void MonteCarloRenderer::ResetKernelStatistics()
+    {
+        m_profiler.Reset();
+    }
+
+    bool MonteCarloRenderer::WriteKernelTrace(std::string const& filename)
+    {
+        return m_profiler.WriteChromeTrace(filename);
+    }
+
     void MonteCarloRenderer::HandleMissedRays(const ClwScene &scene , uint32_t w, uint32_t h,
         CLWBuffer<ray> rays, CLWBuffer<Intersection> intersections, CLWBuffer<int> pixel_indices,
         CLWBuffer<int> output_indices, std::size_t size, CLWBuffer<RadeonRays::float3> output)
     {
         // Fetch kernel
-        auto misskernel = GetKernel("ShadeBackgroundImage") ;
+        auto misskernel = GetKernel("ShadeBackgroundImage", scene.GetTextureBuildOptions());
 
         // Set kernel parameters
         int argc = 0;
@@ -414,12 +439,12 @@ namespace Baikal
         misskernel.SetArg(argc++, scene.background_idx);
         misskernel.SetArg(argc++, w);
         misskernel.SetArg(argc++, h);
-        misskernel.SetArg(argc++, scene.textures);
-        misskernel.SetArg(argc++, scene.texturedata);
+        scene.SetTextureArgs(misskernel, argc);
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            // Primary rays only
+            m_profiler.Record("ShadeBackgroundImage", 0, Launch1D(misskernel, size));
         }
     }
     
@@ -27,11 +27,14 @@ THE SOFTWARE.
 #include "SceneGraph/clwscene.h"
 #include "Controllers/clw_scene_controller.h"
 #include "Utils/clw_class.h"
+#include "Utils/cl_profiler.h"
 #include "Estimators/estimator.h"
 
 #include "CLW.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 
 namespace Baikal
@@ -79,6 +82,14 @@ namespace Baikal
 
         // Set max number of light bounces
         void SetMaxBounces(std::uint32_t max_bounces);
+
+        // Record device times of kernels, requires a queue created with profiling (CLProfiler::CreateContext)
+        void SetProfilingEnabled(bool enabled);
+        // Kernel times per bounce since the last reset
+        std::vector<CLProfiler::Statistics> GetKernelStatistics(bool wait = true);
+        void ResetKernelStatistics();
+        // Write recent kernel launches as Chrome trace JSON
+        bool WriteKernelTrace(std::string const& filename);
         
     protected:
         void GeneratePrimaryRays(
@@ -116,6 +127,7 @@ namespace Baikal
 
     private:
         ClwClass m_uberv2_kernels;
+        CLProfiler m_profiler;
     };
 
 }
@@ -5,6 +5,13 @@
 #include "SceneGraph/scene1.h"
 #include "radeon_rays.h"
 #include "SceneGraph/Collector/collector.h"
+#include "Utils/geometry_dedup.h"
+
+#include <array>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
 namespace Baikal
@@ -20,14 +27,46 @@ namespace Baikal
         kOrthographic
     };
 
+    enum class TextureBackend
+    {
+        // Texels are fetched and filtered from the texture data buffer
+        kBuffer,
+        // Finest levels are additionally sampled through image arrays
+        kImages
+    };
+
     struct ClwScene
     {
         #include "Kernels/CL/payload.cl"
 
-        CLWBuffer<RadeonRays::float3> vertices;
-        CLWBuffer<RadeonRays::float3> normals;
-        CLWBuffer<RadeonRays::float2> uvs;
-        CLWBuffer<int> indices;
+        // Scene features kernels are specialized for, see GetFeatureBuildOptions
+        enum Feature
+        {
+            kFeatureVolumes = 1 << 0,
+            kFeatureEnvironmentLight = 1 << 1,
+            kFeatureAreaLights = 1 << 2,
+            // Point, spot and directional lights
+            kFeatureAnalyticLights = 1 << 3,
+            kFeatureShadingNormals = 1 << 4,
+            kFeatureAll = (1 << 5) - 1
+        };
+
+        // Host memory backing geometry and texture buffers created with CL_MEM_USE_HOST_PTR
+        // (devices sharing memory with host). Declared before buffers to outlive them.
+        std::shared_ptr<void> vertices_storage;
+        std::shared_ptr<void> normals_storage;
+        std::shared_ptr<void> uvs_storage;
+        std::shared_ptr<void> tangents_storage;
+        std::shared_ptr<void> indices_storage;
+        std::shared_ptr<void> texturedata_storage;
+
+        // Raw geometry data, layout is defined per shape by Shape::compression
+        CLWBuffer<char> vertices;
+        CLWBuffer<char> normals;
+        CLWBuffer<char> uvs;
+        // Octahedral encoded per vertex tangents, bitangent sign in bit 16
+        CLWBuffer<char> tangents;
+        CLWBuffer<char> indices;
 
         CLWBuffer<Shape> shapes;
         CLWBuffer<ShapeAdditionalData> shapes_additional;
@@ -37,6 +76,8 @@ namespace Baikal
         CLWBuffer<Volume> volumes;
         CLWBuffer<Texture> textures;
         CLWBuffer<char> texturedata;
+        // Image arrays indexed by TextureImage, valid for TextureBackend::kImages only
+        std::shared_ptr<_cl_mem> texture_images[kTextureImageCount];
 
         CLWBuffer<Camera> camera;
         CLWBuffer<int> light_distributions;
@@ -48,14 +89,89 @@ namespace Baikal
         std::unique_ptr<Bundle> input_map_leafs_bundle;
         std::unique_ptr<Bundle> input_map_bundle;
 
+        // Offset in texturedata each texture id was last uploaded at
+        std::map<std::uint32_t, std::size_t> texture_data_offsets;
+        // Offset in material_attributes of each material id
+        std::unordered_map<std::uint32_t, std::int32_t> material_offsets;
+        // Generated kernel headers, installed into program manager when the scene becomes current
+        std::string uberv2_source;
+        std::string inputmaps_source;
+
+        // Slot of each input map id used by materials, input_map_data starts with a header per slot
+        std::map<std::uint32_t, std::int32_t> input_map_slots;
+        // Host copies of input_map_data contents: headers with leaf indices, then leafs.
+        // Kept as raw entries, InputMapData is not default constructible on host.
+        std::vector<std::array<std::int32_t, 4>> input_map_table;
+        std::vector<std::array<std::int32_t, 4>> input_map_leafs;
+
         int num_lights;
         int num_volumes;
         int envmapidx;
         int background_idx;
         int camera_volume_index;
         CameraType camera_type;
+        TextureBackend texture_backend = TextureBackend::kBuffer;
+        // Mask of Feature values present in the scene, updated by the controller
+        std::uint32_t features = kFeatureAll;
+
+        // Scene meshes compiled as instances of identical ones, the scene graph keeps them as is
+        GeometryDuplicates geometry_duplicates;
 
         std::vector<RadeonRays::Shape*> isect_shapes;
         std::vector<RadeonRays::Shape*> visible_shapes;
+
+        // Build options selecting texture fetch path of kernels using TEXTURE_ARG_LIST
+        char const* GetTextureBuildOptions() const
+        {
+            return GetTextureBuildOptions(texture_backend);
+        }
+
+        static char const* GetTextureBuildOptions(TextureBackend backend)
+        {
+            return backend == TextureBackend::kImages ? " -D BAIKAL_TEXTURE_IMAGES " : "";
+        }
+
+        // Build options removing code paths for features the scene does not use.
+        // Programs keep compiled variants per option string, so kernels are only
+        // rebuilt when the mask changes.
+        std::string GetFeatureBuildOptions() const
+        {
+            static std::pair<std::uint32_t, char const*> const kFeatureDefines[] =
+            {
+                { kFeatureVolumes, " -D BAIKAL_NO_VOLUMES" },
+                { kFeatureEnvironmentLight, " -D BAIKAL_NO_ENVIRONMENT_LIGHT" },
+                { kFeatureAreaLights, " -D BAIKAL_NO_AREA_LIGHTS" },
+                { kFeatureAnalyticLights, " -D BAIKAL_NO_ANALYTIC_LIGHTS" },
+                { kFeatureShadingNormals, " -D BAIKAL_NO_SHADING_NORMALS" }
+            };
+
+            std::string options;
+
+            for (auto const& define : kFeatureDefines)
+            {
+                if ((features & define.first) == 0)
+                {
+                    options.append(define.second);
+                }
+            }
+
+            return options.empty() ? options : options + " ";
+        }
+
+        // Set arguments declared by TEXTURE_ARG_LIST
+        template <typename Index>
+        void SetTextureArgs(CLWKernel& kernel, Index& argc) const
+        {
+            kernel.SetArg(argc++, textures);
+            kernel.SetArg(argc++, texturedata);
+
+            if (texture_backend == TextureBackend::kImages)
+            {
+                for (auto const& image : texture_images)
+                {
+                    kernel.SetArg(argc++, image.get());
+                }
+            }
+        }
     };
 }
@@ -25,6 +25,7 @@ namespace Baikal
         EnvironmentOverride m_environment_override;
 
         DirtyFlags m_dirty_flags;
+        std::uint32_t m_change_count;
         std::mutex m_scene_mutex;
     };
 
@@ -32,6 +33,7 @@ namespace Baikal
     : m_impl(new SceneImpl)
     {
         m_impl->m_camera = nullptr;
+        m_impl->m_change_count = 0;
         ClearDirtyFlags();
     }
 
@@ -50,6 +52,12 @@ namespace Baikal
     void Scene1::SetDirtyFlag(DirtyFlags flag) const
     {
         m_impl->m_dirty_flags = m_impl->m_dirty_flags | flag;
+        ++m_impl->m_change_count;
+    }
+
+    std::uint32_t Scene1::GetChangeCount() const
+    {
+        return m_impl->m_change_count;
     }
 
     void Scene1::SetCamera(Camera::Ptr camera)
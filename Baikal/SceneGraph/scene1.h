@@ -106,6 +106,8 @@ namespace Baikal
         void SetDirtyFlag(DirtyFlags flag) const;
         // Clear all flags
         void ClearDirtyFlags() const;
+        // Number of SetDirtyFlag() calls, tells if the scene changed since a given point
+        std::uint32_t GetChangeCount() const;
 
         // Check if the scene is ready for rendering
         bool IsValid() const;
@@ -7,7 +7,7 @@ namespace Baikal
     static int g_scene_controller_id = -1;
 
     SceneObject::SceneObject()
-        : m_dirty(), m_id(g_next_id++)
+        : m_dirty(), m_change_count(0), m_id(g_next_id++)
     {
     }
 
@@ -25,6 +25,7 @@ namespace Baikal
         {
             // Set all bits to 1
             m_dirty.set();
+            ++m_change_count;
         }
         else
         {
@@ -32,6 +32,7 @@
 #include <memory>
 #include <vector>
 #include <bitset>
+#include <cstdint>
 
 namespace Baikal
 {
@@ -47,6 +48,8 @@ namespace Baikal
         virtual bool IsDirty() const;
         // Set dirty flag
         virtual void SetDirty(bool dirty) const;
+        // Number of times the object has been marked dirty, tells if it changed since a given point
+        std::uint32_t GetChangeCount() const;
 
         // Set & get name
         void SetName(std::string const& name);
@@ -70,6 +73,7 @@ namespace Baikal
         // Bit mask size, equals to bit count of std::uint32_t
         static const int kMaxDirtyBits = 32;
         mutable std::bitset<kMaxDirtyBits> m_dirty;
+        mutable std::uint32_t m_change_count;
 
         std::string m_name;
         std::uint32_t m_id;
@@ -80,6 +84,11 @@ namespace Baikal
     {
     }
 
+    inline std::uint32_t SceneObject::GetChangeCount() const
+    {
+        return m_change_count;
+    }
+
     inline std::string SceneObject::GetName() const
     {
         return m_name;
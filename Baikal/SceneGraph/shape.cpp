@@ -1,15 +1,24 @@
 #include "shape.h"
 #include <cassert>
+#include <stdexcept>
 
 namespace Baikal
 {
     Mesh::Mesh() :
     m_aabb_cached(false)
+    , m_replaced_arrays(0)
+    , m_data_released(false)
+    , m_num_released_vertices(0)
+    , m_num_released_normals(0)
+    , m_num_released_uvs(0)
+    , m_num_released_indices(0)
     {
     }
     
     void Mesh::SetIndices(std::uint32_t const* indices, std::size_t num_indices)
     {
+        BeginReplace(kIndicesArray);
+
         assert(indices);
         assert(num_indices != 0);
         
@@ -23,21 +32,36 @@ namespace Baikal
 
     void Mesh::SetIndices(std::vector<std::uint32_t>&& indices)
     {
+        BeginReplace(kIndicesArray);
         m_indices = std::move(indices);
+        m_aabb_cached = false;
     }
 
     std::size_t Mesh::GetNumIndices() const
     {
-        return m_indices.size();
+        if (m_external.storage)
+        {
+            return m_external.num_indices;
+        }
+
+        return m_data_released && !(m_replaced_arrays & kIndicesArray) ? m_num_released_indices : m_indices.size();
         
     }
     std::uint32_t const* Mesh::GetIndices() const
     {
+        if (m_external.storage)
+        {
+            return m_external.indices;
+        }
+
+        EnsureDataLoaded();
         return &m_indices[0];
     }
     
     void Mesh::SetVertices(RadeonRays::float3 const* vertices, std::size_t num_vertices)
     {
+        BeginReplace(kVerticesArray);
+
         assert(vertices);
         assert(num_vertices != 0);
         
@@ -51,6 +75,8 @@ namespace Baikal
     
     void Mesh::SetVertices(float const* vertices, std::size_t num_vertices)
     {
+        BeginReplace(kVerticesArray);
+
         assert(vertices);
         assert(num_vertices != 0);
         
@@ -70,22 +96,37 @@ namespace Baikal
 
     void Mesh::SetVertices(std::vector<RadeonRays::float3>&& vertices)
     {
+        BeginReplace(kVerticesArray);
         m_vertices = std::move(vertices);
+        m_aabb_cached = false;
     }
 
     
     std::size_t Mesh::GetNumVertices() const
     {
-        return m_vertices.size();
+        if (m_external.storage)
+        {
+            return m_external.num_vertices;
+        }
+
+        return m_data_released && !(m_replaced_arrays & kVerticesArray) ? m_num_released_vertices : m_vertices.size();
     }
     
     RadeonRays::float3 const* Mesh::GetVertices() const
     {
+        if (m_external.storage)
+        {
+            return m_external.vertices;
+        }
+
+        EnsureDataLoaded();
         return &m_vertices[0];
     }
     
     void Mesh::SetNormals(RadeonRays::float3 const* normals, std::size_t num_normals)
     {
+        BeginReplace(kNormalsArray);
+
         assert(normals);
         assert(num_normals != 0);
         
@@ -99,6 +140,8 @@ namespace Baikal
     
     void Mesh::SetNormals(float const* normals, std::size_t num_normals)
     {
+        BeginReplace(kNormalsArray);
+
         assert(normals);
         assert(num_normals != 0);
         
@@ -118,22 +161,37 @@ namespace Baikal
 
     void Mesh::SetNormals(std::vector<RadeonRays::float3>&& normals)
     {
+        BeginReplace(kNormalsArray);
         m_normals = std::move(normals);
+        m_aabb_cached = false;
     }
 
     
     std::size_t Mesh::GetNumNormals() const
     {
-        return m_normals.size();
+        if (m_external.storage)
+        {
+            return m_external.num_normals;
+        }
+
+        return m_data_released && !(m_replaced_arrays & kNormalsArray) ? m_num_released_normals : m_normals.size();
     }
 
     RadeonRays::float3 const* Mesh::GetNormals() const
     {
+        if (m_external.storage)
+        {
+            return m_external.normals;
+        }
+
+        EnsureDataLoaded();
         return &m_normals[0];
     }
 
     void Mesh::SetUVs(RadeonRays::float2 const* uvs, std::size_t num_uvs)
     {
+        BeginReplace(kUVsArray);
+
         assert(uvs);
         assert(num_uvs != 0);
         
@@ -147,6 +205,8 @@ namespace Baikal
     
     void Mesh::SetUVs(float const* uvs, std::size_t num_uvs)
     {
+        BeginReplace(kUVsArray);
+
         assert(uvs);
         assert(num_uvs != 0);
         
@@ -164,19 +224,54 @@ namespace Baikal
 
     void Mesh::SetUVs(std::vector<RadeonRays::float2>&& uvs)
     {
+        BeginReplace(kUVsArray);
         m_uvs = std::move(uvs);
+        m_aabb_cached = false;
     }
 
     std::size_t Mesh::GetNumUVs() const
     {
-        return m_uvs.size();
+        if (m_external.storage)
+        {
+            return m_external.num_uvs;
+        }
+
+        return m_data_released && !(m_replaced_arrays & kUVsArray) ? m_num_released_uvs : m_uvs.size();
     }
     
     RadeonRays::float2 const* Mesh::GetUVs() const
     {
+        if (m_external.storage)
+        {
+            return m_external.uvs;
+        }
+
+        EnsureDataLoaded();
         return &m_uvs[0];
     }
 
+    void Mesh::SetTangents(std::vector<RadeonRays::float4>&& tangents)
+    {
+        BeginReplace(kTangentsArray);
+        m_tangents = std::move(tangents);
+        SetDirty(true);
+    }
+
+    std::size_t Mesh::GetNumTangents() const
+    {
+        return m_external.storage ? m_external.num_tangents : m_tangents.size();
+    }
+
+    RadeonRays::float4 const* Mesh::GetTangents() const
+    {
+        if (m_external.storage)
+        {
+            return m_external.tangents;
+        }
+
+        return m_tangents.empty() ? nullptr : &m_tangents[0];
+    }
+
     RadeonRays::bbox Shape::GetWorldAABB() const
     {
         RadeonRays::bbox result;
@@ -208,10 +303,16 @@ namespace Baikal
     {
         if (!m_aabb_cached)
         {
+            EnsureDataLoaded();
+
+            auto indices = GetIndices();
+            auto vertices = GetVertices();
+            auto num_indices = GetNumIndices();
+
             m_aabb = RadeonRays::bbox();
-            for (std::size_t i = 0; i < m_indices.size(); ++i)
+            for (std::size_t i = 0; i < num_indices; ++i)
             {
-                m_aabb.grow(m_vertices[m_indices[i]]);
+                m_aabb.grow(vertices[indices[i]]);
             }
             m_aabb_cached = true;
         }
@@ -222,7 +323,171 @@ namespace Baikal
     void Mesh::SetDirty(bool dirty) const
     {
         Shape::SetDirty(dirty);
-        m_aabb_cached = false;
+
+        // Released geometry can change only by replacing an array,
+        // so keep AABB available without reloading otherwise
+        if (dirty && (!m_data_released || (m_replaced_arrays & (kVerticesArray | kIndicesArray))))
+        {
+            m_aabb_cached = false;
+        }
+    }
+
+    void Mesh::SetReloadCallback(ReloadCallback callback)
+    {
+        m_reload_callback = callback;
+
+        // Arrays replaced while released are still not restored by the new callback
+        if (!m_data_released)
+        {
+            m_replaced_arrays = 0;
+        }
+    }
+
+    void Mesh::ReleaseData()
+    {
+        if (!m_reload_callback || m_data_released || m_replaced_arrays)
+        {
+            return;
+        }
+
+        // Make sure AABB is available without data
+        GetLocalAABB();
+
+        std::lock_guard<std::mutex> lock(m_reload_mutex);
+
+        m_num_released_vertices = m_vertices.size();
+        m_num_released_normals = m_normals.size();
+        m_num_released_uvs = m_uvs.size();
+        m_num_released_indices = m_indices.size();
+
+        // Swap with empty vectors to actually free memory
+        std::vector<RadeonRays::float3>().swap(m_vertices);
+        std::vector<RadeonRays::float3>().swap(m_normals);
+        std::vector<RadeonRays::float2>().swap(m_uvs);
+        std::vector<std::uint32_t>().swap(m_indices);
+        std::vector<RadeonRays::float4>().swap(m_tangents);
+
+        m_data_released = true;
+    }
+
+    bool Mesh::IsDataReleased() const
+    {
+        return m_data_released;
+    }
+
+    void Mesh::EnsureDataLoaded() const
+    {
+        if (!m_data_released)
+        {
+            return;
+        }
+
+        // Concurrent readers wait for a single reload
+        std::lock_guard<std::mutex> lock(m_reload_mutex);
+
+        if (!m_data_released)
+        {
+            return;
+        }
+
+        if ((m_replaced_arrays & kReloadedArrays) != kReloadedArrays)
+        {
+            std::vector<RadeonRays::float3> vertices(m_num_released_vertices);
+            std::vector<RadeonRays::float3> normals(m_num_released_normals);
+            std::vector<RadeonRays::float2> uvs(m_num_released_uvs);
+            std::vector<std::uint32_t> indices(m_num_released_indices);
+
+            m_reload_callback(vertices, normals, uvs, indices);
+
+            if (vertices.size() != m_num_released_vertices ||
+                normals.size() != m_num_released_normals ||
+                uvs.size() != m_num_released_uvs ||
+                indices.size() != m_num_released_indices)
+            {
+                throw std::runtime_error("Mesh: reloaded data does not match released data");
+            }
+
+            // Replaced arrays are kept, their reloaded copies are dropped
+            if (!(m_replaced_arrays & kVerticesArray))
+            {
+                m_vertices = std::move(vertices);
+            }
+
+            if (!(m_replaced_arrays & kNormalsArray))
+            {
+                m_normals = std::move(normals);
+            }
+
+            if (!(m_replaced_arrays & kUVsArray))
+            {
+                m_uvs = std::move(uvs);
+            }
+
+            if (!(m_replaced_arrays & kIndicesArray))
+            {
+                m_indices = std::move(indices);
+            }
+        }
+
+        m_data_released = false;
+    }
+
+    void Mesh::BeginReplace(Array array)
+    {
+        if (m_data_released)
+        {
+            // Don't reload the array being replaced, the callback keeps restoring the other ones
+            m_replaced_arrays |= array;
+        }
+        else
+        {
+            // Callback can't restore edited data
+            m_reload_callback = nullptr;
+            m_replaced_arrays = 0;
+        }
+
+        CopyExternalData();
+        m_tangents.clear();
+    }
+
+    void Mesh::SetExternalData(ExternalData const& data)
+    {
+        // All arrays are replaced, released data is not reloaded
+        m_reload_callback = nullptr;
+        m_replaced_arrays = 0;
+        m_data_released = false;
+
+        // Free own arrays, external ones are used from now on
+        std::vector<RadeonRays::float3>().swap(m_vertices);
+        std::vector<RadeonRays::float3>().swap(m_normals);
+        std::vector<RadeonRays::float2>().swap(m_uvs);
+        std::vector<std::uint32_t>().swap(m_indices);
+        std::vector<RadeonRays::float4>().swap(m_tangents);
+
+        m_external = data;
+
+        SetDirty(true);
+    }
+
+    bool Mesh::HasExternalData() const
+    {
+        return m_external.storage != nullptr;
+    }
+
+    void Mesh::CopyExternalData()
+    {
+        if (!m_external.storage)
+        {
+            return;
+        }
+
+        m_indices.assign(m_external.indices, m_external.indices + m_external.num_indices);
+        m_vertices.assign(m_external.vertices, m_external.vertices + m_external.num_vertices);
+        m_normals.assign(m_external.normals, m_external.normals + m_external.num_normals);
+        m_uvs.assign(m_external.uvs, m_external.uvs + m_external.num_uvs);
+        m_tangents.assign(m_external.tangents, m_external.tangents + m_external.num_tangents);
+
+        m_external = ExternalData();
     }
 
     RadeonRays::bbox Instance::GetLocalAABB() const
@@ -32,7 +32,10 @@
 #include "math/float2.h"
 #include "math/matrix.h"
 #include "math/bbox.h"
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -161,6 +164,36 @@ namespace Baikal
         std::size_t GetNumUVs() const;
         RadeonRays::float2 const* GetUVs() const;
 
+        // Set and get optional per vertex tangents: xyz is the tangent, w is bitangent sign
+        // (bitangent = w * cross(normal, tangent)). Tangents are derived data: setting any other
+        // array or releasing data drops them and they are generated on scene compile instead.
+        // Setting tangents affects reload callback the same way other setters do.
+        void SetTangents(std::vector<RadeonRays::float4>&& tangents);
+        std::size_t GetNumTangents() const;
+        RadeonRays::float4 const* GetTangents() const;
+
+        // Arrays owned by external storage, e.g. ranges of a memory mapped file
+        struct ExternalData
+        {
+            // Keeps arrays alive while the mesh references them
+            std::shared_ptr<void const> storage;
+            std::uint32_t const* indices = nullptr;
+            std::size_t num_indices = 0;
+            RadeonRays::float3 const* vertices = nullptr;
+            std::size_t num_vertices = 0;
+            RadeonRays::float3 const* normals = nullptr;
+            std::size_t num_normals = 0;
+            RadeonRays::float2 const* uvs = nullptr;
+            std::size_t num_uvs = 0;
+            RadeonRays::float4 const* tangents = nullptr;
+            std::size_t num_tangents = 0;
+        };
+
+        // Reference external arrays instead of copying them. Data is copied
+        // into the mesh on the first edit only.
+        void SetExternalData(ExternalData const& data);
+        bool HasExternalData() const;
+
         // Local space AABB
         RadeonRays::bbox GetLocalAABB() const override;
 
@@ -168,6 +201,24 @@ namespace Baikal
         // m_aabb_cached flag reset
         void SetDirty(bool dirty) const override;
 
+        // Callback restoring mesh data after ReleaseData(), arrays are passed in resized to original sizes
+        using ReloadCallback = std::function<void(std::vector<RadeonRays::float3>& vertices,
+                                                  std::vector<RadeonRays::float3>& normals,
+                                                  std::vector<RadeonRays::float2>& uvs,
+                                                  std::vector<std::uint32_t>& indices)>;
+
+        // Set callback used to restore released data. Any setter call resets
+        // the callback since it can't restore edited data. Setters called while data
+        // is released don't reload it: the replaced array is kept, the other ones are
+        // reloaded on access and the data can't be released again afterwards.
+        void SetReloadCallback(ReloadCallback callback);
+        // Free host copy of mesh data if reload callback is set. Array sizes and
+        // AABB are kept, data is transparently reloaded on the next access.
+        // Reloading is thread safe, so released meshes can be read concurrently.
+        void ReleaseData();
+        // Check if data is released at the moment
+        bool IsDataReleased() const;
+
         // Forbidden stuff
         Mesh(Mesh const&) = delete;
         Mesh& operator = (Mesh const&) = delete;
@@ -176,13 +227,47 @@ namespace Baikal
         Mesh();
         
     private:
-        std::vector<RadeonRays::float3> m_vertices;
-        std::vector<RadeonRays::float3> m_normals;
-        std::vector<RadeonRays::float2> m_uvs;
-        std::vector<std::uint32_t> m_indices;
+        // Arrays which can be replaced by setters
+        enum Array
+        {
+            kVerticesArray = 1 << 0,
+            kNormalsArray = 1 << 1,
+            kUVsArray = 1 << 2,
+            kIndicesArray = 1 << 3,
+            kTangentsArray = 1 << 4,
+            // Arrays restored by reload callback
+            kReloadedArrays = kVerticesArray | kNormalsArray | kUVsArray | kIndicesArray
+        };
+
+        // Restore released data using reload callback
+        void EnsureDataLoaded() const;
+        // Prepare replacing one of the arrays by a setter
+        void BeginReplace(Array array);
+        // Copy external arrays into the mesh before editing
+        void CopyExternalData();
+
+        // Data is mutable since it is reloaded on access after release
+        mutable std::vector<RadeonRays::float3> m_vertices;
+        mutable std::vector<RadeonRays::float3> m_normals;
+        mutable std::vector<RadeonRays::float2> m_uvs;
+        mutable std::vector<std::uint32_t> m_indices;
+        std::vector<RadeonRays::float4> m_tangents;
+        ExternalData m_external;
 
         mutable RadeonRays::bbox m_aabb;
         mutable bool m_aabb_cached;
+
+        ReloadCallback m_reload_callback;
+        // Combination of Array flags reload callback can't restore since they were replaced
+        std::uint32_t m_replaced_arrays;
+        mutable std::atomic<bool> m_data_released;
+        // Serializes reloading released data from concurrent readers
+        mutable std::mutex m_reload_mutex;
+        // Array sizes of released data
+        std::size_t m_num_released_vertices;
+        std::size_t m_num_released_normals;
+        std::size_t m_num_released_uvs;
+        std::size_t m_num_released_indices;
     };
     
     inline Shape::~Shape()
@@ -1,6 +1,7 @@
 #include "texture.h"
 
 #include "Utils/half.h"
+#include "Utils/block_compression.h"
 
 namespace Baikal
 {
@@ -11,7 +12,7 @@ namespace Baikal
         switch (m_format) {
         case Format::kRgba8:
         {
-            auto data = reinterpret_cast<std::uint8_t*>(m_data.get());
+            auto data = reinterpret_cast<std::uint8_t const*>(GetData());
             auto num_elements = m_size.x * m_size.y * m_size.z;
 
 
@@ -28,7 +29,7 @@ namespace Baikal
         }
         case Format::kRgba16:
         {
-            auto data = reinterpret_cast<std::uint16_t*>(m_data.get());
+            auto data = reinterpret_cast<std::uint16_t const*>(GetData());
             auto num_elements = m_size.x * m_size.y * m_size.z;
 
             for (auto i = 0; i < num_elements; ++i)
@@ -50,7 +51,7 @@ namespace Baikal
         }
         case Format::kRgba32:
         {
-            auto data = reinterpret_cast<float*>(m_data.get());
+            auto data = reinterpret_cast<float const*>(GetData());
             auto num_elements = m_size.x * m_size.y * m_size.z;
 
             for (auto i = 0; i < num_elements; ++i)
@@ -65,6 +66,81 @@ namespace Baikal
             avg *= (1.f / num_elements);
             break;
         }
+        case Format::kR8:
+        {
+            auto data = reinterpret_cast<std::uint8_t const*>(GetData());
+            auto num_elements = m_size.x * m_size.y * m_size.z;
+
+            for (auto i = 0; i < num_elements; ++i)
+            {
+                float r = data[i] / 255.f;
+                avg += RadeonRays::float3(r, r, r);
+            }
+
+            avg *= (1.f / num_elements);
+            break;
+        }
+        case Format::kRG8:
+        {
+            auto data = reinterpret_cast<std::uint8_t const*>(GetData());
+            auto num_elements = m_size.x * m_size.y * m_size.z;
+
+            for (auto i = 0; i < num_elements; ++i)
+            {
+                float r = data[2 * i] / 255.f;
+                float g = data[2 * i + 1] / 255.f;
+                avg += RadeonRays::float3(r, g, 0.f);
+            }
+
+            avg *= (1.f / num_elements);
+            break;
+        }
+        case Format::kR16F:
+        {
+            auto data = reinterpret_cast<std::uint16_t const*>(GetData());
+            auto num_elements = m_size.x * m_size.y * m_size.z;
+
+            for (auto i = 0; i < num_elements; ++i)
+            {
+                half hr;
+                hr.setBits(data[i]);
+                float r = hr;
+                avg += RadeonRays::float3(r, r, r);
+            }
+
+            avg *= (1.f / num_elements);
+            break;
+        }
+        case Format::kR32F:
+        {
+            auto data = reinterpret_cast<float const*>(GetData());
+            auto num_elements = m_size.x * m_size.y * m_size.z;
+
+            for (auto i = 0; i < num_elements; ++i)
+            {
+                avg += RadeonRays::float3(data[i], data[i], data[i]);
+            }
+
+            avg *= (1.f / num_elements);
+            break;
+        }
+        case Format::kBC1:
+        case Format::kBC4:
+        case Format::kBC5:
+        case Format::kBC6H:
+        case Format::kBC7:
+        {
+            auto data = DecodeImage(m_format, GetData(), m_size.x, m_size.y * m_size.z);
+            auto num_elements = m_size.x * m_size.y * m_size.z;
+
+            for (auto i = 0; i < num_elements; ++i)
+            {
+                avg += RadeonRays::float3(data[4 * i], data[4 * i + 1], data[4 * i + 2]);
+            }
+
+            avg *= (1.f / num_elements);
+            break;
+        }
         default:
             break;
         }
@@ -77,6 +153,10 @@ namespace Baikal
             TextureConcrete() = default;
             TextureConcrete(char* data, RadeonRays::int3 size, Format format) :
                 Texture(data, size, format) {}
+            TextureConcrete(std::shared_ptr<char const> data, RadeonRays::int3 size, Format format) :
+                Texture(data, size, format) {}
+            TextureConcrete(std::shared_future<std::shared_ptr<char const>> data, RadeonRays::int3 size, Format format) :
+                Texture(data, size, format) {}
         };
     }
 
@@ -87,4 +167,12 @@ namespace Baikal
     Texture::Ptr Texture::Create(char* data, RadeonRays::int3 size, Format format) {
         return std::make_shared<TextureConcrete>(data, size, format);
     }
+
+    Texture::Ptr Texture::Create(std::shared_ptr<char const> data, RadeonRays::int3 size, Format format) {
+        return std::make_shared<TextureConcrete>(data, size, format);
+    }
+
+    Texture::Ptr Texture::Create(std::shared_future<std::shared_ptr<char const>> data, RadeonRays::int3 size, Format format) {
+        return std::make_shared<TextureConcrete>(data, size, format);
+    }
 }
@@ -31,6 +31,8 @@
 #include "math/float3.h"
 #include "math/float2.h"
 #include "math/int3.h"
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
 
@@ -52,11 +54,39 @@ namespace Baikal
         {
             kRgba8,
             kRgba16,
-            kRgba32
+            kRgba32,
+            // Single and dual channel formats, single channel textures
+            // are sampled as (r, r, r, r) and dual channel as (r, g, 0, 1)
+            kR8,
+            kRG8,
+            kR16F,
+            kR32F,
+            // Block compressed formats, data is stored in 4x4 texel blocks
+            kBC1,
+            kBC4,
+            kBC5,
+            kBC6H,
+            kBC7
+        };
+
+        // Texel order in device memory
+        enum class Layout
+        {
+            // Row major
+            kLinear,
+            // Row major 4x4 texel tiles
+            kTiled,
+            // Morton order inside row major 8x8 texel tiles
+            kMorton
         };
 
         using Ptr = std::shared_ptr<Texture>;
         static Ptr Create(char* data, RadeonRays::int3 size, Format format);
+        // Texture referencing read-only data owned by someone else (e.g. mapped file), no copy is made
+        static Ptr Create(std::shared_ptr<char const> data, RadeonRays::int3 size, Format format);
+        // Texture with data produced asynchronously, GetData() waits for it (runs deferred futures).
+        // Produced data has to be of the given size and format.
+        static Ptr Create(std::shared_future<std::shared_ptr<char const>> data, RadeonRays::int3 size, Format format);
         static Ptr Create();
 
         // Destructor (the data is destroyed as well)
@@ -74,9 +104,40 @@ namespace Baikal
         // Get data size in bytes
         std::size_t GetSizeInBytes() const;
 
+        // Data size in bytes for given format and dimensions
+        static std::size_t GetDataSize(Format format, RadeonRays::int3 size);
+        // Size of a single pixel in bytes, 0 for block compressed formats
+        static std::size_t GetPixelSize(Format format);
+        // Number of channels stored per pixel
+        static std::uint32_t GetChannelCount(Format format);
+
         // Average normalized value
         RadeonRays::float3 ComputeAverageValue() const;
 
+        // Enable mip chain generation on upload (enabled by default, 2D textures only)
+        void SetMipmapEnabled(bool enabled);
+        // Check if mip chain is generated for the texture
+        bool IsMipmapEnabled() const;
+
+        // Set preferred texel layout in device memory, linear by default.
+        // Block compressed and 3D textures are always stored linearly.
+        void SetLayout(Layout layout);
+        // Get preferred texel layout
+        Layout GetLayout() const;
+
+        // Callback filling GetSizeInBytes() bytes of released texture data
+        using ReloadCallback = std::function<void(char* data)>;
+
+        // Set callback used to restore released data, SetData() resets it
+        void SetReloadCallback(ReloadCallback callback);
+        // Free host copy of texture data if reload callback is set,
+        // data is transparently reloaded on the next access
+        void ReleaseData();
+        // Check if data is released at the moment
+        bool IsDataReleased() const;
+        // Check if asynchronously produced data hasn't been accessed yet
+        bool IsDataPending() const;
+
         // Disallow copying
         Texture(Texture const&) = delete;
         Texture& operator = (Texture const&) = delete;
@@ -86,20 +147,36 @@ namespace Baikal
         Texture();
         // Note, that texture takes ownership of its data array
         Texture(char* data, RadeonRays::int3 size, Format format);
+        // Shared data is kept alive by the texture
+        Texture(std::shared_ptr<char const> data, RadeonRays::int3 size, Format format);
+        // Data is taken from the future on first access
+        Texture(std::shared_future<std::shared_ptr<char const>> data, RadeonRays::int3 size, Format format);
 
     private:
-        // Image data
-        std::unique_ptr<char[]> m_data;
+        // Image data (mutable since it is reloaded on access after release)
+        mutable std::unique_ptr<char[]> m_data;
+        // Externally owned image data, used instead of m_data if set
+        mutable std::shared_ptr<char const> m_shared_data;
+        // Data being produced, moved to m_shared_data on access
+        mutable std::shared_future<std::shared_ptr<char const>> m_pending_data;
+        // Callback restoring released data
+        ReloadCallback m_reload_callback;
         // Image dimensions
         RadeonRays::int3 m_size;
         // Format
         Format m_format;
+        // Generate mip chain
+        bool m_mipmap_enabled;
+        // Texel layout in device memory
+        Layout m_layout;
     };
 
     inline Texture::Texture()
         : m_data(new char[16])
         , m_size(2, 2, 1)
         , m_format(Format::kRgba8)
+        , m_mipmap_enabled(true)
+        , m_layout(Layout::kLinear)
     {
         // Create checkerboard by default
         m_data[0] = m_data[1] = m_data[2] = m_data[3] = (char)0xFF;
@@ -112,6 +189,34 @@ namespace Baikal
         : m_data(data)
         , m_size(size)
         , m_format(format)
+        , m_mipmap_enabled(true)
+        , m_layout(Layout::kLinear)
+    {
+        if (size.z == 0)
+        {
+            m_size.z = 1;
+        }
+    }
+
+    inline Texture::Texture(std::shared_ptr<char const> data, RadeonRays::int3 size, Format format)
+        : m_shared_data(data)
+        , m_size(size)
+        , m_format(format)
+        , m_mipmap_enabled(true)
+        , m_layout(Layout::kLinear)
+    {
+        if (size.z == 0)
+        {
+            m_size.z = 1;
+        }
+    }
+
+    inline Texture::Texture(std::shared_future<std::shared_ptr<char const>> data, RadeonRays::int3 size, Format format)
+        : m_pending_data(data)
+        , m_size(size)
+        , m_format(format)
+        , m_mipmap_enabled(true)
+        , m_layout(Layout::kLinear)
     {
         if (size.z == 0)
         {
@@ -121,6 +226,9 @@ namespace Baikal
 
     inline void Texture::SetData(char* data, RadeonRays::int3 size, Format format)
     {
+        m_reload_callback = nullptr;
+        m_shared_data.reset();
+        m_pending_data = {};
         m_data.reset(data);
         m_size = size;
 
@@ -140,32 +248,131 @@ namespace Baikal
 
     inline char const* Texture::GetData() const
     {
+        if (m_pending_data.valid())
+        {
+            m_shared_data = m_pending_data.get();
+            m_pending_data = {};
+        }
+
+        if (m_shared_data)
+        {
+            return m_shared_data.get();
+        }
+
+        if (!m_data && m_reload_callback)
+        {
+            std::unique_ptr<char[]> data(new char[GetSizeInBytes()]);
+            m_reload_callback(data.get());
+            m_data = std::move(data);
+        }
+
         return m_data.get();
     }
 
+    inline void Texture::SetReloadCallback(ReloadCallback callback)
+    {
+        m_reload_callback = callback;
+    }
+
+    inline void Texture::ReleaseData()
+    {
+        if (m_reload_callback && !m_pending_data.valid())
+        {
+            m_data.reset();
+            m_shared_data.reset();
+        }
+    }
+
+    inline bool Texture::IsDataReleased() const
+    {
+        return !m_data && !m_shared_data && !m_pending_data.valid();
+    }
+
+    inline bool Texture::IsDataPending() const
+    {
+        return m_pending_data.valid();
+    }
+
+    inline void Texture::SetMipmapEnabled(bool enabled)
+    {
+        if (m_mipmap_enabled != enabled)
+        {
+            m_mipmap_enabled = enabled;
+            SetDirty(true);
+        }
+    }
+
+    inline bool Texture::IsMipmapEnabled() const
+    {
+        return m_mipmap_enabled;
+    }
+
+    inline void Texture::SetLayout(Layout layout)
+    {
+        if (m_layout != layout)
+        {
+            m_layout = layout;
+            SetDirty(true);
+        }
+    }
+
+    inline Texture::Layout Texture::GetLayout() const
+    {
+        return m_layout;
+    }
+
     inline Texture::Format Texture::GetFormat() const
     {
         return m_format;
     }
 
-    inline std::size_t Texture::GetSizeInBytes() const
+    inline std::size_t Texture::GetPixelSize(Format format)
     {
-        std::uint32_t component_size = 1;
-
-        switch (m_format) {
-        case Format::kRgba8:
-            component_size = 1;
-            break;
-        case Format::kRgba16:
-            component_size = 2;
-            break;
-        case Format::kRgba32:
-            component_size = 4;
-            break;
+        switch (format) {
+        case Format::kRgba8: return 4;
+        case Format::kRgba16: return 8;
+        case Format::kRgba32: return 16;
+        case Format::kR8: return 1;
+        case Format::kRG8: return 2;
+        case Format::kR16F: return 2;
+        case Format::kR32F: return 4;
+        default: return 0;
+        }
+    }
+
+    inline std::uint32_t Texture::GetChannelCount(Format format)
+    {
+        switch (format) {
+        case Format::kR8:
+        case Format::kR16F:
+        case Format::kR32F:
+        case Format::kBC4:
+            return 1;
+        case Format::kRG8:
+        case Format::kBC5:
+            return 2;
         default:
-            break;
+            return 4;
         }
+    }
 
-        return 4 * component_size * m_size.x * m_size.y * m_size.z;
+    inline std::size_t Texture::GetDataSize(Format format, RadeonRays::int3 size)
+    {
+        switch (format) {
+        case Format::kBC1:
+        case Format::kBC4:
+            return 8 * ((size.x + 3) / 4) * ((size.y + 3) / 4) * size.z;
+        case Format::kBC5:
+        case Format::kBC6H:
+        case Format::kBC7:
+            return 16 * ((size.x + 3) / 4) * ((size.y + 3) / 4) * size.z;
+        default:
+            return GetPixelSize(format) * size.x * size.y * size.z;
+        }
+    }
+
+    inline std::size_t Texture::GetSizeInBytes() const
+    {
+        return GetDataSize(m_format, m_size);
     }
 }
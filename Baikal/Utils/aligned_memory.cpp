@@ -0,0 +1,70 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Utils/aligned_memory.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <malloc.h>
+#include <Windows.h>
+#else
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+
+namespace Baikal
+{
+    std::size_t GetPageSize()
+    {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<std::size_t>(info.dwPageSize);
+#else
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    std::shared_ptr<void> AllocateAligned(std::size_t size, std::size_t alignment)
+    {
+#ifdef _WIN32
+        void* ptr = _aligned_malloc(size, alignment);
+
+        if (!ptr)
+        {
+            throw std::runtime_error("AllocateAligned: failed to allocate memory");
+        }
+
+        return std::shared_ptr<void>(ptr, [](void* p) { _aligned_free(p); });
+#else
+        void* ptr = nullptr;
+
+        if (posix_memalign(&ptr, alignment, size) != 0)
+        {
+            throw std::runtime_error("AllocateAligned: failed to allocate memory");
+        }
+
+        return std::shared_ptr<void>(ptr, [](void* p) { free(p); });
+#endif
+    }
+}
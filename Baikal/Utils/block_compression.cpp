@@ -0,0 +1,838 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Utils/block_compression.h"
+#include "Utils/half.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        // BC7 two subset partitions, bit i is the subset of texel i
+        std::uint16_t const kPartitions2[64] =
+        {
+            0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+            0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+            0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+            0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+            0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+            0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+            0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+            0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+        };
+
+        // BC7 three subset partitions, 2 bits per texel
+        std::uint32_t const kPartitions3[64] =
+        {
+            0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+            0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+            0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+            0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+            0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+            0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+            0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+            0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+        };
+
+        // Anchor texels of the second subset (two subsets) and
+        // second and third subsets (three subsets)
+        std::uint8_t const kAnchors2[64] =
+        {
+            15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+            15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+            15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+            6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+        };
+
+        std::uint8_t const kAnchors31[64] =
+        {
+            3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+            3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+            8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+            3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+        };
+
+        std::uint8_t const kAnchors32[64] =
+        {
+            15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+            15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+            15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+            15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+        };
+
+        int const kWeights2[] = { 0, 21, 43, 64 };
+        int const kWeights3[] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+        int const kWeights4[] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        int const* GetWeights(int bits)
+        {
+            return bits == 2 ? kWeights2 : (bits == 3 ? kWeights3 : kWeights4);
+        }
+
+        // Bits are read starting from the least significant bit of the first byte
+        class BitReader
+        {
+        public:
+            BitReader(std::uint8_t const* data, int offset = 0) : m_data(data), m_offset(offset) {}
+
+            std::uint32_t Read(int count)
+            {
+                std::uint32_t value = 0;
+                for (int i = 0; i < count; ++i, ++m_offset)
+                {
+                    value |= ((m_data[m_offset >> 3] >> (m_offset & 7)) & 1u) << i;
+                }
+                return value;
+            }
+
+            int GetOffset() const { return m_offset; }
+
+        private:
+            std::uint8_t const* m_data;
+            int m_offset;
+        };
+
+        void DecodeColor565(std::uint16_t color, float* out)
+        {
+            int r = (color >> 11) & 0x1F;
+            int g = (color >> 5) & 0x3F;
+            int b = color & 0x1F;
+            out[0] = ((r << 3) | (r >> 2)) / 255.f;
+            out[1] = ((g << 2) | (g >> 4)) / 255.f;
+            out[2] = ((b << 3) | (b >> 2)) / 255.f;
+            out[3] = 1.f;
+        }
+
+        void DecodeBC1(std::uint8_t const* block, float* texels)
+        {
+            auto c0 = static_cast<std::uint16_t>(block[0] | (block[1] << 8));
+            auto c1 = static_cast<std::uint16_t>(block[2] | (block[3] << 8));
+
+            float palette[4][4];
+            DecodeColor565(c0, palette[0]);
+            DecodeColor565(c1, palette[1]);
+
+            for (int c = 0; c < 3; ++c)
+            {
+                if (c0 > c1)
+                {
+                    palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+                    palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+                }
+                else
+                {
+                    palette[2][c] = 0.5f * (palette[0][c] + palette[1][c]);
+                    palette[3][c] = 0.f;
+                }
+            }
+
+            palette[2][3] = 1.f;
+            palette[3][3] = c0 > c1 ? 1.f : 0.f;
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int index = (block[4 + (i >> 2)] >> ((i & 3) * 2)) & 3;
+                std::copy(palette[index], palette[index] + 4, texels + 4 * i);
+            }
+        }
+
+        // Decode single channel block into every 4th float of the output
+        void DecodeBC4(std::uint8_t const* block, float* texels)
+        {
+            int r0 = block[0];
+            int r1 = block[1];
+
+            BitReader reader(block, 16);
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int index = reader.Read(3);
+                float value;
+
+                if (index < 2)
+                {
+                    value = static_cast<float>(index == 0 ? r0 : r1);
+                }
+                else if (r0 > r1)
+                {
+                    value = (r0 * (8 - index) + r1 * (index - 1)) / 7.f;
+                }
+                else if (index < 6)
+                {
+                    value = (r0 * (6 - index) + r1 * (index - 1)) / 5.f;
+                }
+                else
+                {
+                    value = index == 6 ? 0.f : 255.f;
+                }
+
+                texels[4 * i] = value / 255.f;
+            }
+        }
+
+        enum Bc6Field
+        {
+            RW, GW, BW, RX, GX, BX, RY, GY, BY, RZ, GZ, BZ, D
+        };
+
+        struct Bc6Segment
+        {
+            std::uint8_t field;
+            std::uint8_t shift;
+            std::uint8_t count;
+        };
+
+        struct Bc6Mode
+        {
+            std::uint8_t code;
+            bool transformed;
+            bool two_regions;
+            int endpoint_bits;
+            int delta_bits[3];
+            Bc6Segment layout[24];
+        };
+
+        // Field layout following the mode bits
+        Bc6Mode const kBc6Modes[14] =
+        {
+            { 0x00, true, true, 10, { 5, 5, 5 },
+                { { GY, 4, 1 }, { BY, 4, 1 }, { BZ, 4, 1 }, { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 } } },
+            { 0x01, true, true, 7, { 6, 6, 6 },
+                { { GY, 5, 1 }, { GZ, 4, 1 }, { GZ, 5, 1 }, { RW, 0, 7 }, { BZ, 0, 1 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 7 }, { BY, 5, 1 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 7 }, { BZ, 3, 1 }, { BZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 }, { RY, 0, 6 }, { RZ, 0, 6 }, { D, 0, 5 } } },
+            { 0x02, true, true, 11, { 5, 4, 4 },
+                { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 5 }, { RW, 10, 1 }, { GY, 0, 4 }, { GX, 0, 4 }, { GW, 10, 1 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 4 }, { BW, 10, 1 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 } } },
+            { 0x06, true, true, 11, { 4, 5, 4 },
+                { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 10, 1 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { GW, 10, 1 }, { GZ, 0, 4 }, { BX, 0, 4 }, { BW, 10, 1 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 4 }, { BZ, 0, 1 }, { BZ, 2, 1 }, { RZ, 0, 4 }, { GY, 4, 1 }, { BZ, 3, 1 }, { D, 0, 5 } } },
+            { 0x0A, true, true, 11, { 4, 4, 5 },
+                { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 10, 1 }, { BY, 4, 1 }, { GY, 0, 4 }, { GX, 0, 4 }, { GW, 10, 1 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BW, 10, 1 }, { BY, 0, 4 }, { RY, 0, 4 }, { BZ, 1, 1 }, { BZ, 2, 1 }, { RZ, 0, 4 }, { BZ, 4, 1 }, { BZ, 3, 1 }, { D, 0, 5 } } },
+            { 0x0E, true, true, 9, { 5, 5, 5 },
+                { { RW, 0, 9 }, { BY, 4, 1 }, { GW, 0, 9 }, { GY, 4, 1 }, { BW, 0, 9 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 } } },
+            { 0x12, true, true, 8, { 6, 5, 5 },
+                { { RW, 0, 8 }, { GZ, 4, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 8 }, { BZ, 3, 1 }, { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 6 }, { RZ, 0, 6 }, { D, 0, 5 } } },
+            { 0x16, true, true, 8, { 5, 6, 5 },
+                { { RW, 0, 8 }, { BZ, 0, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { GY, 5, 1 }, { GY, 4, 1 }, { BW, 0, 8 }, { GZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 } } },
+            { 0x1A, true, true, 8, { 5, 5, 6 },
+                { { RW, 0, 8 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { BY, 5, 1 }, { GY, 4, 1 }, { BW, 0, 8 }, { BZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 } } },
+            { 0x1E, false, true, 6, { 6, 6, 6 },
+                { { RW, 0, 6 }, { GZ, 4, 1 }, { BZ, 0, 1 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 6 }, { GY, 5, 1 }, { BY, 5, 1 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 6 }, { GZ, 5, 1 }, { BZ, 3, 1 }, { BZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 }, { RY, 0, 6 }, { RZ, 0, 6 }, { D, 0, 5 } } },
+            { 0x03, false, false, 10, { 10, 10, 10 },
+                { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 10 }, { GX, 0, 10 }, { BX, 0, 10 } } },
+            { 0x07, true, false, 11, { 9, 9, 9 },
+                { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 9 }, { RW, 10, 1 }, { GX, 0, 9 }, { GW, 10, 1 }, { BX, 0, 9 }, { BW, 10, 1 } } },
+            { 0x0B, true, false, 12, { 8, 8, 8 },
+                { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 8 }, { RW, 11, 1 }, { RW, 10, 1 }, { GX, 0, 8 }, { GW, 11, 1 }, { GW, 10, 1 }, { BX, 0, 8 }, { BW, 11, 1 }, { BW, 10, 1 } } },
+            { 0x0F, true, false, 16, { 4, 4, 4 },
+                { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 15, 1 }, { RW, 14, 1 }, { RW, 13, 1 }, { RW, 12, 1 }, { RW, 11, 1 }, { RW, 10, 1 }, { GX, 0, 4 }, { GW, 15, 1 }, { GW, 14, 1 }, { GW, 13, 1 }, { GW, 12, 1 }, { GW, 11, 1 }, { GW, 10, 1 }, { BX, 0, 4 }, { BW, 15, 1 }, { BW, 14, 1 }, { BW, 13, 1 }, { BW, 12, 1 }, { BW, 11, 1 }, { BW, 10, 1 } } }
+        };
+
+        int SignExtend(int value, int bits)
+        {
+            int shift = 32 - bits;
+            return static_cast<int>(static_cast<std::uint32_t>(value) << shift) >> shift;
+        }
+
+        int UnquantizeBC6(int value, int bits)
+        {
+            if (bits >= 15) return value;
+            if (value == 0) return 0;
+            if (value == (1 << bits) - 1) return 0xFFFF;
+            return ((value << 16) + 0x8000) >> bits;
+        }
+
+        void DecodeBC6H(std::uint8_t const* block, float* texels)
+        {
+            BitReader reader(block);
+
+            std::uint32_t code = reader.Read(2);
+            if (code > 1)
+            {
+                code |= reader.Read(3) << 2;
+            }
+
+            Bc6Mode const* mode = nullptr;
+            for (auto const& m : kBc6Modes)
+            {
+                if (m.code == code)
+                {
+                    mode = &m;
+                    break;
+                }
+            }
+
+            if (!mode)
+            {
+                std::fill(texels, texels + 64, 0.f);
+                for (int i = 0; i < 16; ++i) texels[4 * i + 3] = 1.f;
+                return;
+            }
+
+            int fields[13] = {};
+            for (auto const& segment : mode->layout)
+            {
+                if (!segment.count) break;
+                fields[segment.field] |= reader.Read(segment.count) << segment.shift;
+            }
+
+            // endpoints[region * 2 + end][channel]
+            int endpoints[4][3];
+            int num_endpoints = mode->two_regions ? 4 : 2;
+            int mask = (1 << mode->endpoint_bits) - 1;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                endpoints[0][c] = fields[RW + c];
+
+                for (int e = 1; e < num_endpoints; ++e)
+                {
+                    int value = fields[RW + 3 * e + c];
+
+                    if (mode->transformed)
+                    {
+                        value = (endpoints[0][c] + SignExtend(value, mode->delta_bits[c])) & mask;
+                    }
+
+                    endpoints[e][c] = value;
+                }
+
+                for (int e = 0; e < num_endpoints; ++e)
+                {
+                    endpoints[e][c] = UnquantizeBC6(endpoints[e][c], mode->endpoint_bits);
+                }
+            }
+
+            int partition = fields[D];
+            int index_bits = mode->two_regions ? 3 : 4;
+            auto weights = GetWeights(index_bits);
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int region = mode->two_regions ? (kPartitions2[partition] >> i) & 1 : 0;
+                bool anchor = i == 0 || (mode->two_regions && i == kAnchors2[partition]);
+                int index = reader.Read(anchor ? index_bits - 1 : index_bits);
+                int weight = weights[index];
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    int a = endpoints[2 * region][c];
+                    int b = endpoints[2 * region + 1][c];
+                    int value = (a * (64 - weight) + b * weight + 32) >> 6;
+
+                    half h;
+                    h.setBits(static_cast<unsigned short>((value * 31) >> 6));
+                    texels[4 * i + c] = h;
+                }
+
+                texels[4 * i + 3] = 1.f;
+            }
+        }
+
+        struct Bc7Mode
+        {
+            int num_subsets;
+            int partition_bits;
+            int rotation_bits;
+            int index_selection_bits;
+            int color_bits;
+            int alpha_bits;
+            int endpoint_pbits;
+            int shared_pbits;
+            int index_bits;
+            int index_bits2;
+        };
+
+        Bc7Mode const kBc7Modes[8] =
+        {
+            { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+            { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+            { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+            { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+            { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+            { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+            { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+            { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+        };
+
+        int GetBC7Subset(int num_subsets, int partition, int texel)
+        {
+            switch (num_subsets)
+            {
+            case 2: return (kPartitions2[partition] >> texel) & 1;
+            case 3: return (kPartitions3[partition] >> (2 * texel)) & 3;
+            default: return 0;
+            }
+        }
+
+        bool IsBC7Anchor(int num_subsets, int partition, int texel)
+        {
+            switch (num_subsets)
+            {
+            case 2: return texel == 0 || texel == kAnchors2[partition];
+            case 3: return texel == 0 || texel == kAnchors31[partition] || texel == kAnchors32[partition];
+            default: return texel == 0;
+            }
+        }
+
+        void DecodeBC7(std::uint8_t const* block, float* texels)
+        {
+            int mode_index = 0;
+            while (mode_index < 8 && !(block[0] & (1 << mode_index)))
+            {
+                ++mode_index;
+            }
+
+            // Reserved mode
+            if (mode_index == 8)
+            {
+                std::fill(texels, texels + 64, 0.f);
+                return;
+            }
+
+            auto const& mode = kBc7Modes[mode_index];
+            BitReader reader(block, mode_index + 1);
+
+            int partition = reader.Read(mode.partition_bits);
+            int rotation = reader.Read(mode.rotation_bits);
+            int index_selection = reader.Read(mode.index_selection_bits);
+
+            int num_endpoints = 2 * mode.num_subsets;
+            int endpoints[6][4] = {};
+
+            for (int c = 0; c < 3; ++c)
+            {
+                for (int e = 0; e < num_endpoints; ++e)
+                {
+                    endpoints[e][c] = reader.Read(mode.color_bits);
+                }
+            }
+
+            for (int e = 0; e < num_endpoints; ++e)
+            {
+                endpoints[e][3] = mode.alpha_bits ? reader.Read(mode.alpha_bits) : 255;
+            }
+
+            int color_bits = mode.color_bits;
+            int alpha_bits = mode.alpha_bits;
+
+            if (mode.endpoint_pbits || mode.shared_pbits)
+            {
+                int pbits[6];
+
+                if (mode.endpoint_pbits)
+                {
+                    for (int e = 0; e < num_endpoints; ++e) pbits[e] = reader.Read(1);
+                }
+                else
+                {
+                    for (int s = 0; s < mode.num_subsets; ++s) pbits[2 * s] = pbits[2 * s + 1] = reader.Read(1);
+                }
+
+                for (int e = 0; e < num_endpoints; ++e)
+                {
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        endpoints[e][c] = (endpoints[e][c] << 1) | pbits[e];
+                    }
+
+                    if (alpha_bits)
+                    {
+                        endpoints[e][3] = (endpoints[e][3] << 1) | pbits[e];
+                    }
+                }
+
+                ++color_bits;
+                if (alpha_bits) ++alpha_bits;
+            }
+
+            for (int e = 0; e < num_endpoints; ++e)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    int v = endpoints[e][c] << (8 - color_bits);
+                    endpoints[e][c] = v | (v >> color_bits);
+                }
+
+                if (alpha_bits)
+                {
+                    int v = endpoints[e][3] << (8 - alpha_bits);
+                    endpoints[e][3] = v | (v >> alpha_bits);
+                }
+            }
+
+            int indices[16];
+            int indices2[16] = {};
+
+            for (int i = 0; i < 16; ++i)
+            {
+                bool anchor = IsBC7Anchor(mode.num_subsets, partition, i);
+                indices[i] = reader.Read(anchor ? mode.index_bits - 1 : mode.index_bits);
+            }
+
+            if (mode.index_bits2)
+            {
+                for (int i = 0; i < 16; ++i)
+                {
+                    indices2[i] = reader.Read(i == 0 ? mode.index_bits2 - 1 : mode.index_bits2);
+                }
+            }
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int subset = GetBC7Subset(mode.num_subsets, partition, i);
+                auto const& e0 = endpoints[2 * subset];
+                auto const& e1 = endpoints[2 * subset + 1];
+
+                int color_weight = GetWeights(mode.index_bits)[indices[i]];
+                int alpha_weight = color_weight;
+
+                if (mode.index_bits2)
+                {
+                    alpha_weight = GetWeights(mode.index_bits2)[indices2[i]];
+
+                    if (index_selection)
+                    {
+                        color_weight = GetWeights(mode.index_bits2)[indices2[i]];
+                        alpha_weight = GetWeights(mode.index_bits)[indices[i]];
+                    }
+                }
+
+                int rgba[4];
+                for (int c = 0; c < 3; ++c)
+                {
+                    rgba[c] = (e0[c] * (64 - color_weight) + e1[c] * color_weight + 32) >> 6;
+                }
+
+                rgba[3] = (e0[3] * (64 - alpha_weight) + e1[3] * alpha_weight + 32) >> 6;
+
+                if (rotation)
+                {
+                    std::swap(rgba[3], rgba[rotation - 1]);
+                }
+
+                for (int c = 0; c < 4; ++c)
+                {
+                    texels[4 * i + c] = rgba[c] / 255.f;
+                }
+            }
+        }
+
+        std::uint8_t ToUnorm8(float value)
+        {
+            return static_cast<std::uint8_t>(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+        }
+
+        // Range fit: endpoints are min and max of the channel, every texel
+        // gets the closest of the 8 interpolated values
+        void EncodeBC4(float const* texels, std::uint8_t* block)
+        {
+            std::uint8_t values[16];
+            std::uint8_t min_value = 255;
+            std::uint8_t max_value = 0;
+
+            for (int i = 0; i < 16; ++i)
+            {
+                values[i] = ToUnorm8(texels[4 * i]);
+                min_value = std::min(min_value, values[i]);
+                max_value = std::max(max_value, values[i]);
+            }
+
+            std::memset(block, 0, 8);
+            block[0] = max_value;
+            block[1] = min_value;
+
+            if (max_value == min_value)
+            {
+                return;
+            }
+
+            int offset = 16;
+            for (int i = 0; i < 16; ++i)
+            {
+                int step = static_cast<int>(std::lround((max_value - values[i]) * 7.f / (max_value - min_value)));
+                int index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+
+                for (int b = 0; b < 3; ++b, ++offset)
+                {
+                    block[offset >> 3] |= static_cast<std::uint8_t>(((index >> b) & 1) << (offset & 7));
+                }
+            }
+        }
+
+        std::uint16_t ToColor565(float const* color)
+        {
+            auto r = static_cast<int>(std::min(std::max(color[0], 0.f), 1.f) * 31.f + 0.5f);
+            auto g = static_cast<int>(std::min(std::max(color[1], 0.f), 1.f) * 63.f + 0.5f);
+            auto b = static_cast<int>(std::min(std::max(color[2], 0.f), 1.f) * 31.f + 0.5f);
+            return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+        }
+
+        // Range fit along the bounding box diagonal, alpha is ignored
+        void EncodeBC1(float const* texels, std::uint8_t* block)
+        {
+            float min_color[3] = { 1.f, 1.f, 1.f };
+            float max_color[3] = { 0.f, 0.f, 0.f };
+            float mean[3] = { 0.f, 0.f, 0.f };
+
+            for (int i = 0; i < 16; ++i)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    float value = std::min(std::max(texels[4 * i + c], 0.f), 1.f);
+                    min_color[c] = std::min(min_color[c], value);
+                    max_color[c] = std::max(max_color[c], value);
+                    mean[c] += value / 16.f;
+                }
+            }
+
+            // Pick the diagonal of the box matching the direction of the color spread:
+            // channels anticorrelated with the widest one go from max to min
+            int widest = 0;
+            for (int c = 1; c < 3; ++c)
+            {
+                if (max_color[c] - min_color[c] > max_color[widest] - min_color[widest]) widest = c;
+            }
+
+            for (int c = 0; c < 3; ++c)
+            {
+                float covariance = 0.f;
+                for (int i = 0; i < 16; ++i)
+                {
+                    covariance += (std::min(std::max(texels[4 * i + c], 0.f), 1.f) - mean[c]) *
+                        (std::min(std::max(texels[4 * i + widest], 0.f), 1.f) - mean[widest]);
+                }
+
+                if (covariance < 0.f)
+                {
+                    std::swap(min_color[c], max_color[c]);
+                }
+            }
+
+            auto c0 = ToColor565(max_color);
+            auto c1 = ToColor565(min_color);
+
+            std::memset(block, 0, 8);
+
+            if (c0 < c1)
+            {
+                std::swap(c0, c1);
+                std::swap(min_color, max_color);
+            }
+
+            block[0] = c0 & 0xFF;
+            block[1] = c0 >> 8;
+            block[2] = c1 & 0xFF;
+            block[3] = c1 >> 8;
+
+            // All indices 0 pick c0
+            if (c0 == c1)
+            {
+                return;
+            }
+
+            float axis[3];
+            float length2 = 0.f;
+            for (int c = 0; c < 3; ++c)
+            {
+                axis[c] = min_color[c] - max_color[c];
+                length2 += axis[c] * axis[c];
+            }
+
+            int const remap[4] = { 0, 2, 3, 1 };
+
+            for (int i = 0; i < 16; ++i)
+            {
+                float t = 0.f;
+                for (int c = 0; c < 3; ++c)
+                {
+                    t += (std::min(std::max(texels[4 * i + c], 0.f), 1.f) - max_color[c]) * axis[c];
+                }
+
+                t = length2 > 0.f ? std::min(std::max(t / length2, 0.f), 1.f) : 0.f;
+                int index = remap[static_cast<int>(std::lround(t * 3.f))];
+                block[4 + (i >> 2)] |= static_cast<std::uint8_t>(index << ((i & 3) * 2));
+            }
+        }
+    }
+
+    bool IsBlockCompressed(Texture::Format format)
+    {
+        switch (format)
+        {
+        case Texture::Format::kBC1:
+        case Texture::Format::kBC4:
+        case Texture::Format::kBC5:
+        case Texture::Format::kBC6H:
+        case Texture::Format::kBC7:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    std::size_t GetBlockSize(Texture::Format format)
+    {
+        switch (format)
+        {
+        case Texture::Format::kBC1:
+        case Texture::Format::kBC4:
+            return 8;
+        case Texture::Format::kBC5:
+        case Texture::Format::kBC6H:
+        case Texture::Format::kBC7:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    bool IsBlockEncodingSupported(Texture::Format format)
+    {
+        return format == Texture::Format::kBC1 ||
+            format == Texture::Format::kBC4 ||
+            format == Texture::Format::kBC5;
+    }
+
+    void DecodeBlock(Texture::Format format, std::uint8_t const* block, float* texels)
+    {
+        switch (format)
+        {
+        case Texture::Format::kBC1:
+            DecodeBC1(block, texels);
+            break;
+        case Texture::Format::kBC4:
+            // Same expansion as R8 and RG8 in texture.cl
+            DecodeBC4(block, texels);
+            for (int i = 0; i < 16; ++i)
+            {
+                texels[4 * i + 1] = texels[4 * i + 2] = texels[4 * i + 3] = texels[4 * i];
+            }
+            break;
+        case Texture::Format::kBC5:
+            DecodeBC4(block, texels);
+            DecodeBC4(block + 8, texels + 1);
+            for (int i = 0; i < 16; ++i)
+            {
+                texels[4 * i + 2] = 0.f;
+                texels[4 * i + 3] = 1.f;
+            }
+            break;
+        case Texture::Format::kBC6H:
+            DecodeBC6H(block, texels);
+            break;
+        case Texture::Format::kBC7:
+            DecodeBC7(block, texels);
+            break;
+        default:
+            throw std::runtime_error("DecodeBlock: texture format is not block compressed");
+        }
+    }
+
+    void EncodeBlock(Texture::Format format, float const* texels, std::uint8_t* block)
+    {
+        switch (format)
+        {
+        case Texture::Format::kBC1:
+            EncodeBC1(texels, block);
+            break;
+        case Texture::Format::kBC4:
+            EncodeBC4(texels, block);
+            break;
+        case Texture::Format::kBC5:
+            EncodeBC4(texels, block);
+            EncodeBC4(texels + 1, block + 8);
+            break;
+        default:
+            throw std::runtime_error("EncodeBlock: block encoding is not supported for the format");
+        }
+    }
+
+    std::vector<float> DecodeImage(Texture::Format format, char const* data, int width, int height)
+    {
+        std::vector<float> result(4 * width * height);
+
+        int blocks_x = (width + 3) / 4;
+        int blocks_y = (height + 3) / 4;
+        auto block_size = GetBlockSize(format);
+        auto block = reinterpret_cast<std::uint8_t const*>(data);
+
+        float texels[64];
+
+        for (int by = 0; by < blocks_y; ++by)
+        {
+            for (int bx = 0; bx < blocks_x; ++bx, block += block_size)
+            {
+                DecodeBlock(format, block, texels);
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    int x = 4 * bx + (i & 3);
+                    int y = 4 * by + (i >> 2);
+
+                    if (x < width && y < height)
+                    {
+                        std::copy(texels + 4 * i, texels + 4 * i + 4, &result[4 * (y * width + x)]);
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+
+    char* EncodeImage(Texture::Format format, float const* texels, int width, int height)
+    {
+        if (!IsBlockEncodingSupported(format))
+        {
+            throw std::runtime_error("EncodeImage: block encoding is not supported for the format");
+        }
+
+        int blocks_x = (width + 3) / 4;
+        int blocks_y = (height + 3) / 4;
+        auto block_size = GetBlockSize(format);
+
+        auto data = new char[blocks_x * blocks_y * block_size];
+        auto block = reinterpret_cast<std::uint8_t*>(data);
+
+        float block_texels[64];
+
+        for (int by = 0; by < blocks_y; ++by)
+        {
+            for (int bx = 0; bx < blocks_x; ++bx, block += block_size)
+            {
+                // Partial blocks replicate edge texels
+                for (int i = 0; i < 16; ++i)
+                {
+                    int x = std::min(4 * bx + (i & 3), width - 1);
+                    int y = std::min(4 * by + (i >> 2), height - 1);
+                    std::copy(texels + 4 * (y * width + x), texels + 4 * (y * width + x) + 4, block_texels + 4 * i);
+                }
+
+                EncodeBlock(format, block_texels, block);
+            }
+        }
+
+        return data;
+    }
+}
@@ -0,0 +1,57 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "SceneGraph/texture.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    // Check if texture format stores texels in compressed 4x4 blocks.
+    bool IsBlockCompressed(Texture::Format format);
+
+    // Size of a compressed 4x4 block in bytes.
+    std::size_t GetBlockSize(Texture::Format format);
+
+    // Check if the format can be encoded on the host (BC1, BC4 and BC5),
+    // BC6H and BC7 textures are decode only and have to come precompressed.
+    bool IsBlockEncodingSupported(Texture::Format format);
+
+    // Decode 4x4 block into 16 row major RGBA float texels. BC4 is replicated
+    // into RGB, BC5 is treated as a tangent space normal map and gets Z reconstructed,
+    // BC6H is expected to be unsigned (BC6H_UF16).
+    void DecodeBlock(Texture::Format format, std::uint8_t const* block, float* texels);
+
+    // Encode 16 row major RGBA float texels into a block.
+    // Throws std::runtime_error if encoding is not supported for the format.
+    void EncodeBlock(Texture::Format format, float const* texels, std::uint8_t* block);
+
+    // Decode block compressed image into RGBA float texels.
+    std::vector<float> DecodeImage(Texture::Format format, char const* data, int width, int height);
+
+    // Encode RGBA float image into block compressed data allocated with new[],
+    // so it can be passed to Texture::Create().
+    char* EncodeImage(Texture::Format format, float const* texels, int width, int height);
+}
@@ -25,18 +25,26 @@ THE SOFTWARE.
 #include <array>
 
 #include "cl_inputmap_generator.h"
+#include "inputmap_optimizer.h"
 #include "SceneGraph/uberv2material.h"
 #include "SceneGraph/inputmaps.h"
 
 
 using namespace Baikal;
 
-const std::string header = "#ifndef INPUTMAPS_CL\n#define INPUTMAPS_CL\n\n";
-const std::string footer = "#endif\n\n";
+const std::string header = "#ifndef INPUTMAPS_CL\n#define INPUTMAPS_CL\n\n"
+    // Leaf i of the input map, params points to its leaf indices
+    "#define INPUT_MAP_LEAF(i) input_map_values[input_map_values[params + (i)].int_values.idx]\n\n"
+    "float4 InputMapRemap(float4 source_range, float4 destination_range, float4 data)\n{\n"
+    "\treturn mix((float4)(destination_range.x), (float4)(destination_range.y), (data - source_range.x) / (source_range.y - source_range.x));\n"
+    "}\n\n";
+const std::string footer = "#undef INPUT_MAP_LEAF\n\n#endif\n\n";
 
 const std::string float4_selector_header =
     "float4 GetInputMapFloat4(uint input_id, DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)\n{\n"
-    "\tswitch(input_id)\n\t{\n";
+    "\tif ((int)input_id < 0)\n\t{\n\t\treturn 0.0f;\n\t}\n"
+    "\tint params = input_map_values[input_id].header.params;\n"
+    "\tswitch(input_map_values[input_id].header.signature)\n\t{\n";
 const std::string float4_selector_footer = "\t}\n\treturn 0.0f;\n}\n";
 
 const std::string float_selector_header =
@@ -44,87 +52,142 @@ const std::string float_selector_header =
     "\treturn GetInputMapFloat4(input_id, dg, input_map_values, TEXTURE_ARGS).x;\n"
     "}\n";
 
-void CLInputMapGenerator::Generate(const Collector& input_map_collector, const Collector& input_map_leaf_collector)
+void CLInputMapGenerator::Generate(const Collector& input_map_collector, bool optimize)
 {
     m_source_code = header;
-    m_read_functions.clear();
-    m_float4_selector = float4_selector_header;
-    m_float_selector = float_selector_header;
+    m_signatures.clear();
+    m_instances.clear();
+    m_folded_constants.clear();
 
-    m_generated_inputs.clear();
+    InputMapOptimizer optimizer;
 
-    // We need to guarantee order. So sort it by id using map
-    std::map <uint32_t, InputMap::Ptr> inputs;
+    // Function body of each input map, leafs are referenced by position only
+    std::map<std::uint32_t, std::string> bodies;
 
     auto mat_iter = input_map_collector.CreateIterator();
     for (; mat_iter->IsValid(); mat_iter->Next())
     {
         auto input = mat_iter->ItemAs<InputMap>();
-        inputs.insert(std::make_pair(input->GetId(), input));
+        auto root = optimize ? optimizer.Optimize(input) : input;
+
+        m_read_functions.clear();
+        m_declarations.clear();
+        m_uses.clear();
+        m_temporaries.clear();
+        CountUses(root);
+
+        Instance instance;
+        GenerateInputSource(root, instance.leafs);
+
+        // Intermediate folds are not read by any function
+        for (auto const& leaf : instance.leafs)
+        {
+            if (optimizer.GetFoldedConstants().count(leaf))
+            {
+                m_folded_constants.insert(leaf);
+            }
+        }
+
+        auto body = m_declarations + "\treturn (float4)(\n\t" + m_read_functions + "\t);\n";
+        m_signatures.emplace(body, 0);
+        bodies[input->GetId()] = body;
+        m_instances[input->GetId()] = std::move(instance);
     }
 
-    for (auto &input : inputs)
+    // Number signatures in body order, so the source does not depend on ids or collection order
+    std::string float4_selector = float4_selector_header;
+    std::uint32_t signature = 0;
+
+    for (auto& body : m_signatures)
     {
-        GenerateSingleInput(input.second, input_map_leaf_collector);
+        body.second = signature++;
+        std::string name = "ReadInputMap" + std::to_string(body.second);
+
+        m_source_code += "float4 " + name + "(DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, int params, TEXTURE_ARG_LIST)\n{\n" +
+            body.first + "}\n";
+        float4_selector += "\t\tcase " + std::to_string(body.second) + ": return " + name + "(dg, input_map_values, params, TEXTURE_ARGS);\n";
     }
 
-    m_source_code += m_read_functions;
-    m_source_code += m_float4_selector + float4_selector_footer;
+    for (auto& instance : m_instances)
+    {
+        instance.second.signature = m_signatures[bodies[instance.first]];
+    }
+
+    m_source_code += float4_selector + float4_selector_footer;
     m_source_code += float_selector_header;
     m_source_code += footer;
 }
 
-void CLInputMapGenerator::GenerateSingleInput(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector)
+void CLInputMapGenerator::CountUses(InputMap::Ptr const& input)
 {
-    if (m_generated_inputs.find(input->GetId()) != m_generated_inputs.end()) return;
-
-    std::string input_id = std::to_string(input->GetId());
+    if (++m_uses[input.get()] > 1)
+    {
+        return;
+    }
 
-    //Generate code for selectors
-    m_float4_selector += "\t\tcase " + input_id + ": return ReadInputMap" + input_id + "(dg, input_map_values, TEXTURE_ARGS);\n";
-    m_float_selector += "\t\tcase " + input_id + ": return ReadInputMap" + input_id + "(dg, input_map_values, TEXTURE_ARGS).x;\n";
+    for (auto const& i : InputMapOptimizer::GetInputs(*input))
+    {
+        CountUses(i);
+    }
+}
 
-    m_read_functions += "float4 ReadInputMap" + input_id + "(DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)\n{\n"
-        "\treturn (float4)(\n\t";
+void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap> input, std::vector<InputMap::Ptr>& leafs)
+{
+    // Constants are cheap to read and keep their own parameter, so the
+    // function does not depend on which constants are shared
+    bool constant = input->m_type == InputMap::InputMapType::kConstantFloat ||
+        input->m_type == InputMap::InputMapType::kConstantFloat3;
 
-    GenerateInputSource(input, input_map_leaf_collector);
+    if (constant || m_uses[input.get()] < 2)
+    {
+        GenerateExpression(input, leafs);
+        return;
+    }
 
-    m_read_functions += "\t);\n}\n";
+    auto temporary = m_temporaries.find(input.get());
+    if (temporary == m_temporaries.end())
+    {
+        std::string expression;
+        std::swap(expression, m_read_functions);
+        GenerateExpression(input, leafs);
+        std::swap(expression, m_read_functions);
+
+        std::string name = "t" + std::to_string(m_temporaries.size());
+        m_declarations += "\tfloat4 " + name + " = (float4)(\n\t" + expression + "\t);\n";
+        temporary = m_temporaries.emplace(input.get(), name).first;
+    }
 
-    m_generated_inputs.insert(input->GetId());
+    m_read_functions += temporary->second + "\n";
 }
 
-void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector)
+void CLInputMapGenerator::GenerateExpression(std::shared_ptr<Baikal::InputMap> input, std::vector<InputMap::Ptr>& leafs)
 {
     switch (input->m_type)
     {
 
         case InputMap::InputMapType::kConstantFloat:
-        {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
-
-            m_read_functions += "((float4)(input_map_values[" + std::to_string(index) + "].float_value.value, 0.0f))\n";
-            break;
-        }
         case InputMap::InputMapType::kConstantFloat3:
         {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
+            std::string leaf = "INPUT_MAP_LEAF(" + std::to_string(leafs.size()) + ")";
+            leafs.push_back(input);
 
-            m_read_functions += "((float4)(input_map_values[" + std::to_string(index) + "].float_value.value, 0.0f))\n";
+            m_read_functions += "((float4)(" + leaf + ".float_value.value, 0.0f))\n";
             break;
         }
         case InputMap::InputMapType::kSampler:
         {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
+            std::string leaf = "INPUT_MAP_LEAF(" + std::to_string(leafs.size()) + ")";
+            leafs.push_back(input);
 
-            m_read_functions += "Texture_Sample2D(dg->uv, TEXTURE_ARGS_IDX(input_map_values[" + std::to_string(index) + "].int_values.idx))\n";
+            m_read_functions += "Texture_Sample2DLod(dg->uv, dg->lod, TEXTURE_ARGS_IDX(" + leaf + ".int_values.idx))\n";
             break;
         }
         case InputMap::InputMapType::kSamplerBumpmap:
         {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
+            std::string leaf = "INPUT_MAP_LEAF(" + std::to_string(leafs.size()) + ")";
+            leafs.push_back(input);
 
-            m_read_functions += "(float4)(Texture_SampleBump(dg->uv, TEXTURE_ARGS_IDX(input_map_values[" + std::to_string(index) + "].int_values.idx)), 1.0f)\n";
+            m_read_functions += "(float4)(Texture_SampleBumpLod(dg->uv, dg->lod, TEXTURE_ARGS_IDX(" + leaf + ".int_values.idx)), 1.0f)\n";
             break;
         }
         // Two inputs
@@ -133,9 +196,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Add *i = static_cast<InputMap_Add*>(input.get());
 
             m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t)\n\t + \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -144,9 +207,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Sub *i = static_cast<InputMap_Sub*>(input.get());
 
             m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t)\n\t - \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -155,9 +218,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Mul *i = static_cast<InputMap_Mul*>(input.get());
 
             m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t)\n\t * \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -166,9 +229,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Div *i = static_cast<InputMap_Div*>(input.get());
 
             m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t)\n\t / \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -177,9 +240,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Min *i = static_cast<InputMap_Min*>(input.get());
 
             m_read_functions += "min(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -188,9 +251,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Max *i = static_cast<InputMap_Max*>(input.get());
 
             m_read_functions += "max(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -199,9 +262,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Dot3 *i = static_cast<InputMap_Dot3*>(input.get());
 
             m_read_functions += "((float4)(dot(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  ".xyz\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += ".xyz\t), 0.0f, 0.0f, 0.0f))\n";
             break;
         }
@@ -210,9 +273,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Dot4 *i = static_cast<InputMap_Dot4*>(input.get());
 
             m_read_functions += "((float4)(dot(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t), 0.0f, 0.0f, 0.0f))\n";
             break;
         }
@@ -221,9 +284,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Cross3 *i = static_cast<InputMap_Cross3*>(input.get());
 
             m_read_functions += "((float4)(cross(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  ".xyz\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += ".xyz\t), 0.0f))\n";
             break;
         }
@@ -232,9 +295,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Cross4 *i = static_cast<InputMap_Cross4*>(input.get());
 
             m_read_functions += "cross(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -243,9 +306,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Pow *i = static_cast<InputMap_Pow*>(input.get());
 
             m_read_functions += "pow(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += ".x\t)\n";
             break;
         }
@@ -254,9 +317,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Mod *i = static_cast<InputMap_Mod*>(input.get());
 
             m_read_functions += "fmod(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -266,7 +329,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Sin *i = static_cast<InputMap_Sin*>(input.get());
 
             m_read_functions += "sin(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -275,7 +338,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Cos *i = static_cast<InputMap_Cos*>(input.get());
 
             m_read_functions += "cos(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -284,7 +347,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Tan *i = static_cast<InputMap_Tan*>(input.get());
 
             m_read_functions += "tan(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -293,7 +356,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Asin *i = static_cast<InputMap_Asin*>(input.get());
 
             m_read_functions += "asin(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -302,7 +365,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Acos *i = static_cast<InputMap_Acos*>(input.get());
 
             m_read_functions += "acos(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -311,7 +374,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Atan *i = static_cast<InputMap_Atan*>(input.get());
 
             m_read_functions += "atan(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -320,7 +383,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Length3 *i = static_cast<InputMap_Length3*>(input.get());
 
             m_read_functions += "(float4)(length(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += ".xyz\t), 0.0f, 0.0f, 0.0f)\n";
             break;
         }
@@ -329,7 +392,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Normalize3 *i = static_cast<InputMap_Normalize3*>(input.get());
 
             m_read_functions += "(float4)(normalize(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += ".xyz\t), 0.0f)\n";
             break;
         }
@@ -338,7 +401,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Floor *i = static_cast<InputMap_Floor*>(input.get());
 
             m_read_functions += "floor(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -347,7 +410,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Abs *i = static_cast<InputMap_Abs*>(input.get());
 
             m_read_functions += "fabs(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -357,11 +420,11 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Lerp *i = static_cast<InputMap_Lerp*>(input.get());
 
             m_read_functions += "mix(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetControl(), input_map_leaf_collector);
+            GenerateInputSource(i->GetControl(), leafs);
             m_read_functions += "\t)\n";
             break;
         }
@@ -372,7 +435,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             assert(static_cast<uint32_t>(i->GetSelection()) < selection_to_text.size());
 
             m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions +=  selection_to_text[static_cast<uint32_t>(i->GetSelection())];
             m_read_functions += "\n\t)\n";
             break;
@@ -383,7 +446,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             auto mask = i->GetMask();
 
             m_read_functions += "shuffle(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions += "\t, \n\t\t";
             m_read_functions += "(uint4)(" + std::to_string(mask[0]) + ", " + std::to_string(mask[1]) + ", " + std::to_string(mask[2]) + ", " + std::to_string(mask[3]) + ")\n";
             m_read_functions += "\t)\n";
@@ -395,9 +458,9 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             auto mask = i->GetMask();
 
             m_read_functions += "shuffle2(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
+            GenerateInputSource(i->GetA(), leafs);
             m_read_functions += "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
+            GenerateInputSource(i->GetB(), leafs);
             m_read_functions += "\t, \n\t\t";
             m_read_functions += "(uint4)(" + std::to_string(mask[0]) + ", " + std::to_string(mask[1]) + ", " + std::to_string(mask[2]) + ", " + std::to_string(mask[3]) + ")\n";
             m_read_functions += "\t)\n";
@@ -432,27 +495,21 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
                 std::to_string(mat4.m31) + ", " +
                 std::to_string(mat4.m32) + ", " +
                 std::to_string(mat4.m33) + ")),\n\t\t(";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
+            GenerateInputSource(i->GetArg(), leafs);
             m_read_functions +=  "\t)\n\t)";
             break;
         }
         case InputMap::InputMapType::kRemap:
         {
             InputMap_Remap *i = static_cast<InputMap_Remap*>(input.get());
-            //mix(float3(dest.x), float3(dest.y), (val - src.x) / (src.y - src.x))
-            m_read_functions += "mix((float4)(\n\t\t";
-            GenerateInputSource(i->GetDestinationRange(), input_map_leaf_collector);
-            m_read_functions += ".x)\t, \n\t\t(float4)(\n\t\t";
-            GenerateInputSource(i->GetDestinationRange(), input_map_leaf_collector);
-            m_read_functions += ".y)\t, \n\t\t((\n\t\t";
-            GenerateInputSource(i->GetData(), input_map_leaf_collector);
-            m_read_functions += ") - \n\t\t(\n\t\t";
-            GenerateInputSource(i->GetSourceRange(), input_map_leaf_collector);
-            m_read_functions += ".x)) / \n\t\t((\n\t\t";
-            GenerateInputSource(i->GetSourceRange(), input_map_leaf_collector);
-            m_read_functions += ".y)  - \n\t\t(\n\t\t";
-            GenerateInputSource(i->GetSourceRange(), input_map_leaf_collector);
-            m_read_functions += ".x)))\t\n";
+
+            m_read_functions += "InputMapRemap(\n\t\t";
+            GenerateInputSource(i->GetSourceRange(), leafs);
+            m_read_functions += "\t, \n\t\t";
+            GenerateInputSource(i->GetDestinationRange(), leafs);
+            m_read_functions += "\t, \n\t\t";
+            GenerateInputSource(i->GetData(), leafs);
+            m_read_functions += "\t)\n";
             break;
         }
 
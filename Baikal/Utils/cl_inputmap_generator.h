@@ -23,11 +23,13 @@ THE SOFTWARE.
 
 #pragma once
 
+#include <map>
 #include <set>
+#include <vector>
 
 #include "SceneGraph/scene1.h"
+#include "SceneGraph/inputmap.h"
 #include "SceneGraph/Collector/collector.h"
-#include "SceneGraph/clwscene.h"
 
 namespace Baikal
 {
@@ -35,17 +37,27 @@ namespace Baikal
     class CLInputMapGenerator
     {
     public:
+        // Generated function used by an input map and the leafs it reads, in parameter order
+        struct Instance
+        {
+            std::uint32_t signature;
+            std::vector<InputMap::Ptr> leafs;
+        };
+
         /**
         * @brief Generates source code for input maps. 
         *
         * Code stored inside Generator object.
-        * Makes lookups into leaf collectors to get parameters
-        * Each input map will create single function that will output float4 value
+        * Input maps with the same graph structure share a single function
+        * returning float4 value, leafs are read through a parameter table in
+        * input map data (see ClwSceneController::UpdateInputMaps). Source only
+        * changes when the set of structures does.
+        * Nodes used more than once are evaluated once into a temporary.
         *
         * @param input_map_collector set of input maps for generation
-        * @param input_map_leaf_collector list of leaf nodes that holds values
+        * @param optimize run InputMapOptimizer on the graphs first
         */
-        void Generate(const Collector& input_map_collector, const Collector& input_map_leaf_collector);
+        void Generate(const Collector& input_map_collector, bool optimize = false);
 
         // Returns generated source
         const std::string& GetGeneratedSource() const
@@ -53,15 +65,40 @@ namespace Baikal
             return m_source_code;
         }
 
+        // Returns instances by input map id
+        const std::map<std::uint32_t, Instance>& GetInstances() const
+        {
+            return m_instances;
+        }
+
+        // Number of distinct functions generated
+        std::size_t GetSignatureCount() const
+        {
+            return m_signatures.size();
+        }
+
+        // Leafs created by optimization, they are not part of the scene
+        const std::set<InputMap::Ptr>& GetFoldedConstants() const
+        {
+            return m_folded_constants;
+        }
+
     private:
-        // Proceed single input, writes function header and function call
-        void GenerateSingleInput(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector);
         // Writes source code for single input map. Called recursively.
-        void GenerateInputSource(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector);
+        void GenerateInputSource(std::shared_ptr<Baikal::InputMap> input, std::vector<InputMap::Ptr>& leafs);
+        // Writes expression of the node itself
+        void GenerateExpression(std::shared_ptr<Baikal::InputMap> input, std::vector<InputMap::Ptr>& leafs);
+        // Counts references to the nodes of the graph
+        void CountUses(InputMap::Ptr const& input);
         std::string m_source_code;
         std::string m_read_functions;
-        std::string m_float4_selector;
-        std::string m_float_selector;
-        std::set<uint32_t> m_generated_inputs;
+        // Temporaries of the current function
+        std::string m_declarations;
+        std::map<InputMap const*, std::uint32_t> m_uses;
+        std::map<InputMap const*, std::string> m_temporaries;
+        std::set<InputMap::Ptr> m_folded_constants;
+        // Function body -> signature index
+        std::map<std::string, std::uint32_t> m_signatures;
+        std::map<std::uint32_t, Instance> m_instances;
     };
 }
@@ -0,0 +1,287 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "cl_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        // Trace keeps the most recent commands only
+        std::size_t const kMaxTraceEvents = 1 << 16;
+
+        bool GetProfilingInfo(cl_event event, cl_profiling_info info, cl_ulong& value)
+        {
+            return clGetEventProfilingInfo(event, info, sizeof(cl_ulong), &value, nullptr) == CL_SUCCESS;
+        }
+    }
+
+    CLProfiler::Scope::Scope(CLProfiler* profiler, char const* name, int bounce)
+        : m_profiler(profiler && profiler->IsEnabled() ? profiler : nullptr)
+    {
+        if (m_profiler)
+        {
+            m_profiler->Begin(name, bounce);
+        }
+    }
+
+    CLProfiler::Scope::~Scope()
+    {
+        if (m_profiler)
+        {
+            m_profiler->End();
+        }
+    }
+
+    CLProfiler::CLProfiler(CLWContext context)
+        : m_context(context)
+        , m_enabled(false)
+    {
+    }
+
+    CLProfiler::~CLProfiler()
+    {
+        for (auto& command : m_open)
+        {
+            Discard(command);
+        }
+
+        for (auto& command : m_pending)
+        {
+            Discard(command);
+        }
+    }
+
+    CLWContext CLProfiler::CreateContext(CLWDevice device, cl_context_properties* props)
+    {
+        cl_device_id device_id = device.GetID();
+        cl_int status = CL_SUCCESS;
+
+        cl_context context = clCreateContext(props, 1, &device_id, nullptr, nullptr, &status);
+        if (status != CL_SUCCESS)
+        {
+            throw CLWException(status, "clCreateContext failed");
+        }
+
+        cl_command_queue queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &status);
+        if (status != CL_SUCCESS)
+        {
+            clReleaseContext(context);
+            throw CLWException(status, "clCreateCommandQueue failed");
+        }
+
+        // CLWContext retains both
+        auto result = CLWContext::Create(context, &device_id, &queue, 1);
+        clReleaseCommandQueue(queue);
+        clReleaseContext(context);
+        return result;
+    }
+
+    void CLProfiler::SetEnabled(bool enabled)
+    {
+        if (enabled)
+        {
+            cl_command_queue_properties properties = 0;
+            clGetCommandQueueInfo(m_context.GetCommandQueue(0), CL_QUEUE_PROPERTIES, sizeof(properties), &properties, nullptr);
+
+            if (!(properties & CL_QUEUE_PROFILING_ENABLE))
+            {
+                throw std::runtime_error("CLProfiler: command queue was created without profiling enabled");
+            }
+        }
+
+        m_enabled = enabled;
+    }
+
+    void CLProfiler::Record(char const* name, int bounce, CLWEvent const& event)
+    {
+        cl_event handle = event;
+        if (!m_enabled || !handle)
+        {
+            return;
+        }
+
+        clRetainEvent(handle);
+        m_pending.push_back(Command{ name, bounce, handle, handle });
+    }
+
+    cl_event CLProfiler::EnqueueMarker()
+    {
+        cl_event event = nullptr;
+        cl_int status = clEnqueueMarkerWithWaitList(m_context.GetCommandQueue(0), 0, nullptr, &event);
+        if (status != CL_SUCCESS)
+        {
+            throw std::runtime_error("CLProfiler: clEnqueueMarkerWithWaitList failed");
+        }
+
+        return event;
+    }
+
+    void CLProfiler::Begin(char const* name, int bounce)
+    {
+        if (m_enabled)
+        {
+            m_open.push_back(Command{ name, bounce, EnqueueMarker(), nullptr });
+        }
+    }
+
+    void CLProfiler::End()
+    {
+        if (m_open.empty())
+        {
+            return;
+        }
+
+        auto command = m_open.back();
+        m_open.pop_back();
+        command.end = EnqueueMarker();
+        m_pending.push_back(command);
+    }
+
+    void CLProfiler::Discard(Command& command)
+    {
+        if (command.end && command.end != command.start)
+        {
+            clReleaseEvent(command.end);
+        }
+
+        clReleaseEvent(command.start);
+    }
+
+    void CLProfiler::Update(bool wait)
+    {
+        // The queue is in order, commands finish in the order they were recorded
+        while (!m_pending.empty())
+        {
+            auto& command = m_pending.front();
+
+            if (wait)
+            {
+                clWaitForEvents(1, &command.end);
+            }
+            else
+            {
+                cl_int status = CL_COMPLETE;
+                clGetEventInfo(command.end, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+
+                if (status > CL_COMPLETE)
+                {
+                    break;
+                }
+            }
+
+            cl_ulong start = 0;
+            cl_ulong end = 0;
+            auto start_info = command.start == command.end ? CL_PROFILING_COMMAND_START : CL_PROFILING_COMMAND_END;
+
+            // Failed commands have no profiling info
+            if (GetProfilingInfo(command.start, start_info, start) &&
+                GetProfilingInfo(command.end, CL_PROFILING_COMMAND_END, end) && end >= start)
+            {
+                auto time = (end - start) * 1e-6f;
+                auto key = std::make_pair(command.bounce, command.name);
+                auto it = m_statistics.find(key);
+
+                if (it == m_statistics.end())
+                {
+                    m_statistics.emplace(key, Statistics{ command.name, command.bounce, 1, time, time, time });
+                }
+                else
+                {
+                    auto& stats = it->second;
+                    ++stats.count;
+                    stats.total_time += time;
+                    stats.min_time = std::min(stats.min_time, time);
+                    stats.max_time = std::max(stats.max_time, time);
+                }
+
+                m_trace.push_back(TraceEvent{ command.name, command.bounce, start, end });
+                if (m_trace.size() > kMaxTraceEvents)
+                {
+                    m_trace.pop_front();
+                }
+            }
+
+            Discard(command);
+            m_pending.pop_front();
+        }
+    }
+
+    std::vector<CLProfiler::Statistics> CLProfiler::GetStatistics(bool wait)
+    {
+        Update(wait);
+
+        std::vector<Statistics> result;
+        for (auto const& stats : m_statistics)
+        {
+            result.push_back(stats.second);
+        }
+
+        return result;
+    }
+
+    void CLProfiler::Reset()
+    {
+        for (auto& command : m_pending)
+        {
+            Discard(command);
+        }
+
+        m_pending.clear();
+        m_statistics.clear();
+        m_trace.clear();
+    }
+
+    bool CLProfiler::WriteChromeTrace(std::string const& filename)
+    {
+        Update(true);
+
+        std::ofstream out(filename);
+        if (!out)
+        {
+            return false;
+        }
+
+        // Timestamps are device nanoseconds, trace uses microseconds from the first command
+        auto origin = m_trace.empty() ? 0.0 : static_cast<double>(m_trace.front().start);
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\"traceEvents\":[\n";
+
+        for (std::size_t i = 0; i < m_trace.size(); ++i)
+        {
+            auto const& event = m_trace[i];
+            out << "{\"name\":\"" << event.name << "\",\"cat\":\"" <<
+                (event.bounce == kNoBounce ? std::string("frame") : "bounce " + std::to_string(event.bounce)) <<
+                "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << (event.start - origin) * 1e-3 <<
+                ",\"dur\":" << (event.end - event.start) * 1e-3 << ",\"args\":{\"bounce\":" << event.bounce << "}}" <<
+                (i + 1 < m_trace.size() ? ",\n" : "\n");
+        }
+
+        out << "],\"displayTimeUnit\":\"ms\"}\n";
+        return static_cast<bool>(out);
+    }
+}
@@ -0,0 +1,132 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "CLW.h"
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+     \brief Collects device execution times of kernels and other queued work.
+
+     Kernel launches are recorded with the events they return, work enqueued by
+     other libraries (intersector, parallel primitives) is timed with markers
+     enqueued around it. Times are aggregated per name and bounce, the most recent
+     commands are kept for Chrome trace export (chrome://tracing, Perfetto).
+
+     Requires a command queue created with CL_QUEUE_PROFILING_ENABLE, see CreateContext.
+     */
+    class CLProfiler
+    {
+    public:
+        // Bounce of work that does not belong to a bounce
+        static int const kNoBounce = -1;
+
+        struct Statistics
+        {
+            std::string name;
+            int bounce;
+            std::uint32_t count;
+            // Milliseconds
+            float total_time;
+            float min_time;
+            float max_time;
+        };
+
+        // Times work enqueued during its lifetime, does nothing if profiler is null or disabled
+        class Scope
+        {
+        public:
+            Scope(CLProfiler* profiler, char const* name, int bounce = kNoBounce);
+            ~Scope();
+
+            Scope(Scope const&) = delete;
+            Scope& operator = (Scope const&) = delete;
+
+        private:
+            CLProfiler* m_profiler;
+        };
+
+        explicit CLProfiler(CLWContext context);
+        ~CLProfiler();
+
+        // Context with profiling enabled on its queue, props are passed to clCreateContext
+        static CLWContext CreateContext(CLWDevice device, cl_context_properties* props = nullptr);
+
+        // Throws if the queue does not support profiling
+        void SetEnabled(bool enabled);
+        bool IsEnabled() const { return m_enabled; }
+
+        // Record kernel launch
+        void Record(char const* name, int bounce, CLWEvent const& event);
+        // Start and finish a region of queued work
+        void Begin(char const* name, int bounce = kNoBounce);
+        void End();
+
+        // Collect times of finished commands, waits for all of them if wait is set
+        void Update(bool wait = false);
+        // Sorted by bounce and name, only finished commands are counted unless wait is set
+        std::vector<Statistics> GetStatistics(bool wait = true);
+        void Reset();
+        // Waits for recorded commands and writes them as Chrome trace JSON
+        bool WriteChromeTrace(std::string const& filename);
+
+        CLProfiler(CLProfiler const&) = delete;
+        CLProfiler& operator = (CLProfiler const&) = delete;
+
+    private:
+        struct Command
+        {
+            std::string name;
+            int bounce;
+            // Kernels use start and end of one event, regions end of two markers
+            cl_event start;
+            cl_event end;
+        };
+
+        struct TraceEvent
+        {
+            std::string name;
+            int bounce;
+            cl_ulong start;
+            cl_ulong end;
+        };
+
+        cl_event EnqueueMarker();
+        // Release events, times are not collected
+        void Discard(Command& command);
+
+        CLWContext m_context;
+        bool m_enabled;
+        std::vector<Command> m_open;
+        std::deque<Command> m_pending;
+        std::map<std::pair<int, std::string>, Statistics> m_statistics;
+        std::deque<TraceEvent> m_trace;
+    };
+}
@@ -24,98 +24,66 @@ THE SOFTWARE.
 
 #include <assert.h>
 #include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <algorithm>
 #include <fstream>
 #include <sstream>
-#include <regex>
 
 #include "cl_program_manager.h"
 #include "version.h"
-#include "Utils/mkpath.h"
+#include "Utils/hash.h"
 
 //#define DUMP_PROGRAM_SOURCE 1
 
 using namespace Baikal;
 
-inline std::uint32_t jenkins_one_at_a_time_hash(char const *key, size_t len)
+namespace
 {
-    std::uint32_t hash, i;
-    for (hash = i = 0; i < len; ++i)
+    std::string GetDriverVersion(CLWDevice device)
     {
-        hash += key[i];
-        hash += (hash << 10);
-        hash ^= (hash >> 6);
-    }
-    hash += (hash << 3);
-    hash ^= (hash >> 11);
-    hash += (hash << 15);
-    return hash;
-}
-
-// Computting check sum algo
-// Copy from here: https://codereview.stackexchange.com/questions/104948/32-bit-checksum-of-a-file
-inline std::uint32_t CheckSum(const std::string &source)
-{
-    std::uint32_t check_sum = 0;
-    unsigned shift = 0;
-    for (uint32_t ch : source)
-    {
-        check_sum += (ch << shift);
-        shift += 8;
-        if (shift == 32) {
-            shift = 0;
+        std::size_t size = 0;
+        if (clGetDeviceInfo(device.GetID(), CL_DRIVER_VERSION, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        {
+            return std::string();
         }
-    }
-    return check_sum;
-}
 
-inline bool LoadBinaries(std::string const& name, std::vector<std::uint8_t>& data)
-{
-    std::ifstream in(name, std::ios::in | std::ios::binary);
-    if (in)
-    {
-        data.clear();
-        std::streamoff beg = in.tellg();
-        in.seekg(0, std::ios::end);
-        std::streamoff fileSize = in.tellg() - beg;
-        in.seekg(0, std::ios::beg);
-        data.resize(static_cast<unsigned>(fileSize));
-        in.read((char*)&data[0], fileSize);
-        return true;
-    }
-    else
-    {
-        return false;
+        std::vector<char> version(size);
+        clGetDeviceInfo(device.GetID(), CL_DRIVER_VERSION, size, version.data(), nullptr);
+        return std::string(version.data());
     }
-}
-
-inline void SaveBinaries(std::string const& name, std::vector<std::uint8_t>& data)
-{
-    mkfilepath(name);
-
-    std::ofstream out(name, std::ios::out | std::ios::binary);
 
-    if (out)
+    std::string ToHex(std::uint64_t value)
     {
-        out.write((char*)&data[0], data.size());
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+        return buffer;
     }
 }
 
-
 CLProgram::CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWContext context,
-                     const std::string &program_name, const std::string &cache_path) :
+                     const std::string &program_name) :
     m_program_manager(program_manager),
     m_program_name(program_name),
-    m_cache_path(cache_path),
     m_id(id),
     m_context(context)
 {
 };
 
+bool CLProgram::IsDirty() const
+{
+    std::lock_guard<std::mutex> lock(*m_mutex);
+    return m_is_dirty;
+}
+
+void CLProgram::SetDirty()
+{
+    std::lock_guard<std::mutex> lock(*m_mutex);
+    m_is_dirty = true;
+}
+
 void CLProgram::SetSource(const std::string &source)
 {
-    m_compiled_source.reserve(1024 * 1024); //Just reserve 1M for now
     m_program_source = source;
     ParseSource(m_program_source);
 }
@@ -142,7 +110,7 @@ void CLProgram::ParseSource(const std::string &source)
     }
 }
 
-void CLProgram::BuildSource(const std::string &source)
+void CLProgram::BuildSource(const std::string &source, std::string &compiled_source)
 {
     std::string::size_type offset = 0;
     std::string::size_type position = 0;
@@ -151,7 +119,7 @@ void CLProgram::BuildSource(const std::string &source)
     {
         // Append not-include part of source
         if (position != offset)
-            m_compiled_source += source.substr(offset, position - offset - 1);
+            compiled_source += source.substr(offset, position - offset - 1);
 
         // Get include file name
         std::string::size_type end_position = source.find(">", position);
@@ -166,15 +134,45 @@ void CLProgram::BuildSource(const std::string &source)
         {
             m_included_headers.insert(fname);
             // Append included file to source
-            BuildSource(m_program_manager->ReadHeader(fname));
+            BuildSource(m_program_manager->ReadHeader(fname), compiled_source);
         }
     }
 
     // Append rest of the file
-    m_compiled_source += source.substr(offset);
+    compiled_source += source.substr(offset);
+}
+
+void CLProgram::UpdateSource()
+{
+    if (!m_is_dirty && m_compiled_source)
+    {
+        return;
+    }
+
+    std::string compiled_source;
+    compiled_source.reserve(1024 * 1024); //Just reserve 1M for now
+
+    m_programs.clear();
+    m_included_headers.clear();
+    BuildSource(m_program_source, compiled_source);
+
+    m_compiled_source = std::make_shared<std::string const>(std::move(compiled_source));
+    m_is_dirty = false;
 }
 
 CLWProgram CLProgram::Compile(const std::string &opts)
+{
+    std::shared_ptr<std::string const> source;
+    {
+        std::lock_guard<std::mutex> lock(*m_mutex);
+        UpdateSource();
+        source = m_compiled_source;
+    }
+
+    return Compile(*source, opts);
+}
+
+CLWProgram CLProgram::Compile(const std::string &source, const std::string &opts) const
 {
     std::chrono::time_point<std::chrono::high_resolution_clock> start, end;
     start = std::chrono::high_resolution_clock::now();
@@ -182,14 +180,14 @@ CLWProgram CLProgram::Compile(const std::string &opts)
     CLWProgram compiled_program;
     try
     {
-        compiled_program = CLWProgram::CreateFromSource(m_compiled_source.c_str(), m_compiled_source.size(), opts.c_str(), m_context);
+        compiled_program = CLWProgram::CreateFromSource(source.c_str(), source.size(), opts.c_str(), m_context);
         /*
          * Code below usable for cache debugging
          */
 #ifdef DUMP_PROGRAM_SOURCE
         auto e = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
         std::ofstream file(m_program_name + std::to_string(e) + ".cl");
-        file << m_compiled_source;
+        file << source;
         file.close();
 #endif
     }
@@ -199,16 +197,15 @@ CLWProgram CLProgram::Compile(const std::string &opts)
         std::cerr << "Dumping source to file:" << m_program_name << ".cl.failed" << std::endl;
         std::string fname = m_program_name + ".cl.failed";
         std::ofstream file(fname);
-        file << m_compiled_source;
+        file << source;
         file.close();
         throw;
     }
 
     end = std::chrono::high_resolution_clock::now();
     int elapsed_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-    std::cerr << "Program compilation time: " << elapsed_ms << " ms" << std::endl;
+    std::cerr << "Program " << m_program_name << " compilation time: " << elapsed_ms << " ms" << std::endl;
 
-    m_is_dirty = false;
     return compiled_program;
 }
 
@@ -217,89 +214,115 @@ bool CLProgram::IsHeaderNeeded(const std::string &header_name) const
     return (m_required_headers.find(header_name) != m_required_headers.end());
 }
 
-CLWProgram CLProgram::GetCLWProgram(const std::string &opts)
+bool CLProgram::HasHeaders() const
 {
-    // global dirty flag
-    if (m_is_dirty)
+    for (auto const& header : m_required_headers)
     {
-        m_programs.clear();
-        m_compiled_source.clear();
-        m_included_headers.clear();
-        BuildSource(m_program_source);
+        if (m_program_manager->ReadHeader(header).empty())
+        {
+            return false;
+        }
     }
 
-    auto it = m_programs.find(opts);
-    if (it != m_programs.end())
+    return true;
+}
+
+CLWProgram CLProgram::GetCLWProgram(const std::string &opts)
+{
+    auto cache = m_program_manager->GetProgramCache();
+    auto bundle = m_program_manager->GetProgramBundle();
+    std::shared_ptr<std::string const> source;
+    std::string key;
+
     {
-        return it->second;
+        std::lock_guard<std::mutex> lock(*m_mutex);
+        UpdateSource();
+
+        auto it = m_programs.find(opts);
+        if (it != m_programs.end())
+        {
+            return it->second;
+        }
+
+        source = m_compiled_source;
+
+        if (cache || bundle)
+        {
+            key = GetCacheKey(*source, opts);
+        }
     }
 
+    // Build without holding the lock, so other option sets can be built concurrently
     CLWProgram result;
-    //check if we can get it from cache
-    if (!m_cache_path.empty())
-    {
-        std::string filename = GetFilenameHash(opts);
+    bool loaded = false;
+    std::vector<std::uint8_t> binary;
 
-        auto cached_program_path = m_cache_path;
-        cached_program_path.append("/");
-        cached_program_path.append(filename);
-        cached_program_path.append(".bin");
+    //check if we can get it from precompiled bundle or cache
+    for (auto source_cache : { bundle, cache })
+    {
+        if (loaded || !source_cache || !source_cache->Load(m_program_name, key, binary))
+        {
+            continue;
+        }
 
-        std::vector<std::uint8_t> binary;
-        if (LoadBinaries(cached_program_path, binary))
+        // Driver might still refuse the binary, e.g. after an update that kept its version string
+        try
         {
-            // Create from binary
             std::size_t size = binary.size();
             auto binaries = &binary[0];
             result = CLWProgram::CreateFromBinary(&binaries, &size, m_context);
-            m_programs[opts] = result;
+            loaded = true;
         }
-        else
+        catch (CLWException&)
         {
-            result = Compile(opts);
-            m_programs[opts] = result;
+            source_cache->Reject(m_program_name, key);
+        }
+    }
+
+    if (!loaded)
+    {
+        result = Compile(*source, opts);
 
-            // Save binaries
+        if (cache)
+        {
             result.GetBinaries(0, binary);
-            SaveBinaries(cached_program_path, binary);
+            cache->Store(m_program_name, key, binary);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(*m_mutex);
+
+        // Headers might have changed meanwhile, only keep programs built from current source
+        if (!m_is_dirty && source == m_compiled_source)
+        {
+            m_programs[opts] = result;
         }
     }
 
-    m_is_dirty = false;
     return result;
 }
 
-std::string CLProgram::GetFilenameHash(std::string const& opts) const
+std::string CLProgram::GetCacheKey(const std::string &source, std::string const& opts) const
 {
-    auto name = m_program_name;
-    auto device_name = m_context.GetDevice(0).GetName();
-
-    std::regex forbidden("(\\\\)|[\\./:<>\\\"\\|\\?\\*]");
-
-    device_name = std::regex_replace(device_name, forbidden, "_");
-    device_name.erase(
-        std::remove_if(device_name.begin(), device_name.end(), isspace),
-                      device_name.end());
-
-    name.append("_");
-    name.append(device_name);
-
-    auto extra = m_context.GetDevice(0).GetVersion();
-    extra.append(opts);
-
-    std::ostringstream oss;
-    oss << jenkins_one_at_a_time_hash(extra.c_str(), extra.size());
-
-    name.append("_");
-    name.append(oss.str());
-
-
-    std::uint32_t file_hash = CheckSum(m_compiled_source);
-
-    name.append("_");
-    name.append(std::to_string(file_hash));
-
-    name.append(BAIKAL_VERSION);
+    auto device = m_context.GetDevice(0);
+
+    std::ostringstream key;
+    key << m_program_name << "\n"
+        << device.GetName() << "\n"
+        << device.GetVersion() << "\n"
+        << GetDriverVersion(device) << "\n"
+        << opts << "\n"
+        << BAIKAL_VERSION << "\n"
+        << ToHex(HashBuffer64(source.data(), source.size())) << "\n";
+
+    // Headers are inlined into the compiled source, hashing them separately
+    // keeps the key valid if include expansion changes
+    for (auto const& header : m_included_headers)
+    {
+        auto header_source = m_program_manager->ReadHeader(header);
+        key << header << " " << ToHex(HashBuffer64(header_source.data(), header_source.size())) << "\n";
+    }
 
-    return name;
+    return key.str();
 }
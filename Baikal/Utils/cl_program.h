@@ -22,6 +22,8 @@ THE SOFTWARE.
 
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <set>
@@ -38,13 +40,15 @@ namespace Baikal
     public:
         CLProgram() = default;
         // Constructs CLProgram empty object
-        CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWContext context, const std::string &program_name, const std::string &cache_path);
+        CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWContext context, const std::string &program_name);
         // Check if program should be recompiled
-        bool IsDirty() const { return m_is_dirty; }
+        bool IsDirty() const;
         // Sets dirty flag on program
-        void SetDirty() { m_is_dirty = true; }
+        void SetDirty();
         // Returns program id
         uint32_t GetId() const { return m_id; }
+        // Returns program name
+        const std::string& GetName() const { return m_program_name; }
         /**
          * @brief Sets program source
          *
@@ -58,13 +62,16 @@ namespace Baikal
          * 
          * This function will build program and compile it if it's durty.
          * This function respronsible for shader cache handling. If required program
-         * already exists in disk or in-memory cache returns it.
-         * For caching uses simple uint32 crc of source code.
+         * already exists in precompiled bundle, disk or in-memory cache returns it.
+         * Disk cache entries are keyed by GetCacheKey().
+         * Safe to call from several threads, different options compile concurrently.
          */
         CLWProgram GetCLWProgram(const std::string &opts);
 
         // Checks if specified header required by program
         bool IsHeaderNeeded(const std::string &header_name) const;
+        // Checks if all required headers have source, generated headers are empty until scene is compiled
+        bool HasHeaders() const;
 
         // Compiles program. In case of error dumps source into current folder
         CLWProgram Compile(const std::string &opts);
@@ -77,14 +84,20 @@ namespace Baikal
          * include directives with source code.
          * Duplicate includes removed.
          */
-        void BuildSource(const std::string &source);
-        // Returns hash for file name
-        std::string GetFilenameHash(std::string const& opts) const;
+        void BuildSource(const std::string &source, std::string &compiled_source);
+        // Rebuilds compiled source if program is dirty, m_mutex must be locked
+        void UpdateSource();
+        // Compiles given full source
+        CLWProgram Compile(const std::string &source, const std::string &opts) const;
+        /**
+         * Returns disk cache key: hashes of the compiled source and every included
+         * header, device name and version, driver version, options and Baikal version.
+         */
+        std::string GetCacheKey(const std::string &source, std::string const& opts) const;
 
         const CLProgramManager *m_program_manager;
         std::string m_program_name;    ///< Program name
-        std::string m_cache_path;      ///< Cache folder path
-        std::string m_compiled_source; ///< Final program source with all headers
+        std::shared_ptr<std::string const> m_compiled_source; ///< Final program source with all headers
         std::string m_program_source;  ///< Program source code without modifications
         std::unordered_set<std::string> m_required_headers; ///< Set of required headers
 
@@ -94,6 +107,6 @@ namespace Baikal
         uint32_t m_id;
         CLWContext m_context;
         std::set<std::string> m_included_headers; ///< Set of included headers
-
+        std::shared_ptr<std::mutex> m_mutex = std::make_shared<std::mutex>(); ///< Guards program state, shared by copies
     };
 }
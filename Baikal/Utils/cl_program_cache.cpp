@@ -0,0 +1,530 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "cl_program_cache.h"
+#include "hash.h"
+#include "log.h"
+#include "mkpath.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#ifdef WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Baikal
+{
+    namespace
+    {
+        std::uint32_t const kEntryMagic = 0x504c4342; // "BCLP"
+        std::uint32_t const kEntryVersion = 1;
+        char const* kEntryExtension = ".bin";
+        char const* kIndexFilename = "index.txt";
+        char const* kIndexHeader = "BaikalProgramCache 1";
+        char const* kOptionsFilename = "options.txt";
+        char const* kWorkGroupSizesFilename = "workgroup_sizes.txt";
+
+        struct EntryHeader
+        {
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint32_t key_size;
+            std::uint32_t padding;
+            std::uint64_t binary_size;
+        };
+
+        bool FileExists(std::string const& path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            return static_cast<bool>(in);
+        }
+
+        std::string GetUniqueSuffix()
+        {
+#ifdef WIN32
+            auto pid = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+            auto pid = static_cast<unsigned long>(getpid());
+#endif
+            return "." + std::to_string(pid) + "." +
+                std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        }
+
+        // Write file under a unique name and rename it, readers never see partial files
+        template <typename Writer>
+        bool WriteFileAtomic(std::string const& path, Writer&& writer)
+        {
+            auto temp_path = path + GetUniqueSuffix();
+            {
+                std::ofstream out(temp_path, std::ios::binary);
+                if (!out)
+                {
+                    return false;
+                }
+
+                writer(out);
+
+                if (!out)
+                {
+                    out.close();
+                    std::remove(temp_path.c_str());
+                    return false;
+                }
+            }
+
+            if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+            {
+                std::remove(temp_path.c_str());
+                return false;
+            }
+
+            return true;
+        }
+    }
+
+    std::size_t const CLProgramCache::kMaxProgramOptions;
+
+    CLProgramCache::CLProgramCache(std::string const& directory, std::uint64_t max_size, bool read_only)
+        : m_directory(directory)
+        , m_max_size(max_size)
+        , m_read_only(read_only)
+        , m_clock(0)
+        , m_index_dirty(false)
+    {
+        if (!m_read_only)
+        {
+            mkpath(m_directory);
+        }
+
+        ReadIndex();
+        ReadOptions();
+        ReadWorkGroupSizes();
+    }
+
+    CLProgramCache::~CLProgramCache()
+    {
+        if (m_index_dirty)
+        {
+            WriteIndex();
+        }
+
+        LogInfo(m_read_only ? "Program bundle: " : "Program cache: ", m_statistics.hits, " hits, ", m_statistics.misses, " misses, ",
+            m_statistics.rejected, " rejected, ", m_statistics.evictions, " evicted\n");
+    }
+
+    std::string CLProgramCache::GetEntryFilename(std::string const& name, std::string const& key) const
+    {
+        char hash[32];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(HashBuffer64(key.data(), key.size())));
+        return name + "_" + hash + kEntryExtension;
+    }
+
+    bool CLProgramCache::Load(std::string const& name, std::string const& key, std::vector<std::uint8_t>& binary)
+    {
+        auto filename = GetEntryFilename(name, key);
+        auto path = m_directory + "/" + filename;
+
+        std::ifstream in(path, std::ios::binary);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!in)
+        {
+            ++m_statistics.misses;
+            return false;
+        }
+
+        EntryHeader header;
+        std::string stored_key;
+
+        bool valid = static_cast<bool>(in.read(reinterpret_cast<char*>(&header), sizeof(EntryHeader))) &&
+            header.magic == kEntryMagic && header.version == kEntryVersion && header.key_size == key.size();
+
+        if (valid)
+        {
+            stored_key.resize(header.key_size);
+            valid = in.read(&stored_key[0], header.key_size) && stored_key == key;
+        }
+
+        if (valid)
+        {
+            binary.resize(static_cast<std::size_t>(header.binary_size));
+            valid = binary.empty() || in.read(reinterpret_cast<char*>(binary.data()), binary.size());
+        }
+
+        // Truncated entry or hash collision, will be overwritten by the next store
+        if (!valid)
+        {
+            ++m_statistics.misses;
+            ++m_statistics.rejected;
+            return false;
+        }
+
+        if (!m_read_only)
+        {
+            auto& entry = m_index[filename];
+            entry.size = sizeof(EntryHeader) + header.key_size + header.binary_size;
+            entry.last_use = ++m_clock;
+            m_index_dirty = true;
+        }
+
+        ++m_statistics.hits;
+        return true;
+    }
+
+    void CLProgramCache::Store(std::string const& name, std::string const& key, std::vector<std::uint8_t> const& binary)
+    {
+        if (m_read_only)
+        {
+            return;
+        }
+
+        auto filename = GetEntryFilename(name, key);
+
+        EntryHeader header;
+        header.magic = kEntryMagic;
+        header.version = kEntryVersion;
+        header.key_size = static_cast<std::uint32_t>(key.size());
+        header.padding = 0;
+        header.binary_size = binary.size();
+
+        bool stored = WriteFileAtomic(m_directory + "/" + filename, [&](std::ofstream& out)
+        {
+            out.write(reinterpret_cast<char const*>(&header), sizeof(EntryHeader));
+            out.write(key.data(), key.size());
+            out.write(reinterpret_cast<char const*>(binary.data()), binary.size());
+        });
+
+        if (!stored)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto& entry = m_index[filename];
+        entry.size = sizeof(EntryHeader) + key.size() + binary.size();
+        entry.last_use = ++m_clock;
+        ++m_statistics.stores;
+
+        Evict(filename);
+        WriteIndex();
+    }
+
+    void CLProgramCache::Reject(std::string const& name, std::string const& key)
+    {
+        auto filename = GetEntryFilename(name, key);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_read_only)
+        {
+            std::remove((m_directory + "/" + filename).c_str());
+            m_index.erase(filename);
+            m_index_dirty = true;
+        }
+
+        // Load counted it as a hit
+        --m_statistics.hits;
+        ++m_statistics.misses;
+        ++m_statistics.rejected;
+    }
+
+    CLProgramCache::Statistics CLProgramCache::GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+
+    std::size_t CLProgramCache::GetEntryCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_index.size();
+    }
+
+    void CLProgramCache::AddProgramOptions(std::string const& name, std::string const& opts)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_read_only)
+        {
+            return;
+        }
+
+        // One "name<tab>last use<tab>options" line per set, options of other processes are kept
+        ReadOptions();
+        m_options[name][opts] = ++m_clock;
+
+        for (auto& program : m_options)
+        {
+            auto& options = program.second;
+
+            while (options.size() > kMaxProgramOptions)
+            {
+                auto oldest = std::min_element(options.begin(), options.end(),
+                    [](std::pair<std::string const, std::uint64_t> const& lhs, std::pair<std::string const, std::uint64_t> const& rhs)
+                    {
+                        return lhs.second < rhs.second;
+                    });
+
+                options.erase(oldest);
+            }
+        }
+
+        WriteFileAtomic(m_directory + "/" + kOptionsFilename, [this](std::ofstream& out)
+        {
+            for (auto const& program : m_options)
+            {
+                for (auto const& options : program.second)
+                {
+                    out << program.first << "\t" << options.second << "\t" << options.first << "\n";
+                }
+            }
+        });
+    }
+
+    std::vector<std::string> CLProgramCache::GetProgramOptions(std::string const& name) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_options.find(name);
+        if (it == m_options.end())
+        {
+            return std::vector<std::string>();
+        }
+
+        std::vector<std::string> result;
+        for (auto const& options : it->second)
+        {
+            result.push_back(options.first);
+        }
+
+        return result;
+    }
+
+    void CLProgramCache::ReadOptions()
+    {
+        std::ifstream in(m_directory + "/" + kOptionsFilename);
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            auto tab = line.find('\t');
+            auto second_tab = line.find('\t', tab + 1);
+            if (tab == std::string::npos || second_tab == std::string::npos)
+            {
+                continue;
+            }
+
+            std::uint64_t last_use = 0;
+            std::istringstream(line.substr(tab + 1, second_tab - tab - 1)) >> last_use;
+
+            auto& recorded = m_options[line.substr(0, tab)][line.substr(second_tab + 1)];
+            recorded = std::max(recorded, last_use);
+            m_clock = std::max(m_clock, last_use);
+        }
+    }
+
+    void CLProgramCache::SetWorkGroupSize(std::string const& key, std::vector<std::size_t> const& size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_read_only)
+        {
+            return;
+        }
+
+        // One "key<tab>sizes" line per kernel, sizes tuned by other processes are kept
+        ReadWorkGroupSizes();
+        m_workgroup_sizes[key] = size;
+
+        WriteFileAtomic(m_directory + "/" + kWorkGroupSizesFilename, [this](std::ofstream& out)
+        {
+            for (auto const& entry : m_workgroup_sizes)
+            {
+                out << entry.first;
+
+                for (std::size_t i = 0; i < entry.second.size(); ++i)
+                {
+                    out << (i == 0 ? "\t" : " ") << entry.second[i];
+                }
+
+                out << "\n";
+            }
+        });
+    }
+
+    bool CLProgramCache::GetWorkGroupSize(std::string const& key, std::vector<std::size_t>& size) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_workgroup_sizes.find(key);
+        if (it == m_workgroup_sizes.end())
+        {
+            return false;
+        }
+
+        size = it->second;
+        return true;
+    }
+
+    void CLProgramCache::ReadWorkGroupSizes()
+    {
+        std::ifstream in(m_directory + "/" + kWorkGroupSizesFilename);
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            auto tab = line.find('\t');
+            if (tab == std::string::npos)
+            {
+                continue;
+            }
+
+            std::istringstream iss(line.substr(tab + 1));
+            std::vector<std::size_t> size;
+            std::size_t value;
+
+            while (iss >> value)
+            {
+                size.push_back(value);
+            }
+
+            if (!size.empty())
+            {
+                m_workgroup_sizes[line.substr(0, tab)] = size;
+            }
+        }
+    }
+
+    void CLProgramCache::ReadIndex()
+    {
+        std::ifstream in(m_directory + "/" + kIndexFilename);
+        std::string line;
+
+        if (!std::getline(in, line) || line != kIndexHeader)
+        {
+            return;
+        }
+
+        while (std::getline(in, line))
+        {
+            std::istringstream iss(line);
+            std::string filename;
+            IndexEntry entry;
+
+            if (!(iss >> filename >> entry.size >> entry.last_use))
+            {
+                continue;
+            }
+
+            // Keep the most recent access known to any process
+            auto it = m_index.find(filename);
+            if (it == m_index.end())
+            {
+                m_index.emplace(filename, entry);
+            }
+            else
+            {
+                it->second.last_use = std::max(it->second.last_use, entry.last_use);
+            }
+
+            m_clock = std::max(m_clock, entry.last_use);
+        }
+    }
+
+    void CLProgramCache::WriteIndex()
+    {
+        ReadIndex();
+
+        // Drop entries removed by other processes
+        for (auto it = m_index.begin(); it != m_index.end();)
+        {
+            if (FileExists(m_directory + "/" + it->first))
+            {
+                ++it;
+            }
+            else
+            {
+                it = m_index.erase(it);
+            }
+        }
+
+        WriteFileAtomic(m_directory + "/" + kIndexFilename, [this](std::ofstream& out)
+        {
+            out << kIndexHeader << "\n";
+
+            for (auto const& entry : m_index)
+            {
+                out << entry.first << " " << entry.second.size << " " << entry.second.last_use << "\n";
+            }
+        });
+
+        m_index_dirty = false;
+    }
+
+    void CLProgramCache::Evict(std::string const& keep_file)
+    {
+        std::uint64_t total_size = 0;
+        std::vector<std::pair<std::uint64_t, std::string>> entries;
+
+        for (auto const& entry : m_index)
+        {
+            total_size += entry.second.size;
+            entries.emplace_back(entry.second.last_use, entry.first);
+        }
+
+        if (total_size <= m_max_size)
+        {
+            return;
+        }
+
+        // Oldest access first
+        std::sort(entries.begin(), entries.end());
+
+        for (auto const& entry : entries)
+        {
+            if (total_size <= m_max_size)
+            {
+                break;
+            }
+
+            if (entry.second == keep_file)
+            {
+                continue;
+            }
+
+            // Entries already removed by another process are dropped as well
+            std::remove((m_directory + "/" + entry.second).c_str());
+            total_size -= m_index[entry.second].size;
+            m_index.erase(entry.second);
+            ++m_statistics.evictions;
+        }
+    }
+}
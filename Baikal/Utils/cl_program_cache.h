@@ -0,0 +1,131 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+     \brief Persistent cache of compiled OpenCL program binaries.
+
+     Entries are addressed by a key string describing everything the binary
+     depends on (source, headers, device, driver, options). The file name is a hash
+     of the key and the key itself is stored in the entry, so stale or colliding
+     binaries are never returned. Entries are written under a temporary name and
+     renamed, access order is kept in an index file and least recently used
+     entries are removed once the total size exceeds the limit.
+
+     Option sets programs were built with are recorded as well, so the next run
+     can compile them ahead of time. Only the most recently used sets of each program
+     are kept. So are work-group sizes found by CLWorkGroupTuner.
+
+     A read only cache is used for precompiled bundles shipped with the application:
+     entries are loaded but never stored, rejected or evicted and no files are written.
+     */
+    class CLProgramCache
+    {
+    public:
+        struct Statistics
+        {
+            std::uint32_t hits = 0;
+            std::uint32_t misses = 0;
+            // Entries found on disk but rejected as corrupted or not loadable
+            std::uint32_t rejected = 0;
+            std::uint32_t stores = 0;
+            std::uint32_t evictions = 0;
+        };
+
+        // Number of option sets recorded per program
+        static std::size_t const kMaxProgramOptions = 16;
+
+        // Use directory for cache entries (created if missing unless read only), max_size is in bytes
+        CLProgramCache(std::string const& directory, std::uint64_t max_size, bool read_only = false);
+        // Flushes access times to the index
+        ~CLProgramCache();
+
+        // Load binary for the key, false on miss
+        bool Load(std::string const& name, std::string const& key, std::vector<std::uint8_t>& binary);
+        // Store binary for the key, evicts old entries if needed
+        void Store(std::string const& name, std::string const& key, std::vector<std::uint8_t> const& binary);
+        // Remove entry the driver failed to create a program from
+        void Reject(std::string const& name, std::string const& key);
+
+        Statistics GetStatistics() const;
+        // Number of entries known to the index
+        std::size_t GetEntryCount() const;
+        bool IsReadOnly() const { return m_read_only; }
+
+        // Record options the program has been built with, least recently used
+        // sets are dropped once there are more than kMaxProgramOptions
+        void AddProgramOptions(std::string const& name, std::string const& opts);
+        // Options recorded for the program by this or previous runs
+        std::vector<std::string> GetProgramOptions(std::string const& name) const;
+
+        // Record local size tuned for the kernel key
+        void SetWorkGroupSize(std::string const& key, std::vector<std::size_t> const& size);
+        // Local size recorded by this or previous runs, false if there is none
+        bool GetWorkGroupSize(std::string const& key, std::vector<std::size_t>& size) const;
+
+        // Disallow copying
+        CLProgramCache(CLProgramCache const&) = delete;
+        CLProgramCache& operator = (CLProgramCache const&) = delete;
+
+    private:
+        struct IndexEntry
+        {
+            std::uint64_t size;
+            std::uint64_t last_use;
+        };
+
+        // Entry file name, name is only used to make files recognizable
+        std::string GetEntryFilename(std::string const& name, std::string const& key) const;
+        // Merge index file from disk into m_index
+        void ReadIndex();
+        // Write index atomically, merged with entries other processes stored meanwhile
+        void WriteIndex();
+        // Remove least recently used entries except keep_file until the cache fits into max_size
+        void Evict(std::string const& keep_file);
+        // Merge recorded options from disk into m_options
+        void ReadOptions();
+        // Merge tuned work-group sizes from disk into m_workgroup_sizes
+        void ReadWorkGroupSizes();
+
+        std::string m_directory;
+        std::uint64_t m_max_size;
+        bool m_read_only;
+
+        mutable std::mutex m_mutex;
+        std::map<std::string, IndexEntry> m_index;
+        // Program name -> options -> last use
+        std::map<std::string, std::map<std::string, std::uint64_t>> m_options;
+        std::map<std::string, std::vector<std::size_t>> m_workgroup_sizes;
+        std::uint64_t m_clock;
+        bool m_index_dirty;
+        Statistics m_statistics;
+    };
+}
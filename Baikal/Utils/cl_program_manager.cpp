@@ -46,10 +46,31 @@ std::string ReadFile(const std::string &fname)
     str.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
     return str;
 }
-CLProgramManager::CLProgramManager(const std::string &cache_path) :
+CLProgramManager::CLProgramManager(const std::string &cache_path, std::uint64_t cache_max_size) :
     m_cache_path(cache_path)
 {
+    if (!m_cache_path.empty())
+    {
+        m_program_cache = std::make_shared<CLProgramCache>(m_cache_path, cache_max_size);
+    }
+
+    m_workgroup_tuner.reset(new CLWorkGroupTuner(m_program_cache.get()));
+}
+
+void CLProgramManager::SetProgramBundle(const std::string &path)
+{
+    m_program_bundle.reset();
 
+    if (path.empty())
+    {
+        return;
+    }
+
+    auto bundle = std::make_shared<CLProgramCache>(path, 0, true);
+    if (bundle->GetEntryCount() > 0)
+    {
+        m_program_bundle = bundle;
+    }
 }
 
 uint32_t CLProgramManager::CreateProgramFromFile(CLWContext context, const std::string &fname) const
@@ -76,7 +97,9 @@ uint32_t CLProgramManager::CreateProgramFromFile(CLWContext context, const std::
 
 uint32_t CLProgramManager::CreateProgramFromSource(CLWContext context, const std::string &name, const std::string &source) const
 {
-    CLProgram prg(this, m_next_program_id++, context, name, m_cache_path);
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+    CLProgram prg(this, m_next_program_id++, context, name);
     prg.SetSource(source);
     m_programs.insert(std::make_pair(prg.GetId(), prg));
     return prg.GetId();
@@ -84,19 +107,40 @@ uint32_t CLProgramManager::CreateProgramFromSource(CLWContext context, const std
 
 void CLProgramManager::AddHeader(const std::string &header, const std::string &source) const
 {
-    std::string currect_header_code = m_headers[header];
-    if (currect_header_code != source)
+    std::vector<CLProgram*> dirty_programs;
+
     {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        std::string currect_header_code = m_headers[header];
+        if (currect_header_code == source)
+        {
+            return;
+        }
+
         m_headers[header] = source;
 
         for (auto &program : m_programs)
         {
             if (program.second.IsHeaderNeeded(header))
             {
-                program.second.SetDirty();
+                dirty_programs.push_back(&program.second);
+
+                // Builds in flight use the old source, next request starts a new one
+                auto it = m_pending.lower_bound(std::make_pair(program.first, std::string()));
+                while (it != m_pending.end() && it->first.first == program.first)
+                {
+                    it = m_pending.erase(it);
+                }
             }
         }
     }
+
+    // Program lock is taken before the manager one while building, so mark them unlocked
+    for (auto program : dirty_programs)
+    {
+        program->SetDirty();
+    }
 }
 
 void CLProgramManager::LoadHeader(const std::string &header) const
@@ -105,19 +149,164 @@ void CLProgramManager::LoadHeader(const std::string &header) const
     AddHeader(header, header_source);
 }
 
-const std::string& CLProgramManager::ReadHeader(const std::string &header) const
+std::string CLProgramManager::ReadHeader(const std::string &header) const
 {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
     return m_headers[header];
 }
 
 CLWProgram CLProgramManager::GetProgram(uint32_t id, const std::string &opts) const
 {
-    CLProgram &program = m_programs[id];
-    return program.GetCLWProgram(opts);
+    AddProgramOptions(id, opts);
+
+    std::shared_future<CLWProgram> pending;
+    CLProgram* program = nullptr;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        auto it = m_pending.find(std::make_pair(id, opts));
+        if (it != m_pending.end())
+        {
+            pending = it->second.future;
+        }
+
+        program = &m_programs[id];
+    }
+
+    if (pending.valid())
+    {
+        return pending.get();
+    }
+
+    return program->GetCLWProgram(opts);
 }
 
 void CLProgramManager::CompileProgram(uint32_t id, const std::string &opts) const
 {
-    CLProgram &program = m_programs[id];
-    program.Compile(opts);
+    CLProgram* program = nullptr;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        program = &m_programs[id];
+    }
+
+    program->Compile(opts);
+}
+
+void CLProgramManager::AddProgramOptions(uint32_t id, const std::string &opts) const
+{
+    std::string name;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        if (!m_program_options[id].insert(opts).second)
+        {
+            return;
+        }
+
+        name = m_programs[id].GetName();
+    }
+
+    if (m_program_cache)
+    {
+        m_program_cache->AddProgramOptions(name, opts);
+    }
+}
+
+std::shared_future<CLWProgram> CLProgramManager::CompileProgramAsync(uint32_t id, const std::string &opts) const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+    auto key = std::make_pair(id, opts);
+    auto it = m_pending.find(key);
+    if (it != m_pending.end())
+    {
+        return it->second.future;
+    }
+
+    if (!m_compile_pool)
+    {
+        m_compile_pool.reset(new ThreadPool());
+    }
+
+    auto program = &m_programs[id];
+    auto serial = m_next_serial++;
+
+    auto future = m_compile_pool->Submit([this, program, key, serial]()
+    {
+        // Entry is removed by the task itself, also if the build throws
+        struct PendingEraser
+        {
+            const CLProgramManager* manager;
+            std::pair<uint32_t, std::string> const& key;
+            std::uint64_t serial;
+
+            ~PendingEraser()
+            {
+                std::lock_guard<std::recursive_mutex> lock(manager->m_mutex);
+
+                auto it = manager->m_pending.find(key);
+                if (it != manager->m_pending.end() && it->second.serial == serial)
+                {
+                    manager->m_pending.erase(it);
+                }
+            }
+        } eraser { this, key, serial };
+
+        return program->GetCLWProgram(key.second);
+    }).share();
+
+    m_pending[key] = PendingBuild { future, serial };
+    return future;
+}
+
+std::vector<std::shared_future<CLWProgram>> CLProgramManager::CompileAllAsync() const
+{
+    std::vector<std::pair<uint32_t, std::string>> builds;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        for (auto const& program : m_programs)
+        {
+            if (!program.second.HasHeaders())
+            {
+                continue;
+            }
+
+            std::set<std::string> options;
+
+            auto it = m_program_options.find(program.first);
+            if (it != m_program_options.end())
+            {
+                options = it->second;
+            }
+
+            for (auto cache : { m_program_bundle.get(), m_program_cache.get() })
+            {
+                if (cache)
+                {
+                    auto recorded = cache->GetProgramOptions(program.second.GetName());
+                    options.insert(recorded.begin(), recorded.end());
+                }
+            }
+
+            for (auto const& opts : options)
+            {
+                builds.emplace_back(program.first, opts);
+            }
+        }
+    }
+
+    std::vector<std::shared_future<CLWProgram>> futures;
+    futures.reserve(builds.size());
+
+    for (auto const& build : builds)
+    {
+        futures.push_back(CompileProgramAsync(build.first, build.second));
+    }
+
+    return futures;
 }
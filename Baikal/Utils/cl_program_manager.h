@@ -24,12 +24,19 @@ THE SOFTWARE.
 
 #include <string>
 #include <stdint.h>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <vector>
 
 #include "CLWProgram.h"
 #include "CLWContext.h"
 #include "cl_program.h"
+#include "cl_program_cache.h"
+#include "cl_workgroup_tuner.h"
+#include "thread_pool.h"
 
 
 namespace Baikal
@@ -37,8 +44,8 @@ namespace Baikal
     class CLProgramManager
     {
     public:
-        // Constructor
-        explicit CLProgramManager(const std::string &cache_path);
+        // Constructor, programs are not cached on disk if cache_path is empty
+        explicit CLProgramManager(const std::string &cache_path, std::uint64_t cache_max_size = 512ull << 20);
         // Creates program from file and returns its id
         uint32_t CreateProgramFromFile(CLWContext context, const std::string &fname) const;
         // Creates program from source and returns its id
@@ -48,16 +55,51 @@ namespace Baikal
         // Adds header to map from source
         void AddHeader(const std::string &header, const std::string &source) const;
         // Reads header from disk and returns its source
-        const std::string& ReadHeader(const std::string &header) const;
-        // Returns compiled program
+        std::string ReadHeader(const std::string &header) const;
+        // Returns compiled program, waits for background compilation of the same options if any
         CLWProgram GetProgram(uint32_t id, const std::string &opts) const;
         // Compiles program
         void CompileProgram(uint32_t id, const std::string &opts) const;
+        // Returns disk cache of program binaries, nullptr if caching is disabled
+        CLProgramCache* GetProgramCache() const { return m_program_cache.get(); }
+        // Use precompiled binaries from directory written by KernelPrecompiler, ignored if it has no entries
+        void SetProgramBundle(const std::string &path);
+        // Returns read only bundle of precompiled programs, nullptr if there is none
+        CLProgramCache* GetProgramBundle() const { return m_program_bundle.get(); }
+        // Returns tuner of kernel local sizes, results are stored in the disk cache if there is one
+        CLWorkGroupTuner* GetWorkGroupTuner() const { return m_workgroup_tuner.get(); }
+
+        // Registers options the program is going to be built with
+        void AddProgramOptions(uint32_t id, const std::string &opts) const;
+        // Builds program on the compile thread pool, requests for the same options share one build
+        std::shared_future<CLWProgram> CompileProgramAsync(uint32_t id, const std::string &opts) const;
+        /**
+         * @brief Builds all programs with registered options in background
+         *
+         * Options recorded in the disk cache by previous runs are built as well.
+         * Programs depending on generated headers are skipped until the headers are added.
+         */
+        std::vector<std::shared_future<CLWProgram>> CompileAllAsync() const;
 
     private:
+        struct PendingBuild
+        {
+            std::shared_future<CLWProgram> future;
+            std::uint64_t serial;
+        };
+
         mutable std::string m_cache_path; ///< Path to cache folder
+        std::shared_ptr<CLProgramCache> m_program_cache; ///< Disk cache of program binaries
+        std::shared_ptr<CLProgramCache> m_program_bundle; ///< Precompiled binaries, checked before the cache
+        std::unique_ptr<CLWorkGroupTuner> m_workgroup_tuner; ///< Local sizes of kernels, uses m_program_cache
+        mutable std::recursive_mutex m_mutex; ///< Guards maps below
         mutable std::map<uint32_t, CLProgram> m_programs; ///< Cache of programs by id
         mutable std::map<std::string, std::string> m_headers; ///< Headers map
+        mutable std::map<uint32_t, std::set<std::string>> m_program_options; ///< Registered options by program id
+        mutable std::map<std::pair<uint32_t, std::string>, PendingBuild> m_pending; ///< Builds in flight
+        mutable std::uint64_t m_next_serial = 0;
         static uint32_t m_next_program_id;
+        // Declared last, so workers are joined before the members they use are destroyed
+        mutable std::unique_ptr<ThreadPool> m_compile_pool;
     };
 }
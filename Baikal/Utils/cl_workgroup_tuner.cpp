@@ -0,0 +1,383 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "cl_workgroup_tuner.h"
+#include "cl_program_cache.h"
+#include "hash.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+namespace Baikal
+{
+    namespace
+    {
+        // Launches per candidate, the best one is used
+        std::uint32_t const kSamplesPerCandidate = 3;
+        std::size_t const kMinLocalSize = 16;
+        std::size_t const kMaxLocalSize = 1024;
+        std::size_t const kMaxLocalSize2D = 256;
+
+        std::string GetDeviceString(cl_device_id device, cl_device_info info)
+        {
+            std::size_t size = 0;
+            if (clGetDeviceInfo(device, info, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+            {
+                return "";
+            }
+
+            std::vector<char> value(size);
+            clGetDeviceInfo(device, info, size, value.data(), nullptr);
+            return std::string(value.data());
+        }
+
+        std::string GetKernelName(cl_kernel kernel)
+        {
+            std::size_t size = 0;
+            if (clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+            {
+                return "";
+            }
+
+            std::vector<char> value(size);
+            clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, size, value.data(), nullptr);
+            return std::string(value.data());
+        }
+
+        std::string GetBuildOptions(cl_kernel kernel, cl_device_id device)
+        {
+            cl_program program = nullptr;
+            std::size_t size = 0;
+
+            if (clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, nullptr) != CL_SUCCESS ||
+                clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_OPTIONS, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+            {
+                return "";
+            }
+
+            std::vector<char> value(size);
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_OPTIONS, size, value.data(), nullptr);
+            return std::string(value.data());
+        }
+    }
+
+    CLWorkGroupTuner::CLWorkGroupTuner(CLProgramCache* cache)
+        : m_cache(cache)
+        , m_enabled(true)
+    {
+    }
+
+    CLWorkGroupTuner::~CLWorkGroupTuner()
+    {
+        for (auto const& handle : m_handles)
+        {
+            clReleaseKernel(std::get<0>(handle.first));
+        }
+    }
+
+    void CLWorkGroupTuner::SetEnabled(bool enabled)
+    {
+        m_enabled = enabled;
+    }
+
+    bool CLWorkGroupTuner::IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    CLWEvent CLWorkGroupTuner::Launch1D(CLWContext context, CLWKernel const& kernel, std::size_t global_size, std::size_t default_local_size)
+    {
+        return Launch(context, kernel, 1, &global_size, &default_local_size);
+    }
+
+    CLWEvent CLWorkGroupTuner::Launch2D(CLWContext context, CLWKernel const& kernel, std::size_t const* global_size, std::size_t const* default_local_size)
+    {
+        return Launch(context, kernel, 2, global_size, default_local_size);
+    }
+
+    std::string CLWorkGroupTuner::GetKey(CLWDevice device, cl_kernel kernel, std::uint32_t dims, std::string& name)
+    {
+        cl_device_id device_id = device.GetID();
+
+        auto it = m_devices.find(device_id);
+        if (it == m_devices.end())
+        {
+            it = m_devices.emplace(device_id, device.GetName() + "\n" + device.GetVersion() + "\n" +
+                GetDeviceString(device_id, CL_DRIVER_VERSION) + "\n").first;
+        }
+
+        // Sizes depend on the device, driver and the code the options select
+        name = GetKernelName(kernel);
+        auto fingerprint = it->second + GetBuildOptions(kernel, device_id);
+
+        char hash[32];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(HashBuffer64(fingerprint.data(), fingerprint.size())));
+        return name + "_" + std::to_string(dims) + "d_" + hash;
+    }
+
+    bool CLWorkGroupTuner::GetTunedLocalSize(CLWContext context, CLWKernel const& kernel, std::uint32_t dims, std::size_t* local_size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Kernels that were never launched have no state
+        std::string name;
+        auto it = m_kernels.find(GetKey(context.GetDevice(0), kernel, dims, name));
+        if (it == m_kernels.end() || !it->second.tuned)
+        {
+            return false;
+        }
+
+        std::copy(it->second.local_size, it->second.local_size + dims, local_size);
+        return true;
+    }
+
+    CLWorkGroupTuner::KernelState& CLWorkGroupTuner::GetState(CLWContext context, CLWKernel const& kernel,
+        std::uint32_t dims, std::size_t const* default_local_size)
+    {
+        cl_kernel handle = kernel;
+        auto handle_key = std::make_tuple(handle, context.GetDevice(0).GetID(), dims);
+
+        // Querying name and build options on every launch is too slow
+        auto cached = m_handles.find(handle_key);
+        if (cached != m_handles.end())
+        {
+            return *cached->second;
+        }
+
+        // Drop kernels only the tuner still references, their programs are gone
+        for (auto it = m_handles.begin(); it != m_handles.end();)
+        {
+            cl_uint references = 0;
+            clGetKernelInfo(std::get<0>(it->first), CL_KERNEL_REFERENCE_COUNT, sizeof(references), &references, nullptr);
+
+            if (references == 1)
+            {
+                clReleaseKernel(std::get<0>(it->first));
+                it = m_handles.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        auto& state = FindState(context, handle, dims, default_local_size);
+        clRetainKernel(handle);
+        m_handles.emplace(handle_key, &state);
+        return state;
+    }
+
+    CLWorkGroupTuner::KernelState& CLWorkGroupTuner::FindState(CLWContext context, cl_kernel handle,
+        std::uint32_t dims, std::size_t const* default_local_size)
+    {
+        auto device = context.GetDevice(0);
+        cl_device_id device_id = device.GetID();
+
+        std::string name;
+        auto key = GetKey(device, handle, dims, name);
+
+        auto it = m_kernels.find(key);
+        if (it != m_kernels.end())
+        {
+            return it->second;
+        }
+
+        KernelState state;
+        state.name = name;
+        state.key = key;
+        state.dims = dims;
+        state.local_size[0] = default_local_size[0];
+        state.local_size[1] = dims > 1 ? default_local_size[1] : 1;
+        state.tuned = false;
+        state.next = 0;
+        state.tuning_size[0] = 0;
+        state.tuning_size[1] = 0;
+
+        std::size_t max_size = 0;
+        std::size_t max_item_sizes[3] = { 0, 0, 0 };
+        clGetKernelWorkGroupInfo(handle, device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_size), &max_size, nullptr);
+        clGetDeviceInfo(device_id, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_item_sizes), max_item_sizes, nullptr);
+
+        auto fits = [&](std::size_t x, std::size_t y)
+        {
+            return x * y <= max_size && x <= max_item_sizes[0] && (dims == 1 || y <= max_item_sizes[1]);
+        };
+
+        std::vector<std::size_t> stored;
+        if (m_cache && m_cache->GetWorkGroupSize(state.key, stored) && stored.size() == dims &&
+            fits(stored[0], dims > 1 ? stored[1] : 1))
+        {
+            state.local_size[0] = stored[0];
+            state.local_size[1] = dims > 1 ? stored[1] : 1;
+            state.tuned = true;
+            return m_kernels.emplace(key, std::move(state)).first->second;
+        }
+
+        auto add_candidate = [&](std::size_t x, std::size_t y)
+        {
+            auto same = [&](Candidate const& c) { return c.local_size[0] == x && c.local_size[1] == y; };
+            if (fits(x, y) && std::none_of(state.candidates.begin(), state.candidates.end(), same))
+            {
+                state.candidates.push_back(Candidate{ { x, y }, std::numeric_limits<double>::max(), 0 });
+            }
+        };
+
+        add_candidate(state.local_size[0], state.local_size[1]);
+
+        if (dims == 1)
+        {
+            for (std::size_t x = kMinLocalSize; x <= kMaxLocalSize; x *= 2)
+            {
+                add_candidate(x, 1);
+            }
+        }
+        else
+        {
+            for (std::size_t x = 4; x <= 64; x *= 2)
+            {
+                for (std::size_t y = 1; y <= 32; y *= 2)
+                {
+                    if (x * y >= kMinLocalSize * 2 && x * y <= kMaxLocalSize2D)
+                    {
+                        add_candidate(x, y);
+                    }
+                }
+            }
+        }
+
+        // Nothing to choose from, also taken if the limits could not be queried
+        if (state.candidates.size() < 2)
+        {
+            state.tuned = true;
+            state.candidates.clear();
+        }
+
+        return m_kernels.emplace(key, std::move(state)).first->second;
+    }
+
+    CLWEvent CLWorkGroupTuner::Launch(CLWContext context, CLWKernel const& kernel, std::uint32_t dims,
+        std::size_t const* global_size, std::size_t const* default_local_size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto& state = GetState(context, kernel, dims, default_local_size);
+
+        if (!state.tuned && m_enabled)
+        {
+            // Launch sizes differ between bounces, candidates are compared on the first size only
+            if (state.tuning_size[0] == 0)
+            {
+                state.tuning_size[0] = global_size[0];
+                state.tuning_size[1] = dims > 1 ? global_size[1] : 1;
+            }
+
+            if (state.tuning_size[0] == global_size[0] && (dims == 1 || state.tuning_size[1] == global_size[1]))
+            {
+                return Measure(context, kernel, state, global_size);
+            }
+        }
+
+        std::size_t local_size[2] = { default_local_size[0], dims > 1 ? default_local_size[1] : 1 };
+        if (state.tuned)
+        {
+            local_size[0] = state.local_size[0];
+            local_size[1] = state.local_size[1];
+        }
+
+        std::size_t rounded_size[2] =
+        {
+            (global_size[0] + local_size[0] - 1) / local_size[0] * local_size[0],
+            dims > 1 ? (global_size[1] + local_size[1] - 1) / local_size[1] * local_size[1] : 1
+        };
+
+        return dims == 1 ?
+            context.Launch1D(0, rounded_size[0], local_size[0], kernel) :
+            context.Launch2D(0, rounded_size, local_size, kernel);
+    }
+
+    CLWEvent CLWorkGroupTuner::Measure(CLWContext context, CLWKernel const& kernel, KernelState& state, std::size_t const* global_size)
+    {
+        // Candidates take turns, so each one sees launches of different frames
+        auto& candidate = state.candidates[state.next];
+        state.next = (state.next + 1) % state.candidates.size();
+
+        std::size_t local_size[2] = { candidate.local_size[0], candidate.local_size[1] };
+        std::size_t rounded_size[2] =
+        {
+            (global_size[0] + local_size[0] - 1) / local_size[0] * local_size[0],
+            state.dims > 1 ? (global_size[1] + local_size[1] - 1) / local_size[1] * local_size[1] : 1
+        };
+
+        context.Finish(0);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        auto event = state.dims == 1 ?
+            context.Launch1D(0, rounded_size[0], local_size[0], kernel) :
+            context.Launch2D(0, rounded_size, local_size, kernel);
+        event.Wait();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        // Device timestamps if the queue has profiling enabled, host time otherwise
+        cl_event handle = event;
+        cl_ulong device_start = 0;
+        cl_ulong device_end = 0;
+        double time = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+        if (clGetEventProfilingInfo(handle, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &device_start, nullptr) == CL_SUCCESS &&
+            clGetEventProfilingInfo(handle, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &device_end, nullptr) == CL_SUCCESS &&
+            device_end >= device_start)
+        {
+            time = static_cast<double>(device_end - device_start);
+        }
+
+        candidate.time = std::min(candidate.time, time);
+        ++candidate.samples;
+
+        auto measured = std::all_of(state.candidates.begin(), state.candidates.end(),
+            [](Candidate const& c) { return c.samples >= kSamplesPerCandidate; });
+
+        if (measured)
+        {
+            auto best = std::min_element(state.candidates.begin(), state.candidates.end(),
+                [](Candidate const& a, Candidate const& b) { return a.time < b.time; });
+
+            state.local_size[0] = best->local_size[0];
+            state.local_size[1] = best->local_size[1];
+            state.tuned = true;
+
+            std::vector<std::size_t> size(best->local_size, best->local_size + state.dims);
+            if (m_cache)
+            {
+                m_cache->SetWorkGroupSize(state.key, size);
+            }
+
+            LogInfo("Work-group size of ", state.name, ": ", state.local_size[0],
+                state.dims > 1 ? "x" + std::to_string(state.local_size[1]) : std::string(), "\n");
+
+            state.candidates.clear();
+        }
+
+        return event;
+    }
+}
@@ -0,0 +1,113 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "CLW.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace Baikal
+{
+    class CLProgramCache;
+
+    /**
+     \brief Picks local work-group sizes of kernels by measuring them.
+
+     The first launches of a kernel on a device cycle through candidate local sizes
+     allowed by CL_KERNEL_WORK_GROUP_SIZE, each launch is timed once the queue is idle.
+     Only launches with the global size of the first one are measured, so candidates
+     are compared on the same work. After every candidate has been measured a few times the fastest one is used for
+     all further launches and stored in the program cache, so later runs skip tuning.
+     Work is never launched twice, tuning only makes the first frames synchronous.
+
+     Global sizes are rounded up to a multiple of the local size, so kernels have to
+     check bounds and must not depend on the local size.
+     */
+    class CLWorkGroupTuner
+    {
+    public:
+        // Tuned sizes are loaded from and stored to cache if it is not null
+        explicit CLWorkGroupTuner(CLProgramCache* cache);
+        ~CLWorkGroupTuner();
+
+        // When disabled kernels that are not tuned yet use default sizes
+        void SetEnabled(bool enabled);
+        bool IsEnabled() const;
+
+        CLWEvent Launch1D(CLWContext context, CLWKernel const& kernel, std::size_t global_size, std::size_t default_local_size);
+        CLWEvent Launch2D(CLWContext context, CLWKernel const& kernel, std::size_t const* global_size, std::size_t const* default_local_size);
+
+        // Returns false while the kernel is not tuned yet
+        bool GetTunedLocalSize(CLWContext context, CLWKernel const& kernel, std::uint32_t dims, std::size_t* local_size);
+
+        CLWorkGroupTuner(CLWorkGroupTuner const&) = delete;
+        CLWorkGroupTuner& operator = (CLWorkGroupTuner const&) = delete;
+
+    private:
+        struct Candidate
+        {
+            std::size_t local_size[2];
+            // Best launch time in nanoseconds
+            double time;
+            std::uint32_t samples;
+        };
+
+        struct KernelState
+        {
+            std::string name;
+            std::string key;
+            std::uint32_t dims;
+            std::size_t local_size[2];
+            bool tuned;
+            std::vector<Candidate> candidates;
+            std::size_t next;
+            // Global size candidates are measured on, zero until the first tuning launch
+            std::size_t tuning_size[2];
+        };
+
+        // Kernel name, dimensions and a hash of device, driver and build options
+        std::string GetKey(CLWDevice device, cl_kernel kernel, std::uint32_t dims, std::string& name);
+        // Looks the state up by kernel object, by name and options on a miss
+        KernelState& GetState(CLWContext context, CLWKernel const& kernel, std::uint32_t dims, std::size_t const* default_local_size);
+        KernelState& FindState(CLWContext context, cl_kernel kernel, std::uint32_t dims, std::size_t const* default_local_size);
+        CLWEvent Launch(CLWContext context, CLWKernel const& kernel, std::uint32_t dims, std::size_t const* global_size, std::size_t const* default_local_size);
+        // Launch one candidate while tuning and record its time
+        CLWEvent Measure(CLWContext context, CLWKernel const& kernel, KernelState& state, std::size_t const* global_size);
+
+        CLProgramCache* m_cache;
+        std::atomic<bool> m_enabled;
+        std::mutex m_mutex;
+        // Device and driver part of the key per device
+        std::map<cl_device_id, std::string> m_devices;
+        // Kernel objects are recreated with programs, states are shared by all of them
+        std::map<std::string, KernelState> m_kernels;
+        // Resolved states of kernel objects, the kernels are retained so handles are not reused
+        std::map<std::tuple<cl_kernel, cl_device_id, std::uint32_t>, KernelState*> m_handles;
+    };
+}
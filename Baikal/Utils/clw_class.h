@@ -41,6 +41,11 @@ namespace Baikal
         std::string GetDefaultBuildOpts() const { return m_default_opts; }
         std::string GetFullBuildOpts() const;
 
+        // Launch with the local size tuned for the kernel, global size is rounded up to a multiple of it.
+        // Kernels must check bounds and must not depend on the local size
+        CLWEvent Launch1D(CLWKernel const& kernel, std::size_t global_size, std::size_t default_local_size = 64) const;
+        CLWEvent Launch2D(CLWKernel const& kernel, std::size_t const* global_size, std::size_t const* default_local_size) const;
+
     private:
         void AddCommonOptions(std::string& opts) const;
 
@@ -73,6 +78,8 @@ namespace Baikal
         {
             m_program_manager->AddHeader(header.first, header.second);
         }
+
+        m_program_manager->AddProgramOptions(m_program_id, options);
     }
 #else
     inline ClwClass::ClwClass(
@@ -87,6 +94,7 @@ namespace Baikal
         AddCommonOptions(options);
 
         m_program_id = m_program_manager->CreateProgramFromFile(context, cl_file);
+        m_program_manager->AddProgramOptions(m_program_id, options);
     }
 #endif
 
@@ -98,6 +106,16 @@ namespace Baikal
     }
 
 
+    inline CLWEvent ClwClass::Launch1D(CLWKernel const& kernel, std::size_t global_size, std::size_t default_local_size) const
+    {
+        return m_program_manager->GetWorkGroupTuner()->Launch1D(m_context, kernel, global_size, default_local_size);
+    }
+
+    inline CLWEvent ClwClass::Launch2D(CLWKernel const& kernel, std::size_t const* global_size, std::size_t const* default_local_size) const
+    {
+        return m_program_manager->GetWorkGroupTuner()->Launch2D(m_context, kernel, global_size, default_local_size);
+    }
+
     inline void ClwClass::AddCommonOptions(std::string& opts) const
     {
         opts.append(" -cl-mad-enable -cl-fast-relaxed-math "
@@ -126,5 +144,7 @@ namespace Baikal
     inline void ClwClass::SetDefaultBuildOptions(std::string const& opts)
     {
         m_default_opts = opts;
+        // Let background compilation pick the new permutation up
+        m_program_manager->AddProgramOptions(m_program_id, GetFullBuildOpts());
     }
 }
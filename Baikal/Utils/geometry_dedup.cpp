@@ -0,0 +1,205 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "geometry_dedup.h"
+#include "hash.h"
+#include "log.h"
+
+#include "SceneGraph/scene1.h"
+#include "SceneGraph/shape.h"
+#include "SceneGraph/light.h"
+#include "SceneGraph/iterator.h"
+
+#include "math/mathutils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    namespace
+    {
+        std::size_t GetMeshBytes(Mesh const& mesh)
+        {
+            return mesh.GetNumVertices() * sizeof(float3) +
+                mesh.GetNumNormals() * sizeof(float3) +
+                mesh.GetNumUVs() * sizeof(float2) +
+                mesh.GetNumIndices() * sizeof(std::uint32_t);
+        }
+
+        // Exact comparison of everything except positions, positions have to
+        // be equal to base positions translated by the offset of the first vertex.
+        bool IsSameGeometry(Mesh const& base, Mesh const& mesh)
+        {
+            if (base.GetNumVertices() != mesh.GetNumVertices() ||
+                base.GetNumNormals() != mesh.GetNumNormals() ||
+                base.GetNumUVs() != mesh.GetNumUVs() ||
+                base.GetNumIndices() != mesh.GetNumIndices())
+            {
+                return false;
+            }
+
+            if (!std::equal(base.GetIndices(), base.GetIndices() + base.GetNumIndices(), mesh.GetIndices()) ||
+                !std::equal(base.GetNormals(), base.GetNormals() + base.GetNumNormals(), mesh.GetNormals(),
+                    [](float3 const& a, float3 const& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }) ||
+                !std::equal(base.GetUVs(), base.GetUVs() + base.GetNumUVs(), mesh.GetUVs(),
+                    [](float2 const& a, float2 const& b) { return a.x == b.x && a.y == b.y; }))
+            {
+                return false;
+            }
+
+            if (base.GetNumVertices() == 0)
+            {
+                return true;
+            }
+
+            auto base_vertices = base.GetVertices();
+            auto vertices = mesh.GetVertices();
+            auto offset = vertices[0] - base_vertices[0];
+
+            return std::equal(base_vertices, base_vertices + base.GetNumVertices(), vertices,
+                [&offset](float3 const& a, float3 const& b)
+            {
+                auto p = a + offset;
+                return p.x == b.x && p.y == b.y && p.z == b.z;
+            });
+        }
+    }
+
+    std::uint64_t ComputeMeshHash(Mesh const& mesh)
+    {
+        auto hash = HashValue(mesh.GetNumVertices());
+        hash = HashValue(mesh.GetNumNormals(), hash);
+        hash = HashValue(mesh.GetNumUVs(), hash);
+        hash = Hash64(mesh.GetIndices(), mesh.GetNumIndices() * sizeof(std::uint32_t), hash);
+        hash = Hash64(mesh.GetNormals(), mesh.GetNumNormals() * sizeof(float3), hash);
+        hash = Hash64(mesh.GetUVs(), mesh.GetNumUVs() * sizeof(float2), hash);
+        return hash;
+    }
+
+    GeometryDuplicates FindDuplicateGeometry(Scene1 const& scene, GeometryDedupStats& stats)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        stats = GeometryDedupStats();
+        GeometryDuplicates duplicates;
+
+        // Meshes which have to stay meshes: emissive ones (area lights
+        // reference them directly) and the ones already used as instance bases.
+        std::set<Shape::Ptr> pinned;
+
+        auto light_iter = scene.CreateLightIterator();
+        for (; light_iter->IsValid(); light_iter->Next())
+        {
+            auto area_light = std::dynamic_pointer_cast<AreaLight>(light_iter->ItemAs<Light>());
+
+            if (area_light)
+            {
+                pinned.insert(area_light->GetShape());
+            }
+        }
+
+        std::vector<Mesh::Ptr> meshes;
+
+        auto shape_iter = scene.CreateShapeIterator();
+        for (; shape_iter->IsValid(); shape_iter->Next())
+        {
+            auto shape = shape_iter->ItemAs<Shape>();
+
+            if (auto mesh = std::dynamic_pointer_cast<Mesh>(shape))
+            {
+                meshes.push_back(mesh);
+            }
+            else if (auto instance = std::dynamic_pointer_cast<Instance>(shape))
+            {
+                pinned.insert(instance->GetBaseShape());
+            }
+        }
+
+        stats.num_meshes = meshes.size();
+
+        // Candidate base meshes grouped by hash
+        std::unordered_map<std::uint64_t, std::vector<Mesh::Ptr>> bases;
+
+        for (auto& mesh : meshes)
+        {
+            if (mesh->GetNumIndices() == 0)
+            {
+                continue;
+            }
+
+            auto& candidates = bases[ComputeMeshHash(*mesh)];
+
+            auto base = std::find_if(candidates.cbegin(), candidates.cend(),
+                [&mesh](Mesh::Ptr const& candidate) { return IsSameGeometry(*candidate, *mesh); });
+
+            if (base == candidates.cend() || pinned.count(mesh))
+            {
+                // Pinned meshes can still serve as bases for others
+                candidates.push_back(mesh);
+                continue;
+            }
+
+            duplicates[mesh] = GeometryDuplicate{ *base, mesh->GetVertices()[0] - (*base)->GetVertices()[0] };
+
+            ++stats.num_instanced;
+            stats.num_triangles_removed += mesh->GetNumIndices() / 3;
+            stats.bytes_saved += GetMeshBytes(*mesh);
+        }
+
+        auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        LogInfo("Geometry deduplication: ", stats.num_instanced, " of ", stats.num_meshes,
+            " meshes instanced, ", stats.num_triangles_removed, " triangles and ",
+            stats.bytes_saved / (1024 * 1024), " MB saved in ", delta, " ms\n");
+
+        return duplicates;
+    }
+
+    GeometryDedupStats DeduplicateGeometry(Scene1& scene)
+    {
+        GeometryDedupStats stats;
+        auto duplicates = FindDuplicateGeometry(scene, stats);
+
+        for (auto const& duplicate : duplicates)
+        {
+            auto const& mesh = duplicate.first;
+
+            auto instance = Instance::Create(duplicate.second.base);
+            instance->SetTransform(mesh->GetTransform() * translation(duplicate.second.offset));
+            instance->SetMaterial(mesh->GetMaterial());
+            instance->SetVolumeMaterial(mesh->GetVolumeMaterial());
+            instance->SetVisibilityMask(mesh->GetVisibilityMask());
+            instance->SetGroupId(mesh->GetGroupId());
+            instance->SetName(mesh->GetName());
+
+            scene.DetachShape(mesh);
+            scene.AttachShape(instance);
+        }
+
+        return stats;
+    }
+}
@@ -0,0 +1,89 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+/**
+ \file geometry_dedup.h
+ \brief Detection of duplicate meshes and their conversion into instances.
+ */
+#pragma once
+
+#include "SceneGraph/shape.h"
+#include "math/float3.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace Baikal
+{
+    class Scene1;
+
+    // Results of geometry deduplication pass
+    struct GeometryDedupStats
+    {
+        // Number of meshes examined
+        std::size_t num_meshes = 0;
+        // Number of meshes replaced by instances
+        std::size_t num_instanced = 0;
+        // Triangles which are not passed to BVH builder anymore
+        std::size_t num_triangles_removed = 0;
+        // Vertex, normal, uv and index bytes which are not uploaded anymore
+        std::size_t bytes_saved = 0;
+    };
+
+    // Mesh with the same geometry and translation reproducing the duplicate
+    struct GeometryDuplicate
+    {
+        Mesh::Ptr base;
+        RadeonRays::float3 offset;
+    };
+
+    // Duplicate meshes mapped to their bases
+    using GeometryDuplicates = std::map<Mesh::Ptr, GeometryDuplicate>;
+
+    /**
+     \brief Computes fingerprint of mesh topology and attributes.
+
+     Positions are not hashed since duplicates are allowed to differ by translation
+     (e.g. OBJ meshes baked into world space), they are checked during verification.
+     */
+    std::uint64_t ComputeMeshHash(Mesh const& mesh);
+
+    /**
+     \brief Finds scene meshes which can be rendered as instances of other scene meshes.
+
+     Two meshes are considered duplicates if they have identical indices, normals and uvs
+     and positions of one are exactly the positions of the other translated by a single offset.
+     Meshes referenced by area lights or used as instance base shapes are never replaced.
+     The scene is not modified.
+     */
+    GeometryDuplicates FindDuplicateGeometry(Scene1 const& scene, GeometryDedupStats& stats);
+
+    /**
+     \brief Replaces duplicate meshes in the scene by instances of a single base mesh.
+
+     Duplicates are found by FindDuplicateGeometry. Each one is detached from the scene
+     and an instance with the same material, volume, visibility, group id and name is attached
+     instead.
+     */
+    GeometryDedupStats DeduplicateGeometry(Scene1& scene);
+}
@@ -0,0 +1,103 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+/**
+ \file hash.h
+ \brief Fast non-cryptographic hashing used to fingerprint scene data.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Baikal
+{
+    // 64-bit FNV-1a offset basis, used as initial value for incremental hashing
+    std::uint64_t constexpr kHashSeed = 14695981039346656037ull;
+
+    // 64-bit FNV-1a over a raw byte range. Pass previous result as seed
+    // to hash several ranges as a single stream.
+    inline std::uint64_t Hash64(void const* data, std::size_t size, std::uint64_t seed = kHashSeed)
+    {
+        auto bytes = static_cast<std::uint8_t const*>(data);
+        auto hash = seed;
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    // 64-bit MurmurHash64A, consumes 8 bytes per step so it is much faster than
+    // Hash64() on large buffers such as image data. Not compatible with Hash64().
+    inline std::uint64_t HashBuffer64(void const* data, std::size_t size, std::uint64_t seed = kHashSeed)
+    {
+        std::uint64_t const m = 0xc6a4a7935bd1e995ull;
+        int const r = 47;
+
+        auto bytes = static_cast<std::uint8_t const*>(data);
+        auto hash = seed ^ (size * m);
+
+        for (std::size_t i = 0; i + 8 <= size; i += 8)
+        {
+            std::uint64_t k;
+            std::memcpy(&k, bytes + i, sizeof(k));
+
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+
+            hash ^= k;
+            hash *= m;
+        }
+
+        auto tail = bytes + (size & ~std::size_t(7));
+        switch (size & 7)
+        {
+        case 7: hash ^= std::uint64_t(tail[6]) << 48; // fall through
+        case 6: hash ^= std::uint64_t(tail[5]) << 40; // fall through
+        case 5: hash ^= std::uint64_t(tail[4]) << 32; // fall through
+        case 4: hash ^= std::uint64_t(tail[3]) << 24; // fall through
+        case 3: hash ^= std::uint64_t(tail[2]) << 16; // fall through
+        case 2: hash ^= std::uint64_t(tail[1]) << 8; // fall through
+        case 1: hash ^= std::uint64_t(tail[0]);
+            hash *= m;
+        }
+
+        hash ^= hash >> r;
+        hash *= m;
+        hash ^= hash >> r;
+
+        return hash;
+    }
+
+    // Hash single POD value
+    template <typename T>
+    inline std::uint64_t HashValue(T const& value, std::uint64_t seed = kHashSeed)
+    {
+        return Hash64(&value, sizeof(T), seed);
+    }
+}
@@ -0,0 +1,566 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "inputmap_optimizer.h"
+#include "SceneGraph/inputmaps.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <sstream>
+
+namespace Baikal
+{
+    namespace
+    {
+        using Type = InputMap::InputMapType;
+        // Input map value as seen by the kernels
+        using Value = std::array<float, 4>;
+
+        template <Type type>
+        std::vector<InputMap::Ptr> GetTwoArgInputs(InputMap const& input)
+        {
+            auto const& i = static_cast<InputMap_TwoArg<type> const&>(input);
+            return { i.GetA(), i.GetB() };
+        }
+
+        template <Type type>
+        std::vector<InputMap::Ptr> GetOneArgInputs(InputMap const& input)
+        {
+            auto const& i = static_cast<InputMap_OneArg<type> const&>(input);
+            return { i.GetArg() };
+        }
+
+        template <Type type>
+        InputMap::Ptr CreateTwoArg(std::vector<InputMap::Ptr> const& inputs)
+        {
+            return InputMap_TwoArg<type>::Create(inputs[0], inputs[1]);
+        }
+
+        template <Type type>
+        InputMap::Ptr CreateOneArg(std::vector<InputMap::Ptr> const& inputs)
+        {
+            return InputMap_OneArg<type>::Create(inputs[0]);
+        }
+
+        // Creates node of the same kind with other inputs
+        InputMap::Ptr Clone(InputMap const& input, std::vector<InputMap::Ptr> const& inputs)
+        {
+            switch (input.m_type)
+            {
+                case Type::kAdd: return CreateTwoArg<Type::kAdd>(inputs);
+                case Type::kSub: return CreateTwoArg<Type::kSub>(inputs);
+                case Type::kMul: return CreateTwoArg<Type::kMul>(inputs);
+                case Type::kDiv: return CreateTwoArg<Type::kDiv>(inputs);
+                case Type::kMin: return CreateTwoArg<Type::kMin>(inputs);
+                case Type::kMax: return CreateTwoArg<Type::kMax>(inputs);
+                case Type::kDot3: return CreateTwoArg<Type::kDot3>(inputs);
+                case Type::kCross3: return CreateTwoArg<Type::kCross3>(inputs);
+                case Type::kDot4: return CreateTwoArg<Type::kDot4>(inputs);
+                case Type::kCross4: return CreateTwoArg<Type::kCross4>(inputs);
+                case Type::kPow: return CreateTwoArg<Type::kPow>(inputs);
+                case Type::kMod: return CreateTwoArg<Type::kMod>(inputs);
+                case Type::kSin: return CreateOneArg<Type::kSin>(inputs);
+                case Type::kCos: return CreateOneArg<Type::kCos>(inputs);
+                case Type::kTan: return CreateOneArg<Type::kTan>(inputs);
+                case Type::kAsin: return CreateOneArg<Type::kAsin>(inputs);
+                case Type::kAcos: return CreateOneArg<Type::kAcos>(inputs);
+                case Type::kAtan: return CreateOneArg<Type::kAtan>(inputs);
+                case Type::kLength3: return CreateOneArg<Type::kLength3>(inputs);
+                case Type::kNormalize3: return CreateOneArg<Type::kNormalize3>(inputs);
+                case Type::kFloor: return CreateOneArg<Type::kFloor>(inputs);
+                case Type::kAbs: return CreateOneArg<Type::kAbs>(inputs);
+                case Type::kLerp:
+                    return InputMap_Lerp::Create(inputs[0], inputs[1], inputs[2]);
+                case Type::kSelect:
+                    return InputMap_Select::Create(inputs[0], static_cast<InputMap_Select const&>(input).GetSelection());
+                case Type::kShuffle:
+                    return InputMap_Shuffle::Create(inputs[0], static_cast<InputMap_Shuffle const&>(input).GetMask());
+                case Type::kShuffle2:
+                    return InputMap_Shuffle2::Create(inputs[0], inputs[1], static_cast<InputMap_Shuffle2 const&>(input).GetMask());
+                case Type::kMatMul:
+                    return InputMap_MatMul::Create(inputs[0], static_cast<InputMap_MatMul const&>(input).GetMatrix());
+                case Type::kRemap:
+                    return InputMap_Remap::Create(inputs[0], inputs[1], inputs[2]);
+                default:
+                    assert(false);
+                    return nullptr;
+            }
+        }
+
+        bool GetConstant(InputMap const& input, Value& value)
+        {
+            switch (input.m_type)
+            {
+                case Type::kConstantFloat3:
+                {
+                    auto v = static_cast<InputMap_ConstantFloat3 const&>(input).GetValue();
+                    value = { { v.x, v.y, v.z, 0.f } };
+                    return true;
+                }
+                case Type::kConstantFloat:
+                {
+                    auto v = static_cast<InputMap_ConstantFloat const&>(input).GetValue();
+                    value = { { v, v, v, 0.f } };
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        bool IsSplat(Value const& value, float s)
+        {
+            return value[0] == s && value[1] == s && value[2] == s;
+        }
+
+        float Dot3(Value const& a, Value const& b)
+        {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        }
+
+        template <typename Func>
+        Value Apply(Value const& a, Value const& b, Func func)
+        {
+            return { { func(a[0], b[0]), func(a[1], b[1]), func(a[2], b[2]), func(a[3], b[3]) } };
+        }
+
+        // Same operations as the generated code
+        Value Evaluate(InputMap const& input, std::vector<Value> const& args)
+        {
+            auto const& a = args[0];
+            auto const& b = args.size() > 1 ? args[1] : args[0];
+
+            switch (input.m_type)
+            {
+                case Type::kAdd: return Apply(a, b, [](float x, float y) { return x + y; });
+                case Type::kSub: return Apply(a, b, [](float x, float y) { return x - y; });
+                case Type::kMul: return Apply(a, b, [](float x, float y) { return x * y; });
+                case Type::kDiv: return Apply(a, b, [](float x, float y) { return x / y; });
+                case Type::kMin: return Apply(a, b, [](float x, float y) { return std::min(x, y); });
+                case Type::kMax: return Apply(a, b, [](float x, float y) { return std::max(x, y); });
+                case Type::kMod: return Apply(a, b, [](float x, float y) { return std::fmod(x, y); });
+                case Type::kPow: return Apply(a, a, [&b](float x, float) { return std::pow(x, b[0]); });
+                case Type::kSin: return Apply(a, a, [](float x, float) { return std::sin(x); });
+                case Type::kCos: return Apply(a, a, [](float x, float) { return std::cos(x); });
+                case Type::kTan: return Apply(a, a, [](float x, float) { return std::tan(x); });
+                case Type::kAsin: return Apply(a, a, [](float x, float) { return std::asin(x); });
+                case Type::kAcos: return Apply(a, a, [](float x, float) { return std::acos(x); });
+                case Type::kAtan: return Apply(a, a, [](float x, float) { return std::atan(x); });
+                case Type::kFloor: return Apply(a, a, [](float x, float) { return std::floor(x); });
+                case Type::kAbs: return Apply(a, a, [](float x, float) { return std::fabs(x); });
+                case Type::kDot3: return { { Dot3(a, b), 0.f, 0.f, 0.f } };
+                case Type::kDot4: return { { Dot3(a, b) + a[3] * b[3], 0.f, 0.f, 0.f } };
+                case Type::kLength3: return { { std::sqrt(Dot3(a, a)), 0.f, 0.f, 0.f } };
+                case Type::kNormalize3:
+                {
+                    auto length = std::sqrt(Dot3(a, a));
+                    return { { a[0] / length, a[1] / length, a[2] / length, 0.f } };
+                }
+                // cross() of float4 ignores and clears w
+                case Type::kCross3:
+                case Type::kCross4:
+                    return { { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0], 0.f } };
+                case Type::kLerp:
+                {
+                    auto const& control = args[2];
+                    return { { a[0] + (b[0] - a[0]) * control[0], a[1] + (b[1] - a[1]) * control[1],
+                        a[2] + (b[2] - a[2]) * control[2], a[3] + (b[3] - a[3]) * control[3] } };
+                }
+                case Type::kSelect:
+                {
+                    auto v = a[static_cast<std::uint32_t>(static_cast<InputMap_Select const&>(input).GetSelection())];
+                    return { { v, v, v, v } };
+                }
+                case Type::kShuffle:
+                {
+                    auto mask = static_cast<InputMap_Shuffle const&>(input).GetMask();
+                    return { { a[mask[0] & 3], a[mask[1] & 3], a[mask[2] & 3], a[mask[3] & 3] } };
+                }
+                case Type::kShuffle2:
+                {
+                    auto mask = static_cast<InputMap_Shuffle2 const&>(input).GetMask();
+                    Value result;
+                    for (auto i = 0u; i < 4; ++i)
+                    {
+                        auto lane = mask[i] & 7;
+                        result[i] = lane < 4 ? a[lane] : b[lane - 4];
+                    }
+                    return result;
+                }
+                case Type::kMatMul:
+                {
+                    auto m = static_cast<InputMap_MatMul const&>(input).GetMatrix();
+                    return { {
+                        m.m00 * a[0] + m.m01 * a[1] + m.m02 * a[2] + m.m03 * a[3],
+                        m.m10 * a[0] + m.m11 * a[1] + m.m12 * a[2] + m.m13 * a[3],
+                        m.m20 * a[0] + m.m21 * a[1] + m.m22 * a[2] + m.m23 * a[3],
+                        m.m30 * a[0] + m.m31 * a[1] + m.m32 * a[2] + m.m33 * a[3] } };
+                }
+                case Type::kRemap:
+                {
+                    // a is source range, b is destination range
+                    auto const& data = args[2];
+                    return Apply(data, data, [&a, &b](float x, float)
+                    {
+                        auto t = (x - a[0]) / (a[1] - a[0]);
+                        return b[0] + (b[1] - b[0]) * t;
+                    });
+                }
+                default:
+                    assert(false);
+                    return a;
+            }
+        }
+
+        // Whether w of the input is read when w of the result is needed or not
+        bool InputNeedsW(InputMap const& input, std::size_t index, bool need_w)
+        {
+            switch (input.m_type)
+            {
+                case Type::kDot3:
+                case Type::kCross3:
+                case Type::kCross4:
+                case Type::kLength3:
+                case Type::kNormalize3:
+                    return false;
+                case Type::kDot4:
+                case Type::kMatMul:
+                    return true;
+                // Exponent is read as scalar
+                case Type::kPow:
+                    return index == 0 && need_w;
+                // Ranges are read as .x and .y
+                case Type::kRemap:
+                    return index == 2 && need_w;
+                case Type::kSelect:
+                    return static_cast<InputMap_Select const&>(input).GetSelection() == InputMap_Select::Selection::kW;
+                case Type::kShuffle:
+                case Type::kShuffle2:
+                {
+                    auto mask = input.m_type == Type::kShuffle ?
+                        static_cast<InputMap_Shuffle const&>(input).GetMask() :
+                        static_cast<InputMap_Shuffle2 const&>(input).GetMask();
+                    auto w_lane = input.m_type == Type::kShuffle ? 3u : (index == 0 ? 3u : 7u);
+                    auto lane_mask = input.m_type == Type::kShuffle ? 3u : 7u;
+
+                    for (auto i = 0u; i < (need_w ? 4u : 3u); ++i)
+                    {
+                        if ((mask[i] & lane_mask) == w_lane)
+                        {
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                default:
+                    return need_w;
+            }
+        }
+
+        // Node parameters not expressed by its inputs
+        std::string GetAttributes(InputMap const& input)
+        {
+            std::ostringstream attributes;
+
+            switch (input.m_type)
+            {
+                case Type::kConstantFloat3:
+                case Type::kConstantFloat:
+                    // Constants are edited independently, never merge them
+                    attributes << &input;
+                    break;
+                case Type::kSampler:
+                case Type::kSamplerBumpmap:
+                    attributes << static_cast<InputMap_Sampler const&>(input).GetTexture().get();
+                    break;
+                case Type::kSelect:
+                    attributes << static_cast<std::uint32_t>(static_cast<InputMap_Select const&>(input).GetSelection());
+                    break;
+                case Type::kShuffle:
+                case Type::kShuffle2:
+                {
+                    auto mask = input.m_type == Type::kShuffle ?
+                        static_cast<InputMap_Shuffle const&>(input).GetMask() :
+                        static_cast<InputMap_Shuffle2 const&>(input).GetMask();
+                    attributes << mask[0] << "," << mask[1] << "," << mask[2] << "," << mask[3];
+                    break;
+                }
+                case Type::kMatMul:
+                {
+                    auto m = static_cast<InputMap_MatMul const&>(input).GetMatrix();
+                    attributes.precision(9);
+                    attributes << m.m00 << "," << m.m01 << "," << m.m02 << "," << m.m03 << ","
+                        << m.m10 << "," << m.m11 << "," << m.m12 << "," << m.m13 << ","
+                        << m.m20 << "," << m.m21 << "," << m.m22 << "," << m.m23 << ","
+                        << m.m30 << "," << m.m31 << "," << m.m32 << "," << m.m33;
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            return attributes.str();
+        }
+    }
+
+    std::vector<InputMap::Ptr> InputMapOptimizer::GetInputs(InputMap const& input)
+    {
+        switch (input.m_type)
+        {
+            case Type::kAdd: return GetTwoArgInputs<Type::kAdd>(input);
+            case Type::kSub: return GetTwoArgInputs<Type::kSub>(input);
+            case Type::kMul: return GetTwoArgInputs<Type::kMul>(input);
+            case Type::kDiv: return GetTwoArgInputs<Type::kDiv>(input);
+            case Type::kMin: return GetTwoArgInputs<Type::kMin>(input);
+            case Type::kMax: return GetTwoArgInputs<Type::kMax>(input);
+            case Type::kDot3: return GetTwoArgInputs<Type::kDot3>(input);
+            case Type::kCross3: return GetTwoArgInputs<Type::kCross3>(input);
+            case Type::kDot4: return GetTwoArgInputs<Type::kDot4>(input);
+            case Type::kCross4: return GetTwoArgInputs<Type::kCross4>(input);
+            case Type::kPow: return GetTwoArgInputs<Type::kPow>(input);
+            case Type::kMod: return GetTwoArgInputs<Type::kMod>(input);
+            case Type::kShuffle2: return GetTwoArgInputs<Type::kShuffle2>(input);
+            case Type::kSin: return GetOneArgInputs<Type::kSin>(input);
+            case Type::kCos: return GetOneArgInputs<Type::kCos>(input);
+            case Type::kTan: return GetOneArgInputs<Type::kTan>(input);
+            case Type::kAsin: return GetOneArgInputs<Type::kAsin>(input);
+            case Type::kAcos: return GetOneArgInputs<Type::kAcos>(input);
+            case Type::kAtan: return GetOneArgInputs<Type::kAtan>(input);
+            case Type::kLength3: return GetOneArgInputs<Type::kLength3>(input);
+            case Type::kNormalize3: return GetOneArgInputs<Type::kNormalize3>(input);
+            case Type::kFloor: return GetOneArgInputs<Type::kFloor>(input);
+            case Type::kAbs: return GetOneArgInputs<Type::kAbs>(input);
+            case Type::kSelect: return GetOneArgInputs<Type::kSelect>(input);
+            case Type::kShuffle: return GetOneArgInputs<Type::kShuffle>(input);
+            case Type::kMatMul: return GetOneArgInputs<Type::kMatMul>(input);
+            case Type::kLerp:
+            {
+                auto const& i = static_cast<InputMap_Lerp const&>(input);
+                return { i.GetA(), i.GetB(), i.GetControl() };
+            }
+            case Type::kRemap:
+            {
+                auto const& i = static_cast<InputMap_Remap const&>(input);
+                return { i.GetSourceRange(), i.GetDestinationRange(), i.GetData() };
+            }
+            default:
+                return {};
+        }
+    }
+
+    InputMap::Ptr InputMapOptimizer::Optimize(InputMap::Ptr input)
+    {
+        // Kernels only read xyz of the result
+        return Rewrite(input, false);
+    }
+
+    InputMap::Ptr InputMapOptimizer::Rewrite(InputMap::Ptr input, bool need_w)
+    {
+        auto key = std::make_pair(input, need_w);
+        auto rewritten = m_rewritten.find(key);
+        if (rewritten != m_rewritten.end())
+        {
+            return rewritten->second;
+        }
+
+        auto inputs = GetInputs(*input);
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            inputs[i] = Rewrite(inputs[i], InputNeedsW(*input, i, need_w));
+        }
+
+        auto node = Intern(input, inputs);
+
+        auto simplified_key = std::make_pair(node, need_w);
+        auto simplified = m_simplified.find(simplified_key);
+        if (simplified == m_simplified.end())
+        {
+            simplified = m_simplified.emplace(simplified_key, Simplify(node, need_w)).first;
+        }
+
+        auto result = simplified->second ? simplified->second : node;
+        m_rewritten.emplace(key, result);
+        return result;
+    }
+
+    InputMap::Ptr InputMapOptimizer::Intern(InputMap::Ptr input, std::vector<InputMap::Ptr> const& inputs)
+    {
+        std::ostringstream key;
+        key << static_cast<int>(input->m_type) << ":" << GetAttributes(*input);
+        for (auto const& i : inputs)
+        {
+            key << ":" << i.get();
+        }
+
+        auto node = m_nodes.find(key.str());
+        if (node != m_nodes.end())
+        {
+            if (node->second != input)
+            {
+                ++m_statistics.merged;
+            }
+            return node->second;
+        }
+
+        // Authored node is used as is unless its inputs were rewritten
+        auto result = inputs == GetInputs(*input) ? input : Clone(*input, inputs);
+        m_nodes.emplace(key.str(), result);
+        return result;
+    }
+
+    InputMap::Ptr InputMapOptimizer::CreateConstant(float x, float y, float z, bool fixed)
+    {
+        InputMap::Ptr constant = InputMap_ConstantFloat3::Create(RadeonRays::float3(x, y, z));
+        m_folded.insert(constant);
+        if (fixed)
+        {
+            m_fixed.insert(constant);
+        }
+        return constant;
+    }
+
+    InputMap::Ptr InputMapOptimizer::Simplify(InputMap::Ptr input, bool need_w)
+    {
+        auto inputs = GetInputs(*input);
+        if (inputs.empty())
+        {
+            return nullptr;
+        }
+
+        std::vector<Value> values(inputs.size());
+        std::vector<bool> constant(inputs.size());
+        bool all_constant = true;
+        bool all_fixed = true;
+
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            constant[i] = GetConstant(*inputs[i], values[i]);
+            all_constant = all_constant && constant[i];
+            all_fixed = all_fixed && m_fixed.count(inputs[i]) != 0;
+        }
+
+        // Constants are stored as float3, w of the result has to be 0 if it is read
+        if (all_constant)
+        {
+            auto value = Evaluate(*input, values);
+            if (!need_w || value[3] == 0.f)
+            {
+                ++m_statistics.folded;
+                return CreateConstant(value[0], value[1], value[2], all_fixed);
+            }
+        }
+
+        // Authored constants are edited without regenerating the source, so identities
+        // only look at constants whose value does not depend on the scene
+        auto is_fixed = [&](std::size_t i) { return m_fixed.count(inputs[i]) != 0; };
+        auto is_constant = [&](std::size_t i, float s) { return is_fixed(i) && IsSplat(values[i], s); };
+
+        InputMap::Ptr result;
+
+        // Kernels are built with -cl-fast-relaxed-math, values are assumed finite
+        switch (input->m_type)
+        {
+            case Type::kAdd:
+                result = is_constant(1, 0.f) ? inputs[0] : is_constant(0, 0.f) ? inputs[1] : nullptr;
+                break;
+            case Type::kSub:
+                if (is_constant(1, 0.f))
+                {
+                    result = inputs[0];
+                }
+                else if (inputs[0] == inputs[1])
+                {
+                    result = CreateConstant(0.f, 0.f, 0.f, true);
+                }
+                break;
+            case Type::kMul:
+                if (is_constant(0, 0.f) || is_constant(1, 0.f))
+                {
+                    result = CreateConstant(0.f, 0.f, 0.f, true);
+                }
+                // Constant w is 0, multiplying by one clears w
+                else if (!need_w)
+                {
+                    result = is_constant(1, 1.f) ? inputs[0] : is_constant(0, 1.f) ? inputs[1] : nullptr;
+                }
+                break;
+            case Type::kDiv:
+                result = !need_w && is_constant(1, 1.f) ? inputs[0] : nullptr;
+                break;
+            case Type::kMin:
+            case Type::kMax:
+                result = inputs[0] == inputs[1] ? inputs[0] : nullptr;
+                break;
+            case Type::kPow:
+                result = is_fixed(1) && values[1][0] == 1.f ? inputs[0] : nullptr;
+                break;
+            case Type::kLerp:
+                if (inputs[0] == inputs[1] || is_constant(2, 0.f))
+                {
+                    result = inputs[0];
+                }
+                else if (!need_w && is_constant(2, 1.f))
+                {
+                    result = inputs[1];
+                }
+                break;
+            case Type::kShuffle:
+            case Type::kShuffle2:
+            {
+                auto mask = input->m_type == Type::kShuffle ?
+                    static_cast<InputMap_Shuffle const&>(*input).GetMask() :
+                    static_cast<InputMap_Shuffle2 const&>(*input).GetMask();
+                auto lane_mask = input->m_type == Type::kShuffle ? 3u : 7u;
+
+                // Lanes in order from a single input
+                for (std::size_t i = 0; i < inputs.size() && !result; ++i)
+                {
+                    bool identity = true;
+                    for (auto lane = 0u; lane < (need_w ? 4u : 3u); ++lane)
+                    {
+                        identity = identity && (mask[lane] & lane_mask) == lane + 4 * i;
+                    }
+                    result = identity ? inputs[i] : nullptr;
+                }
+                break;
+            }
+            case Type::kRemap:
+            {
+                // Equal ranges, empty range divides by zero and is kept
+                bool identity = is_fixed(0) && is_fixed(1) &&
+                    values[0][0] == values[1][0] && values[0][1] == values[1][1] && values[0][0] != values[0][1];
+                result = identity ? inputs[2] : nullptr;
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (result)
+        {
+            ++m_statistics.simplified;
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,95 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SceneGraph/inputmap.h"
+
+namespace Baikal
+{
+    /**
+    * @brief Rewrites input map graphs before code generation.
+    *
+    * Constant subgraphs are folded into InputMap_ConstantFloat3, identical
+    * subgraphs and samples of the same texture are merged and identities
+    * (x + 0, x * 1, mix(a, b, 0), no-op shuffles and remaps, ...) are removed.
+    * Value based identities only apply to constants that do not depend on
+    * authored values, an edited constant never changes the generated source.
+    * Nodes no longer reachable are dropped. The authored graph is never
+    * modified: rewritten nodes are new objects, unchanged nodes are shared.
+    *
+    * Lanes are tracked as the kernels see them, constants read as (x, y, z, 0)
+    * and only xyz of the result is used, so w is only preserved where an
+    * operation reads it.
+    */
+    class InputMapOptimizer
+    {
+    public:
+        struct Statistics
+        {
+            std::uint32_t folded = 0;
+            std::uint32_t merged = 0;
+            std::uint32_t simplified = 0;
+        };
+
+        // Returns optimized graph of the input map
+        InputMap::Ptr Optimize(InputMap::Ptr input);
+
+        // Constants created by folding, their values are not part of the scene
+        const std::set<InputMap::Ptr>& GetFoldedConstants() const
+        {
+            return m_folded;
+        }
+
+        Statistics GetStatistics() const
+        {
+            return m_statistics;
+        }
+
+        // Inputs of the node in argument order
+        static std::vector<InputMap::Ptr> GetInputs(InputMap const& input);
+
+    private:
+        InputMap::Ptr Rewrite(InputMap::Ptr input, bool need_w);
+        // Returns the single node for the structure, creates it if needed
+        InputMap::Ptr Intern(InputMap::Ptr input, std::vector<InputMap::Ptr> const& inputs);
+        // Returns folded or simplified replacement, nullptr if there is none
+        InputMap::Ptr Simplify(InputMap::Ptr input, bool need_w);
+        // Fixed constants do not depend on authored values
+        InputMap::Ptr CreateConstant(float x, float y, float z, bool fixed);
+
+        // Keys hold the nodes, so addresses are not reused while the optimizer is alive
+        std::map<std::pair<InputMap::Ptr, bool>, InputMap::Ptr> m_rewritten;
+        std::map<std::pair<InputMap::Ptr, bool>, InputMap::Ptr> m_simplified;
+        std::map<std::string, InputMap::Ptr> m_nodes;
+        std::set<InputMap::Ptr> m_folded;
+        std::set<InputMap::Ptr> m_fixed;
+        Statistics m_statistics;
+    };
+}
@@ -0,0 +1,301 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Utils/mipmap.h"
+#include "Utils/half.h"
+#include "Utils/block_compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace Baikal
+{
+    namespace
+    {
+        float ToFloat(std::uint8_t value) { return value / 255.f; }
+        float ToFloat(std::uint16_t value) { half h; h.setBits(value); return h; }
+        float ToFloat(float value) { return value; }
+
+        void FromFloat(float value, std::uint8_t& out)
+        {
+            out = static_cast<std::uint8_t>(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+        }
+
+        void FromFloat(float value, std::uint16_t& out) { out = half(value).bits(); }
+        void FromFloat(float value, float& out) { out = value; }
+
+        // 2x2 box filter of a level into the next one, odd edge texels are clamped
+        template <typename T>
+        void Downsample(T const* src, int src_width, int src_height, T* dst, int dst_width, int dst_height, int num_channels = 4)
+        {
+            for (int y = 0; y < dst_height; ++y)
+            {
+                int y0 = std::min(2 * y, src_height - 1);
+                int y1 = std::min(2 * y + 1, src_height - 1);
+
+                for (int x = 0; x < dst_width; ++x)
+                {
+                    int x0 = std::min(2 * x, src_width - 1);
+                    int x1 = std::min(2 * x + 1, src_width - 1);
+
+                    for (int c = 0; c < num_channels; ++c)
+                    {
+                        float sum = ToFloat(src[num_channels * (y0 * src_width + x0) + c]) +
+                            ToFloat(src[num_channels * (y0 * src_width + x1) + c]) +
+                            ToFloat(src[num_channels * (y1 * src_width + x0) + c]) +
+                            ToFloat(src[num_channels * (y1 * src_width + x1) + c]);
+
+                        FromFloat(0.25f * sum, dst[num_channels * (y * dst_width + x) + c]);
+                    }
+                }
+            }
+        }
+
+        // Spread 3 low bits of the value to even bit positions
+        std::uint32_t SpreadBits(std::uint32_t value)
+        {
+            value = (value | (value << 2)) & 0x33;
+            return (value | (value << 1)) & 0x55;
+        }
+
+        // Index of texel (x, y) in the level, has to match Texture_GetTexelIndex() in texture.cl
+        std::size_t GetTexelIndex(Texture::Layout layout, int width, int x, int y)
+        {
+            switch (layout)
+            {
+            case Texture::Layout::kTiled:
+            {
+                std::size_t tile = (y >> 2) * ((width + 3) >> 2) + (x >> 2);
+                return tile * 16 + ((y & 3) << 2) + (x & 3);
+            }
+            case Texture::Layout::kMorton:
+            {
+                std::size_t tile = (y >> 3) * ((width + 7) >> 3) + (x >> 3);
+                return tile * 64 + (SpreadBits(x & 7) | (SpreadBits(y & 7) << 1));
+            }
+            default:
+                return static_cast<std::size_t>(y) * width + x;
+            }
+        }
+
+        // Dimension padded to whole tiles
+        int GetPaddedSize(Texture::Layout layout, int size)
+        {
+            switch (layout)
+            {
+            case Texture::Layout::kTiled: return (size + 3) & ~3;
+            case Texture::Layout::kMorton: return (size + 7) & ~7;
+            default: return size;
+            }
+        }
+
+        void WriteLinearMipChain(Texture const& texture, char* data)
+        {
+            auto format = texture.GetFormat();
+            auto size = texture.GetSize();
+
+            std::memcpy(data, texture.GetData(), texture.GetSizeInBytes());
+
+            auto num_levels = GetMipLevelCount(texture);
+
+            if (IsBlockCompressed(format))
+            {
+                // Filter in float and re-encode every level
+                auto texels = DecodeImage(format, texture.GetData(), size.x, size.y);
+
+                for (std::uint32_t i = 1; i < num_levels; ++i)
+                {
+                    data += GetMipLevelSize(format, Texture::Layout::kLinear, size.x, size.y);
+
+                    int width = std::max(size.x >> 1, 1);
+                    int height = std::max(size.y >> 1, 1);
+
+                    std::vector<float> level(4 * width * height);
+                    Downsample(texels.data(), size.x, size.y, level.data(), width, height);
+
+                    std::unique_ptr<char[]> encoded(EncodeImage(format, level.data(), width, height));
+                    std::memcpy(data, encoded.get(), GetBlockSize(format) * ((width + 3) / 4) * ((height + 3) / 4));
+
+                    texels.swap(level);
+                    size.x = width;
+                    size.y = height;
+                }
+
+                return;
+            }
+
+            for (std::uint32_t i = 1; i < num_levels; ++i)
+            {
+                auto src = data;
+                data += GetMipLevelSize(format, Texture::Layout::kLinear, size.x, size.y);
+
+                int width = std::max(size.x >> 1, 1);
+                int height = std::max(size.y >> 1, 1);
+
+                switch (format)
+                {
+                case Texture::Format::kRgba8:
+                    Downsample(reinterpret_cast<std::uint8_t const*>(src), size.x, size.y,
+                        reinterpret_cast<std::uint8_t*>(data), width, height);
+                    break;
+                case Texture::Format::kRgba16:
+                    Downsample(reinterpret_cast<std::uint16_t const*>(src), size.x, size.y,
+                        reinterpret_cast<std::uint16_t*>(data), width, height);
+                    break;
+                case Texture::Format::kRgba32:
+                    Downsample(reinterpret_cast<float const*>(src), size.x, size.y,
+                        reinterpret_cast<float*>(data), width, height);
+                    break;
+                case Texture::Format::kR8:
+                case Texture::Format::kRG8:
+                    Downsample(reinterpret_cast<std::uint8_t const*>(src), size.x, size.y,
+                        reinterpret_cast<std::uint8_t*>(data), width, height, Texture::GetChannelCount(format));
+                    break;
+                case Texture::Format::kR16F:
+                    Downsample(reinterpret_cast<std::uint16_t const*>(src), size.x, size.y,
+                        reinterpret_cast<std::uint16_t*>(data), width, height, 1);
+                    break;
+                case Texture::Format::kR32F:
+                    Downsample(reinterpret_cast<float const*>(src), size.x, size.y,
+                        reinterpret_cast<float*>(data), width, height, 1);
+                    break;
+                default:
+                    break;
+                }
+
+                size.x = width;
+                size.y = height;
+            }
+        }
+    }
+
+    Texture::Layout GetTextureLayout(Texture const& texture)
+    {
+        // Compressed blocks are already 4x4 tiles
+        if (IsBlockCompressed(texture.GetFormat()) || texture.GetSize().z > 1)
+        {
+            return Texture::Layout::kLinear;
+        }
+
+        return texture.GetLayout();
+    }
+
+    std::uint32_t GetMipLevelCount(Texture const& texture)
+    {
+        auto size = texture.GetSize();
+
+        // Block compressed levels can only be generated for formats we can encode
+        bool can_downsample = !IsBlockCompressed(texture.GetFormat()) ||
+            IsBlockEncodingSupported(texture.GetFormat());
+
+        if (!texture.IsMipmapEnabled() || size.z > 1 || !can_downsample)
+        {
+            return 1;
+        }
+
+        std::uint32_t num_levels = 1;
+        for (auto dim = std::max(size.x, size.y); dim > 1; dim >>= 1)
+        {
+            ++num_levels;
+        }
+
+        return num_levels;
+    }
+
+    std::size_t GetMipLevelSize(Texture::Format format, Texture::Layout layout, int width, int height)
+    {
+        auto size = IsBlockCompressed(format) ?
+            GetBlockSize(format) * ((width + 3) / 4) * ((height + 3) / 4) :
+            Texture::GetPixelSize(format) * GetPaddedSize(layout, width) * GetPaddedSize(layout, height);
+        return (size + 0xF) / 0x10 * 0x10;
+    }
+
+    std::size_t GetMipChainSize(Texture const& texture)
+    {
+        auto size = texture.GetSize();
+
+        if (size.z > 1)
+        {
+            return GetMipLevelSize(texture.GetFormat(), Texture::Layout::kLinear, size.x, size.y * size.z);
+        }
+
+        std::size_t chain_size = 0;
+        auto layout = GetTextureLayout(texture);
+        auto num_levels = GetMipLevelCount(texture);
+
+        for (std::uint32_t i = 0; i < num_levels; ++i)
+        {
+            chain_size += GetMipLevelSize(texture.GetFormat(), layout, size.x, size.y);
+            size.x = std::max(size.x >> 1, 1);
+            size.y = std::max(size.y >> 1, 1);
+        }
+
+        return chain_size;
+    }
+
+    void WriteMipChain(Texture const& texture, char* data)
+    {
+        auto layout = GetTextureLayout(texture);
+
+        if (layout == Texture::Layout::kLinear)
+        {
+            WriteLinearMipChain(texture, data);
+            return;
+        }
+
+        // Levels are generated row major and reordered into tiles
+        auto format = texture.GetFormat();
+        auto size = texture.GetSize();
+        auto texel_size = Texture::GetPixelSize(format);
+
+        std::size_t linear_size = 0;
+        auto num_levels = GetMipLevelCount(texture);
+        for (std::uint32_t i = 0; i < num_levels; ++i)
+        {
+            linear_size += GetMipLevelSize(format, Texture::Layout::kLinear, std::max(size.x >> i, 1), std::max(size.y >> i, 1));
+        }
+
+        std::vector<char> linear(linear_size);
+        WriteLinearMipChain(texture, linear.data());
+
+        char const* src = linear.data();
+
+        for (std::uint32_t i = 0; i < num_levels; ++i)
+        {
+            for (int y = 0; y < size.y; ++y)
+            {
+                for (int x = 0; x < size.x; ++x)
+                {
+                    std::memcpy(data + GetTexelIndex(layout, size.x, x, y) * texel_size,
+                        src + (static_cast<std::size_t>(y) * size.x + x) * texel_size, texel_size);
+                }
+            }
+
+            src += GetMipLevelSize(format, Texture::Layout::kLinear, size.x, size.y);
+            data += GetMipLevelSize(format, layout, size.x, size.y);
+
+            size.x = std::max(size.x >> 1, 1);
+            size.y = std::max(size.y >> 1, 1);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "SceneGraph/texture.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Baikal
+{
+    // Number of mip levels uploaded for the texture: full chain down to 1x1
+    // for mipmapped 2D textures, single level otherwise.
+    std::uint32_t GetMipLevelCount(Texture const& texture);
+
+    // Texel layout the texture is uploaded with: texture preference for 2D
+    // uncompressed textures, linear otherwise.
+    Texture::Layout GetTextureLayout(Texture const& texture);
+
+    // Size in bytes of a single mip level. Tiled levels are padded to whole tiles
+    // and all levels to 16 bytes, this has to match Texture_GetLevelSize() in texture.cl.
+    std::size_t GetMipLevelSize(Texture::Format format, Texture::Layout layout, int width, int height);
+
+    // Size in bytes of the texture data with all its mip levels.
+    std::size_t GetMipChainSize(Texture const& texture);
+
+    // Write texture data followed by box filtered mip levels, each level
+    // is generated from the previous one. Texels are written in GetTextureLayout() order.
+    void WriteMipChain(Texture const& texture, char* data);
+}
@@ -0,0 +1,271 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Utils/normal_map.h"
+#include "Utils/half.h"
+#include "Utils/block_compression.h"
+#include "SceneGraph/shape.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <memory>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    // Same as GetOrthoVector in utils.cl
+    static float3 GetOrthoVector(float3 const& n)
+    {
+        if (std::fabs(n.z) > 0.f)
+        {
+            auto k = std::sqrt(n.y * n.y + n.z * n.z);
+            return float3(0.f, -n.z / k, n.y / k);
+        }
+
+        auto k = std::sqrt(n.x * n.x + n.y * n.y);
+        return float3(n.y / k, -n.x / k, 0.f);
+    }
+
+    static float3 ProjectToPlane(float3 const& v, float3 const& n)
+    {
+        return v - n * dot(n, v);
+    }
+
+    static float Length(float3 const& v)
+    {
+        return std::sqrt(dot(v, v));
+    }
+
+    std::vector<float4> ComputeTangents(float3 const* positions, float3 const* normals,
+        float2 const* uvs, std::size_t num_vertices, std::uint32_t const* indices, std::size_t num_indices)
+    {
+        std::vector<float3> tangents(num_vertices);
+        std::vector<float3> bitangents(num_vertices);
+
+        for (std::size_t i = 0; uvs && i + 2 < num_indices; i += 3)
+        {
+            std::uint32_t idx[3] = { indices[i], indices[i + 1], indices[i + 2] };
+
+            auto e1 = positions[idx[1]] - positions[idx[0]];
+            auto e2 = positions[idx[2]] - positions[idx[0]];
+            auto du1 = uvs[idx[1]].x - uvs[idx[0]].x;
+            auto dv1 = uvs[idx[1]].y - uvs[idx[0]].y;
+            auto du2 = uvs[idx[2]].x - uvs[idx[0]].x;
+            auto dv2 = uvs[idx[2]].y - uvs[idx[0]].y;
+
+            auto det = du1 * dv2 - du2 * dv1;
+
+            if (det == 0.f || !std::isfinite(det))
+            {
+                continue;
+            }
+
+            auto t = (e1 * dv2 - e2 * dv1) * (1.f / det);
+            auto b = (e2 * du1 - e1 * du2) * (1.f / det);
+
+            for (auto k = 0; k < 3; ++k)
+            {
+                auto v = idx[k];
+                auto a = positions[idx[(k + 1) % 3]] - positions[v];
+                auto c = positions[idx[(k + 2) % 3]] - positions[v];
+                auto la = Length(a);
+                auto lc = Length(c);
+
+                if (la == 0.f || lc == 0.f)
+                {
+                    continue;
+                }
+
+                auto angle = std::acos(std::min(std::max(dot(a, c) / (la * lc), -1.f), 1.f));
+                auto n = normals ? normals[v] : normalize(cross(e1, e2));
+                auto vt = ProjectToPlane(t, n);
+                auto vb = ProjectToPlane(b, n);
+                auto lt = Length(vt);
+                auto lb = Length(vb);
+
+                if (lt > 0.f)
+                {
+                    tangents[v] += vt * (angle / lt);
+                }
+
+                if (lb > 0.f)
+                {
+                    bitangents[v] += vb * (angle / lb);
+                }
+            }
+        }
+
+        std::vector<float4> result(num_vertices);
+
+        for (std::size_t i = 0; i < num_vertices; ++i)
+        {
+            auto n = normals ? normalize(normals[i]) : float3(0.f, 0.f, 1.f);
+            auto t = ProjectToPlane(tangents[i], n);
+
+            if (!(Length(t) > 1e-6f))
+            {
+                t = GetOrthoVector(n);
+            }
+
+            t = normalize(t);
+
+            auto sign = dot(cross(n, t), bitangents[i]) < 0.f ? -1.f : 1.f;
+            result[i] = float4(t.x, t.y, t.z, sign);
+        }
+
+        return result;
+    }
+
+    std::vector<float4> ComputeTangents(Mesh const& mesh)
+    {
+        auto num_vertices = mesh.GetNumVertices();
+
+        return ComputeTangents(mesh.GetVertices(),
+            mesh.GetNumNormals() == num_vertices ? mesh.GetNormals() : nullptr,
+            mesh.GetNumUVs() == num_vertices ? mesh.GetUVs() : nullptr,
+            num_vertices, mesh.GetIndices(), mesh.GetNumIndices());
+    }
+
+    // First channel of the texture as floats
+    static std::vector<float> GetHeights(Texture const& texture)
+    {
+        auto format = texture.GetFormat();
+        auto size = texture.GetSize();
+        auto num_texels = static_cast<std::size_t>(size.x) * size.y;
+        auto data = texture.GetData();
+
+        std::vector<float> heights(num_texels);
+
+        switch (format)
+        {
+            case Texture::Format::kRgba8:
+            case Texture::Format::kRG8:
+            case Texture::Format::kR8:
+            {
+                auto texels = reinterpret_cast<std::uint8_t const*>(data);
+                auto stride = Texture::GetPixelSize(format);
+
+                for (std::size_t i = 0; i < num_texels; ++i)
+                {
+                    heights[i] = texels[i * stride] / 255.f;
+                }
+                break;
+            }
+            case Texture::Format::kRgba16:
+            case Texture::Format::kR16F:
+            {
+                auto texels = reinterpret_cast<std::uint16_t const*>(data);
+                auto stride = Texture::GetChannelCount(format);
+
+                for (std::size_t i = 0; i < num_texels; ++i)
+                {
+                    half h;
+                    h.setBits(texels[i * stride]);
+                    heights[i] = h;
+                }
+                break;
+            }
+            case Texture::Format::kRgba32:
+            case Texture::Format::kR32F:
+            {
+                auto texels = reinterpret_cast<float const*>(data);
+                auto stride = Texture::GetChannelCount(format);
+
+                for (std::size_t i = 0; i < num_texels; ++i)
+                {
+                    heights[i] = texels[i * stride];
+                }
+                break;
+            }
+            default:
+            {
+                auto texels = DecodeImage(format, data, size.x, size.y);
+
+                for (std::size_t i = 0; i < num_texels; ++i)
+                {
+                    heights[i] = texels[4 * i];
+                }
+                break;
+            }
+        }
+
+        return heights;
+    }
+
+    static std::shared_ptr<char const> ComputeNormalMapData(Texture const& bump)
+    {
+        auto size = bump.GetSize();
+        auto width = size.x;
+        auto height = size.y;
+        auto heights = GetHeights(bump);
+
+        auto data = std::shared_ptr<char>(new char[Texture::GetDataSize(Texture::Format::kRG8, size)], std::default_delete<char[]>());
+        auto texels = reinterpret_cast<std::uint8_t*>(data.get());
+
+        // Neighbours wrap around like in Texture_SampleBump
+        auto fetch = [&](int s, int t)
+        {
+            return heights[((t + height) % height) * width + (s + width) % width];
+        };
+
+        auto pack = [](float value)
+        {
+            return static_cast<std::uint8_t>(std::round((0.5f * value + 0.5f) * 255.f));
+        };
+
+        for (auto t = 0; t < height; ++t)
+        {
+            for (auto s = 0; s < width; ++s)
+            {
+                auto gx = fetch(s - 1, t - 1) - fetch(s + 1, t - 1) + 2.f * fetch(s - 1, t) - 2.f * fetch(s + 1, t) + fetch(s - 1, t + 1) - fetch(s + 1, t + 1);
+                auto gy = fetch(s - 1, t - 1) + 2.f * fetch(s, t - 1) + fetch(s + 1, t - 1) - fetch(s - 1, t + 1) - 2.f * fetch(s, t + 1) - fetch(s + 1, t + 1);
+                auto n = normalize(float3(gx, gy, 1.f));
+
+                // Z is reconstructed when the normal is applied
+                auto texel = texels + 2 * (static_cast<std::size_t>(t) * width + s);
+                texel[0] = pack(n.x);
+                texel[1] = pack(n.y);
+            }
+        }
+
+        return data;
+    }
+
+    Texture::Ptr ConvertBumpToNormalMap(Texture::Ptr bump)
+    {
+        auto size = bump->GetSize();
+        auto mipmap_enabled = bump->IsMipmapEnabled();
+
+        // Source is dropped once converted, the future keeps the callable alive
+        auto data = std::async(std::launch::deferred, [bump]() mutable
+        {
+            auto result = ComputeNormalMapData(*bump);
+            bump.reset();
+            return result;
+        }).share();
+
+        auto texture = Texture::Create(data, RadeonRays::int3(size.x, size.y, 1), Texture::Format::kRG8);
+        texture->SetMipmapEnabled(mipmap_enabled);
+        return texture;
+    }
+}
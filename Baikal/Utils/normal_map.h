@@ -0,0 +1,49 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "SceneGraph/texture.h"
+#include "math/float2.h"
+#include "math/float3.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    class Mesh;
+
+    // Per vertex tangent frames following MikkTSpace conventions: face tangents are weighted by
+    // corner angle and projected to the vertex normal plane, w is the bitangent sign so that
+    // bitangent = w * cross(normal, tangent). Vertices without valid UV mapping get an arbitrary
+    // tangent orthogonal to the normal. uvs may be null.
+    std::vector<RadeonRays::float4> ComputeTangents(RadeonRays::float3 const* positions, RadeonRays::float3 const* normals,
+        RadeonRays::float2 const* uvs, std::size_t num_vertices, std::uint32_t const* indices, std::size_t num_indices);
+    std::vector<RadeonRays::float4> ComputeTangents(Mesh const& mesh);
+
+    // RG8 tangent space normal map (X and Y packed to [0, 1], Z is reconstructed by the shading
+    // code), computed from the first channel of a height map with the Sobel filter
+    // Texture_SampleBump uses. Conversion is deferred to the first data access, so pending
+    // bump map loads are not waited for.
+    Texture::Ptr ConvertBumpToNormalMap(Texture::Ptr bump);
+}
@@ -0,0 +1,127 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "texture_dedup.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace Baikal
+{
+    namespace
+    {
+        // Entries are not swept while there are only a few of them
+        std::size_t const kMinPruneSize = 64;
+
+        std::uint64_t HashHeader(Texture const& texture, std::uint64_t seed)
+        {
+            auto size = texture.GetSize();
+            auto hash = HashValue(texture.GetFormat(), seed);
+            hash = HashValue(size.x, hash);
+            hash = HashValue(size.y, hash);
+            return HashValue(size.z, hash);
+        }
+
+        bool IsSameTexture(Texture const& lhs, Texture const& rhs)
+        {
+            auto lhs_size = lhs.GetSize();
+            auto rhs_size = rhs.GetSize();
+
+            return lhs.GetFormat() == rhs.GetFormat() &&
+                lhs_size.x == rhs_size.x && lhs_size.y == rhs_size.y && lhs_size.z == rhs_size.z &&
+                std::memcmp(lhs.GetData(), rhs.GetData(), lhs.GetSizeInBytes()) == 0;
+        }
+    }
+
+    std::uint64_t ComputeTextureHash(Texture const& texture)
+    {
+        return HashBuffer64(texture.GetData(), texture.GetSizeInBytes(), HashHeader(texture, kHashSeed));
+    }
+
+    TextureRegistry& TextureRegistry::GetInstance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    Texture::Ptr TextureRegistry::Register(Texture::Ptr texture)
+    {
+        return Register(ComputeTextureHash(*texture), texture, true);
+    }
+
+    Texture::Ptr TextureRegistry::Register(std::uint64_t source_hash, Texture::Ptr texture)
+    {
+        // Source hashes and data hashes never refer to the same texture
+        return Register(HashHeader(*texture, ~source_hash), texture, false);
+    }
+
+    Texture::Ptr TextureRegistry::Register(std::uint64_t hash, Texture::Ptr texture, bool compare_data)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ++m_stats.num_textures;
+
+        // Drop entries of freed textures once the map has doubled since the last sweep
+        if (m_textures.size() >= m_prune_size)
+        {
+            for (auto iter = m_textures.begin(); iter != m_textures.end();)
+            {
+                iter = iter->second.expired() ? m_textures.erase(iter) : std::next(iter);
+            }
+
+            m_prune_size = std::max(2 * m_textures.size(), kMinPruneSize);
+        }
+
+        auto& entry = m_textures[hash];
+        auto registered = entry.lock();
+
+        // Hash collisions of different data keep both textures
+        if (registered && registered != texture && (!compare_data || IsSameTexture(*registered, *texture)))
+        {
+            ++m_stats.num_duplicates;
+            m_stats.bytes_saved += texture->GetSizeInBytes();
+            return registered;
+        }
+
+        if (!registered)
+        {
+            entry = texture;
+        }
+
+        return texture;
+    }
+
+    TextureDedupStats TextureRegistry::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    void TextureRegistry::Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_textures.clear();
+        m_stats = TextureDedupStats();
+        m_prune_size = 0;
+    }
+}
@@ -0,0 +1,84 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+/**
+ \file texture_dedup.h
+ \brief Registry sharing a single texture between loads of identical images.
+ */
+#pragma once
+
+#include "SceneGraph/texture.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace Baikal
+{
+    // Results of texture deduplication
+    struct TextureDedupStats
+    {
+        // Number of textures passed to the registry
+        std::size_t num_textures = 0;
+        // Number of textures replaced by previously registered ones
+        std::size_t num_duplicates = 0;
+        // Texture data bytes which are not stored and uploaded anymore
+        std::size_t bytes_saved = 0;
+    };
+
+    /**
+     \brief Returns a shared texture for duplicate image data.
+
+     Textures are fingerprinted by format, size and data. Registry holds weak references
+     only, so textures are freed as usual once the scene drops them. Registered textures
+     are shared between materials and must not be modified with SetData().
+     */
+    class TextureRegistry
+    {
+    public:
+        // Registry shared by image loaders
+        static TextureRegistry& GetInstance();
+
+        // Return registered texture with identical format, size and data or register this one
+        Texture::Ptr Register(Texture::Ptr texture);
+        // Same for textures identified by a fingerprint of their source (e.g. image file contents),
+        // used for textures which are not decoded yet
+        Texture::Ptr Register(std::uint64_t source_hash, Texture::Ptr texture);
+
+        TextureDedupStats GetStats() const;
+        // Forget registered textures and reset stats
+        void Clear();
+
+    private:
+        Texture::Ptr Register(std::uint64_t hash, Texture::Ptr texture, bool compare_data);
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::uint64_t, std::weak_ptr<Texture>> m_textures;
+        TextureDedupStats m_stats;
+        // Number of entries triggering the next sweep of expired ones
+        std::size_t m_prune_size = 0;
+    };
+
+    // Fingerprint of texture format, size and data
+    std::uint64_t ComputeTextureHash(Texture const& texture);
+}
@@ -0,0 +1,86 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Utils/thread_pool.h"
+
+#include <algorithm>
+
+namespace Baikal
+{
+    ThreadPool::ThreadPool(std::size_t num_threads)
+        : m_stop(false)
+    {
+        if (num_threads == 0)
+        {
+            num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        m_threads.reserve(num_threads);
+        for (std::size_t i = 0; i < num_threads; ++i)
+        {
+            m_threads.emplace_back(&ThreadPool::Run, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_all();
+
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+                if (m_tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+
+            task();
+        }
+    }
+
+    ThreadPool& ThreadPool::GetDefault()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+}
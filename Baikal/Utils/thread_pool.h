@@ -0,0 +1,88 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+     \brief Fixed size pool of worker threads executing tasks in submission order.
+     */
+    class ThreadPool
+    {
+    public:
+        // Use hardware thread count if num_threads is 0
+        explicit ThreadPool(std::size_t num_threads = 0);
+        // Finishes queued tasks and joins the workers
+        ~ThreadPool();
+
+        // Queue the task, its result or exception is delivered through the future
+        template <typename F>
+        std::future<typename std::result_of<F()>::type> Submit(F&& task);
+
+        std::size_t GetThreadCount() const { return m_threads.size(); }
+
+        // Pool shared by scene and image loaders
+        static ThreadPool& GetDefault();
+
+        // Disallow copying
+        ThreadPool(ThreadPool const&) = delete;
+        ThreadPool& operator = (ThreadPool const&) = delete;
+
+    private:
+        void Run();
+
+        std::vector<std::thread> m_threads;
+        std::queue<std::function<void()>> m_tasks;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_stop;
+    };
+
+    template <typename F>
+    inline std::future<typename std::result_of<F()>::type> ThreadPool::Submit(F&& task)
+    {
+        using Result = typename std::result_of<F()>::type;
+
+        // std::function requires copyable callables
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        auto future = packaged->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.emplace([packaged]() { (*packaged)(); });
+        }
+
+        m_condition.notify_one();
+        return future;
+    }
+}
@@ -0,0 +1,103 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Utils/vertex_compression.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    namespace
+    {
+        std::int16_t EncodeSnorm16(float value)
+        {
+            return static_cast<std::int16_t>(std::round(std::min(std::max(value, -1.f), 1.f) * 32767.f));
+        }
+
+        std::uint16_t Quantize(float value, float min, float extent)
+        {
+            return static_cast<std::uint16_t>(extent > 0.f ? std::round(std::min(std::max((value - min) / extent, 0.f), 1.f) * 65535.f) : 0.f);
+        }
+    }
+
+    void QuantizePosition(float3 const& p, float3 const& pmin, float3 const& extents, std::uint16_t* quantized)
+    {
+        quantized[0] = Quantize(p.x, pmin.x, extents.x);
+        quantized[1] = Quantize(p.y, pmin.y, extents.y);
+        quantized[2] = Quantize(p.z, pmin.z, extents.z);
+    }
+
+    float3 DequantizePosition(std::uint16_t const* quantized, float3 const& offset, float3 const& scale)
+    {
+        return float3(offset.x + quantized[0] * scale.x, offset.y + quantized[1] * scale.y, offset.z + quantized[2] * scale.z);
+    }
+
+    std::uint32_t EncodeOctahedralNormal(float3 const& n)
+    {
+        auto sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+
+        if (sum == 0.f)
+        {
+            return 0u;
+        }
+
+        auto x = n.x / sum;
+        auto y = n.y / sum;
+
+        if (n.z < 0.f)
+        {
+            auto ox = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+            auto oy = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+            x = ox;
+            y = oy;
+        }
+
+        return static_cast<std::uint16_t>(EncodeSnorm16(x)) | (static_cast<std::uint32_t>(static_cast<std::uint16_t>(EncodeSnorm16(y))) << 16);
+    }
+
+    float3 DecodeOctahedralNormal(std::uint32_t packed)
+    {
+        auto x = static_cast<std::int16_t>(packed & 0xffff) / 32767.f;
+        auto y = static_cast<std::int16_t>(packed >> 16) / 32767.f;
+        auto z = 1.f - std::fabs(x) - std::fabs(y);
+        auto t = std::max(-z, 0.f);
+        x += x >= 0.f ? -t : t;
+        y += y >= 0.f ? -t : t;
+
+        auto length = std::sqrt(x * x + y * y + z * z);
+        return float3(x / length, y / length, z / length);
+    }
+
+    std::uint32_t EncodeTangent(float4 const& t)
+    {
+        auto packed = EncodeOctahedralNormal(float3(t.x, t.y, t.z));
+        return t.w < 0.f ? (packed | 0x10000u) : (packed & ~0x10000u);
+    }
+
+    void EncodeShortIndices(std::uint32_t const* indices, std::size_t num_indices, std::uint16_t* encoded)
+    {
+        std::transform(indices, indices + num_indices, encoded,
+            [](std::uint32_t index) { return static_cast<std::uint16_t>(index); });
+    }
+}
@@ -0,0 +1,48 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/float3.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Baikal
+{
+    // Encoders of the compressed vertex layouts ClwScene uses, decoders mirror Scene_Fetch* in scene.cl.
+
+    // Quantize position to 16 bits per component relative to bounds
+    void QuantizePosition(RadeonRays::float3 const& p, RadeonRays::float3 const& pmin, RadeonRays::float3 const& extents, std::uint16_t* quantized);
+    // scale is extents / 65535
+    RadeonRays::float3 DequantizePosition(std::uint16_t const* quantized, RadeonRays::float3 const& offset, RadeonRays::float3 const& scale);
+
+    // Octahedral normal packed into two 16-bit snorm values
+    std::uint32_t EncodeOctahedralNormal(RadeonRays::float3 const& n);
+    RadeonRays::float3 DecodeOctahedralNormal(std::uint32_t packed);
+
+    // Octahedral tangent with bitangent sign (w) stored in the lowest bit of the second component
+    std::uint32_t EncodeTangent(RadeonRays::float4 const& t);
+
+    // 16-bit indices address at most 64K vertices
+    inline bool CanUseShortIndices(std::size_t num_vertices) { return num_vertices <= 0x10000; }
+    void EncodeShortIndices(std::uint32_t const* indices, std::size_t num_indices, std::uint16_t* encoded);
+}
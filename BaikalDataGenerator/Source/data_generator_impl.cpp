@@ -105,7 +105,7 @@ DataGeneratorImpl::DataGeneratorImpl(SceneObject* scene,
 
     m_context = std::make_unique<CLWContext>(CLWContext::Create(devices[device_idx]));
 
-    m_factory = std::make_unique<Baikal::ClwRenderFactory>(*m_context, "cache");
+    m_factory = std::make_unique<Baikal::ClwRenderFactory>(*m_context, "cache", "kernel_bundle");
 
     auto render = m_factory->CreateRenderer(
         Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
@@ -125,6 +125,8 @@ DataGeneratorImpl::DataGeneratorImpl(SceneObject* scene,
     }
 
     m_renderer->SetMaxBounces(num_bounces);
+
+    m_factory->WarmUp();
 }
 
 void DataGeneratorImpl::SaveMetadata() const
@@ -0,0 +1,291 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "compressed_image_io.h"
+#include "Utils/block_compression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        std::uint32_t MakeFourCC(char a, char b, char c, char d)
+        {
+            return static_cast<std::uint32_t>(a) | (static_cast<std::uint32_t>(b) << 8) |
+                (static_cast<std::uint32_t>(c) << 16) | (static_cast<std::uint32_t>(d) << 24);
+        }
+
+        struct DdsPixelFormat
+        {
+            std::uint32_t size;
+            std::uint32_t flags;
+            std::uint32_t fourcc;
+            std::uint32_t rgb_bit_count;
+            std::uint32_t bit_masks[4];
+        };
+
+        struct DdsHeader
+        {
+            std::uint32_t size;
+            std::uint32_t flags;
+            std::uint32_t height;
+            std::uint32_t width;
+            std::uint32_t pitch_or_linear_size;
+            std::uint32_t depth;
+            std::uint32_t mip_map_count;
+            std::uint32_t reserved1[11];
+            DdsPixelFormat pixel_format;
+            std::uint32_t caps[4];
+            std::uint32_t reserved2;
+        };
+
+        struct DdsHeaderDx10
+        {
+            std::uint32_t dxgi_format;
+            std::uint32_t resource_dimension;
+            std::uint32_t misc_flag;
+            std::uint32_t array_size;
+            std::uint32_t misc_flags2;
+        };
+
+        struct KtxHeader
+        {
+            std::uint8_t identifier[12];
+            std::uint32_t endianness;
+            std::uint32_t gl_type;
+            std::uint32_t gl_type_size;
+            std::uint32_t gl_format;
+            std::uint32_t gl_internal_format;
+            std::uint32_t gl_base_internal_format;
+            std::uint32_t pixel_width;
+            std::uint32_t pixel_height;
+            std::uint32_t pixel_depth;
+            std::uint32_t number_of_array_elements;
+            std::uint32_t number_of_faces;
+            std::uint32_t number_of_mipmap_levels;
+            std::uint32_t bytes_of_key_value_data;
+        };
+
+        static_assert(sizeof(DdsHeader) == 124, "DDS header size mismatch");
+        static_assert(sizeof(KtxHeader) == 64, "KTX header size mismatch");
+
+        std::uint32_t const kDdsFourCCFlag = 0x4;
+
+        bool GetDdsFormat(std::uint32_t fourcc, Texture::Format& format)
+        {
+            if (fourcc == MakeFourCC('D', 'X', 'T', '1'))
+                format = Texture::Format::kBC1;
+            else if (fourcc == MakeFourCC('A', 'T', 'I', '1') || fourcc == MakeFourCC('B', 'C', '4', 'U'))
+                format = Texture::Format::kBC4;
+            else if (fourcc == MakeFourCC('A', 'T', 'I', '2') || fourcc == MakeFourCC('B', 'C', '5', 'U'))
+                format = Texture::Format::kBC5;
+            else
+                return false;
+
+            return true;
+        }
+
+        bool GetDxgiFormat(std::uint32_t dxgi_format, Texture::Format& format)
+        {
+            switch (dxgi_format)
+            {
+            // DXGI_FORMAT_BC1_TYPELESS, DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC1_UNORM_SRGB
+            case 70: case 71: case 72: format = Texture::Format::kBC1; return true;
+            // DXGI_FORMAT_BC4_TYPELESS, DXGI_FORMAT_BC4_UNORM
+            case 79: case 80: format = Texture::Format::kBC4; return true;
+            // DXGI_FORMAT_BC5_TYPELESS, DXGI_FORMAT_BC5_UNORM
+            case 82: case 83: format = Texture::Format::kBC5; return true;
+            // DXGI_FORMAT_BC6H_UF16, signed BC6H is not supported
+            case 95: format = Texture::Format::kBC6H; return true;
+            // DXGI_FORMAT_BC7_TYPELESS, DXGI_FORMAT_BC7_UNORM, DXGI_FORMAT_BC7_UNORM_SRGB
+            case 97: case 98: case 99: format = Texture::Format::kBC7; return true;
+            default: return false;
+            }
+        }
+
+        bool GetKtxFormat(std::uint32_t gl_internal_format, Texture::Format& format)
+        {
+            switch (gl_internal_format)
+            {
+            // GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT and their sRGB variants
+            case 0x83F0: case 0x83F1: case 0x8C4C: case 0x8C4D: format = Texture::Format::kBC1; return true;
+            // GL_COMPRESSED_RED_RGTC1
+            case 0x8DBB: format = Texture::Format::kBC4; return true;
+            // GL_COMPRESSED_RG_RGTC2
+            case 0x8DBD: format = Texture::Format::kBC5; return true;
+            // GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT
+            case 0x8E8F: format = Texture::Format::kBC6H; return true;
+            // GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+            case 0x8E8C: case 0x8E8D: format = Texture::Format::kBC7; return true;
+            default: return false;
+            }
+        }
+
+        std::string GetExtension(std::string const& filename)
+        {
+            auto pos = filename.find_last_of('.');
+            if (pos == std::string::npos)
+            {
+                return std::string();
+            }
+
+            auto ext = filename.substr(pos + 1);
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+            return ext;
+        }
+
+        // Read top level data of known size and wrap it into the texture
+        Texture::Ptr ReadTexture(std::ifstream& in, std::string const& filename,
+            RadeonRays::int3 const& size, Texture::Format format)
+        {
+            auto data_size = GetBlockSize(format) * ((size.x + 3) / 4) * ((size.y + 3) / 4);
+            std::unique_ptr<char[]> data(new char[data_size]);
+
+            if (!in.read(data.get(), data_size))
+            {
+                throw std::runtime_error("Image " + filename + " is truncated");
+            }
+
+            return Texture::Create(data.release(), size, format);
+        }
+
+        // Read DDS headers, the stream is left at the top level data
+        void ReadDdsHeader(std::ifstream& in, std::string const& filename, RadeonRays::int3& size, Texture::Format& format)
+        {
+            std::uint32_t magic = 0;
+            DdsHeader header;
+
+            if (!in.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != MakeFourCC('D', 'D', 'S', ' ') ||
+                !in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.size != sizeof(DdsHeader))
+            {
+                throw std::runtime_error("Image " + filename + " is not a valid DDS file");
+            }
+
+            if (!(header.pixel_format.flags & kDdsFourCCFlag))
+            {
+                throw std::runtime_error("Image " + filename + ": uncompressed DDS images are not supported");
+            }
+
+            bool supported = false;
+
+            if (header.pixel_format.fourcc == MakeFourCC('D', 'X', '1', '0'))
+            {
+                DdsHeaderDx10 header_dx10;
+                if (!in.read(reinterpret_cast<char*>(&header_dx10), sizeof(header_dx10)))
+                {
+                    throw std::runtime_error("Image " + filename + " is not a valid DDS file");
+                }
+
+                supported = GetDxgiFormat(header_dx10.dxgi_format, format);
+            }
+            else
+            {
+                supported = GetDdsFormat(header.pixel_format.fourcc, format);
+            }
+
+            if (!supported)
+            {
+                throw std::runtime_error("Image " + filename + ": DDS format is not supported");
+            }
+
+            size = RadeonRays::int3(header.width, header.height, 1);
+        }
+
+        // Read KTX header, the stream is left at the top level data
+        void ReadKtxHeader(std::ifstream& in, std::string const& filename, RadeonRays::int3& size, Texture::Format& format)
+        {
+            std::uint8_t const identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+            KtxHeader header;
+
+            if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+                std::memcmp(header.identifier, identifier, sizeof(identifier)) != 0)
+            {
+                throw std::runtime_error("Image " + filename + " is not a valid KTX file");
+            }
+
+            if (header.endianness != 0x04030201)
+            {
+                throw std::runtime_error("Image " + filename + ": big endian KTX files are not supported");
+            }
+
+            if (header.gl_type != 0 || !GetKtxFormat(header.gl_internal_format, format))
+            {
+                throw std::runtime_error("Image " + filename + ": KTX format is not supported");
+            }
+
+            // Skip key/value pairs and size of the first level
+            in.seekg(header.bytes_of_key_value_data + sizeof(std::uint32_t), std::ios::cur);
+
+            size = RadeonRays::int3(header.pixel_width, std::max(header.pixel_height, 1u), 1);
+        }
+
+        // Open the container and read its headers
+        std::ifstream OpenCompressedImage(std::string const& filename, RadeonRays::int3& size, Texture::Format& format)
+        {
+            std::ifstream in(filename, std::ios::binary | std::ios::in);
+
+            if (!in)
+            {
+                throw std::runtime_error("Can't load " + filename + " image");
+            }
+
+            if (GetExtension(filename) == "dds")
+            {
+                ReadDdsHeader(in, filename, size, format);
+            }
+            else
+            {
+                ReadKtxHeader(in, filename, size, format);
+            }
+
+            return in;
+        }
+    }
+
+    bool IsCompressedImageFile(std::string const& filename)
+    {
+        auto ext = GetExtension(filename);
+        return ext == "dds" || ext == "ktx";
+    }
+
+    Texture::Ptr LoadCompressedImage(std::string const& filename)
+    {
+        RadeonRays::int3 size;
+        Texture::Format format;
+        auto in = OpenCompressedImage(filename, size, format);
+
+        auto texture = ReadTexture(in, filename, size, format);
+        texture->SetName(filename);
+        return texture;
+    }
+
+    void GetCompressedImageInfo(std::string const& filename, RadeonRays::int3& size, Texture::Format& format)
+    {
+        OpenCompressedImage(filename, size, format);
+    }
+}
@@ -0,0 +1,39 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <string>
+
+#include "SceneGraph/texture.h"
+
+namespace Baikal
+{
+    // Check if the file is a DDS or KTX container by its extension
+    bool IsCompressedImageFile(std::string const& filename);
+
+    // Load top mip level of block compressed DDS or KTX image.
+    // Throws std::runtime_error if the file can't be read or its format is not supported.
+    Texture::Ptr LoadCompressedImage(std::string const& filename);
+
+    // Read size and format of the top mip level from the headers only, throws like LoadCompressedImage()
+    void GetCompressedImageInfo(std::string const& filename, RadeonRays::int3& size, Texture::Format& format);
+}
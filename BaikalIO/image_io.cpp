@@ -1,5 +1,11 @@
 #include "image_io.h"
+#include "compressed_image_io.h"
+#include "texture_cache.h"
 #include "SceneGraph/texture.h"
+#include "Utils/block_compression.h"
+#include "Utils/hash.h"
+#include "Utils/texture_dedup.h"
+#include "Utils/thread_pool.h"
 
 #include "OpenImageIO/imageio.h"
 
@@ -7,37 +13,135 @@
 #include "file_utils.h"
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
 namespace Baikal
 {
     class Oiio : public ImageIo
     {
     public:
+        explicit Oiio(bool import_compression)
+            : m_import_compression(import_compression)
+        {
+        }
+
+        Texture::Ptr LoadImage(std::string const& filename) const override;
+        void SaveImage(std::string const& filename, Texture::Ptr texture) const override;
+        void GetImageInfo(std::string const& filename, RadeonRays::int3& size, Texture::Format& format) const override;
+        std::unique_ptr<ImageIo> Clone() const override;
+
+        // Import setting the instance was created with
+        bool IsImportCompressionEnabled() const { return m_import_compression; }
+
+    private:
+        bool m_import_compression;
+    };
+
+    // Loads converted textures from the cache, decodes and stores them on miss
+    class CachedImageIo : public ImageIo
+    {
+    public:
+        CachedImageIo(std::unique_ptr<Oiio> io, std::shared_ptr<TextureCache> cache)
+            : m_io(std::move(io))
+            , m_cache(cache)
+        {
+        }
+
         Texture::Ptr LoadImage(std::string const& filename) const override;
         void SaveImage(std::string const& filename, Texture::Ptr texture) const override;
+        void GetImageInfo(std::string const& filename, RadeonRays::int3& size, Texture::Format& format) const override;
+        std::unique_ptr<ImageIo> Clone() const override;
+
+    private:
+        std::unique_ptr<Oiio> m_io;
+        std::shared_ptr<TextureCache> m_cache;
     };
 
+    static std::atomic<bool> g_import_compression(false);
+
+    // Fingerprint of the image file taken from its metadata so it doesn't need
+    // to be read, false if the file doesn't exist
+    static bool HashImageFile(std::string const& filename, Texture::Format format, std::uint64_t& hash)
+    {
+        std::string actual_filename = filename;
+
+#ifdef __linux__
+        if (!FindFilenameFromCaseInsensitive(filename, actual_filename))
+        {
+            return false;
+        }
+#endif
+
+        auto key = TextureCache::GetSourceKey(actual_filename);
+        if (key.empty())
+        {
+            return false;
+        }
+
+        // Import settings change the format, textures converted differently are not shared
+        key += "\n" + std::to_string(static_cast<int>(format));
+        hash = Hash64(key.data(), key.size());
+        return true;
+    }
+
+    static std::mutex g_texture_cache_mutex;
+    static std::shared_ptr<TextureCache> g_texture_cache;
+
+    // Single and dual channel images keep their channel count, the rest is expanded to RGBA
     static Texture::Format GetTextureFormat(OIIO_NAMESPACE::ImageSpec const& spec)
     {
         OIIO_NAMESPACE_USING
 
         if (spec.format.basetype == TypeDesc::UINT8)
-            return Texture::Format::kRgba8;
+        {
+            if (spec.nchannels == 1)
+                return Texture::Format::kR8;
+            else if (spec.nchannels == 2)
+                return Texture::Format::kRG8;
+            else
+                return Texture::Format::kRgba8;
+        }
         else if (spec.format.basetype == TypeDesc::HALF)
-            return Texture::Format::kRgba16;
+            return spec.nchannels == 1 ? Texture::Format::kR16F : Texture::Format::kRgba16;
         else
-            return Texture::Format::kRgba32;
+            return spec.nchannels == 1 ? Texture::Format::kR32F : Texture::Format::kRgba32;
+    }
+
+    // Format of the loaded texture, 8-bit images without alpha are block compressed if enabled
+    static Texture::Format GetImportFormat(OIIO_NAMESPACE::ImageSpec const& spec, bool import_compression)
+    {
+        auto fmt = GetTextureFormat(spec);
+
+        if (!import_compression || spec.depth != 1)
+            return fmt;
+        else if (fmt == Texture::Format::kR8)
+            return Texture::Format::kBC4;
+        else if (fmt == Texture::Format::kRgba8 && spec.nchannels == 3)
+            return Texture::Format::kBC1;
+        else
+            return fmt;
     }
 
     static OIIO_NAMESPACE::TypeDesc GetTextureFormat(Texture::Format fmt)
     {
         OIIO_NAMESPACE_USING
 
-        if (fmt == Texture::Format::kRgba8)
-            return  TypeDesc::UINT8;
-        else if (fmt == Texture::Format::kRgba16)
+        switch (fmt)
+        {
+        case Texture::Format::kRgba8:
+        case Texture::Format::kR8:
+        case Texture::Format::kRG8:
+            return TypeDesc::UINT8;
+        case Texture::Format::kRgba16:
+        case Texture::Format::kR16F:
             return TypeDesc::HALF;
-        else
+        default:
             return TypeDesc::FLOAT;
+        }
     }
 
     Texture::Ptr Oiio::LoadImage(const std::string &filename) const
@@ -53,6 +157,13 @@ namespace Baikal
         }
 #endif
 
+        if (IsCompressedImageFile(actual_filename))
+        {
+            auto tex = LoadCompressedImage(actual_filename);
+            tex->SetName(filename);
+            return tex;
+        }
+
         std::unique_ptr<ImageInput> input{ImageInput::open(actual_filename)};
 
         if (!input)
@@ -63,60 +174,37 @@ namespace Baikal
         ImageSpec const& spec = input->spec();
 
         auto fmt = GetTextureFormat(spec);
-        char* texturedata = nullptr;
+        auto pixel_size = Texture::GetPixelSize(fmt);
+        auto num_channels = Texture::GetChannelCount(fmt);
+        auto size = spec.width * spec.height * spec.depth * pixel_size;
 
-        if (fmt == Texture::Format::kRgba8)
-        {
-            auto size = spec.width * spec.height * spec.depth * 4;
+        char* texturedata = new char[size];
+        memset(texturedata, 0, size);
 
-            texturedata = new char[size];
-            memset(texturedata, 0, size);
+        // Read data to storage, channels missing in the file stay zero
+        input->read_image(GetTextureFormat(fmt), texturedata, pixel_size);
 
-            // Read data to storage
-            input->read_image(TypeDesc::UINT8, texturedata, sizeof(char) * 4);
+        // Close handle
+        input->close();
 
-            if (spec.nchannels == 1)
+        // Opaque images are encoded, alpha would be lost in BC1
+        auto compressed_fmt = GetImportFormat(spec, m_import_compression);
+        if (compressed_fmt != fmt)
+        {
+            auto num_texels = spec.width * spec.height;
+
+            std::vector<float> texels(4 * num_texels, 0.f);
+            for (auto i = 0; i < num_texels; ++i)
             {
-                // set B, G and A components to 
-                for (auto i = 0; i < size; i += 4)
+                for (auto c = 0u; c < num_channels; ++c)
                 {
-                    texturedata[i + 1] = texturedata[i];
-                    texturedata[i + 2] = texturedata[i];
-                    texturedata[i + 3] = texturedata[i];
+                    texels[4 * i + c] = static_cast<std::uint8_t>(texturedata[num_channels * i + c]) / 255.f;
                 }
-
             }
 
-            // Close handle
-            input->close();
-        }
-        else if (fmt == Texture::Format::kRgba16)
-        {
-            auto size = spec.width * spec.height * spec.depth * sizeof(float) * 2;
-
-            // Resize storage
-            texturedata = new char[size];
-            memset(texturedata, 0, size);
-
-            // Read data to storage
-            input->read_image(TypeDesc::HALF, texturedata, sizeof(float) * 2);
-
-            // Close handle
-            input->close();
-        }
-        else
-        {
-            auto size = spec.width * spec.height * spec.depth * sizeof(RadeonRays::float3);
-
-            // Resize storage
-            texturedata = new char[size];
-            memset(texturedata, 0, size);
-
-            // Read data to storage
-            input->read_image(TypeDesc::FLOAT, texturedata, sizeof(RadeonRays::float3));
-
-            // Close handle
-            input->close();
+            delete[] texturedata;
+            texturedata = EncodeImage(compressed_fmt, texels.data(), spec.width, spec.height);
+            fmt = compressed_fmt;
         }
 
         auto tex = Texture::Create(texturedata, RadeonRays::int3(spec.width, spec.height, spec.depth), fmt);;
@@ -136,9 +224,22 @@ namespace Baikal
         }
 
         auto dim = texture->GetSize();
+
+        // Block compressed textures are written decoded
+        if (IsBlockCompressed(texture->GetFormat()))
+        {
+            auto texels = DecodeImage(texture->GetFormat(), texture->GetData(), dim.x, dim.y);
+
+            ImageSpec spec(dim.x, dim.y, 4, TypeDesc::FLOAT);
+            out->open(filename, spec);
+            out->write_image(TypeDesc::FLOAT, texels.data());
+            out->close();
+            return;
+        }
+
         auto fmt = GetTextureFormat(texture->GetFormat());
 
-        ImageSpec spec(dim.x, dim.y, 4, fmt);
+        ImageSpec spec(dim.x, dim.y, Texture::GetChannelCount(texture->GetFormat()), fmt);
 
         out->open(filename, spec);
 
@@ -147,8 +248,187 @@ namespace Baikal
         out->close();
     }
 
+    void Oiio::GetImageInfo(std::string const& filename, RadeonRays::int3& size, Texture::Format& format) const
+    {
+        OIIO_NAMESPACE_USING
+
+        std::string actual_filename = filename;
+
+#ifdef __linux__
+        if (!FindFilenameFromCaseInsensitive(filename, actual_filename))
+        {
+            throw std::runtime_error("Image " + filename + " doesn't exist");
+        }
+#endif
+
+        // Compressed containers are not decoded anyway
+        if (IsCompressedImageFile(actual_filename))
+        {
+            GetCompressedImageInfo(actual_filename, size, format);
+            return;
+        }
+
+        std::unique_ptr<ImageInput> input{ImageInput::open(actual_filename)};
+
+        if (!input)
+        {
+            throw std::runtime_error("Can't load " + filename + " image");
+        }
+
+        ImageSpec const& spec = input->spec();
+        size = RadeonRays::int3(spec.width, spec.height, spec.depth);
+        format = GetImportFormat(spec, m_import_compression);
+
+        input->close();
+    }
+
+    Texture::Ptr CachedImageIo::LoadImage(std::string const& filename) const
+    {
+        std::string actual_filename = filename;
+
+#ifdef __linux__
+        if (!FindFilenameFromCaseInsensitive(filename, actual_filename))
+        {
+            throw std::runtime_error("Image " + filename + " doesn't exist");
+        }
+#endif
+
+        auto texture = m_cache->Load(actual_filename, m_io->IsImportCompressionEnabled());
+
+        if (!texture)
+        {
+            texture = m_io->LoadImage(filename);
+            m_cache->Store(actual_filename, m_io->IsImportCompressionEnabled(), *texture);
+        }
+
+        texture->SetName(filename);
+        return texture;
+    }
+
+    void CachedImageIo::SaveImage(std::string const& filename, Texture::Ptr texture) const
+    {
+        m_io->SaveImage(filename, texture);
+    }
+
+    std::unique_ptr<ImageIo> Oiio::Clone() const
+    {
+        return std::make_unique<Oiio>(m_import_compression);
+    }
+
+    void CachedImageIo::GetImageInfo(std::string const& filename, RadeonRays::int3& size, Texture::Format& format) const
+    {
+        std::string actual_filename = filename;
+
+#ifdef __linux__
+        if (!FindFilenameFromCaseInsensitive(filename, actual_filename))
+        {
+            throw std::runtime_error("Image " + filename + " doesn't exist");
+        }
+#endif
+
+        // Mapping the entry is cheaper than opening the image
+        if (auto texture = m_cache->Load(actual_filename, m_io->IsImportCompressionEnabled()))
+        {
+            size = texture->GetSize();
+            format = texture->GetFormat();
+            return;
+        }
+
+        m_io->GetImageInfo(filename, size, format);
+    }
+
+    std::unique_ptr<ImageIo> CachedImageIo::Clone() const
+    {
+        return std::make_unique<CachedImageIo>(std::make_unique<Oiio>(m_io->IsImportCompressionEnabled()), m_cache);
+    }
+
+    Texture::Ptr ImageIo::LoadImageAsync(std::string const& filename, bool deferred, bool* shared) const
+    {
+        RadeonRays::int3 size;
+        Texture::Format format;
+        GetImageInfo(filename, size, format);
+
+        // Decode with settings of this IO even if they change or it is destroyed meanwhile
+        std::shared_ptr<ImageIo const> io(Clone());
+
+        // Failures are thrown from the pending data when the texture is accessed
+        auto load = [io, filename, size, format]() -> std::shared_ptr<char const>
+        {
+            auto texture = io->LoadImage(filename);
+            auto loaded_size = texture->GetSize();
+
+            if (texture->GetFormat() != format || loaded_size.x != size.x || loaded_size.y != size.y || loaded_size.z != std::max(size.z, 1))
+            {
+                throw std::runtime_error("Image " + filename + " has changed while loading");
+            }
+
+            // Data stays owned by the loaded texture
+            return std::shared_ptr<char const>(texture, texture->GetData());
+        };
+
+        std::uint64_t source_hash = 0;
+        bool can_share = HashImageFile(filename, format, source_hash);
+
+        std::shared_ptr<std::packaged_task<std::shared_ptr<char const>()>> task;
+        Texture::Ptr texture;
+
+        if (deferred)
+        {
+            texture = Texture::Create(std::async(std::launch::deferred, load).share(), size, format);
+        }
+        else
+        {
+            task = std::make_shared<std::packaged_task<std::shared_ptr<char const>()>>(load);
+            texture = Texture::Create(task->get_future().share(), size, format);
+        }
+
+        texture->SetName(filename);
+
+        auto registered = can_share ? TextureRegistry::GetInstance().Register(source_hash, texture) : texture;
+
+        if (shared)
+        {
+            *shared = registered != texture;
+        }
+
+        // Loading is started only if the image hasn't been loaded already
+        if (task && registered == texture)
+        {
+            ThreadPool::GetDefault().Submit([task]() { (*task)(); });
+        }
+
+        return registered;
+    }
+
+    void ImageIo::SetImportCompression(bool enabled)
+    {
+        g_import_compression = enabled;
+    }
+
+    bool ImageIo::GetImportCompression()
+    {
+        return g_import_compression;
+    }
+
+    void ImageIo::SetTextureCache(std::string const& directory, std::uint64_t max_size)
+    {
+        std::lock_guard<std::mutex> lock(g_texture_cache_mutex);
+        g_texture_cache = directory.empty() ? nullptr : std::make_shared<TextureCache>(directory, max_size);
+    }
+
     std::unique_ptr<ImageIo> ImageIo::CreateImageIo()
     {
-        return std::make_unique<Oiio>();
+        std::shared_ptr<TextureCache> cache;
+        {
+            std::lock_guard<std::mutex> lock(g_texture_cache_mutex);
+            cache = g_texture_cache;
+        }
+
+        if (cache)
+        {
+            return std::make_unique<CachedImageIo>(std::make_unique<Oiio>(g_import_compression), cache);
+        }
+
+        return std::make_unique<Oiio>(g_import_compression);
     }
 }
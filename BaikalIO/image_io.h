@@ -28,6 +28,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <memory>
 
@@ -63,9 +64,29 @@ namespace Baikal
         // Destructor
         virtual ~ImageIo() = default;
         
-        // Load texture from file
+        // Load texture from file, DDS and KTX files are loaded block compressed
         virtual Texture::Ptr LoadImage(std::string const& filename) const = 0;
         virtual void SaveImage(std::string const& filename, Texture::Ptr texture) const = 0;
+        // Read dimensions and format LoadImage() would produce without decoding the image
+        virtual void GetImageInfo(std::string const& filename, RadeonRays::int3& size, Texture::Format& format) const = 0;
+        // Create IO with the same settings, e.g. to decode the image again after this one is gone
+        virtual std::unique_ptr<ImageIo> Clone() const = 0;
+
+        // Return texture with the final size and format right away and load its data on the
+        // default thread pool, or on first data access if deferred. Throws if the file can't be
+        // opened, later decoding failures are rethrown on every access to the texture data.
+        // Loads of the same unchanged file share a single texture through TextureRegistry,
+        // shared is set if such a texture loaded before is returned.
+        Texture::Ptr LoadImageAsync(std::string const& filename, bool deferred = false, bool* shared = nullptr) const;
+
+        // Encode 8-bit images without alpha into BC1 (RGB) or BC4 (grayscale) on load,
+        // disabled by default. Affects image IO instances created afterwards.
+        static void SetImportCompression(bool enabled);
+        static bool GetImportCompression();
+
+        // Keep converted textures in a persistent cache in the directory, images IO created
+        // afterwards load them memory mapped. max_size is in bytes, empty directory disables the cache.
+        static void SetTextureCache(std::string const& directory, std::uint64_t max_size);
         
         // Disallow copying
         ImageIo(ImageIo const&) = delete;
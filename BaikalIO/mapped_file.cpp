@@ -0,0 +1,128 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Baikal
+{
+    MappedFile::Ptr MappedFile::Open(std::string const& filename)
+    {
+        Ptr file(new MappedFile());
+
+#ifdef WIN32
+        file->m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (file->m_file == INVALID_HANDLE_VALUE)
+        {
+            file->m_file = nullptr;
+            throw std::runtime_error("Can't open " + filename);
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file->m_file, &size))
+        {
+            throw std::runtime_error("Can't get size of " + filename);
+        }
+
+        file->m_size = static_cast<std::size_t>(size.QuadPart);
+
+        if (file->m_size > 0)
+        {
+            file->m_mapping = CreateFileMappingA(file->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!file->m_mapping)
+            {
+                throw std::runtime_error("Can't map " + filename);
+            }
+
+            file->m_data = static_cast<char const*>(MapViewOfFile(file->m_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Can't open " + filename);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Can't get size of " + filename);
+        }
+
+        file->m_size = static_cast<std::size_t>(st.st_size);
+
+        if (file->m_size > 0)
+        {
+            void* data = mmap(nullptr, file->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            file->m_data = data == MAP_FAILED ? nullptr : static_cast<char const*>(data);
+        }
+
+        // Mapping stays valid after the descriptor is closed
+        close(fd);
+#endif
+
+        if (file->m_size > 0 && !file->m_data)
+        {
+            throw std::runtime_error("Can't map " + filename);
+        }
+
+        return file;
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifdef WIN32
+        if (m_data)
+        {
+            UnmapViewOfFile(m_data);
+        }
+
+        if (m_mapping)
+        {
+            CloseHandle(m_mapping);
+        }
+
+        if (m_file)
+        {
+            CloseHandle(m_file);
+        }
+#else
+        if (m_data)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+#endif
+    }
+}
@@ -9,13 +9,16 @@
 #include "SceneGraph/inputmaps.h"
 
 #include "image_io.h"
+#include "scene_io.h"
 
 #include "XML/tinyxml2.h"
 
 #include <sstream>
 #include <map>
 #include <stack>
+#include <stdexcept>
 #include <string>
+#include <vector>
 #include <assert.h>
 
 namespace Baikal
@@ -32,7 +35,18 @@ namespace Baikal
         // Load materials from disk
         std::unique_ptr<Iterator> LoadMaterials(std::string const& file_name) override;
 
+        // Save materials into a string
+        std::string SaveMaterialsToString(std::string const& base_path, Iterator& iterator) override;
+
+        // Load materials from a string
+        std::unique_ptr<Iterator> LoadMaterialsFromString(std::string const& data, std::string const& base_path) override;
+
     private:
+        // Write inputs and materials
+        void WriteMaterials(XMLPrinter& printer, Iterator& iterator);
+        // Load inputs and materials from parsed document
+        std::unique_ptr<Iterator> LoadMaterials(XMLDocument& doc);
+
         // Write single material
         void WriteMaterial(ImageIo& io, XMLPrinter& printer, Material::Ptr material);
         // Write single InputMap
@@ -177,7 +191,28 @@ namespace Baikal
         XMLDocument doc;
         XMLPrinter printer;
 
+        WriteMaterials(printer, mat_iter);
+
+        doc.Parse(printer.CStr());
+
+        doc.SaveFile(filename.c_str());
+    }
+
+    std::string MaterialIoXML::SaveMaterialsToString(std::string const& base_path, Iterator& mat_iter)
+    {
+        m_base_path = base_path;
+
+        XMLPrinter printer;
+
+        WriteMaterials(printer, mat_iter);
+
+        return std::string(printer.CStr());
+    }
+
+    void MaterialIoXML::WriteMaterials(XMLPrinter& printer, Iterator& mat_iter)
+    {
         m_tex2name.clear();
+        m_saved_inputs.clear();
 
         auto image_io = ImageIo::CreateImageIo();
 
@@ -215,10 +250,6 @@ namespace Baikal
             }
         }
         printer.CloseElement();
-
-        doc.Parse(printer.CStr());
-
-        doc.SaveFile(filename.c_str());
     }
 
     Material::Ptr MaterialIoXML::LoadMaterial(ImageIo& io, XMLElement& element, const std::map<uint32_t, InputMap::Ptr> &loaded_inputs)
@@ -256,10 +287,6 @@ namespace Baikal
 
     std::unique_ptr<Iterator> MaterialIoXML::LoadMaterials(std::string const& file_name)
     {
-        m_id2mat.clear();
-        m_name2tex.clear();
-        m_resolve_requests.clear();
-
         auto slash = file_name.find_last_of('/');
         if (slash == std::string::npos) slash = file_name.find_last_of('\\');
         if (slash != std::string::npos)
@@ -270,6 +297,29 @@ namespace Baikal
         XMLDocument doc;
         doc.LoadFile(file_name.c_str());
 
+        return LoadMaterials(doc);
+    }
+
+    std::unique_ptr<Iterator> MaterialIoXML::LoadMaterialsFromString(std::string const& data, std::string const& base_path)
+    {
+        m_base_path = base_path;
+
+        XMLDocument doc;
+
+        if (doc.Parse(data.c_str(), data.size()) != XML_SUCCESS)
+        {
+            throw std::runtime_error("MaterialIoXML: cannot parse materials");
+        }
+
+        return LoadMaterials(doc);
+    }
+
+    std::unique_ptr<Iterator> MaterialIoXML::LoadMaterials(XMLDocument& doc)
+    {
+        m_id2mat.clear();
+        m_name2tex.clear();
+        m_resolve_requests.clear();
+
         auto image_io = ImageIo::CreateImageIo();
 
         std::map<uint32_t, XMLElement*> input_map_cache;
@@ -286,12 +336,13 @@ namespace Baikal
             LoadInputMap(*image_io, element, input_map_cache, loaded_elements);
         }
 
-        std::set<Material::Ptr> materials;
+        // Keep document order
+        std::vector<Material::Ptr> materials;
         auto materials_node = doc.FirstChildElement("Materials");
         for (auto element = materials_node->FirstChildElement(); element; element = element->NextSiblingElement())
         {
             auto material = LoadMaterial(*image_io, *element, loaded_elements);
-            materials.insert(material);
+            materials.push_back(material);
         }
 
         // Fix up non-resolved stuff
@@ -300,7 +351,7 @@ namespace Baikal
             i.material->SetInputValue(i.input, m_id2mat[i.id]);
         }
 
-        return std::make_unique<ContainerIterator<std::set<Material::Ptr>>>(std::move(materials));
+        return std::make_unique<ContainerIterator<std::vector<Material::Ptr>>>(std::move(materials));
     }
 
     void MaterialIo::SaveMaterialsFromScene(std::string const& filename, Scene1 const& scene)
@@ -660,7 +711,7 @@ namespace Baikal
                 }
                 else
                 {
-                    texture = io.LoadImage(m_base_path + filename);
+                    texture = SceneIo::LoadImage(io, m_base_path + filename);
                     m_name2tex[name] = texture;
                 }
 
@@ -681,7 +732,7 @@ namespace Baikal
                 }
                 else
                 {
-                    texture = io.LoadImage(m_base_path + filename);
+                    texture = SceneIo::LoadImage(io, m_base_path + filename);
                     m_name2tex[name] = texture;
                 }
 
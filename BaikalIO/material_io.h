@@ -71,6 +71,13 @@ namespace Baikal
         // Load materials from disk
         virtual std::unique_ptr<Iterator> LoadMaterials(std::string const& file_name) = 0;
 
+        // Save materials into a string, unnamed textures are written to base path
+        virtual std::string SaveMaterialsToString(std::string const& base_path, Iterator& iterator) = 0;
+
+        // Load materials from a string, textures are resolved against base path.
+        // Materials are iterated in the order they were saved.
+        virtual std::unique_ptr<Iterator> LoadMaterialsFromString(std::string const& data, std::string const& base_path) = 0;
+
         // Helper method: save all materials in the scene
         void SaveMaterialsFromScene(std::string const& filename, Scene1 const& scene);
 
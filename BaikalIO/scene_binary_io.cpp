@@ -4,240 +4,850 @@
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
 #include "SceneGraph/light.h"
+#include "SceneGraph/camera.h"
 #include "SceneGraph/texture.h"
 #include "SceneGraph/uberv2material.h"
 #include "image_io.h"
+#include "material_io.h"
+#include "mapped_file.h"
 #include "math/mathutils.h"
 #include "Utils/log.h"
+#include "Utils/normal_map.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <stdexcept>
+#include <vector>
 
 namespace Baikal
 {
     // Create static object to register loader. This object will be used as loader
     static SceneBinaryIo scene_binary_io_loader;
 
-    Scene1::Ptr SceneBinaryIo::LoadScene(std::string const& filename, std::string const& basepath) const
+    namespace
     {
-        auto scene = Scene1::Create();
-        auto image_io(ImageIo::CreateImageIo());
+        std::uint32_t const kMagic = 0x4e435342; // "BSCN"
+        std::uint32_t const kVersion = 2;
+        std::uint64_t const kBlobAlignment = 64;
 
-        std::map<std::string, Material*> mats;
+        enum SectionType : std::uint32_t
+        {
+            kShapesSection,
+            kMaterialsSection,
+            kLightsSection,
+            kCameraSection,
+            kSectionCount
+        };
 
-        struct less
+        enum ShapeFlags : std::uint32_t
         {
-            bool operator ()(RadeonRays::float3 const& v1, RadeonRays::float3 const& v2) const {
-                return v1.x < v2.x;
-            }
+            // Shape is attached to the scene, otherwise it is only a base shape for instances
+            kAttached = 0x1
+        };
+
+        enum class LightType : std::uint32_t
+        {
+            kPoint,
+            kDirectional,
+            kSpot,
+            kImageBased,
+            kArea
         };
 
-        std::map<RadeonRays::float3, Material::Ptr, less> c2mats;
+        enum class CameraType : std::uint32_t
+        {
+            kPerspective,
+            kOrthographic
+        };
 
-        std::string full_path = filename;
+        // Range of the file, offset is from the beginning of the file
+        struct Blob
+        {
+            std::uint64_t offset;
+            std::uint64_t size;
+        };
 
-        std::ifstream in(full_path, std::ios::binary | std::ios::in);
+        struct FileHeader
+        {
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint32_t num_sections;
+            std::uint32_t padding;
+            // Records of the section, indexed by SectionType
+            Blob sections[kSectionCount];
+        };
 
-        if (!in)
+        struct ShapeRecord
         {
-            throw std::runtime_error("Cannot open file for reading");
-        }
+            Blob name;
+            Blob indices;
+            Blob vertices;
+            Blob normals;
+            Blob uvs;
+            Blob tangents;
+            // Base shape index for instances, -1 for meshes
+            std::int32_t base_shape;
+            // Material index, -1 if there is no material
+            std::int32_t material;
+            std::uint32_t flags;
+            std::uint32_t visibility_mask;
+            std::uint32_t group_id;
+            std::uint32_t padding;
+            float transform[16];
+        };
 
-        std::uint32_t num_meshes = 0;
-        in.read((char*)&num_meshes, sizeof(std::uint32_t));
+        struct LightRecord
+        {
+            LightType type;
+            // Shape index and primitive for area lights
+            std::int32_t shape;
+            std::uint32_t prim_idx;
+            std::uint32_t mirror_x;
+            float position[3];
+            float direction[3];
+            float radiance[3];
+            float cone_shape[2];
+            float multiplier;
+            // Texture names for image based lights
+            Blob texture;
+            Blob reflection_texture;
+            Blob refraction_texture;
+            Blob transparency_texture;
+            Blob background_texture;
+        };
 
-        LogInfo("Number of objects: ", num_meshes, "\n");
+        struct CameraRecord
+        {
+            CameraType type;
+            float position[3];
+            float forward[3];
+            float up[3];
+            float sensor_size[2];
+            float depth_range[2];
+            float focal_length;
+            float focus_distance;
+            float aperture;
+        };
 
-        for (auto i = 0U; i < num_meshes; ++i)
+        void Store(RadeonRays::float3 const& v, float* out)
         {
-            auto mesh = Mesh::Create();
+            out[0] = v.x;
+            out[1] = v.y;
+            out[2] = v.z;
+        }
+
+        RadeonRays::float3 Load(float const* in)
+        {
+            return RadeonRays::float3(in[0], in[1], in[2]);
+        }
+
+        bool IsAbsolutePath(std::string const& path)
+        {
+            return (!path.empty() && (path[0] == '/' || path[0] == '\\')) ||
+                (path.size() > 1 && path[1] == ':');
+        }
 
-            std::uint32_t num_indices = 0;
-            in.read((char*)&num_indices, sizeof(std::uint32_t));
+        // Texture names are stored relative to the base path when they are located there,
+        // other names are kept as is
+        std::string GetTexturePath(std::string const& name, std::string const& basepath)
+        {
+            if (!basepath.empty() && name.compare(0, basepath.size(), basepath) == 0)
+            {
+                return name.substr(basepath.size());
+            }
 
-            std::uint32_t num_vertices = 0;
-            in.read((char*)&num_vertices, sizeof(std::uint32_t));
+            return name;
+        }
 
+        class BinaryWriter
+        {
+        public:
+            explicit BinaryWriter(std::string const& filename)
+                : m_out(filename, std::ios::binary | std::ios::out)
+            {
+                if (!m_out)
+                {
+                    throw std::runtime_error("Cannot open file for writing");
+                }
+            }
 
-            std::uint32_t num_normals = 0;
-            in.read((char*)&num_normals, sizeof(std::uint32_t));
+            // Append data aligned to the specified boundary
+            Blob Write(void const* data, std::size_t size, std::uint64_t alignment = kBlobAlignment)
+            {
+                auto offset = static_cast<std::uint64_t>(m_out.tellp());
+                auto padding = (alignment - offset % alignment) % alignment;
 
+                static char const zeros[kBlobAlignment] = {};
+                m_out.write(zeros, padding);
+                m_out.write(static_cast<char const*>(data), size);
 
-            std::uint32_t num_uvs = 0;
-            in.read((char*)&num_uvs, sizeof(std::uint32_t));
+                return Blob{ offset + padding, size };
+            }
 
+            Blob Write(std::string const& str)
             {
-                std::vector<std::uint32_t> indices(num_indices);
-                in.read((char*)&indices[0], num_indices * sizeof(std::uint32_t));
+                return Write(str.data(), str.size(), 1);
+            }
 
-                mesh->SetIndices(&indices[0], num_indices);
+            template <typename T>
+            Blob Write(std::vector<T> const& records)
+            {
+                return Write(records.data(), records.size() * sizeof(T));
             }
 
+            void WriteHeader(FileHeader const& header)
             {
-                std::vector<RadeonRays::float3> vertices(num_vertices);
-                in.read((char*)&vertices[0], num_vertices * sizeof(RadeonRays::float3));
+                m_out.seekp(0);
+                m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+                if (!m_out)
+                {
+                    throw std::runtime_error("Cannot write scene file");
+                }
+            }
+
+        private:
+            std::ofstream m_out;
+        };
 
-                mesh->SetVertices(&vertices[0], num_vertices);
+        class BinaryReader
+        {
+        public:
+            explicit BinaryReader(MappedFile::Ptr file)
+                : m_file(file)
+            {
             }
 
+            template <typename T>
+            T const* Get(Blob const& blob) const
             {
-                std::vector<RadeonRays::float3> normals(num_normals);
-                in.read((char*)&normals[0], num_normals * sizeof(RadeonRays::float3));
+                if (blob.offset > m_file->GetSize() || blob.size > m_file->GetSize() - blob.offset || blob.size % sizeof(T))
+                {
+                    throw std::runtime_error("Corrupted scene file");
+                }
 
-                mesh->SetNormals(&normals[0], num_normals);
+                return blob.size ? reinterpret_cast<T const*>(m_file->GetData() + blob.offset) : nullptr;
             }
 
+            template <typename T>
+            std::size_t GetCount(Blob const& blob) const
             {
-                std::vector<RadeonRays::float2> uvs(num_uvs);
-                in.read((char*)&uvs[0], num_uvs * sizeof(RadeonRays::float2));
+                return static_cast<std::size_t>(blob.size / sizeof(T));
+            }
+
+            std::string GetString(Blob const& blob) const
+            {
+                auto data = Get<char>(blob);
+                return data ? std::string(data, data + blob.size) : std::string();
+            }
 
-                mesh->SetUVs(&uvs[0], num_uvs);
+        private:
+            MappedFile::Ptr m_file;
+        };
+
+        // Version 1: meshes only, no header
+        Scene1::Ptr LoadSceneV1(std::string const& filename)
+        {
+            auto scene = Scene1::Create();
+            auto image_io(ImageIo::CreateImageIo());
+
+            std::string full_path = filename;
+
+            std::ifstream in(full_path, std::ios::binary | std::ios::in);
+
+            if (!in)
+            {
+                throw std::runtime_error("Cannot open file for reading");
             }
 
+            std::uint32_t num_meshes = 0;
+            in.read((char*)&num_meshes, sizeof(std::uint32_t));
+
+            LogInfo("Number of objects: ", num_meshes, "\n");
 
+            for (auto i = 0U; i < num_meshes; ++i)
             {
-                std::uint32_t flag = 0;
-                in.read(reinterpret_cast<char*>(&flag), sizeof(flag));
+                auto mesh = Mesh::Create();
 
-                if (!flag)
+                std::uint32_t num_indices = 0;
+                in.read((char*)&num_indices, sizeof(std::uint32_t));
+
+                std::uint32_t num_vertices = 0;
+                in.read((char*)&num_vertices, sizeof(std::uint32_t));
+
+
+                std::uint32_t num_normals = 0;
+                in.read((char*)&num_normals, sizeof(std::uint32_t));
+
+
+                std::uint32_t num_uvs = 0;
+                in.read((char*)&num_uvs, sizeof(std::uint32_t));
+
+                auto data_offset = in.tellg();
+
+                {
+                    std::vector<std::uint32_t> indices(num_indices);
+                    in.read((char*)&indices[0], num_indices * sizeof(std::uint32_t));
+
+                    mesh->SetIndices(std::move(indices));
+                }
+
+                {
+                    std::vector<RadeonRays::float3> vertices(num_vertices);
+                    in.read((char*)&vertices[0], num_vertices * sizeof(RadeonRays::float3));
+
+                    mesh->SetVertices(std::move(vertices));
+                }
+
+                {
+                    std::vector<RadeonRays::float3> normals(num_normals);
+                    in.read((char*)&normals[0], num_normals * sizeof(RadeonRays::float3));
+
+                    mesh->SetNormals(std::move(normals));
+                }
+
+                {
+                    std::vector<RadeonRays::float2> uvs(num_uvs);
+                    in.read((char*)&uvs[0], num_uvs * sizeof(RadeonRays::float2));
+
+                    mesh->SetUVs(std::move(uvs));
+                }
+
+                // Let the mesh drop its data after upload and read it back from the file when needed
+                mesh->SetReloadCallback([full_path, data_offset](std::vector<RadeonRays::float3>& vertices,
+                    std::vector<RadeonRays::float3>& normals, std::vector<RadeonRays::float2>& uvs, std::vector<std::uint32_t>& indices)
                 {
-                    RadeonRays::float3 albedo;
-                    in.read(reinterpret_cast<char*>(&albedo.x), sizeof(RadeonRays::float3));
+                    std::ifstream in(full_path, std::ios::binary | std::ios::in);
+
+                    if (!in)
+                    {
+                        throw std::runtime_error("Cannot open file for reading");
+                    }
 
-                    /*auto iter = c2mats.find(albedo);
+                    in.seekg(data_offset);
+                    in.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(std::uint32_t));
+                    in.read(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(RadeonRays::float3));
+                    in.read(reinterpret_cast<char*>(normals.data()), normals.size() * sizeof(RadeonRays::float3));
+                    in.read(reinterpret_cast<char*>(uvs.data()), uvs.size() * sizeof(RadeonRays::float2));
+                });
+
+                // Material data is not supported, skip it
+                {
+                    std::uint32_t flag = 0;
+                    in.read(reinterpret_cast<char*>(&flag), sizeof(flag));
 
-                    if (iter != c2mats.cend())
+                    if (!flag)
                     {
-                        material = iter->second;
+                        RadeonRays::float3 albedo;
+                        in.read(reinterpret_cast<char*>(&albedo.x), sizeof(RadeonRays::float3));
                     }
                     else
                     {
-                        material = new SingleBxdf(SingleBxdf::BxdfType::kLambert);
-                        material->SetInputValue("albedo", albedo);
-                        c2mats[albedo] = material;
-                        scene->AttachAutoreleaseObject(material);
-                    }*/
+                        std::uint32_t size = 0;
+                        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+                        in.seekg(size, std::ios::cur);
+                    }
+
+                    mesh->SetMaterial(nullptr);
+                }
+
+                scene->AttachShape(mesh);
+            }
+
+            auto  ibl_texture = image_io->LoadImage("../Resources/Textures/Canopus_Ground_4k.exr");
+
+            auto ibl = ImageBasedLight::Create();
+            ibl->SetTexture(ibl_texture);
+            ibl->SetMultiplier(1.f);
+
+            // TODO: temporary code to add directional light
+            auto light = DirectionalLight::Create();
+            light->SetDirection(RadeonRays::normalize(RadeonRays::float3(-1.1f, -0.6f, -0.4f)));
+            light->SetEmittedRadiance(7.f * RadeonRays::float3(1.f, 0.95f, 0.92f));
+
+            scene->AttachLight(light);
+            scene->AttachLight(ibl);
+
+            return scene;
+        }
+    }
+
+    Scene1::Ptr SceneBinaryIo::LoadScene(std::string const& filename, std::string const& basepath) const
+    {
+        auto file = MappedFile::Open(filename);
+
+        FileHeader header = {};
+
+        if (file->GetSize() >= sizeof(header))
+        {
+            std::memcpy(&header, file->GetData(), sizeof(header));
+        }
+
+        if (header.magic != kMagic)
+        {
+            return LoadSceneV1(filename);
+        }
+
+        if (header.version != kVersion || header.num_sections != kSectionCount)
+        {
+            throw std::runtime_error("Unsupported scene file version");
+        }
+
+        BinaryReader reader(file);
+        auto scene = Scene1::Create();
+        auto image_io(ImageIo::CreateImageIo());
+
+        // Materials
+        std::vector<Material::Ptr> materials;
+        {
+            auto xml = reader.GetString(header.sections[kMaterialsSection]);
+
+            if (!xml.empty())
+            {
+                auto material_io = MaterialIo::CreateMaterialIoXML();
+                auto material_iter = material_io->LoadMaterialsFromString(xml, basepath);
+
+                for (; material_iter->IsValid(); material_iter->Next())
+                {
+                    materials.push_back(material_iter->ItemAs<Material>());
                 }
-                else
+            }
+        }
+
+        auto get_material = [&materials](std::int32_t idx)
+        {
+            return idx >= 0 && idx < static_cast<std::int32_t>(materials.size()) ? materials[idx] : nullptr;
+        };
+
+        // Shapes, geometry is used right from the mapping
+        auto shape_records = reader.Get<ShapeRecord>(header.sections[kShapesSection]);
+        auto num_shapes = reader.GetCount<ShapeRecord>(header.sections[kShapesSection]);
+
+        std::vector<Shape::Ptr> shapes(num_shapes);
+
+        // Meshes go first since instances reference them
+        for (std::size_t i = 0; i < num_shapes; ++i)
+        {
+            auto const& record = shape_records[i];
+
+            if (record.base_shape >= 0)
+            {
+                continue;
+            }
+
+            Mesh::ExternalData data;
+            data.storage = file;
+            data.indices = reader.Get<std::uint32_t>(record.indices);
+            data.num_indices = reader.GetCount<std::uint32_t>(record.indices);
+            data.vertices = reader.Get<RadeonRays::float3>(record.vertices);
+            data.num_vertices = reader.GetCount<RadeonRays::float3>(record.vertices);
+            data.normals = reader.Get<RadeonRays::float3>(record.normals);
+            data.num_normals = reader.GetCount<RadeonRays::float3>(record.normals);
+            data.uvs = reader.Get<RadeonRays::float2>(record.uvs);
+            data.num_uvs = reader.GetCount<RadeonRays::float2>(record.uvs);
+            data.tangents = reader.Get<RadeonRays::float4>(record.tangents);
+            data.num_tangents = reader.GetCount<RadeonRays::float4>(record.tangents);
+
+            // Mapped data goes to the device as is, check it once here instead of on every use.
+            // Attributes share vertex indices, so each present array has to cover all vertices.
+            auto covers_vertices = [&data](std::size_t count) { return count == 0 || count >= data.num_vertices; };
+
+            if (data.num_indices % 3 ||
+                !covers_vertices(data.num_normals) || !covers_vertices(data.num_uvs) || !covers_vertices(data.num_tangents) ||
+                std::any_of(data.indices, data.indices + data.num_indices,
+                    [&data](std::uint32_t index) { return index >= data.num_vertices; }))
+            {
+                throw std::runtime_error("Corrupted scene file");
+            }
+
+            auto mesh = Mesh::Create();
+            mesh->SetExternalData(data);
+            shapes[i] = mesh;
+        }
+
+        for (std::size_t i = 0; i < num_shapes; ++i)
+        {
+            auto const& record = shape_records[i];
+
+            if (record.base_shape >= 0)
+            {
+                if (record.base_shape >= static_cast<std::int32_t>(num_shapes) || !shapes[record.base_shape])
                 {
-                    std::uint32_t size = 0;
-                    in.read(reinterpret_cast<char*>(&size), sizeof(size));
-
-                    std::vector<char> buff(size);
-                    in.read(&buff[0], sizeof(char) * size);
-
-                    //std::string name(buff.cbegin(), buff.cend());
-
-                    //auto iter = mats.find(name);
-
-                    //if (iter != mats.cend())
-                    //{
-                    //    material = iter->second;
-                    //}
-                    //else
-                    //{
-                    //    LogInfo("Loading texture ", name, "\n");
-                    //    auto texture = image_io->LoadImage(basepath + name);
-                    //    //material = new SingleBxdf(SingleBxdf::BxdfType::kLambert);
-                    //    //material->SetInputValue("albedo", texture);
-                    //    //mats[name] = material;
-                    //    //scene->AttachAutoreleaseObject(texture);
-                    //    //scene->AttachAutoreleaseObject(material);
-                    //}
+                    throw std::runtime_error("Corrupted scene file");
+                }
+
+                shapes[i] = Instance::Create(shapes[record.base_shape]);
+            }
+
+            auto& shape = shapes[i];
+            auto const& m = record.transform;
+
+            shape->SetName(reader.GetString(record.name));
+            shape->SetMaterial(get_material(record.material));
+            shape->SetVisibilityMask(record.visibility_mask);
+            shape->SetGroupId(record.group_id);
+            shape->SetTransform(RadeonRays::matrix(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7],
+                m[8], m[9], m[10], m[11], m[12], m[13], m[14], m[15]));
+
+            if (record.flags & kAttached)
+            {
+                scene->AttachShape(shape);
+            }
+        }
+
+        // Lights
+        std::map<std::string, Texture::Ptr> textures;
+
+        auto load_texture = [&](Blob const& name_blob) -> Texture::Ptr
+        {
+            auto name = reader.GetString(name_blob);
 
+            if (name.empty())
+            {
+                return nullptr;
+            }
+
+            auto iter = textures.find(name);
+
+            if (iter != textures.cend())
+            {
+                return iter->second;
+            }
+
+            // Absolute paths are not prefixed with the base path
+            bool shared = false;
+            auto texture = SceneIo::LoadImage(*image_io, IsAbsolutePath(name) ? name : basepath + name, &shared);
+
+            // Texture loaded by someone else keeps its name
+            if (!shared)
+            {
+                texture->SetName(name);
+            }
+
+            textures[name] = texture;
+            return texture;
+        };
+
+        auto light_records = reader.Get<LightRecord>(header.sections[kLightsSection]);
+        auto num_lights = reader.GetCount<LightRecord>(header.sections[kLightsSection]);
+
+        for (std::size_t i = 0; i < num_lights; ++i)
+        {
+            auto const& record = light_records[i];
+            Light::Ptr light;
+
+            switch (record.type)
+            {
+            case LightType::kPoint:
+                light = PointLight::Create();
+                break;
+            case LightType::kDirectional:
+                light = DirectionalLight::Create();
+                break;
+            case LightType::kSpot:
+            {
+                auto spot = SpotLight::Create();
+                spot->SetConeShape(RadeonRays::float2(record.cone_shape[0], record.cone_shape[1]));
+                light = spot;
+                break;
+            }
+            case LightType::kImageBased:
+            {
+                auto ibl = ImageBasedLight::Create();
+                ibl->SetTexture(load_texture(record.texture));
+                ibl->SetReflectionTexture(load_texture(record.reflection_texture));
+                ibl->SetRefractionTexture(load_texture(record.refraction_texture));
+                ibl->SetTransparencyTexture(load_texture(record.transparency_texture));
+                ibl->SetBackgroundTexture(load_texture(record.background_texture));
+                ibl->SetMultiplier(record.multiplier);
+                ibl->SetMirrorX(record.mirror_x != 0);
+                light = ibl;
+                break;
+            }
+            case LightType::kArea:
+            {
+                if (record.shape < 0 || record.shape >= static_cast<std::int32_t>(num_shapes))
+                {
+                    throw std::runtime_error("Corrupted scene file");
                 }
 
-                mesh->SetMaterial(nullptr);
+                light = AreaLight::Create(shapes[record.shape], record.prim_idx);
+                break;
+            }
+            default:
+                throw std::runtime_error("Corrupted scene file");
             }
 
-            scene->AttachShape(mesh);
+            light->SetPosition(Load(record.position));
+            light->SetDirection(Load(record.direction));
+            light->SetEmittedRadiance(Load(record.radiance));
+            scene->AttachLight(light);
         }
 
-        auto  ibl_texture = image_io->LoadImage("../Resources/Textures/Canopus_Ground_4k.exr");
+        // Camera
+        if (reader.GetCount<CameraRecord>(header.sections[kCameraSection]) > 0)
+        {
+            auto const& record = *reader.Get<CameraRecord>(header.sections[kCameraSection]);
+
+            auto eye = Load(record.position);
+            auto at = eye + Load(record.forward);
+            auto up = Load(record.up);
 
-        auto ibl = ImageBasedLight::Create();
-        ibl->SetTexture(ibl_texture);
-        ibl->SetMultiplier(1.f);
+            Camera::Ptr camera;
 
-        // TODO: temporary code to add directional light
-        auto light = DirectionalLight::Create();
-        light->SetDirection(RadeonRays::normalize(RadeonRays::float3(-1.1f, -0.6f, -0.4f)));
-        light->SetEmittedRadiance(7.f * RadeonRays::float3(1.f, 0.95f, 0.92f));
+            if (record.type == CameraType::kOrthographic)
+            {
+                camera = OrthographicCamera::Create(eye, at, up);
+            }
+            else
+            {
+                auto perspective = PerspectiveCamera::Create(eye, at, up);
+                perspective->SetFocalLength(record.focal_length);
+                perspective->SetFocusDistance(record.focus_distance);
+                perspective->SetAperture(record.aperture);
+                camera = perspective;
+            }
 
-        auto light1 = DirectionalLight::Create();
-        light1->SetDirection(RadeonRays::float3(0.3f, -1.f, -0.5f));
-        light1->SetEmittedRadiance(RadeonRays::float3(1.f, 0.8f, 0.65f));
+            camera->SetSensorSize(RadeonRays::float2(record.sensor_size[0], record.sensor_size[1]));
+            camera->SetDepthRange(RadeonRays::float2(record.depth_range[0], record.depth_range[1]));
+            scene->SetCamera(camera);
+        }
 
-        scene->AttachLight(light);
-        //scene->AttachLight(light1);
-        scene->AttachLight(ibl);
+        LogInfo("Loaded ", scene->GetNumShapes(), " shapes, ", materials.size(), " materials, ", num_lights, " lights\n");
 
         return scene;
     }
 
     void SceneBinaryIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const
     {
-        std::string full_path = filename;
+        BinaryWriter out(filename);
+        auto image_io(ImageIo::CreateImageIo());
 
-        std::ofstream out(full_path, std::ios::binary | std::ios::out);
+        // Header is written last when section locations are known
+        FileHeader header = {};
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.num_sections = kSectionCount;
+        out.Write(&header, sizeof(header));
 
-        if (!out)
+        // Collect shapes: attached ones first, then instance base shapes not attached to the scene
+        std::vector<Shape::Ptr> shapes;
+        std::map<Shape::Ptr, std::int32_t> shape_indices;
+        std::vector<Material::Ptr> materials;
+        std::map<Material::Ptr, std::int32_t> material_indices;
+
+        auto shape_iter = scene.CreateShapeIterator();
+
+        for (; shape_iter->IsValid(); shape_iter->Next())
         {
-            throw std::runtime_error("Cannot open file for writing");
+            auto shape = shape_iter->ItemAs<Shape>();
+            shape_indices.emplace(shape, static_cast<std::int32_t>(shapes.size()));
+            shapes.push_back(shape);
         }
 
-        auto default_material = UberV2Material::Create();
+        auto num_attached = shapes.size();
 
-        auto num_shapes = (std::uint32_t)scene.GetNumShapes();
-        out.write((char*)&num_shapes, sizeof(std::uint32_t));
+        for (std::size_t i = 0; i < num_attached; ++i)
+        {
+            auto instance = std::dynamic_pointer_cast<Instance>(shapes[i]);
 
-        auto shape_iter = scene.CreateShapeIterator();
+            if (instance && shape_indices.emplace(instance->GetBaseShape(), static_cast<std::int32_t>(shapes.size())).second)
+            {
+                shapes.push_back(instance->GetBaseShape());
+            }
+        }
 
-        for (; shape_iter->IsValid(); shape_iter->Next())
+        for (auto& shape : shapes)
+        {
+            auto material = shape->GetMaterial();
+
+            if (material && material_indices.emplace(material, static_cast<std::int32_t>(materials.size())).second)
+            {
+                materials.push_back(material);
+            }
+        }
+
+        // Shapes
+        std::vector<ShapeRecord> shape_records(shapes.size());
+
+        for (std::size_t i = 0; i < shapes.size(); ++i)
+        {
+            auto& shape = shapes[i];
+            auto& record = shape_records[i];
+
+            record.name = out.Write(shape->GetName());
+            record.base_shape = -1;
+            record.material = shape->GetMaterial() ? material_indices[shape->GetMaterial()] : -1;
+            record.flags = i < num_attached ? kAttached : 0u;
+            record.visibility_mask = shape->GetVisibilityMask();
+            record.group_id = shape->GetGroupId();
+
+            auto transform = shape->GetTransform();
+            float const m[16] =
+            {
+                transform.m00, transform.m01, transform.m02, transform.m03,
+                transform.m10, transform.m11, transform.m12, transform.m13,
+                transform.m20, transform.m21, transform.m22, transform.m23,
+                transform.m30, transform.m31, transform.m32, transform.m33
+            };
+            std::copy(m, m + 16, record.transform);
+
+            if (auto instance = std::dynamic_pointer_cast<Instance>(shape))
+            {
+                record.base_shape = shape_indices[instance->GetBaseShape()];
+                continue;
+            }
+
+            auto mesh = std::dynamic_pointer_cast<Mesh>(shape);
+
+            if (!mesh)
+            {
+                throw std::runtime_error("Shape type is not supported");
+            }
+
+            record.indices = out.Write(mesh->GetIndices(), mesh->GetNumIndices() * sizeof(std::uint32_t));
+            record.vertices = out.Write(mesh->GetVertices(), mesh->GetNumVertices() * sizeof(RadeonRays::float3));
+            record.normals = out.Write(mesh->GetNormals(), mesh->GetNumNormals() * sizeof(RadeonRays::float3));
+            record.uvs = out.Write(mesh->GetUVs(), mesh->GetNumUVs() * sizeof(RadeonRays::float2));
+
+            // Store tangents so they are not generated on every load
+            if (mesh->GetNumTangents() == mesh->GetNumVertices())
+            {
+                record.tangents = out.Write(mesh->GetTangents(), mesh->GetNumTangents() * sizeof(RadeonRays::float4));
+            }
+            else
+            {
+                record.tangents = out.Write(ComputeTangents(*mesh));
+            }
+        }
+
+        header.sections[kShapesSection] = out.Write(shape_records);
+
+        // Materials
+        if (!materials.empty())
         {
-            auto mesh = shape_iter->ItemAs<Mesh>();
-            auto num_indices = (std::uint32_t)mesh->GetNumIndices();
-            out.write((char*)&num_indices, sizeof(std::uint32_t));
+            auto material_io = MaterialIo::CreateMaterialIoXML();
+            ContainerIterator<std::vector<Material::Ptr>> material_iter(std::move(materials));
+            header.sections[kMaterialsSection] = out.Write(material_io->SaveMaterialsToString(basepath, material_iter));
+        }
 
-            auto num_vertices = (std::uint32_t)mesh->GetNumVertices();
-            out.write((char*)&num_vertices, sizeof(std::uint32_t));
+        // Lights
+        std::vector<LightRecord> light_records;
+        std::map<Texture::Ptr, Blob> texture_names;
 
-            auto num_normals = (std::uint32_t)mesh->GetNumNormals();
-            out.write((char*)&num_normals, sizeof(std::uint32_t));
+        auto write_texture = [&](Texture::Ptr texture)
+        {
+            if (!texture)
+            {
+                return Blob{};
+            }
 
-            auto num_uvs = (std::uint32_t)mesh->GetNumUVs();
-            out.write((char*)&num_uvs, sizeof(std::uint32_t));
+            auto iter = texture_names.find(texture);
 
-            out.write((char const*)mesh->GetIndices(), mesh->GetNumIndices() * sizeof(std::uint32_t));
-            out.write((char const*)mesh->GetVertices(), mesh->GetNumVertices() * sizeof(RadeonRays::float3));
-            out.write((char const*)mesh->GetNormals(), mesh->GetNumNormals() * sizeof(RadeonRays::float3));
-            out.write((char const*)mesh->GetUVs(), mesh->GetNumUVs() * sizeof(RadeonRays::float2));
+            if (iter != texture_names.cend())
+            {
+                return iter->second;
+            }
 
-            auto material = mesh->GetMaterial();
+            auto name = GetTexturePath(texture->GetName(), basepath);
 
-            /*if (!material)
+            if (name.empty())
             {
-                material = default_material;
+                name = std::to_string(reinterpret_cast<std::uint64_t>(texture.get())) + ".exr";
+                image_io->SaveImage(basepath + name, texture);
             }
 
-            auto diffuse = std::dynamic_pointer_cast<SingleBxdf>(material);
+            return texture_names[texture] = out.Write(name);
+        };
+
+        auto light_iter = scene.CreateLightIterator();
+
+        for (; light_iter->IsValid(); light_iter->Next())
+        {
+            auto light = light_iter->ItemAs<Light>();
 
-            if (!diffuse)
+            LightRecord record = {};
+            record.shape = -1;
+            Store(light->GetPosition(), record.position);
+            Store(light->GetDirection(), record.direction);
+            Store(light->GetEmittedRadiance(), record.radiance);
+
+            if (std::dynamic_pointer_cast<PointLight>(light))
+            {
+                record.type = LightType::kPoint;
+            }
+            else if (std::dynamic_pointer_cast<DirectionalLight>(light))
+            {
+                record.type = LightType::kDirectional;
+            }
+            else if (auto spot = std::dynamic_pointer_cast<SpotLight>(light))
+            {
+                record.type = LightType::kSpot;
+                record.cone_shape[0] = spot->GetConeShape().x;
+                record.cone_shape[1] = spot->GetConeShape().y;
+            }
+            else if (auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light))
             {
-                diffuse = std::dynamic_pointer_cast<SingleBxdf>(material->GetInputValue("base_material").mat_value);
+                record.type = LightType::kImageBased;
+                record.multiplier = ibl->GetMultiplier();
+                record.mirror_x = ibl->GetMirrorX() ? 1u : 0u;
+                record.texture = write_texture(ibl->GetTexture());
+                record.reflection_texture = write_texture(ibl->GetReflectionTexture());
+                record.refraction_texture = write_texture(ibl->GetRefractionTexture());
+                record.transparency_texture = write_texture(ibl->GetTransparencyTexture());
+                record.background_texture = write_texture(ibl->GetBackgroundTexture());
             }
+            else if (auto area = std::dynamic_pointer_cast<AreaLight>(light))
+            {
+                auto iter = shape_indices.find(area->GetShape());
 
-            if (!diffuse)
+                if (iter == shape_indices.cend())
+                {
+                    throw std::runtime_error("Area light shape is not in the scene");
+                }
+
+                record.type = LightType::kArea;
+                record.shape = iter->second;
+                record.prim_idx = static_cast<std::uint32_t>(area->GetPrimitiveIdx());
+            }
+            else
             {
-                throw std::runtime_error("Material not supported");
+                throw std::runtime_error("Light type is not supported");
             }
-            diffuse->GetInputValue("albedo");
-            */
 
-            auto albedo = RadeonRays::float3(1.0f, 1.0f, 1.0f);
+            light_records.push_back(record);
+        }
+
+        header.sections[kLightsSection] = out.Write(light_records);
+
+        // Camera
+        if (auto camera = scene.GetCamera())
+        {
+            CameraRecord record = {};
+            record.type = CameraType::kOrthographic;
+            Store(camera->GetPosition(), record.position);
+            Store(camera->GetForwardVector(), record.forward);
+            Store(camera->GetUpVector(), record.up);
+            record.sensor_size[0] = camera->GetSensorSize().x;
+            record.sensor_size[1] = camera->GetSensorSize().y;
+            record.depth_range[0] = camera->GetDepthRange().x;
+            record.depth_range[1] = camera->GetDepthRange().y;
+
+            if (auto perspective = std::dynamic_pointer_cast<PerspectiveCamera>(camera))
+            {
+                record.type = CameraType::kPerspective;
+                record.focal_length = perspective->GetFocalLength();
+                record.focus_distance = perspective->GetFocusDistance();
+                record.aperture = perspective->GetAperture();
+            }
 
-            std::uint32_t flag = 0;
-            out.write(reinterpret_cast<char const*>(&flag), sizeof(flag));
-            out.write(reinterpret_cast<char const*>(&albedo.x), sizeof(RadeonRays::float3));
+            header.sections[kCameraSection] = out.Write(&record, sizeof(record));
         }
+
+        out.WriteHeader(header);
+
+        LogInfo("Saved ", shapes.size(), " shapes, ", material_indices.size(), " materials, ", light_records.size(), " lights\n");
     }
 }
@@ -28,14 +28,22 @@ THE SOFTWARE.
 
 namespace Baikal
 {
-    // Create fake test IO
+    /**
+     \brief Binary scene format.
+
+     Version 2 files start with a header and a section table. Geometry is stored in
+     64 byte aligned blobs which meshes reference directly from the memory mapped file,
+     materials are stored as material XML, textures are referenced by name relative
+     to the base path. Version 1 files (meshes only) are still loaded.
+     */
     class SceneBinaryIo : public SceneIo::Loader
     {
     public:
         SceneBinaryIo() : SceneIo::Loader("bin", this)
         {}
-        // Load scene (this class uses filename to determine what scene to generate)
+        // Load scene
         Scene1::Ptr LoadScene(std::string const& filename, std::string const& basepath) const override;
+        // Save scene in version 2 format, unnamed textures are saved to base path
         void SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const override;
     };
 }
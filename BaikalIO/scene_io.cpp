@@ -7,12 +7,16 @@
 #include "SceneGraph/texture.h"
 #include "math/mathutils.h"
 
+#include <algorithm>
 #include <string>
 #include <map>
 #include <set>
+#include <atomic>
 #include <cassert>
+#include <mutex>
 
 #include "Utils/log.h"
+#include "Utils/texture_dedup.h"
 
 namespace Baikal
 {
@@ -22,6 +26,61 @@ namespace Baikal
         return &instance;
     }
 
+    static std::atomic<SceneIo::TextureLoading> g_texture_loading(SceneIo::TextureLoading::kAsync);
+
+    void SceneIo::SetTextureLoading(TextureLoading mode)
+    {
+        g_texture_loading = mode;
+    }
+
+    SceneIo::TextureLoading SceneIo::GetTextureLoading()
+    {
+        return g_texture_loading;
+    }
+
+    static std::atomic<bool> g_dedup_geometry(false);
+    static std::mutex g_dedup_mutex;
+    static GeometryDedupStats g_dedup_stats;
+
+    void SceneIo::SetGeometryDeduplication(bool enable)
+    {
+        g_dedup_geometry = enable;
+    }
+
+    bool SceneIo::GetGeometryDeduplication()
+    {
+        return g_dedup_geometry;
+    }
+
+    GeometryDedupStats SceneIo::GetGeometryDedupStats()
+    {
+        std::lock_guard<std::mutex> lock(g_dedup_mutex);
+        return g_dedup_stats;
+    }
+
+    Texture::Ptr SceneIo::LoadImage(ImageIo const& io, std::string const& filename, bool* shared)
+    {
+        switch (g_texture_loading)
+        {
+        case TextureLoading::kAsync:
+            return io.LoadImageAsync(filename, false, shared);
+        case TextureLoading::kDeferred:
+            return io.LoadImageAsync(filename, true, shared);
+        default:
+        {
+            auto texture = io.LoadImage(filename);
+            auto registered = TextureRegistry::GetInstance().Register(texture);
+
+            if (shared)
+            {
+                *shared = registered != texture;
+            }
+
+            return registered;
+        }
+        }
+    }
+
     void SceneIo::RegisterLoader(const std::string& ext, SceneIo::Loader *loader)
     {
         GetInstance()->m_loaders[ext] = loader;
@@ -43,7 +102,26 @@ namespace Baikal
             throw std::runtime_error("No loader for \"" + filename + "\" has been found.");
         }
 
-        return loader_it->second->LoadScene(filename, basepath);
+        auto stats_before = TextureRegistry::GetInstance().GetStats();
+        auto scene = loader_it->second->LoadScene(filename, basepath);
+        auto stats_after = TextureRegistry::GetInstance().GetStats();
+
+        LogInfo("Texture deduplication: ", stats_after.num_duplicates - stats_before.num_duplicates,
+            " textures shared, ", (stats_after.bytes_saved - stats_before.bytes_saved) / (1024 * 1024), " MB saved\n");
+
+        // OBJ and binary scenes store repeated objects as separate copies in world space
+        GeometryDedupStats dedup_stats;
+        if (g_dedup_geometry)
+        {
+            dedup_stats = DeduplicateGeometry(*scene);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(g_dedup_mutex);
+            g_dedup_stats = dedup_stats;
+        }
+
+        return scene;
     }
 
     void SceneIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath)
@@ -76,9 +154,37 @@ namespace Baikal
             try
             {
                 LogInfo("Loading ", name, "\n");
-                auto texture = io.LoadImage(fname);
-                texture->SetName(name);
+                bool shared = false;
+                auto texture = SceneIo::LoadImage(io, fname, &shared);
                 m_texture_cache[name] = texture;
+
+                // Texture loaded by someone else keeps its name and reload callback
+                if (shared)
+                {
+                    return texture;
+                }
+
+                texture->SetName(name);
+
+                // Texture can drop its data after upload and read the file again when needed,
+                // it is decoded with the same settings and must still match the texture layout
+                std::shared_ptr<ImageIo const> reload_io(io.Clone());
+                auto size = texture->GetSize();
+                auto format = texture->GetFormat();
+
+                texture->SetReloadCallback([reload_io, fname, size, format](char* data)
+                {
+                    auto reloaded = reload_io->LoadImage(fname);
+                    auto reloaded_size = reloaded->GetSize();
+
+                    if (reloaded->GetFormat() != format || reloaded_size.x != size.x || reloaded_size.y != size.y || reloaded_size.z != std::max(size.z, 1))
+                    {
+                        throw std::runtime_error("Texture " + fname + " has changed since it was loaded");
+                    }
+
+                    std::copy(reloaded->GetData(), reloaded->GetData() + reloaded->GetSizeInBytes(), data);
+                });
+
                 return texture;
             }
             catch (std::runtime_error &)
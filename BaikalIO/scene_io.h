@@ -33,6 +33,7 @@
 #include <map>
 #include "SceneGraph/texture.h"
 #include "SceneGraph/scene1.h"
+#include "Utils/geometry_dedup.h"
 
 #ifdef WIN32
 #ifdef BAIKAL_EXPORT_API
@@ -59,6 +60,17 @@ namespace Baikal
     class SceneIo
     {
     public:
+        // How importers load textures
+        enum class TextureLoading
+        {
+            // Decode on the calling thread
+            kImmediate,
+            // Decode on the thread pool, data is waited for on first access (upload)
+            kAsync,
+            // Decode on first access, textures which are never uploaded are never decoded
+            kDeferred
+        };
+
         /**
         \brief Interface for file format handler
 
@@ -96,6 +108,19 @@ namespace Baikal
         // Saves scene to file using resource base path
         static void BAIKAL_API_ENTRY SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath);
 
+        // Set texture loading mode for scene and material importers, kAsync by default
+        static void BAIKAL_API_ENTRY SetTextureLoading(TextureLoading mode);
+        static TextureLoading BAIKAL_API_ENTRY GetTextureLoading();
+        // Replace duplicate meshes of loaded scenes by instances, off by default
+        static void BAIKAL_API_ENTRY SetGeometryDeduplication(bool enable);
+        static bool BAIKAL_API_ENTRY GetGeometryDeduplication();
+        // Results of the deduplication pass of the last LoadScene, empty if it was off
+        static GeometryDedupStats BAIKAL_API_ENTRY GetGeometryDedupStats();
+
+        // Load texture according to the texture loading mode, shared is set if a texture
+        // registered before is returned (it must not be modified then)
+        static Texture::Ptr BAIKAL_API_ENTRY LoadImage(ImageIo const& io, std::string const& filename, bool* shared = nullptr);
+
 
     private:
         static SceneIo* GetInstance();
@@ -36,9 +36,14 @@ THE SOFTWARE.
 #include <map>
 #include <set>
 #include <cassert>
+#include <future>
+#include <limits>
+#include <vector>
 
 #include "tiny_obj_loader.h"
 #include "Utils/log.h"
+#include "Utils/normal_map.h"
+#include "Utils/thread_pool.h"
 
 namespace Baikal
 {
@@ -61,11 +66,231 @@ namespace Baikal
         Material::Ptr TranslateMaterialUberV2(ImageIo const& image_io, tinyobj::material_t const& mat, std::string const& basepath, Scene1& scene) const;
 
         mutable std::map<std::string, Material::Ptr> m_material_cache;
+        // Normal maps converted from bump maps, shared by materials using the same bump map
+        mutable std::map<Texture::Ptr, Texture::Ptr> m_normal_map_cache;
     };
 
     // Create static object to register loader. This object will be used as loader
     static SceneIoObj obj_loader;
 
+    namespace
+    {
+        // Faces of a shape using single material
+        struct FaceBucket
+        {
+            int material;
+            std::vector<std::uint32_t> faces;
+        };
+
+        // Group face indices by material id, buckets are sorted by material id (-1 goes first)
+        std::vector<FaceBucket> BucketFacesByMaterial(tinyobj::mesh_t const& mesh, std::size_t num_materials)
+        {
+            auto const& material_ids = mesh.material_ids;
+            auto bucket_index = [num_materials](int material)
+            {
+                return material >= 0 && static_cast<std::size_t>(material) < num_materials ? material + 1 : 0;
+            };
+
+            // Counting sort by material
+            std::vector<std::uint32_t> offsets(num_materials + 2, 0);
+
+            for (auto material : material_ids)
+            {
+                ++offsets[bucket_index(material) + 1];
+            }
+
+            for (std::size_t i = 1; i < offsets.size(); ++i)
+            {
+                offsets[i] += offsets[i - 1];
+            }
+
+            std::vector<FaceBucket> buckets;
+
+            for (std::size_t i = 0; i + 1 < offsets.size(); ++i)
+            {
+                if (offsets[i + 1] > offsets[i])
+                {
+                    buckets.push_back({ static_cast<int>(i) - 1, std::vector<std::uint32_t>(offsets[i + 1] - offsets[i]) });
+                }
+            }
+
+            std::vector<std::uint32_t> fill(num_materials + 1, 0);
+            std::vector<FaceBucket*> bucket_ptrs(num_materials + 1, nullptr);
+
+            for (auto& bucket : buckets)
+            {
+                bucket_ptrs[bucket.material + 1] = &bucket;
+            }
+
+            for (std::size_t i = 0; i < material_ids.size(); ++i)
+            {
+                auto b = bucket_index(material_ids[i]);
+                bucket_ptrs[b]->faces[fill[b]++] = static_cast<std::uint32_t>(i);
+            }
+
+            return buckets;
+        }
+
+        // Open addressing map from OBJ vertex/normal/texcoord index triplets to mesh vertex indices
+        class VertexIndexMap
+        {
+        public:
+            explicit VertexIndexMap(std::size_t expected_size)
+            {
+                Reserve(expected_size);
+            }
+
+            // Find index of the key or insert the value, returns the index and whether it was inserted
+            std::pair<std::uint32_t, bool> Insert(tinyobj::index_t const& key, std::uint32_t value)
+            {
+                // Keep load factor under 1/2
+                if (2 * (m_size + 1) > m_entries.size())
+                {
+                    Reserve(2 * m_size + 2);
+                }
+
+                auto& entry = Find(key);
+
+                if (entry.key.vertex_index != kEmpty)
+                {
+                    return std::make_pair(entry.value, false);
+                }
+
+                entry.key = key;
+                entry.value = value;
+                ++m_size;
+                return std::make_pair(value, true);
+            }
+
+        private:
+            // OBJ indices are >= -1
+            static int const kEmpty = std::numeric_limits<int>::min();
+
+            struct Entry
+            {
+                tinyobj::index_t key;
+                std::uint32_t value;
+            };
+
+            static std::size_t Hash(tinyobj::index_t const& key)
+            {
+                auto h = static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.vertex_index)) * 0x9e3779b97f4a7c15ull;
+                h ^= static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.normal_index)) * 0xc2b2ae3d27d4eb4full;
+                h ^= static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.texcoord_index)) * 0x165667b19e3779f9ull;
+                return static_cast<std::size_t>(h ^ (h >> 32));
+            }
+
+            // Entry holding the key or empty entry to insert it to
+            Entry& Find(tinyobj::index_t const& key)
+            {
+                auto mask = m_entries.size() - 1;
+
+                for (auto i = Hash(key) & mask;; i = (i + 1) & mask)
+                {
+                    auto& entry = m_entries[i];
+
+                    if (entry.key.vertex_index == kEmpty ||
+                        (entry.key.vertex_index == key.vertex_index &&
+                         entry.key.normal_index == key.normal_index &&
+                         entry.key.texcoord_index == key.texcoord_index))
+                    {
+                        return entry;
+                    }
+                }
+            }
+
+            // Rehash to hold size entries with load factor under 1/2
+            void Reserve(std::size_t size)
+            {
+                std::size_t capacity = 16;
+                while (capacity < 2 * size)
+                {
+                    capacity *= 2;
+                }
+
+                if (capacity <= m_entries.size())
+                {
+                    return;
+                }
+
+                std::vector<Entry> entries(capacity, Entry{ { kEmpty, 0, 0 }, 0 });
+                m_entries.swap(entries);
+
+                for (auto const& entry : entries)
+                {
+                    if (entry.key.vertex_index != kEmpty)
+                    {
+                        Find(entry.key) = entry;
+                    }
+                }
+            }
+
+            std::vector<Entry> m_entries;
+            std::size_t m_size = 0;
+        };
+
+        // Build mesh from the faces of OBJ shape, shared vertices are deduplicated
+        Mesh::Ptr BuildMesh(tinyobj::attrib_t const& attrib, tinyobj::mesh_t const& objmesh, std::vector<std::uint32_t> const& faces)
+        {
+            // Closed meshes have about half as many vertices as faces
+            VertexIndexMap used_indices(faces.size() / 2);
+
+            std::vector<RadeonRays::float3> vertices;
+            std::vector<RadeonRays::float3> normals;
+            std::vector<RadeonRays::float2> uvs;
+            std::vector<std::uint32_t> indices;
+            indices.reserve(3 * faces.size());
+
+            for (auto face : faces)
+            {
+                assert(objmesh.num_face_vertices[face] == 3 && "expected triangles");
+
+                for (auto j = 0u; j < 3; ++j)
+                {
+                    auto const& old_index = objmesh.indices[3 * face + j];
+                    auto result = used_indices.Insert(old_index, static_cast<std::uint32_t>(vertices.size()));
+
+                    // Collect vertex/normal/texcoord data. Avoid inserting the same data twice.
+                    if (result.second)
+                    {
+                        auto v = &attrib.vertices[3 * old_index.vertex_index];
+                        vertices.emplace_back(v[0], v[1], v[2]);
+
+                        if (old_index.normal_index != -1)
+                        {
+                            auto n = &attrib.normals[3 * old_index.normal_index];
+                            normals.emplace_back(n[0], n[1], n[2]);
+                        }
+                        else
+                        {
+                            normals.emplace_back(0.f, 0.f, 0.f);
+                        }
+
+                        // If an uv is present
+                        if (old_index.texcoord_index != -1)
+                        {
+                            auto t = &attrib.texcoords[2 * old_index.texcoord_index];
+                            uvs.emplace_back(t[0], t[1]);
+                        }
+                        else
+                        {
+                            uvs.emplace_back(0.f, 0.f);
+                        }
+                    }
+
+                    indices.push_back(result.first);
+                }
+            }
+
+            auto mesh = Mesh::Create();
+            mesh->SetVertices(std::move(vertices));
+            mesh->SetNormals(std::move(normals));
+            mesh->SetUVs(std::move(uvs));
+            mesh->SetIndices(std::move(indices));
+            return mesh;
+        }
+    }
+
 
     Scene1::Ptr SceneIoObj::LoadScene(std::string const& filename, std::string const& basepath) const
     {
@@ -107,117 +332,62 @@ namespace Baikal
             }
         }
 
-        // Enumerate all shapes in the scene
-        for (int s = 0; s < (int)objshapes.size(); ++s)
-        {
-            const auto& shape = objshapes[s];
+        // Split shapes into per material meshes. Local pool: default pool is busy decoding textures
+        // and tasks submitted here are waited for.
+        ThreadPool pool;
 
-            // Find all materials used by this shape.
-            std::set<int> used_materials(std::begin(shape.mesh.material_ids), std::end(shape.mesh.material_ids));
+        // Bucket faces of each shape by material in a single sweep
+        std::vector<std::future<std::vector<FaceBucket>>> shape_buckets;
+        shape_buckets.reserve(objshapes.size());
 
-            // Split the mesh into multiple meshes, each with only one material.
-            for (int used_material : used_materials)
+        for (auto const& shape : objshapes)
+        {
+            shape_buckets.push_back(pool.Submit([&shape, &objmaterials]()
             {
-                // Map from old index to new index.
-                auto index_comp = [](index_t const& a, index_t const& b)
-                {
-                    return (a.vertex_index < b.vertex_index)
-                        || (a.vertex_index == b.vertex_index && a.normal_index < b.normal_index)
-                        || (a.vertex_index == b.vertex_index && a.normal_index == b.normal_index
-                            && a.texcoord_index < b.texcoord_index);
-                };
-                std::map<index_t, unsigned int, decltype(index_comp)> used_indices(index_comp);
+                return BucketFacesByMaterial(shape.mesh, objmaterials.size());
+            }));
+        }
 
-                // Remapped indices.
-                std::vector<unsigned int> indices;
+        // Build meshes for all shapes and materials in parallel
+        std::vector<std::pair<int, std::future<Mesh::Ptr>>> meshes;
 
-                // Collected vertex/normal/texcoord data.
-                std::vector<float> vertices, normals, texcoords;
+        for (std::size_t s = 0; s < objshapes.size(); ++s)
+        {
+            for (auto& bucket : shape_buckets[s].get())
+            {
+                auto faces = std::make_shared<std::vector<std::uint32_t>>(std::move(bucket.faces));
+                auto const& shape = objshapes[s];
 
-                // Go through each face in the mesh.
-                for (size_t i = 0; i < shape.mesh.material_ids.size(); ++i)
+                meshes.emplace_back(bucket.material, pool.Submit([&shape, &attrib, faces]()
                 {
-                    // Skip faces which don't use the current material.
-                    if (shape.mesh.material_ids[i] != used_material) continue;
-
-                    const int num_face_vertices = shape.mesh.num_face_vertices[i];
-                    assert(num_face_vertices == 3 && "expected triangles");
-                    // For each vertex index of this face.
-                    for (int j = 0; j < num_face_vertices; ++j)
-                    {
-                        index_t old_index = shape.mesh.indices[num_face_vertices * i + j];
-
-                        // Collect vertex/normal/texcoord data. Avoid inserting the same data twice.
-                        auto result = used_indices.emplace(old_index, (unsigned int)(vertices.size() / 3));
-                        if (result.second) // Did insert?
-                        {
-                            // Push the new data.
-                            for (int k = 0; k < 3; ++k)
-                            {
-                                vertices.push_back(attrib.vertices[3 * old_index.vertex_index + k]);
-                            }
-
-                            for (int k = 0; k < 3; ++k)
-                            {
-                                normals.push_back(attrib.normals[3 * old_index.normal_index + k]);
-                            }
-
-                            for (int k = 0; k < 2; ++k)
-                            {
-                                // If an uv is present
-                                if (old_index.texcoord_index != -1)
-                                {
-                                    texcoords.push_back(attrib.texcoords[2 * old_index.texcoord_index + k]);
-                                }
-                                else
-                                {
-                                    texcoords.push_back(0.0f);
-                                }
-                            }
-
-                        }
-
-                        const unsigned int new_index = result.first->second;
-                        indices.push_back(new_index);
-                    }
-                }
-
-                // Create empty mesh
-                auto mesh = Mesh::Create();
-
-                // Set vertex and index data
-                auto num_vertices = vertices.size() / 3;
-                mesh->SetVertices(&vertices[0], num_vertices);
-
-                auto num_normals = normals.size() / 3;
-                mesh->SetNormals(&normals[0], num_normals);
-
-                auto num_uvs = texcoords.size() / 2;
-                mesh->SetUVs(&texcoords[0], num_uvs);
-
-                // Set indices
-                auto num_indices = indices.size();
-                mesh->SetIndices(reinterpret_cast<std::uint32_t const*>(&indices[0]), num_indices);
+                    return BuildMesh(attrib, shape.mesh, *faces);
+                }));
+            }
+        }
 
-                // Set material
+        // Attach in shape and material order so the result does not depend on scheduling
+        for (auto& iter : meshes)
+        {
+            auto used_material = iter.first;
+            auto mesh = iter.second.get();
 
-                if (used_material >= 0)
-                {
-                    mesh->SetMaterial(materials[used_material]);
-                }
+            // Set material
+            if (used_material >= 0)
+            {
+                mesh->SetMaterial(materials[used_material]);
+            }
 
-                // Attach to the scene
-                scene->AttachShape(mesh);
+            // Attach to the scene
+            scene->AttachShape(mesh);
 
-                // If the mesh has emissive material we need to add area light for it
-                if (used_material >= 0 && emissives.find(materials[used_material]) != emissives.cend())
+            // If the mesh has emissive material we need to add area light for it
+            if (used_material >= 0 && emissives.find(materials[used_material]) != emissives.cend())
+            {
+                // Add area light for each polygon of emissive mesh
+                for (std::size_t l = 0; l < mesh->GetNumIndices() / 3; ++l)
                 {
-                    // Add area light for each polygon of emissive mesh
-                    for (std::size_t l = 0; l < mesh->GetNumIndices() / 3; ++l)
-                    {
-                        auto light = AreaLight::Create(mesh, l);
-                        scene->AttachLight(light);
-                    }
+                    auto light = AreaLight::Create(mesh, l);
+                    scene->AttachLight(light);
                 }
             }
         }
@@ -261,9 +431,16 @@ namespace Baikal
                 material->SetInputValue(input_name.c_str(), InputMap_Sampler::Create(texture));
             }
         };
-        auto uberv2_set_bump_texture = [](UberV2Material::Ptr material, Texture::Ptr texture)
+        auto uberv2_set_bump_texture = [this](UberV2Material::Ptr material, Texture::Ptr texture)
         {
-            auto bump_sampler = InputMap_SamplerBumpMap::Create(texture);
+            // Height maps are converted to normal maps once here instead of being filtered per shading point
+            auto& normal_map = m_normal_map_cache[texture];
+            if (!normal_map)
+            {
+                normal_map = ConvertBumpToNormalMap(texture);
+            }
+
+            auto bump_sampler = InputMap_Sampler::Create(normal_map);
             auto bump_remap = Baikal::InputMap_Remap::Create(
                 Baikal::InputMap_ConstantFloat3::Create(RadeonRays::float3(0.f, 1.f, 0.f)),
                 Baikal::InputMap_ConstantFloat3::Create(RadeonRays::float3(-1.f, 1.f, 0.f)),
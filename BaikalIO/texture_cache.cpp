@@ -0,0 +1,405 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "texture_cache.h"
+#include "mapped_file.h"
+#include "Utils/hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <direct.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace Baikal
+{
+    namespace
+    {
+        std::uint32_t const kEntryMagic = 0x43585442; // "BTXC"
+        std::uint32_t const kEntryVersion = 1;
+        char const* kEntryExtension = ".btc";
+
+        struct EntryHeader
+        {
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint32_t format;
+            std::int32_t width;
+            std::int32_t height;
+            std::int32_t depth;
+            std::uint32_t key_size;
+            std::uint32_t data_offset;
+            std::uint64_t data_size;
+        };
+
+        struct EntryInfo
+        {
+            std::string path;
+            std::uint64_t size;
+            std::int64_t mtime;
+        };
+
+        bool GetFileInfo(std::string const& path, std::uint64_t& size, std::int64_t& mtime)
+        {
+#ifdef WIN32
+            struct _stat64 st;
+            if (_stat64(path.c_str(), &st) != 0)
+#else
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+#endif
+            {
+                return false;
+            }
+
+            // Nanoseconds where available, entries written within a second have to be ordered
+            size = static_cast<std::uint64_t>(st.st_size);
+#if defined(__APPLE__)
+            mtime = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+            mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+            mtime = static_cast<std::int64_t>(st.st_mtime) * 1000000000;
+#endif
+            return true;
+        }
+
+        std::string GetAbsolutePath(std::string const& path)
+        {
+#ifdef WIN32
+            char buffer[_MAX_PATH];
+            return _fullpath(buffer, path.c_str(), _MAX_PATH) ? buffer : path;
+#else
+            char* resolved = realpath(path.c_str(), nullptr);
+            if (!resolved)
+            {
+                return path;
+            }
+
+            std::string result(resolved);
+            free(resolved);
+            return result;
+#endif
+        }
+
+        void MakeDirectory(std::string const& path)
+        {
+#ifdef WIN32
+            _mkdir(path.c_str());
+#else
+            mkdir(path.c_str(), 0755);
+#endif
+        }
+
+        // Update modification time, it is used as the last access time for eviction
+        void TouchFile(std::string const& path)
+        {
+#ifdef WIN32
+            _utime(path.c_str(), nullptr);
+#else
+            utime(path.c_str(), nullptr);
+#endif
+        }
+
+        std::vector<EntryInfo> ListEntries(std::string const& directory)
+        {
+            std::vector<EntryInfo> entries;
+            std::string const extension(kEntryExtension);
+
+            auto add_entry = [&](std::string const& name)
+            {
+                if (name.size() <= extension.size() ||
+                    name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+                {
+                    return;
+                }
+
+                EntryInfo info;
+                info.path = directory + "/" + name;
+                if (GetFileInfo(info.path, info.size, info.mtime))
+                {
+                    entries.push_back(info);
+                }
+            };
+
+#ifdef WIN32
+            WIN32_FIND_DATAA data;
+            HANDLE handle = FindFirstFileA((directory + "/*" + extension).c_str(), &data);
+            if (handle != INVALID_HANDLE_VALUE)
+            {
+                do
+                {
+                    add_entry(data.cFileName);
+                } while (FindNextFileA(handle, &data));
+
+                FindClose(handle);
+            }
+#else
+            if (DIR* dir = opendir(directory.c_str()))
+            {
+                while (dirent* entry = readdir(dir))
+                {
+                    add_entry(entry->d_name);
+                }
+
+                closedir(dir);
+            }
+#endif
+
+            return entries;
+        }
+
+        std::string GetUniqueSuffix()
+        {
+#ifdef WIN32
+            auto pid = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+            auto pid = static_cast<unsigned long>(getpid());
+#endif
+            return "." + std::to_string(pid) + "." +
+                std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        }
+    }
+
+    TextureCache::TextureCache(std::string const& directory, std::uint64_t max_size)
+        : m_directory(directory)
+        , m_max_size(max_size)
+        , m_size(0)
+        , m_size_valid(false)
+    {
+        MakeDirectory(m_directory);
+    }
+
+    std::string TextureCache::GetSourceKey(std::string const& filename)
+    {
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;
+
+        auto path = GetAbsolutePath(filename);
+        if (!GetFileInfo(path, size, mtime))
+        {
+            return std::string();
+        }
+
+        return path + "\n" + std::to_string(size) + "\n" + std::to_string(mtime);
+    }
+
+    std::string TextureCache::GetEntryPath(std::string const& filename, bool import_compression, std::string& key) const
+    {
+        key = GetSourceKey(filename);
+        if (key.empty())
+        {
+            return std::string();
+        }
+
+        // Import settings change converted data so they are a part of the key
+        key += import_compression ? "\nbc" : "\nraw";
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(Hash64(key.data(), key.size())));
+
+        return m_directory + "/" + name + kEntryExtension;
+    }
+
+    Texture::Ptr TextureCache::Load(std::string const& filename, bool import_compression) const
+    {
+        std::string key;
+        auto entry_path = GetEntryPath(filename, import_compression, key);
+        if (entry_path.empty())
+        {
+            return nullptr;
+        }
+
+        MappedFile::Ptr file;
+        try
+        {
+            file = MappedFile::Open(entry_path);
+        }
+        catch (std::runtime_error&)
+        {
+            return nullptr;
+        }
+
+        if (file->GetSize() < sizeof(EntryHeader))
+        {
+            return nullptr;
+        }
+
+        EntryHeader header;
+        std::memcpy(&header, file->GetData(), sizeof(EntryHeader));
+
+        // Entry might be truncated or belong to another file with the same hash
+        if (header.magic != kEntryMagic || header.version != kEntryVersion ||
+            header.key_size != key.size() || header.data_offset < sizeof(EntryHeader) + header.key_size ||
+            header.data_offset + header.data_size > file->GetSize() ||
+            key.compare(0, key.size(), file->GetData() + sizeof(EntryHeader), header.key_size) != 0)
+        {
+            return nullptr;
+        }
+
+        auto format = static_cast<Texture::Format>(header.format);
+        RadeonRays::int3 size(header.width, header.height, header.depth);
+
+        // Texture keeps the mapping alive
+        std::shared_ptr<char const> data(file, file->GetData() + header.data_offset);
+        auto texture = Texture::Create(data, size, format);
+
+        if (texture->GetSizeInBytes() != header.data_size)
+        {
+            return nullptr;
+        }
+
+        TouchFile(entry_path);
+        return texture;
+    }
+
+    void TextureCache::Store(std::string const& filename, bool import_compression, Texture const& texture) const
+    {
+        std::string key;
+        auto entry_path = GetEntryPath(filename, import_compression, key);
+        if (entry_path.empty())
+        {
+            return;
+        }
+
+        auto size = texture.GetSize();
+
+        EntryHeader header;
+        header.magic = kEntryMagic;
+        header.version = kEntryVersion;
+        header.format = static_cast<std::uint32_t>(texture.GetFormat());
+        header.width = size.x;
+        header.height = size.y;
+        header.depth = size.z;
+        header.key_size = static_cast<std::uint32_t>(key.size());
+        // Page aligned mapping keeps data aligned for any texel type
+        header.data_offset = static_cast<std::uint32_t>((sizeof(EntryHeader) + key.size() + 0x3F) & ~0x3F);
+        header.data_size = texture.GetSizeInBytes();
+
+        // Written under a unique name and renamed, so concurrent loaders never see partial entries
+        auto temp_path = entry_path + GetUniqueSuffix();
+        {
+            std::ofstream out(temp_path, std::ios::binary);
+            if (!out)
+            {
+                return;
+            }
+
+            std::vector<char> padding(header.data_offset - sizeof(EntryHeader) - key.size(), 0);
+            out.write(reinterpret_cast<char const*>(&header), sizeof(EntryHeader));
+            out.write(key.data(), key.size());
+            out.write(padding.data(), padding.size());
+            out.write(texture.GetData(), header.data_size);
+
+            if (!out)
+            {
+                out.close();
+                std::remove(temp_path.c_str());
+                return;
+            }
+        }
+
+        if (std::rename(temp_path.c_str(), entry_path.c_str()) != 0)
+        {
+            std::remove(temp_path.c_str());
+            return;
+        }
+
+        bool evict = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_size_valid)
+            {
+                m_size += header.data_offset + header.data_size;
+            }
+
+            evict = !m_size_valid || m_size > m_max_size;
+        }
+
+        if (evict)
+        {
+            Evict(entry_path);
+        }
+    }
+
+    void TextureCache::Evict() const
+    {
+        Evict(std::string());
+    }
+
+    void TextureCache::Evict(std::string const& keep_path) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto entries = ListEntries(m_directory);
+
+        std::uint64_t total_size = 0;
+        for (auto const& entry : entries)
+        {
+            total_size += entry.size;
+        }
+
+        // Oldest access first
+        std::sort(entries.begin(), entries.end(), [](EntryInfo const& lhs, EntryInfo const& rhs)
+        {
+            return lhs.mtime < rhs.mtime;
+        });
+
+        for (auto const& entry : entries)
+        {
+            if (total_size <= m_max_size)
+            {
+                break;
+            }
+
+            if (entry.path == keep_path)
+            {
+                continue;
+            }
+
+            // Mapped entries can't be removed on Windows, they are skipped
+            if (std::remove(entry.path.c_str()) == 0)
+            {
+                total_size -= entry.size;
+            }
+        }
+
+        m_size = total_size;
+        m_size_valid = true;
+    }
+}
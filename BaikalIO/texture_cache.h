@@ -0,0 +1,76 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "SceneGraph/texture.h"
+
+namespace Baikal
+{
+    /**
+     \brief Persistent cache of converted textures.
+
+     Every entry is a flat file holding texture data in its final host format
+     (after channel conversion and optional block compression). Entries are keyed
+     by absolute path, size and modification time of the source image and loaded
+     by memory mapping, so textures reference the mapped data without copying.
+     Least recently used entries are removed once the total size exceeds the limit.
+     */
+    class TextureCache
+    {
+    public:
+        // Use directory for cache entries (created if missing), max_size is in bytes
+        TextureCache(std::string const& directory, std::uint64_t max_size);
+
+        // Load texture for the image file converted with given import settings,
+        // nullptr if there is no up to date entry
+        Texture::Ptr Load(std::string const& filename, bool import_compression) const;
+        // Store texture loaded from the image file, evicts old entries if needed
+        void Store(std::string const& filename, bool import_compression, Texture const& texture) const;
+        // Remove least recently used entries until the cache fits into max_size
+        void Evict() const;
+
+        // Absolute path, size and modification time of the image file, empty if it doesn't exist
+        static std::string GetSourceKey(std::string const& filename);
+
+        // Disallow copying
+        TextureCache(TextureCache const&) = delete;
+        TextureCache& operator = (TextureCache const&) = delete;
+
+    private:
+        // Path of the entry for the image file, empty if the file doesn't exist
+        std::string GetEntryPath(std::string const& filename, bool import_compression, std::string& key) const;
+        // Evict entries except the one just stored
+        void Evict(std::string const& keep_path) const;
+
+        std::string m_directory;
+        std::uint64_t m_max_size;
+
+        // Total size of the entries, computed on first store
+        mutable std::mutex m_mutex;
+        mutable std::uint64_t m_size;
+        mutable bool m_size_valid;
+    };
+}
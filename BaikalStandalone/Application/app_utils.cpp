@@ -26,7 +26,7 @@ THE SOFTWARE.
 namespace
 {
     char const* kHelpMessage =
-        "Baikal [-p path_to_models][-f model_name][-b][-r][-ns number_of_shadow_rays][-ao ao_radius][-w window_width][-h window_height][-nb number_of_indirect_bounces]";
+        "Baikal [-p path_to_models][-f model_name][-b][-r][-ns number_of_shadow_rays][-ao ao_radius][-w window_width][-h window_height][-nb number_of_indirect_bounces][-tcache texture_cache_dir][-tcache_size texture_cache_mb][-timages 0|1][-dedup][-save_bin scene.bin][-profile]";
 }
 
 namespace Baikal
@@ -92,6 +92,12 @@ namespace Baikal
 
         s.light_file = m_cmd_parser.GetOption("-lights", s.light_file);
 
+        s.texture_cache_path = m_cmd_parser.GetOption("-tcache", s.texture_cache_path);
+
+        s.texture_cache_size = m_cmd_parser.GetOption("-tcache_size", s.texture_cache_size);
+
+        s.save_scene = m_cmd_parser.GetOption("-save_bin", s.save_scene);
+
         if (m_cmd_parser.OptionExists("-ct"))
         {
             auto camera_type = m_cmd_parser.GetOption("-ct");
@@ -106,6 +112,13 @@ namespace Baikal
 
         s.interop = m_cmd_parser.GetOption("-interop", s.interop);
 
+        s.texture_images = m_cmd_parser.GetOption("-timages", s.texture_images);
+
+        if (m_cmd_parser.OptionExists("-dedup"))
+        {
+            s.dedup_geometry = true;
+        }
+
         s.cspeed = m_cmd_parser.GetOption("-cs", s.cspeed);
 
         if (m_cmd_parser.OptionExists("-config"))
@@ -144,6 +157,11 @@ namespace Baikal
             s.cmd_line_mode = true;
         }
 
+        if (m_cmd_parser.OptionExists("-profile"))
+        {
+            s.profile = true;
+        }
+
         return s;
     }
 
@@ -162,6 +180,8 @@ namespace Baikal
         , num_bounces(5)
         , num_samples(-1)
         , interop(true)
+        , texture_images(false)
+        , dedup_geometry(false)
         , cspeed(10.25f)
         , mode(ConfigManager::Mode::kUseSingleGpu)
         //ao
@@ -187,6 +207,7 @@ namespace Baikal
         , recording_enabled(false)
         , benchmark(false)
         , gui_visible(true)
+        , profile(false)
         , time_benchmarked(false)
         , rt_benchmarked(false)
         , time_benchmark(false)
@@ -196,6 +217,9 @@ namespace Baikal
         , base_image_file_name("out")
         , image_file_format("png")
 
+        //texture cache, size in megabytes
+        , texture_cache_size(4096)
+
         //unused
         , num_shadow_rays(1)
         , samplecount(0)
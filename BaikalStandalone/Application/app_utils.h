@@ -47,6 +47,9 @@ namespace Baikal
         int num_bounces;
         int num_samples;
         bool interop;
+        bool texture_images;
+        //replace duplicate meshes by instances at load
+        bool dedup_geometry;
         float cspeed;
         ConfigManager::Mode mode;
 
@@ -75,6 +78,8 @@ namespace Baikal
         bool recording_enabled;
         bool benchmark;
         bool gui_visible;
+        //per-kernel device times, queues are created with profiling enabled
+        bool profile;
 
         //bencmark
         Estimator::RayTracingStats stats;
@@ -90,6 +95,13 @@ namespace Baikal
         //light file
         std::string light_file;
 
+        //persistent texture cache, disabled if empty
+        std::string texture_cache_path;
+        int texture_cache_size;
+
+        //save loaded scene in binary format relative to path, disabled if empty
+        std::string save_scene;
+
         //unused
         int num_shadow_rays;
         int samplecount;
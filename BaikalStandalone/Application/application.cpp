@@ -72,6 +72,7 @@ THE SOFTWARE.
 #include "math/mathutils.h"
 #include "Application/application.h"
 #include "material_io.h"
+#include "image_io.h"
 #include "Application/material_explorer.h"
 
 using namespace RadeonRays;
@@ -524,6 +525,10 @@ namespace Baikal
 
             m_cl->UpdateScene();
         }
+        else if (m_cl->SwapScene())
+        {
+            m_settings.samplecount = 0;
+        }
 
         if (m_settings.num_samples == -1 || m_settings.samplecount <  m_settings.num_samples)
         {
@@ -621,6 +626,11 @@ namespace Baikal
         AppCliParser cli(argc, argv);
         m_settings = cli.Parse();
 
+        if (!m_settings.texture_cache_path.empty())
+        {
+            ImageIo::SetTextureCache(m_settings.texture_cache_path, static_cast<std::uint64_t>(m_settings.texture_cache_size) << 20);
+        }
+
         if (!m_settings.cmd_line_mode)
         {
             // Initialize GLFW
@@ -764,6 +774,21 @@ namespace Baikal
             std::cout << "\tPrimary: " << m_settings.stats.primary_throughput * 1e-6f << " Mrays/s\n";
             std::cout << "\tSecondary: " << m_settings.stats.secondary_throughput * 1e-6f << " Mrays/s\n";
             std::cout << "\tShadow: " << m_settings.stats.shadow_throughput * 1e-6f << " Mrays/s\n";
+
+            if (m_settings.profile)
+            {
+                std::cout << "Kernel profile (bounce, calls, avg ms, total ms):\n";
+                for (auto const& kernel : m_cl->GetKernelStatistics())
+                {
+                    std::cout << "\t" << kernel.name << " " << kernel.bounce << " " << kernel.count << " "
+                        << kernel.total_time / kernel.count << " " << kernel.total_time << "\n";
+                }
+
+                if (m_cl->WriteKernelTrace("kernel_trace.json"))
+                {
+                    std::cout << "Kernel trace saved to kernel_trace.json\n";
+                }
+            }
         }
     }
 
@@ -956,6 +981,30 @@ namespace Baikal
                 ImGui::Text("Shadow rays: %f Mrays/s", stats.shadow_throughput * 1e-6f);
             }
 
+            if (m_settings.profile)
+            {
+                ImGui::Separator();
+                ImGui::Text("Kernel profile, avg ms");
+
+                // Bounce -1 is work outside of the bounce loop, in flight frames are picked up later
+                for (auto const& kernel : m_cl->GetKernelStatistics(false))
+                {
+                    ImGui::Text("%2d %-32s %.3f", kernel.bounce, kernel.name.c_str(), kernel.total_time / kernel.count);
+                }
+
+                if (ImGui::Button("Reset profile"))
+                {
+                    m_cl->ResetKernelStatistics();
+                }
+
+                ImGui::SameLine();
+
+                if (ImGui::Button("Save trace"))
+                {
+                    m_cl->WriteKernelTrace("kernel_trace.json");
+                }
+            }
+
 #ifdef ENABLE_DENOISER
             ImGui::Separator();
 
@@ -34,6 +34,7 @@ THE SOFTWARE.
 
 #include "Renderers/monte_carlo_renderer.h"
 #include "Renderers/adaptive_renderer.h"
+#include "Controllers/clw_scene_controller.h"
 
 #include <fstream>
 #include <sstream>
@@ -64,7 +65,8 @@ namespace Baikal
             m_cfgs,
             settings.num_bounces,
             settings.platform_index,
-            settings.device_index);
+            settings.device_index,
+            settings.profile);
 
         m_width = (std::uint32_t)settings.width;
         m_height = (std::uint32_t)settings.height;
@@ -78,6 +80,11 @@ namespace Baikal
                 << ", vendor: " << device.GetVendor()
                 << ", version: " << device.GetVersion()
                 << "\n";
+
+            if (auto controller = dynamic_cast<ClwSceneController*>(m_cfgs[i].controller.get()))
+            {
+                controller->SetTextureBackend(settings.texture_images ? TextureBackend::kImages : TextureBackend::kBuffer);
+            }
         }
 
         settings.interop = false;
@@ -139,6 +146,12 @@ namespace Baikal
             }
         }
 
+        // Kernels not depending on the scene compile while it loads
+        for (auto& cfg : m_cfgs)
+        {
+            cfg.factory->WarmUp();
+        }
+
         m_shape_id_data.output = m_cfgs[m_primary].factory->CreateOutput(m_width, m_height);
         m_cfgs[m_primary].renderer->Clear(RadeonRays::float3(0, 0, 0), *m_outputs[m_primary].output);
         m_cfgs[m_primary].renderer->Clear(RadeonRays::float3(0, 0, 0), *m_shape_id_data.output);
@@ -203,7 +216,7 @@ namespace Baikal
             if (i == static_cast<std::size_t>(m_primary))
             {
                 m_cfgs[i].renderer->Clear(float3(0, 0, 0), *m_outputs[i].output);
-                m_cfgs[i].controller->CompileScene(m_scene);
+                m_cfgs[i].controller->CompileSceneAsync(m_scene);
                 ++m_ctrl[i].scene_state;
 
 #ifdef ENABLE_DENOISER
@@ -216,6 +229,25 @@ namespace Baikal
         }
     }
 
+    bool AppClRender::SwapScene()
+    {
+        if (!m_cfgs[m_primary].controller->SwapCompiledScene(false))
+        {
+            return false;
+        }
+
+        // Samples rendered so far belong to previous version of the scene
+        m_cfgs[m_primary].renderer->Clear(float3(0, 0, 0), *m_outputs[m_primary].output);
+
+#ifdef ENABLE_DENOISER
+        ClearDenoiserOutputs(m_primary);
+#endif
+
+        // Catch up with edits made while compiling
+        m_cfgs[m_primary].controller->CompileSceneAsync(m_scene);
+        return true;
+    }
+
     void AppClRender::Update(AppSettings& settings)
     {
         ++settings.samplecount;
@@ -571,6 +603,24 @@ namespace Baikal
         }
     }
 
+    std::vector<CLProfiler::Statistics> AppClRender::GetKernelStatistics(bool wait)
+    {
+        return static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[m_primary].renderer.get())->GetKernelStatistics(wait);
+    }
+
+    void AppClRender::ResetKernelStatistics()
+    {
+        for (std::size_t i = 0; i < m_cfgs.size(); ++i)
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[i].renderer.get())->ResetKernelStatistics();
+        }
+    }
+
+    bool AppClRender::WriteKernelTrace(const std::string& filename)
+    {
+        return static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[m_primary].renderer.get())->WriteKernelTrace(filename);
+    }
+
     void AppClRender::SetOutputType(Renderer::OutputType type)
     {
         for (std::size_t i = 0; i < m_cfgs.size(); ++i)
@@ -80,8 +80,10 @@ namespace Baikal
         //copy data from to GL
         void Update(AppSettings& settings);
 
-        //compile scene
+        //compile scene, geometry and texture changes are compiled in background
         void UpdateScene();
+        //swap in scene compiled in background, returns true if output has been cleared
+        bool SwapScene();
         //render
         void Render(int sample_cnt);
         void StartRenderThreads();
@@ -100,6 +102,11 @@ namespace Baikal
         void SetNumBounces(int num_bounces);
         void SetOutputType(Renderer::OutputType type);
 
+        //kernel profile of the primary device, enabled with -profile
+        std::vector<CLProfiler::Statistics> GetKernelStatistics(bool wait = true);
+        void ResetKernelStatistics();
+        bool WriteKernelTrace(const std::string& filename);
+
         std::future<int> GetShapeId(std::uint32_t x, std::uint32_t y);
         Baikal::Shape::Ptr GetShapeById(int shape_id);
 
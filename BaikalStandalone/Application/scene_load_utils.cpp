@@ -135,6 +135,7 @@ Scene1::Ptr LoadScene(Baikal::AppSettings const& settings)
 
     std::string filename = basepath + settings.modelname;
 
+    Baikal::SceneIo::SetGeometryDeduplication(settings.dedup_geometry);
     auto scene = Baikal::SceneIo::LoadScene(filename, basepath);
 
     if (scene == nullptr)
@@ -144,5 +145,12 @@ Scene1::Ptr LoadScene(Baikal::AppSettings const& settings)
 
     LoadMaterials(basepath, scene);
     LoadLights(settings.light_file, scene);
+
+    // Binary scenes load much faster than text formats, convert once and reuse
+    if (!settings.save_scene.empty())
+    {
+        Baikal::SceneIo::SaveScene(*scene, basepath + settings.save_scene, basepath);
+    }
+
     return scene;
 }
\ No newline at end of file
@@ -23,6 +23,8 @@ THE SOFTWARE.
 
 #include "CLW.h"
 #include "RenderFactory/render_factory.h"
+#include "Renderers/monte_carlo_renderer.h"
+#include "Utils/cl_profiler.h"
 
 #ifndef APP_BENCHMARK
 
@@ -45,7 +47,8 @@ void ConfigManager::CreateConfigs(
     std::vector<Config>& configs,
     int initial_num_bounces,
     int req_platform_index,
-    int req_device_index)
+    int req_device_index,
+    bool profile)
 {
     std::vector<CLWPlatform> platforms;
 
@@ -131,7 +134,9 @@ void ConfigManager::CreateConfigs(
 #endif
                 try
                 {
-                    cfg.context = CLWContext::Create(platforms[i].GetDevice(d), props);
+                    cfg.context = profile ?
+                        Baikal::CLProfiler::CreateContext(platforms[i].GetDevice(d), props) :
+                        CLWContext::Create(platforms[i].GetDevice(d), props);
                     cfg.type = kPrimary;
                     cfg.caninterop = true;
                     hasprimary = true;
@@ -153,7 +158,9 @@ void ConfigManager::CreateConfigs(
 
             if (create_without_interop)
             {
-                cfg.context = CLWContext::Create(platforms[i].GetDevice(d));
+                cfg.context = profile ?
+                    Baikal::CLProfiler::CreateContext(platforms[i].GetDevice(d)) :
+                    CLWContext::Create(platforms[i].GetDevice(d));
                 cfg.type = kSecondary;
             }
 
@@ -180,9 +187,14 @@ void ConfigManager::CreateConfigs(
 
     for (std::size_t i = 0; i < configs.size(); ++i)
     {
-        configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context, "cache");
+        configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context, "cache", "kernel_bundle");
         configs[i].controller = configs[i].factory->CreateSceneController();
         configs[i].renderer = configs[i].factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
+
+        if (profile)
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(configs[i].renderer.get())->SetProfilingEnabled(true);
+        }
     }
 }
 
@@ -193,7 +205,8 @@ void ConfigManager::CreateConfigs(
     std::vector<Config>& configs,
     int initial_num_bounces,
     int req_platform_index,
-    int req_device_index)
+    int req_device_index,
+    bool profile)
 {
     std::vector<CLWPlatform> platforms;
 
@@ -219,7 +232,9 @@ void ConfigManager::CreateConfigs(
 
             Config cfg;
             cfg.caninterop = false;
-            cfg.context = CLWContext::Create(platforms[i].GetDevice(d));
+            cfg.context = profile ?
+                Baikal::CLProfiler::CreateContext(platforms[i].GetDevice(d)) :
+                CLWContext::Create(platforms[i].GetDevice(d));
             cfg.type = kSecondary;
 
             configs.push_back(std::move(cfg));
@@ -242,6 +257,11 @@ void ConfigManager::CreateConfigs(
         configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context);
         configs[i].controller = configs[i].factory->CreateSceneController();
         configs[i].renderer = configs[i].factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
+
+        if (profile)
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(configs[i].renderer.get())->SetProfilingEnabled(true);
+        }
     }
 }
 #endif //APP_BENCHMARK
@@ -76,7 +76,8 @@ public:
         std::vector<Config>& renderers,
         int initial_num_bounces,
         int req_platform_index = -1,
-        int req_device_index = -1);
+        int req_device_index = -1,
+        bool profile = false);
 
 private:
 
@@ -28,7 +28,10 @@ THE SOFTWARE.
 #include "RenderFactory/clw_render_factory.h"
 #include "Output/output.h"
 #include "SceneGraph/camera.h"
+#include "SceneGraph/clwscene.h"
+#include "SceneGraph/shape.h"
 #include "scene_io.h"
+#include "Utils/cl_workgroup_tuner.h"
 
 #include "OpenImageIO/imageio.h"
 
@@ -115,6 +118,7 @@ public:
         auto platform = platforms[platform_index];
         auto device = platform.GetDevice(device_index);
         auto context = CLWContext::Create(device);
+        m_context = context;
 
         ASSERT_NO_THROW(m_factory = std::make_unique<Baikal::ClwRenderFactory>(context, "cache"));
         ASSERT_NO_THROW(m_renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer));
@@ -302,6 +306,7 @@ public:
         return std::find(begin, end, option) != end;
     }
 
+    CLWContext m_context;
     std::unique_ptr<Baikal::Renderer> m_renderer;
     std::unique_ptr<Baikal::SceneController<Baikal::ClwScene>> m_controller;
     std::unique_ptr<Baikal::RenderFactory<Baikal::ClwScene>> m_factory;
@@ -340,6 +345,97 @@ TEST_F(BasicTest, RenderTestScene)
     ASSERT_TRUE(CompareToReference(test_name() + ".png"));
 }
 
+// Edits made while scene is compiled in background survive the swap
+TEST_F(BasicTest, AsyncCompile)
+{
+    using RadeonRays::float3;
+    using RadeonRays::float2;
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto num_shapes = m_controller->GetCachedScene(m_scene).shapes.GetElementCount();
+
+    // Geometry change is compiled on a worker thread
+    float3 vertices[] = { float3(-1, 0, 2), float3(1, 0, 2), float3(0, 1, 2) };
+    float3 normals[] = { float3(0, 0, -1), float3(0, 0, -1), float3(0, 0, -1) };
+    float2 uvs[] = { float2(0, 0), float2(1, 0), float2(0, 1) };
+    std::uint32_t indices[] = { 0, 1, 2 };
+
+    auto mesh = Baikal::Mesh::Create();
+    mesh->SetVertices(vertices, 3);
+    mesh->SetNormals(normals, 3);
+    mesh->SetUVs(uvs, 3);
+    mesh->SetIndices(indices, 3);
+    m_scene->AttachShape(mesh);
 
+    ASSERT_NO_THROW(m_controller->CompileSceneAsync(m_scene));
 
+    // Previous version can be rendered meanwhile
+    ASSERT_NO_THROW(m_renderer->Render(m_controller->GetCachedScene(m_scene)));
+    m_camera->SetFocalLength(0.05f);
+
+    ASSERT_TRUE(m_controller->SwapCompiledScene(true));
+    ASSERT_EQ(m_controller->GetCachedScene(m_scene).shapes.GetElementCount(), num_shapes + 1);
+
+    // Camera edit is still pending and is compiled right away, nothing is left in flight
+    ASSERT_NO_THROW(m_controller->CompileSceneAsync(m_scene));
+    ASSERT_FALSE(m_controller->SwapCompiledScene(true));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    Baikal::ClwScene::Camera camera;
+    m_context.ReadBuffer(0, scene.camera, &camera, 1).Wait();
+    ASSERT_EQ(camera.focal_length, 0.05f);
 
+    ClearOutput();
+    ASSERT_NO_THROW(m_renderer->Render(scene));
+}
+
+// Tuner measures candidates on real launches and keeps the fastest local size
+TEST_F(BasicTest, WorkGroupTuner)
+{
+    char const source[] =
+        "__kernel void FillIndex(int n, int base, __global int* out)\n"
+        "{\n"
+        "    int i = get_global_id(0);\n"
+        "    if (i < n) out[i] = base + i;\n"
+        "}\n";
+
+    int const num_items = 1000;
+    auto buffer = m_context.CreateBuffer<int>(num_items, CL_MEM_WRITE_ONLY);
+    std::vector<int> result(num_items);
+
+    Baikal::CLWorkGroupTuner tuner(nullptr);
+    auto program = CLWProgram::CreateFromSource(source, sizeof(source) - 1, "", m_context);
+    auto kernel = program.GetKernel("FillIndex");
+    kernel.SetArg(0, num_items);
+    kernel.SetArg(2, buffer);
+
+    // Every launch does the full work, whatever candidate it measures
+    std::size_t local_size = 0;
+    for (auto i = 0; i < 64 && !tuner.GetTunedLocalSize(m_context, kernel, 1, &local_size); ++i)
+    {
+        kernel.SetArg(1, i);
+        ASSERT_NO_THROW(tuner.Launch1D(m_context, kernel, num_items, 64));
+        m_context.ReadBuffer(0, buffer, result.data(), num_items).Wait();
+        ASSERT_EQ(result[0], i);
+        ASSERT_EQ(result[num_items - 1], i + num_items - 1);
+    }
+
+    std::size_t max_size = 0;
+    clGetKernelWorkGroupInfo(kernel, m_context.GetDevice(0).GetID(), CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_size), &max_size, nullptr);
+    ASSERT_TRUE(tuner.GetTunedLocalSize(m_context, kernel, 1, &local_size));
+    ASSERT_GT(local_size, 0u);
+    ASSERT_LE(local_size, max_size);
+
+    // Rebuilt program shares the tuned size through kernel name and options
+    auto rebuilt = CLWProgram::CreateFromSource(source, sizeof(source) - 1, "", m_context).GetKernel("FillIndex");
+    std::size_t rebuilt_size = 0;
+    ASSERT_TRUE(tuner.GetTunedLocalSize(m_context, rebuilt, 1, &rebuilt_size));
+    ASSERT_EQ(rebuilt_size, local_size);
+
+    rebuilt.SetArg(0, num_items);
+    rebuilt.SetArg(1, -1);
+    rebuilt.SetArg(2, buffer);
+    ASSERT_NO_THROW(tuner.Launch1D(m_context, rebuilt, num_items, 64));
+    m_context.ReadBuffer(0, buffer, result.data(), num_items).Wait();
+    ASSERT_EQ(result[num_items - 1], num_items - 2);
+}
@@ -21,8 +21,34 @@ THE SOFTWARE.
 ********************************************************************/
 #include "gtest/gtest.h"
 
+#include "Utils/block_compression.h"
+#include "Utils/cl_inputmap_generator.h"
+#include "Utils/cl_program_cache.h"
+#include "Utils/inputmap_optimizer.h"
 #include "Utils/distribution1d.h"
+#include "Utils/geometry_dedup.h"
+#include "Utils/mipmap.h"
+#include "Utils/normal_map.h"
+#include "Utils/texture_dedup.h"
+#include "Utils/thread_pool.h"
+#include "Utils/vertex_compression.h"
+#include "Utils/half.h"
+#include "SceneGraph/scene1.h"
+#include "SceneGraph/shape.h"
+#include "SceneGraph/texture.h"
+#include "SceneGraph/iterator.h"
+#include "SceneGraph/inputmaps.h"
 #include "math/mathutils.h"
+#include "image_io.h"
+#include "scene_io.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
 
 class InternalTest : public ::testing::Test
 {
@@ -47,3 +73,801 @@ TEST_F(InternalTest, Distribuiton1D)
 
     cnts[0] += cnts[1];
 }
+
+TEST_F(InternalTest, GeometryDedup)
+{
+    using namespace Baikal;
+    using RadeonRays::float3;
+
+    auto scene = Scene1::Create();
+
+    float3 vertices[] = { float3(0, 0, 0), float3(1, 0, 0), float3(0, 1, 0) };
+    std::uint32_t indices[] = { 0, 1, 2 };
+
+    for (auto i = 0; i < 3; ++i)
+    {
+        // Second and third meshes are translated copies of the first one
+        float3 offset(i * 5.f, 0.f, 0.f);
+        float3 moved[] = { vertices[0] + offset, vertices[1] + offset, vertices[2] + offset };
+
+        auto mesh = Mesh::Create();
+        mesh->SetVertices(moved, 3);
+        mesh->SetNormals(vertices, 3);
+        mesh->SetIndices(indices, 3);
+        scene->AttachShape(mesh);
+    }
+
+    // Positions have to match exactly, slightly moved vertex makes a different mesh
+    {
+        float3 moved[] = { vertices[0], vertices[1], float3(0.f, 1.0001f, 0.f) };
+
+        auto mesh = Mesh::Create();
+        mesh->SetVertices(moved, 3);
+        mesh->SetNormals(vertices, 3);
+        mesh->SetIndices(indices, 3);
+        scene->AttachShape(mesh);
+    }
+
+    // Finding duplicates leaves the scene as is
+    GeometryDedupStats find_stats;
+    auto duplicates = FindDuplicateGeometry(*scene, find_stats);
+
+    ASSERT_EQ(duplicates.size(), 2u);
+    ASSERT_EQ(find_stats.num_instanced, 2u);
+    ASSERT_EQ(scene->GetNumShapes(), 4u);
+
+    for (auto const& duplicate : duplicates)
+    {
+        ASSERT_EQ(duplicate.first->GetVertices()[0].x - duplicate.second.base->GetVertices()[0].x, duplicate.second.offset.x);
+    }
+
+    for (auto shape_iter = scene->CreateShapeIterator(); shape_iter->IsValid(); shape_iter->Next())
+    {
+        ASSERT_TRUE(std::dynamic_pointer_cast<Mesh>(shape_iter->ItemAs<Shape>()) != nullptr);
+    }
+
+    auto stats = DeduplicateGeometry(*scene);
+
+    ASSERT_EQ(stats.num_meshes, 4u);
+    ASSERT_EQ(stats.num_instanced, 2u);
+    ASSERT_EQ(stats.num_triangles_removed, 2u);
+    ASSERT_EQ(scene->GetNumShapes(), 4u);
+
+    auto num_instances = 0u;
+    auto shape_iter = scene->CreateShapeIterator();
+    for (; shape_iter->IsValid(); shape_iter->Next())
+    {
+        auto instance = std::dynamic_pointer_cast<Instance>(shape_iter->ItemAs<Shape>());
+
+        if (instance)
+        {
+            // Translation of the copy has to be moved into instance transform
+            auto aabb = instance->GetWorldAABB();
+            ASSERT_GT(aabb.pmin.x, 4.f);
+            ++num_instances;
+        }
+    }
+
+    ASSERT_EQ(num_instances, 2u);
+}
+
+TEST_F(InternalTest, MeshReleaseData)
+{
+    using namespace Baikal;
+    using RadeonRays::float3;
+
+    float3 vertices[] = { float3(0, 0, 0), float3(1, 0, 0), float3(0, 1, 0) };
+    std::uint32_t indices[] = { 0, 1, 2 };
+
+    auto mesh = Mesh::Create();
+    mesh->SetVertices(vertices, 3);
+    mesh->SetIndices(indices, 3);
+
+    // Nothing to restore data from: release is ignored
+    mesh->ReleaseData();
+    ASSERT_FALSE(mesh->IsDataReleased());
+
+    auto num_reloads = 0;
+    mesh->SetReloadCallback([&](std::vector<float3>& v, std::vector<float3>&, std::vector<RadeonRays::float2>&, std::vector<std::uint32_t>& i)
+    {
+        std::copy(vertices, vertices + 3, v.begin());
+        std::copy(indices, indices + 3, i.begin());
+        ++num_reloads;
+    });
+
+    auto aabb = mesh->GetLocalAABB();
+    mesh->ReleaseData();
+    ASSERT_TRUE(mesh->IsDataReleased());
+
+    // Sizes and bounds are available without reloading
+    ASSERT_EQ(mesh->GetNumVertices(), 3u);
+    ASSERT_EQ(mesh->GetNumIndices(), 3u);
+    mesh->SetDirty(false);
+    ASSERT_EQ(mesh->GetLocalAABB().pmax.x, aabb.pmax.x);
+    ASSERT_EQ(num_reloads, 0);
+
+    // Data access reloads it once, also from concurrent readers
+    std::vector<std::thread> readers;
+    for (auto i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&mesh]() { ASSERT_EQ(mesh->GetVertices()[1].x, 1.f); });
+    }
+
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    ASSERT_EQ(num_reloads, 1);
+    ASSERT_FALSE(mesh->IsDataReleased());
+
+    // Replacing an array of released data doesn't reload it
+    mesh->ReleaseData();
+    float3 new_vertices[] = { float3(0, 0, 0), float3(2, 0, 0), float3(0, 2, 0), float3(2, 2, 0) };
+    mesh->SetVertices(new_vertices, 4);
+    ASSERT_TRUE(mesh->IsDataReleased());
+    ASSERT_EQ(mesh->GetNumVertices(), 4u);
+    ASSERT_EQ(num_reloads, 1);
+
+    // Other arrays are still reloaded on access, replaced one is kept
+    ASSERT_EQ(mesh->GetIndices()[2], 2u);
+    ASSERT_EQ(num_reloads, 2);
+    ASSERT_EQ(mesh->GetVertices()[1].x, 2.f);
+    ASSERT_EQ(mesh->GetLocalAABB().pmax.x, 2.f);
+
+    // Callback can't restore replaced data anymore
+    mesh->ReleaseData();
+    ASSERT_FALSE(mesh->IsDataReleased());
+}
+
+TEST_F(InternalTest, MipChain)
+{
+    using namespace Baikal;
+
+    // 4x2 RGBA8 texture: left half is black, right half is white
+    auto data = new char[4 * 4 * 2];
+    for (auto i = 0; i < 8; ++i)
+    {
+        auto value = (i % 4) < 2 ? 0x00 : 0xFF;
+        std::fill(data + 4 * i, data + 4 * i + 4, static_cast<char>(value));
+    }
+
+    auto texture = Texture::Create(data, RadeonRays::int3(4, 2, 1), Texture::Format::kRgba8);
+
+    // 4x2, 2x1 and 1x1 levels each padded to 16 bytes
+    ASSERT_EQ(GetMipLevelCount(*texture), 3u);
+    ASSERT_EQ(GetMipChainSize(*texture), 32u + 16u + 16u);
+
+    std::vector<char> chain(GetMipChainSize(*texture));
+    WriteMipChain(*texture, chain.data());
+
+    auto level1 = reinterpret_cast<std::uint8_t const*>(chain.data() + 32);
+    ASSERT_EQ(level1[0], 0x00);
+    ASSERT_EQ(level1[4], 0xFF);
+
+    auto level2 = reinterpret_cast<std::uint8_t const*>(chain.data() + 48);
+    ASSERT_EQ(level2[0], 0x80);
+
+    texture->SetMipmapEnabled(false);
+    ASSERT_EQ(GetMipLevelCount(*texture), 1u);
+    ASSERT_EQ(GetMipChainSize(*texture), 32u);
+}
+
+TEST_F(InternalTest, SingleChannelFormats)
+{
+    using namespace Baikal;
+
+    ASSERT_EQ(Texture::GetPixelSize(Texture::Format::kR8), 1u);
+    ASSERT_EQ(Texture::GetPixelSize(Texture::Format::kRG8), 2u);
+    ASSERT_EQ(Texture::GetPixelSize(Texture::Format::kR16F), 2u);
+    ASSERT_EQ(Texture::GetPixelSize(Texture::Format::kR32F), 4u);
+
+    // 4x2 R8 texture with the same content as in MipChain
+    auto data = new char[4 * 2];
+    for (auto i = 0; i < 8; ++i)
+    {
+        data[i] = static_cast<char>((i % 4) < 2 ? 0x00 : 0xFF);
+    }
+
+    auto texture = Texture::Create(data, RadeonRays::int3(4, 2, 1), Texture::Format::kR8);
+    ASSERT_EQ(texture->GetSizeInBytes(), 8u);
+    ASSERT_NEAR(texture->ComputeAverageValue().y, 0.5f, 1e-3f);
+
+    // Every level fits into 16 bytes
+    ASSERT_EQ(GetMipChainSize(*texture), 16u + 16u + 16u);
+
+    std::vector<char> chain(GetMipChainSize(*texture));
+    WriteMipChain(*texture, chain.data());
+
+    auto level1 = reinterpret_cast<std::uint8_t const*>(chain.data() + 16);
+    ASSERT_EQ(level1[0], 0x00);
+    ASSERT_EQ(level1[1], 0xFF);
+
+    auto level2 = reinterpret_cast<std::uint8_t const*>(chain.data() + 32);
+    ASSERT_EQ(level2[0], 0x80);
+}
+
+TEST_F(InternalTest, BlockCompression)
+{
+    using namespace Baikal;
+
+    // 6x5 RGBA image: two flat colors split vertically, covers partial blocks
+    int const width = 6;
+    int const height = 5;
+    std::vector<float> texels(4 * width * height);
+    for (auto i = 0; i < width * height; ++i)
+    {
+        auto value = (i % width) < 3 ? 0.f : 1.f;
+        texels[4 * i] = value;
+        texels[4 * i + 1] = 1.f - value;
+        texels[4 * i + 2] = value;
+        texels[4 * i + 3] = 1.f;
+    }
+
+    for (auto format : { Texture::Format::kBC1, Texture::Format::kBC4, Texture::Format::kBC5 })
+    {
+        auto texture = Texture::Create(EncodeImage(format, texels.data(), width, height), RadeonRays::int3(width, height, 1), format);
+        ASSERT_EQ(texture->GetSizeInBytes(), 4 * GetBlockSize(format));
+
+        auto decoded = DecodeImage(format, texture->GetData(), width, height);
+        for (auto i = 0; i < width * height; ++i)
+        {
+            ASSERT_NEAR(decoded[4 * i], texels[4 * i], 1e-3f);
+
+            // Single and two channel formats are expanded like R8 and RG8
+            if (format == Texture::Format::kBC4)
+            {
+                ASSERT_EQ(decoded[4 * i + 3], decoded[4 * i]);
+            }
+            else if (format == Texture::Format::kBC5)
+            {
+                ASSERT_EQ(decoded[4 * i + 2], 0.f);
+                ASSERT_EQ(decoded[4 * i + 3], 1.f);
+            }
+        }
+
+        // 6x5, 3x2 and 1x1 levels
+        ASSERT_EQ(GetMipLevelCount(*texture), 3u);
+        ASSERT_EQ(GetMipChainSize(*texture), 4 * GetBlockSize(format) + 16u + 16u);
+    }
+
+    // No encoder for BC7, mip levels can't be generated
+    auto texture = Texture::Create(new char[16](), RadeonRays::int3(4, 4, 1), Texture::Format::kBC7);
+    ASSERT_EQ(GetMipLevelCount(*texture), 1u);
+}
+
+TEST_F(InternalTest, VertexCompression)
+{
+    using namespace Baikal;
+    using RadeonRays::float3;
+
+    // Octahedral normals, both hemispheres and the fold seam
+    for (auto n : { float3(0.f, 0.f, 1.f), float3(0.f, 0.f, -1.f), float3(1.f, 0.f, 0.f),
+        float3(0.3f, -0.5f, 0.8f), float3(-0.6f, 0.2f, -0.7f), float3(0.5f, 0.5f, -0.01f) })
+    {
+        n.normalize();
+        auto decoded = DecodeOctahedralNormal(EncodeOctahedralNormal(n));
+        ASSERT_GT(dot(n, decoded), 0.99999f);
+    }
+
+    // Tangent keeps bitangent sign
+    ASSERT_NE(EncodeTangent(RadeonRays::float4(1.f, 0.f, 0.f, -1.f)) & 0x10000u, 0u);
+    ASSERT_EQ(EncodeTangent(RadeonRays::float4(1.f, 0.f, 0.f, 1.f)) & 0x10000u, 0u);
+
+    // Half UVs
+    for (auto uv : { 0.f, 0.25f, 0.5f, 1.f, 3.75f, -2.125f, 0.333f })
+    {
+        ASSERT_NEAR(static_cast<float>(half(uv)), uv, std::fabs(uv) * 1e-3f);
+    }
+
+    // Positions are within half a quantization step
+    float3 pmin(-1.f, 2.f, 0.f);
+    float3 extents(2.f, 0.5f, 0.f);
+    float3 scale = extents * (1.f / 65535.f);
+    for (auto p : { float3(-1.f, 2.f, 0.f), float3(1.f, 2.5f, 0.f), float3(0.123f, 2.2f, 0.f) })
+    {
+        std::uint16_t quantized[3];
+        QuantizePosition(p, pmin, extents, quantized);
+        auto decoded = DequantizePosition(quantized, pmin, scale);
+        ASSERT_LE(std::fabs(decoded.x - p.x), scale.x * 0.5f + 1e-6f);
+        ASSERT_LE(std::fabs(decoded.y - p.y), scale.y * 0.5f + 1e-6f);
+        ASSERT_EQ(decoded.z, p.z);
+    }
+
+    // 16-bit indices cover exactly 64K vertices
+    ASSERT_TRUE(CanUseShortIndices(0x10000));
+    ASSERT_FALSE(CanUseShortIndices(0x10001));
+
+    std::uint32_t indices[] = { 0, 1, 0xffff, 42 };
+    std::uint16_t encoded[4];
+    EncodeShortIndices(indices, 4, encoded);
+    for (auto i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ(encoded[i], indices[i]);
+    }
+}
+
+TEST_F(InternalTest, TextureLayout)
+{
+    using namespace Baikal;
+
+    // 5x3 RGBA8 texture, every texel stores its x and y
+    auto data = new char[4 * 5 * 3];
+    for (auto i = 0; i < 15; ++i)
+    {
+        data[4 * i] = static_cast<char>(i % 5);
+        data[4 * i + 1] = static_cast<char>(i / 5);
+    }
+
+    auto texture = Texture::Create(data, RadeonRays::int3(5, 3, 1), Texture::Format::kRgba8);
+    texture->SetMipmapEnabled(false);
+
+    // 4x4 tiles pad the level to 8x4 texels
+    texture->SetLayout(Texture::Layout::kTiled);
+    ASSERT_EQ(GetMipChainSize(*texture), 8u * 4u * 4u);
+
+    std::vector<char> tiled(GetMipChainSize(*texture));
+    WriteMipChain(*texture, tiled.data());
+    ASSERT_EQ(tiled[4 * 5], 1);
+    ASSERT_EQ(tiled[4 * 5 + 1], 1);
+    ASSERT_EQ(tiled[4 * 16], 4);
+
+    // Morton order inside 8x8 tile: (1, 1) is the 4th texel, (2, 0) the 5th
+    texture->SetLayout(Texture::Layout::kMorton);
+    ASSERT_EQ(GetMipChainSize(*texture), 8u * 8u * 4u);
+
+    std::vector<char> morton(GetMipChainSize(*texture));
+    WriteMipChain(*texture, morton.data());
+    ASSERT_EQ(morton[4 * 3], 1);
+    ASSERT_EQ(morton[4 * 3 + 1], 1);
+    ASSERT_EQ(morton[4 * 4], 2);
+
+    // Compressed textures keep their block order
+    auto bc_texture = Texture::Create(new char[8](), RadeonRays::int3(4, 4, 1), Texture::Format::kBC1);
+    bc_texture->SetLayout(Texture::Layout::kMorton);
+    ASSERT_EQ(GetTextureLayout(*bc_texture), Texture::Layout::kLinear);
+}
+
+TEST_F(InternalTest, TextureCache)
+{
+    using namespace Baikal;
+
+    std::string const filename = "../Resources/Textures/test_albedo1.jpg";
+    auto reference = ImageIo::CreateImageIo()->LoadImage(filename);
+
+    ImageIo::SetTextureCache("texture_cache", 1ull << 30);
+    auto image_io = ImageIo::CreateImageIo();
+
+    // First load fills the cache, the second one maps the entry
+    for (auto i = 0; i < 2; ++i)
+    {
+        auto texture = image_io->LoadImage(filename);
+        ASSERT_EQ(texture->GetFormat(), reference->GetFormat());
+        ASSERT_EQ(texture->GetSize().x, reference->GetSize().x);
+        ASSERT_EQ(texture->GetSize().y, reference->GetSize().y);
+        ASSERT_EQ(texture->GetSizeInBytes(), reference->GetSizeInBytes());
+        ASSERT_EQ(std::memcmp(texture->GetData(), reference->GetData(), reference->GetSizeInBytes()), 0);
+    }
+
+    // Entries follow import settings of the IO instance, not the current global ones
+    ImageIo::SetImportCompression(true);
+    auto compressing_io = ImageIo::CreateImageIo();
+    ImageIo::SetImportCompression(false);
+
+    ASSERT_TRUE(IsBlockCompressed(compressing_io->LoadImage(filename)->GetFormat()));
+    ASSERT_EQ(image_io->LoadImage(filename)->GetFormat(), reference->GetFormat());
+
+    ImageIo::SetTextureCache("", 0);
+}
+
+TEST_F(InternalTest, ProgramCache)
+{
+    using namespace Baikal;
+
+    std::string const directory = "program_cache_test";
+    // Entries of previous runs are not tracked without the index
+    std::remove((directory + "/index.txt").c_str());
+    std::remove((directory + "/options.txt").c_str());
+    std::remove((directory + "/workgroup_sizes.txt").c_str());
+
+    std::vector<std::uint8_t> binary(1000, 42);
+    std::vector<std::uint8_t> loaded;
+
+    {
+        // Two entries fit, the third one evicts the least recently used
+        CLProgramCache cache(directory, 2500);
+        cache.Store("prog", "key0", binary);
+        cache.Store("prog", "key1", binary);
+
+        ASSERT_TRUE(cache.Load("prog", "key0", loaded));
+        ASSERT_EQ(loaded, binary);
+        ASSERT_FALSE(cache.Load("prog", "other source", loaded));
+
+        cache.Store("prog", "key2", binary);
+        ASSERT_TRUE(cache.Load("prog", "key0", loaded));
+        ASSERT_FALSE(cache.Load("prog", "key1", loaded));
+
+        cache.Reject("prog", "key0");
+
+        auto stats = cache.GetStatistics();
+        ASSERT_EQ(stats.hits, 1u);
+        ASSERT_EQ(stats.misses, 3u);
+        ASSERT_EQ(stats.rejected, 1u);
+        ASSERT_EQ(stats.stores, 3u);
+        ASSERT_EQ(stats.evictions, 1u);
+
+        cache.AddProgramOptions("prog", "-D A");
+        cache.AddProgramOptions("prog", "-D B");
+        cache.AddProgramOptions("prog", "-D A");
+
+        // Least recently used option set is dropped
+        for (std::size_t i = 0; i < CLProgramCache::kMaxProgramOptions; ++i)
+        {
+            cache.AddProgramOptions("many", "-D N" + std::to_string(i));
+        }
+
+        cache.AddProgramOptions("many", "-D N0");
+        cache.AddProgramOptions("many", "-D LAST");
+
+        cache.SetWorkGroupSize("Kernel_1d", { 64 });
+        cache.SetWorkGroupSize("Kernel_2d", { 32, 4 });
+        cache.SetWorkGroupSize("Kernel_1d", { 128 });
+    }
+
+    // Index, entries and recorded options persist between instances
+    CLProgramCache cache(directory, 2500);
+    ASSERT_TRUE(cache.Load("prog", "key2", loaded));
+    ASSERT_FALSE(cache.Load("prog", "key0", loaded));
+    ASSERT_EQ(cache.GetProgramOptions("prog"), std::vector<std::string>({ "-D A", "-D B" }));
+    ASSERT_TRUE(cache.GetProgramOptions("other").empty());
+
+    auto many = cache.GetProgramOptions("many");
+    ASSERT_EQ(many.size(), CLProgramCache::kMaxProgramOptions);
+    ASSERT_NE(std::find(many.begin(), many.end(), "-D N0"), many.end());
+    ASSERT_EQ(std::find(many.begin(), many.end(), "-D N1"), many.end());
+    ASSERT_NE(std::find(many.begin(), many.end(), "-D LAST"), many.end());
+
+    std::vector<std::size_t> size;
+    ASSERT_TRUE(cache.GetWorkGroupSize("Kernel_1d", size));
+    ASSERT_EQ(size, std::vector<std::size_t>({ 128 }));
+    ASSERT_TRUE(cache.GetWorkGroupSize("Kernel_2d", size));
+    ASSERT_EQ(size, std::vector<std::size_t>({ 32, 4 }));
+    ASSERT_FALSE(cache.GetWorkGroupSize("Other_1d", size));
+}
+
+TEST_F(InternalTest, InputMapSignatures)
+{
+    using namespace Baikal;
+    using RadeonRays::float3;
+
+    auto a = InputMap_ConstantFloat3::Create(float3(1.f, 2.f, 3.f));
+    auto b = InputMap_ConstantFloat::Create(0.5f);
+    auto c = InputMap_ConstantFloat3::Create(float3(4.f, 5.f, 6.f));
+
+    Collector collector;
+    collector.Collect(InputMap_Mul::Create(a, b));
+    collector.Collect(InputMap_Mul::Create(c, a));
+    collector.Collect(InputMap_Add::Create(a, b));
+    collector.Commit();
+
+    CLInputMapGenerator generator;
+    generator.Generate(collector);
+
+    // Both products share one function
+    ASSERT_EQ(generator.GetInstances().size(), 3u);
+    ASSERT_EQ(generator.GetSignatureCount(), 2u);
+
+    // Same structures with other constants generate the same source
+    auto d = InputMap_ConstantFloat3::Create(float3(0.f, 0.f, 1.f));
+
+    Collector other_collector;
+    other_collector.Collect(InputMap_Mul::Create(d, d));
+    other_collector.Collect(InputMap_Add::Create(d, c));
+    other_collector.Commit();
+
+    CLInputMapGenerator other_generator;
+    other_generator.Generate(other_collector);
+
+    ASSERT_EQ(other_generator.GetGeneratedSource(), generator.GetGeneratedSource());
+
+    for (auto const& instance : other_generator.GetInstances())
+    {
+        ASSERT_EQ(instance.second.leafs.size(), 2u);
+    }
+}
+
+TEST_F(InternalTest, InputMapOptimization)
+{
+    using namespace Baikal;
+    using RadeonRays::float3;
+
+    auto texture = Texture::Create();
+    auto a = InputMap_ConstantFloat3::Create(float3(1.f, 2.f, 3.f));
+    auto two = InputMap_ConstantFloat::Create(2.f);
+    auto one = InputMap_ConstantFloat::Create(1.f);
+
+    // Constant subgraph is folded, the authored graph is kept
+    auto product = InputMap_Mul::Create(a, two);
+    InputMapOptimizer optimizer;
+    auto folded = optimizer.Optimize(InputMap_Add::Create(product, a));
+
+    ASSERT_EQ(folded->m_type, InputMap::InputMapType::kConstantFloat3);
+    auto value = std::static_pointer_cast<InputMap_ConstantFloat3>(folded)->GetValue();
+    ASSERT_EQ(value.x, 3.f);
+    ASSERT_EQ(value.y, 6.f);
+    ASSERT_EQ(value.z, 9.f);
+    ASSERT_EQ(std::static_pointer_cast<InputMap_Mul>(product)->GetA(), a);
+    ASSERT_EQ(optimizer.GetFoldedConstants().count(folded), 1u);
+
+    // Authored constants can be edited, identities on them are kept
+    auto scaled = optimizer.Optimize(InputMap_Mul::Create(InputMap_Sampler::Create(texture), one));
+    ASSERT_EQ(scaled->m_type, InputMap::InputMapType::kMul);
+
+    // cos(x - x) does not depend on the scene, samples of one texture are merged
+    auto fixed_one = InputMap_Cos::Create(InputMap_Sub::Create(InputMap_Sampler::Create(texture), InputMap_Sampler::Create(texture)));
+    auto sample = InputMap_Mul::Create(InputMap_Sampler::Create(texture), fixed_one);
+    auto sum = InputMap_Add::Create(sample, InputMap_Sampler::Create(texture));
+    auto simplified = optimizer.Optimize(sum);
+
+    ASSERT_EQ(simplified->m_type, InputMap::InputMapType::kAdd);
+    auto add = std::static_pointer_cast<InputMap_Add>(simplified);
+    ASSERT_EQ(add->GetA(), add->GetB());
+    ASSERT_EQ(add->GetA()->m_type, InputMap::InputMapType::kSampler);
+
+    // Multiplying by one clears w, which Dot4 reads
+    auto dot = optimizer.Optimize(InputMap_Dot4::Create(sample, sample));
+    ASSERT_EQ(InputMapOptimizer::GetInputs(*dot)[0]->m_type, InputMap::InputMapType::kMul);
+
+    // Generated function samples the texture once
+    Collector collector;
+    collector.Collect(sum);
+    collector.Collect(product);
+    collector.Commit();
+
+    CLInputMapGenerator generator;
+    generator.Generate(collector, true);
+
+    ASSERT_EQ(generator.GetInstances().at(sum->GetId()).leafs.size(), 1u);
+    ASSERT_EQ(generator.GetInstances().at(product->GetId()).leafs.size(), 1u);
+    ASSERT_EQ(generator.GetFoldedConstants().size(), 1u);
+}
+
+TEST_F(InternalTest, PendingTextureData)
+{
+    using namespace Baikal;
+
+    ThreadPool pool(2);
+    std::atomic<int> num_loads(0);
+
+    auto load = [&num_loads]()
+    {
+        ++num_loads;
+        auto data = new char[4 * 2 * 2]();
+        data[0] = 42;
+        return std::shared_ptr<char const>(data, std::default_delete<char const[]>());
+    };
+
+    // Size and format are known before the data is produced
+    auto async_texture = Texture::Create(pool.Submit(load).share(), RadeonRays::int3(2, 2, 1), Texture::Format::kRgba8);
+    ASSERT_EQ(async_texture->GetSizeInBytes(), 16u);
+    ASSERT_EQ(async_texture->GetData()[0], 42);
+    ASSERT_FALSE(async_texture->IsDataPending());
+
+    // Deferred data is produced on first access only
+    auto deferred_texture = Texture::Create(std::async(std::launch::deferred, load).share(), RadeonRays::int3(2, 2, 1), Texture::Format::kRgba8);
+    ASSERT_TRUE(deferred_texture->IsDataPending());
+    ASSERT_EQ(num_loads, 1);
+    ASSERT_EQ(deferred_texture->GetData()[0], 42);
+    ASSERT_EQ(num_loads, 2);
+
+    // Load failures are reported on every data access
+    auto fail = []() -> std::shared_ptr<char const> { throw std::runtime_error("Failed to load"); };
+    auto failed_texture = Texture::Create(pool.Submit(fail).share(), RadeonRays::int3(2, 2, 1), Texture::Format::kRgba8);
+    ASSERT_THROW(failed_texture->GetData(), std::runtime_error);
+    ASSERT_THROW(failed_texture->GetData(), std::runtime_error);
+}
+
+TEST_F(InternalTest, TextureDedup)
+{
+    using namespace Baikal;
+
+    auto create_texture = [](char value)
+    {
+        auto data = new char[4 * 4 * 4];
+        std::fill(data, data + 4 * 4 * 4, value);
+        return Texture::Create(data, RadeonRays::int3(4, 4, 1), Texture::Format::kRgba8);
+    };
+
+    TextureRegistry registry;
+
+    auto texture = registry.Register(create_texture(1));
+    ASSERT_EQ(registry.Register(create_texture(1)), texture);
+    ASSERT_NE(registry.Register(create_texture(2)), texture);
+
+    auto stats = registry.GetStats();
+    ASSERT_EQ(stats.num_textures, 3u);
+    ASSERT_EQ(stats.num_duplicates, 1u);
+    ASSERT_EQ(stats.bytes_saved, 64u);
+
+    // Registry doesn't keep textures alive
+    texture.reset();
+    auto other = create_texture(1);
+    ASSERT_EQ(registry.Register(other), other);
+}
+
+TEST_F(InternalTest, TangentFrames)
+{
+    using namespace Baikal;
+    using namespace RadeonRays;
+
+    float3 positions[] = { float3(0.f, 0.f, 0.f), float3(1.f, 0.f, 0.f), float3(1.f, 1.f, 0.f), float3(0.f, 1.f, 0.f) };
+    float3 normals[] = { float3(0.f, 0.f, 1.f), float3(0.f, 0.f, 1.f), float3(0.f, 0.f, 1.f), float3(0.f, 0.f, 1.f) };
+    float2 uvs[] = { float2(0.f, 0.f), float2(1.f, 0.f), float2(1.f, 1.f), float2(0.f, 1.f) };
+    float2 mirrored_uvs[] = { float2(0.f, 0.f), float2(-1.f, 0.f), float2(-1.f, 1.f), float2(0.f, 1.f) };
+    std::uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+
+    for (auto& t : ComputeTangents(positions, normals, uvs, 4, indices, 6))
+    {
+        ASSERT_NEAR(t.x, 1.f, 1e-5f);
+        ASSERT_NEAR(t.y, 0.f, 1e-5f);
+        ASSERT_NEAR(t.z, 0.f, 1e-5f);
+        ASSERT_EQ(t.w, 1.f);
+    }
+
+    // Mirrored mapping flips the tangent and the bitangent sign
+    for (auto& t : ComputeTangents(positions, normals, mirrored_uvs, 4, indices, 6))
+    {
+        ASSERT_NEAR(t.x, -1.f, 1e-5f);
+        ASSERT_EQ(t.w, -1.f);
+    }
+
+    // Without UVs tangents are still orthogonal to normals
+    for (auto& t : ComputeTangents(positions, normals, nullptr, 4, indices, 6))
+    {
+        ASSERT_NEAR(dot(float3(t.x, t.y, t.z), normals[0]), 0.f, 1e-5f);
+    }
+}
+
+TEST_F(InternalTest, BumpToNormalMap)
+{
+    using namespace Baikal;
+
+    // Height grows along x
+    auto data = new char[4 * 4 * 4];
+    for (auto i = 0; i < 4 * 4; ++i)
+    {
+        std::fill(data + 4 * i, data + 4 * i + 4, static_cast<char>((i % 4) * 60));
+    }
+
+    auto bump = Texture::Create(data, RadeonRays::int3(4, 4, 1), Texture::Format::kRgba8);
+    auto normal_map = ConvertBumpToNormalMap(bump);
+    ASSERT_EQ(normal_map->GetFormat(), Texture::Format::kRG8);
+    ASSERT_TRUE(normal_map->IsDataPending());
+
+    auto texels = reinterpret_cast<std::uint8_t const*>(normal_map->GetData());
+    ASSERT_LT(texels[2 * 5], 128);
+    ASSERT_EQ(texels[2 * 5 + 1], 128);
+}
+
+TEST_F(InternalTest, BinarySceneRoundTrip)
+{
+    using namespace Baikal;
+    using namespace RadeonRays;
+
+    float3 vertices[] = { float3(0.f, 0.f, 0.f), float3(1.f, 0.f, 0.f), float3(0.f, 1.f, 0.f) };
+    float3 normals[] = { float3(0.f, 0.f, 1.f), float3(0.f, 0.f, 1.f), float3(0.f, 0.f, 1.f) };
+    float2 uvs[] = { float2(0.f, 0.f), float2(1.f, 0.f), float2(0.f, 1.f) };
+    std::uint32_t indices[] = { 0, 1, 2 };
+
+    auto mesh = Mesh::Create();
+    mesh->SetVertices(vertices, 3);
+    mesh->SetNormals(normals, 3);
+    mesh->SetUVs(uvs, 3);
+    mesh->SetIndices(indices, 3);
+
+    // Base mesh is not attached, only its instance is
+    auto instance = Instance::Create(mesh);
+    instance->SetTransform(translation(float3(5.f, 0.f, 0.f)));
+
+    auto light = PointLight::Create();
+    light->SetPosition(float3(1.f, 2.f, 3.f));
+
+    auto scene = Scene1::Create();
+    scene->AttachShape(instance);
+    scene->AttachLight(light);
+
+    SceneIo::SaveScene(*scene, "round_trip.bin", "");
+    auto loaded = SceneIo::LoadScene("round_trip.bin", "");
+
+    ASSERT_EQ(loaded->GetNumShapes(), 1u);
+    ASSERT_EQ(loaded->GetNumLights(), 1u);
+
+    auto loaded_instance = loaded->CreateShapeIterator()->ItemAs<Instance>();
+    ASSERT_TRUE(loaded_instance);
+    ASSERT_EQ(loaded_instance->GetTransform().m03, 5.f);
+
+    // Geometry is referenced from the mapped file, tangents are stored along
+    auto loaded_mesh = std::static_pointer_cast<Mesh>(loaded_instance->GetBaseShape());
+    ASSERT_TRUE(loaded_mesh->HasExternalData());
+    ASSERT_EQ(loaded_mesh->GetNumVertices(), 3u);
+    ASSERT_EQ(loaded_mesh->GetNumTangents(), 3u);
+    ASSERT_EQ(std::memcmp(loaded_mesh->GetIndices(), indices, sizeof(indices)), 0);
+    ASSERT_EQ(loaded_mesh->GetVertices()[1].x, 1.f);
+    ASSERT_EQ(loaded_mesh->GetUVs()[2].y, 1.f);
+
+    // Editing copies the data
+    loaded_mesh->SetNormals(normals, 3);
+    ASSERT_FALSE(loaded_mesh->HasExternalData());
+    ASSERT_EQ(loaded_mesh->GetVertices()[1].x, 1.f);
+
+    ASSERT_EQ(loaded->CreateLightIterator()->ItemAs<Light>()->GetPosition().z, 3.f);
+
+    // Release the mapped file before removing it
+    loaded_mesh.reset();
+    loaded_instance.reset();
+    loaded.reset();
+    std::remove("round_trip.bin");
+}
+
+// Import timing benchmark, run explicitly with --gtest_also_run_disabled_tests
+TEST_F(InternalTest, DISABLED_ObjImport_LoadTime)
+{
+    using namespace Baikal;
+
+    // Generate a grid with 2 * kSize^2 triangles spread over kNumMaterials materials
+    auto const kSize = 512;
+    auto const kNumMaterials = 256;
+
+    {
+        std::ofstream mtl("obj_import.mtl");
+        for (auto i = 0; i < kNumMaterials; ++i)
+        {
+            mtl << "newmtl m" << i << "\nKd 0.5 0.5 0.5\n";
+        }
+
+        std::ofstream obj("obj_import.obj");
+        obj << "mtllib obj_import.mtl\nvn 0 0 1\n";
+        for (auto y = 0; y <= kSize; ++y)
+        {
+            for (auto x = 0; x <= kSize; ++x)
+            {
+                obj << "v " << x << " " << y << " 0\nvt " << x / float(kSize) << " " << y / float(kSize) << "\n";
+            }
+        }
+
+        for (auto y = 0; y < kSize; ++y)
+        {
+            for (auto x = 0; x < kSize; ++x)
+            {
+                auto a = y * (kSize + 1) + x + 1;
+                auto b = a + 1;
+                auto c = a + kSize + 2;
+                auto d = a + kSize + 1;
+                obj << "usemtl m" << (x + y) % kNumMaterials << "\n";
+                obj << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 " << c << "/" << c << "/1\n";
+                obj << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+            }
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto scene = SceneIo::LoadScene("obj_import.obj", "");
+    auto elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::remove("obj_import.obj");
+    std::remove("obj_import.mtl");
+
+    std::cout << "OBJ import: " << 2 * kSize * kSize << " triangles, " << kNumMaterials << " materials, "
+        << elapsed << " s" << std::endl;
+
+    std::size_t num_triangles = 0;
+    for (auto iter = scene->CreateShapeIterator(); iter->IsValid(); iter->Next())
+    {
+        auto shape = iter->ItemAs<Shape>();
+        auto instance = std::dynamic_pointer_cast<Instance>(shape);
+        auto mesh = std::static_pointer_cast<Mesh>(instance ? instance->GetBaseShape() : shape);
+        num_triangles += mesh->GetNumIndices() / 3;
+    }
+
+    ASSERT_EQ(num_triangles, 2u * kSize * kSize);
+}
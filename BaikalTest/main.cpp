@@ -30,9 +30,11 @@ THE SOFTWARE.
 #include "material.h"
 #include "aov.h"
 #include "test_scenes.h"
+#include "texture_fetch.h"
 
 #include "uberv2.h"
 #include "input_maps.h"
+#include "zero_copy.h"
 
 int g_argc;
 char** g_argv;
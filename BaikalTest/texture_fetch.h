@@ -0,0 +1,294 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "gtest/gtest.h"
+
+#include "basic.h"
+#include "CLW.h"
+#include "SceneGraph/clwscene.h"
+#include "SceneGraph/texture.h"
+#include "Utils/cl_program_manager.h"
+#include "Utils/mipmap.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Texture fetch throughput for different texel layouts and texture backends,
+// every work item takes a number of bilinear samples from a single large texture
+class TextureFetchTest : public ::testing::Test
+{
+public:
+    static std::uint32_t constexpr kTextureSize = 2048;
+    static std::uint32_t constexpr kNumFetches = 16;
+    static std::uint32_t constexpr kNumRuns = 10;
+
+    virtual void SetUp()
+    {
+        std::vector<CLWPlatform> platforms;
+        ASSERT_NO_THROW(CLWPlatform::CreateAllPlatforms(platforms));
+        ASSERT_GT(platforms.size(), 0u);
+
+        char* device_index_option = BasicTest::GetCmdOption(g_argv, g_argv + g_argc, "-device");
+        char* platform_index_option = BasicTest::GetCmdOption(g_argv, g_argv + g_argc, "-platform");
+
+        auto platform_index = platform_index_option ? atoi(platform_index_option) : 0;
+        auto device_index = device_index_option ? atoi(device_index_option) : 0;
+
+        ASSERT_LT((std::size_t)platform_index, platforms.size());
+        ASSERT_LT((std::uint32_t)device_index, platforms[platform_index].GetDeviceCount());
+
+        m_context = CLWContext::Create(platforms[platform_index].GetDevice(device_index));
+        m_program_manager = std::make_unique<Baikal::CLProgramManager>("cache");
+
+        // Work items are grouped into 8x8 screen tiles as in camera ray generation.
+        // Coherent fetches march along texture rows, incoherent ones jump to random UVs.
+        std::string const source =
+            "#include <../Baikal/Kernels/CL/texture.cl>\n"
+            "__kernel void TextureFetch(TEXTURE_ARG_LIST,\n"
+            "    int incoherent, int num_fetches, __global float4* result)\n"
+            "{\n"
+            "    int width = textures[0].w;\n"
+            "    int height = textures[0].h;\n"
+            "    int group = get_group_id(0);\n"
+            "    int lid = get_local_id(0);\n"
+            "    int x = (group % (width >> 3)) * 8 + (lid & 7);\n"
+            "    int y = (group / (width >> 3)) * 8 + (lid >> 3);\n"
+            "    float2 uv = make_float2((x + 0.5f) / width, (y + 0.5f) / height);\n"
+            "    uint seed = get_global_id(0) * 1664525u + 1013904223u;\n"
+            "    float4 sum = 0.f;\n"
+            "    for (int i = 0; i < num_fetches; ++i)\n"
+            "    {\n"
+            "        if (incoherent)\n"
+            "        {\n"
+            "            seed = seed * 1664525u + 1013904223u;\n"
+            "            uv.x = (seed >> 8) / 16777216.f;\n"
+            "            seed = seed * 1664525u + 1013904223u;\n"
+            "            uv.y = (seed >> 8) / 16777216.f;\n"
+            "        }\n"
+            "        else\n"
+            "        {\n"
+            "            uv.x += 1.f / width;\n"
+            "        }\n"
+            "        sum += Texture_Sample2D(uv, TEXTURE_ARGS_IDX(0));\n"
+            "    }\n"
+            "    result[get_global_id(0)] = sum;\n"
+            "}\n";
+
+        m_program_id = m_program_manager->CreateProgramFromSource(m_context, "texture_fetch", source);
+    }
+
+    bool HasImageSupport() const
+    {
+        cl_bool image_support = CL_FALSE;
+        clGetDeviceInfo(m_context.GetDevice(0).GetID(), CL_DEVICE_IMAGE_SUPPORT, sizeof(image_support), &image_support, nullptr);
+        return image_support == CL_TRUE;
+    }
+
+    // Single layer RGBA image array
+    std::shared_ptr<_cl_mem> CreateImage(cl_channel_type type, std::uint32_t size, void* data)
+    {
+        cl_image_format format = { CL_RGBA, type };
+        cl_image_desc desc = {};
+        desc.image_type = CL_MEM_OBJECT_IMAGE2D_ARRAY;
+        desc.image_width = size;
+        desc.image_height = size;
+        desc.image_array_size = 1;
+
+        cl_int status = CL_SUCCESS;
+        cl_mem image = clCreateImage(m_context, CL_MEM_READ_ONLY | (data ? CL_MEM_COPY_HOST_PTR : 0), &format, &desc, data, &status);
+
+        if (status != CL_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create image");
+        }
+
+        return std::shared_ptr<_cl_mem>(image, clReleaseMemObject);
+    }
+
+    // Run the benchmark and return per work item results
+    std::vector<RadeonRays::float4> RunFetch(Baikal::Texture::Layout layout, bool incoherent, double& fetches_per_second,
+        Baikal::TextureBackend backend = Baikal::TextureBackend::kBuffer)
+    {
+        using namespace Baikal;
+
+        // Noise texture, values don't matter for the throughput
+        auto size = kTextureSize * kTextureSize * 4;
+        auto data = new char[size];
+        for (auto i = 0u; i < size; ++i)
+        {
+            data[i] = static_cast<char>((i * 2654435761u) >> 24);
+        }
+
+        auto texture = Texture::Create(data, RadeonRays::int3(kTextureSize, kTextureSize, 1), Texture::Format::kRgba8);
+        texture->SetMipmapEnabled(false);
+        texture->SetLayout(layout);
+
+        std::vector<char> texturedata(GetMipChainSize(*texture));
+        WriteMipChain(*texture, texturedata.data());
+
+        ClwScene::Texture clw_texture;
+        clw_texture.w = kTextureSize;
+        clw_texture.h = kTextureSize;
+        clw_texture.d = 1;
+        clw_texture.dataoffset = 0;
+        clw_texture.fmt = ClwScene::TextureFormat::RGBA8;
+        clw_texture.levels = 1;
+        clw_texture.layout = layout == Texture::Layout::kTiled ? ClwScene::TextureLayout::kLayoutTiled :
+            (layout == Texture::Layout::kMorton ? ClwScene::TextureLayout::kLayoutMorton : ClwScene::TextureLayout::kLayoutLinear);
+        clw_texture.image = ClwScene::kTextureImageUnorm;
+        clw_texture.layer = 0;
+
+        auto num_items = kTextureSize * kTextureSize;
+
+        ClwScene scene;
+        scene.texture_backend = backend;
+        scene.textures = m_context.CreateBuffer<ClwScene::Texture>(1, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &clw_texture);
+        scene.texturedata = m_context.CreateBuffer<char>(texturedata.size(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, texturedata.data());
+
+        if (backend == TextureBackend::kImages)
+        {
+            // Images ignore texel layout and are filled from the linear texture data
+            float texel[4] = {};
+            scene.texture_images[ClwScene::kTextureImageUnorm] = CreateImage(CL_UNORM_INT8, kTextureSize, const_cast<char*>(texture->GetData()));
+            scene.texture_images[ClwScene::kTextureImageHalf] = CreateImage(CL_HALF_FLOAT, 1, texel);
+            scene.texture_images[ClwScene::kTextureImageFloat] = CreateImage(CL_FLOAT, 1, texel);
+        }
+
+        auto result_buffer = m_context.CreateBuffer<RadeonRays::float4>(num_items, CL_MEM_WRITE_ONLY);
+
+        std::string options = "-cl-mad-enable -cl-fast-relaxed-math -cl-std=CL1.2 -I . ";
+        options.append(scene.GetTextureBuildOptions());
+
+        auto kernel = m_program_manager->GetProgram(m_program_id, options).GetKernel("TextureFetch");
+        int argc = 0;
+        scene.SetTextureArgs(kernel, argc);
+        kernel.SetArg(argc++, incoherent ? 1 : 0);
+        kernel.SetArg(argc++, static_cast<int>(kNumFetches));
+        kernel.SetArg(argc++, result_buffer);
+
+        // Warm up
+        m_context.Launch1D(0, num_items, 64, kernel);
+        m_context.Finish(0);
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (auto i = 0u; i < kNumRuns; ++i)
+        {
+            m_context.Launch1D(0, num_items, 64, kernel);
+        }
+
+        m_context.Finish(0);
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        fetches_per_second = static_cast<double>(num_items) * kNumFetches * kNumRuns / elapsed;
+
+        std::vector<RadeonRays::float4> result(num_items);
+        m_context.ReadBuffer(0, result_buffer, result.data(), num_items).Wait();
+        return result;
+    }
+
+    CLWContext m_context;
+    std::unique_ptr<Baikal::CLProgramManager> m_program_manager;
+    std::uint32_t m_program_id;
+};
+
+TEST_F(TextureFetchTest, TextureFetch_Throughput)
+{
+    using Layout = Baikal::Texture::Layout;
+
+    char const* layout_names[] = { "linear", "tiled", "morton" };
+
+    for (auto incoherent : { false, true })
+    {
+        std::vector<RadeonRays::float4> reference;
+
+        for (auto layout : { Layout::kLinear, Layout::kTiled, Layout::kMorton })
+        {
+            double fetches_per_second = 0.0;
+            std::vector<RadeonRays::float4> result;
+            ASSERT_NO_THROW(result = RunFetch(layout, incoherent, fetches_per_second));
+
+            std::cout << (incoherent ? "incoherent " : "coherent   ") << std::setw(6) << layout_names[static_cast<int>(layout)]
+                << ": " << fetches_per_second * 1e-6 << " Mfetches/s" << std::endl;
+
+            // Layout must not change sampled values
+            if (reference.empty())
+            {
+                reference = std::move(result);
+                continue;
+            }
+
+            for (auto i = 0u; i < result.size(); i += 997)
+            {
+                ASSERT_NEAR(result[i].x, reference[i].x, 1e-3f);
+                ASSERT_NEAR(result[i].w, reference[i].w, 1e-3f);
+            }
+        }
+    }
+}
+
+TEST_F(TextureFetchTest, TextureFetch_Backends)
+{
+    using Baikal::TextureBackend;
+
+    if (!HasImageSupport())
+    {
+        std::cout << "Device does not support images, skipping" << std::endl;
+        return;
+    }
+
+    char const* backend_names[] = { "buffer", "images" };
+
+    // Texture units are allowed to filter with 8 bit weights
+    auto const tolerance = kNumFetches / 128.f;
+
+    for (auto incoherent : { false, true })
+    {
+        std::vector<RadeonRays::float4> reference;
+
+        for (auto backend : { TextureBackend::kBuffer, TextureBackend::kImages })
+        {
+            double fetches_per_second = 0.0;
+            std::vector<RadeonRays::float4> result;
+            ASSERT_NO_THROW(result = RunFetch(Baikal::Texture::Layout::kLinear, incoherent, fetches_per_second, backend));
+
+            std::cout << (incoherent ? "incoherent " : "coherent   ") << std::setw(6) << backend_names[static_cast<int>(backend)]
+                << ": " << fetches_per_second * 1e-6 << " Mfetches/s" << std::endl;
+
+            // Backends must sample the same footprint, including the wrap at texture edges
+            if (reference.empty())
+            {
+                reference = std::move(result);
+                continue;
+            }
+
+            for (auto i = 0u; i < result.size(); ++i)
+            {
+                ASSERT_NEAR(result[i].x, reference[i].x, tolerance);
+                ASSERT_NEAR(result[i].w, reference[i].w, tolerance);
+            }
+        }
+    }
+}
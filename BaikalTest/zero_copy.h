@@ -0,0 +1,156 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "gtest/gtest.h"
+
+#include "basic.h"
+#include "CLW.h"
+#include "RenderFactory/clw_render_factory.h"
+#include "SceneGraph/camera.h"
+#include "SceneGraph/clwscene.h"
+#include "SceneGraph/light.h"
+#include "SceneGraph/scene1.h"
+#include "SceneGraph/shape.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Scene buffers on CPU devices alias host memory instead of keeping a device copy
+class ZeroCopyTest : public ::testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        std::vector<CLWPlatform> platforms;
+        ASSERT_NO_THROW(CLWPlatform::CreateAllPlatforms(platforms));
+
+        for (auto& platform : platforms)
+        {
+            for (auto i = 0u; i < platform.GetDeviceCount(); ++i)
+            {
+                if (platform.GetDevice(i).GetType() == CL_DEVICE_TYPE_CPU)
+                {
+                    m_context = CLWContext::Create(platform.GetDevice(i));
+                    m_has_cpu_device = true;
+                    return;
+                }
+            }
+        }
+    }
+
+    // Triangle which reloads its data on demand, x of vertex 1 is used as a marker
+    Baikal::Mesh::Ptr CreateTriangle(float marker)
+    {
+        using RadeonRays::float3;
+        using RadeonRays::float2;
+
+        std::vector<float3> vertices = { float3(0, 0, 0), float3(marker, 0, 0), float3(0, 1, 0) };
+        std::vector<float3> normals(3, float3(0, 0, 1));
+        std::vector<float2> uvs = { float2(0, 0), float2(1, 0), float2(0, 1) };
+        std::vector<std::uint32_t> indices = { 0, 1, 2 };
+
+        auto mesh = Baikal::Mesh::Create();
+        mesh->SetVertices(vertices.data(), vertices.size());
+        mesh->SetNormals(normals.data(), normals.size());
+        mesh->SetUVs(uvs.data(), uvs.size());
+        mesh->SetIndices(indices.data(), indices.size());
+        mesh->SetReloadCallback([=](std::vector<float3>& v, std::vector<float3>& n, std::vector<float2>& t, std::vector<std::uint32_t>& i)
+        {
+            v = vertices;
+            n = normals;
+            t = uvs;
+            i = indices;
+        });
+
+        return mesh;
+    }
+
+    // Check that mapping the buffer returns its host storage and read vertex 1 x of the mesh
+    float ReadMarker(Baikal::ClwScene const& scene, Baikal::Mesh::Ptr mesh)
+    {
+        // Shapes are not compiled in attach order, look up where the mesh starts
+        std::vector<Baikal::ClwScene::Shape> shapes(scene.shapes.GetElementCount());
+        m_context.ReadBuffer(0, scene.shapes, shapes.data(), shapes.size()).Wait();
+
+        auto iter = std::find_if(shapes.cbegin(), shapes.cend(),
+            [&mesh](Baikal::ClwScene::Shape const& shape) { return static_cast<std::uint32_t>(shape.id) == mesh->GetId(); });
+        EXPECT_TRUE(iter != shapes.cend());
+        if (iter == shapes.cend())
+        {
+            return 0.f;
+        }
+
+        char* data = nullptr;
+        m_context.MapBuffer(0, scene.vertices, CL_MAP_READ, &data).Wait();
+        EXPECT_EQ(data, scene.vertices_storage.get());
+        auto marker = reinterpret_cast<RadeonRays::float3 const*>(data)[iter->startvtx + 1].x;
+        m_context.UnmapBuffer(0, scene.vertices, data).Wait();
+        return marker;
+    }
+
+    CLWContext m_context;
+    bool m_has_cpu_device = false;
+};
+
+TEST_F(ZeroCopyTest, SceneBuffers)
+{
+    using namespace Baikal;
+
+    if (!m_has_cpu_device)
+    {
+        std::cout << "No CPU device, skipping" << std::endl;
+        return;
+    }
+
+    ClwRenderFactory factory(m_context, "cache");
+    auto controller = factory.CreateSceneController();
+
+    // Releasing scene graph copies stays opt-in with zero-copy buffers
+    ASSERT_FALSE(controller->GetHostDataRelease());
+    controller->SetHostDataRelease(true);
+
+    auto scene = Scene1::Create();
+    auto camera = PerspectiveCamera::Create(RadeonRays::float3(0.f, 0.f, -6.f), RadeonRays::float3(0.f, 0.f, 0.f), RadeonRays::float3(0.f, 1.f, 0.f));
+    scene->SetCamera(camera);
+    scene->AttachLight(PointLight::Create());
+
+    auto mesh = CreateTriangle(2.f);
+    scene->AttachShape(mesh);
+
+    ClwScene* compiled = nullptr;
+    ASSERT_NO_THROW(compiled = &controller->CompileScene(scene));
+    ASSERT_TRUE(compiled->vertices_storage != nullptr);
+    ASSERT_EQ(ReadMarker(*compiled, mesh), 2.f);
+    ASSERT_TRUE(mesh->IsDataReleased());
+
+    // Recreating buffers replaces their storage, released mesh is reloaded for upload
+    auto old_storage = compiled->vertices_storage;
+    auto other = CreateTriangle(3.f);
+    scene->AttachShape(other);
+    ASSERT_NO_THROW(compiled = &controller->CompileScene(scene));
+    ASSERT_NE(compiled->vertices_storage, old_storage);
+    ASSERT_EQ(ReadMarker(*compiled, mesh), 2.f);
+    ASSERT_EQ(ReadMarker(*compiled, other), 3.f);
+    ASSERT_TRUE(mesh->IsDataReleased());
+}
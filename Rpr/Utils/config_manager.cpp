@@ -159,9 +159,10 @@ void ConfigManager::CreateConfigs(
 
     for (std::size_t i = 0; i < configs.size(); ++i)
     {
-        configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context, "cache");
+        configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context, "cache", "kernel_bundle");
         configs[i].controller = configs[i].factory->CreateSceneController();
         configs[i].renderer = configs[i].factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
+        configs[i].factory->WarmUp();
     }
 }
 
@@ -221,6 +222,7 @@ void ConfigManager::CreateConfigs(
         configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context);
         configs[i].controller = configs[i].factory->CreateSceneController();
         configs[i].renderer = configs[i].factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
+        configs[i].factory->WarmUp();
     }
 }
 #endif //APP_BENCHMARK
@@ -28,6 +28,7 @@ THE SOFTWARE.
 #include "SceneGraph/material.h"
 #include "image_io.h"
 #include "SceneGraph/iterator.h"
+#include "Utils/texture_dedup.h"
 #include "ImageMaterialObject.h"
 #include "WrapObject/Exception.h"
 
@@ -52,22 +53,28 @@ ImageMaterialObject::ImageMaterialObject(rpr_image_format const in_format, rpr_i
     switch (in_format.type)
     {
     case RPR_COMPONENT_TYPE_UINT8:
+        if (in_format.num_components == 1)
+            data_format = Texture::Format::kR8;
+        else if (in_format.num_components == 2)
+            data_format = Texture::Format::kRG8;
         break;
     case RPR_COMPONENT_TYPE_FLOAT16:
         component_bytes = 2;
-        data_format = Texture::Format::kRgba16;
+        data_format = in_format.num_components == 1 ? Texture::Format::kR16F : Texture::Format::kRgba16;
         break;
     case RPR_COMPONENT_TYPE_FLOAT32:
         component_bytes = 4;
-        data_format = Texture::Format::kRgba32;
+        data_format = in_format.num_components == 1 ? Texture::Format::kR32F : Texture::Format::kRgba32;
         break;
     default:
         throw Exception(RPR_ERROR_INVALID_PARAMETER, "TextureObject: invalid format type.");
     }
     pixel_bytes *= component_bytes;
-    int data_size = 4 * component_bytes * pixels_count;//4 component baikal texture
+    //single and dual channel formats are stored as is, others are expanded to 4 components
+    unsigned int num_components = Texture::GetChannelCount(data_format);
+    int data_size = num_components * component_bytes * pixels_count;
     char* data = new char[data_size];
-    if (in_format.num_components == 4)
+    if (in_format.num_components == num_components)
     {
         //copy data
         memcpy(data, in_data, data_size);
@@ -92,7 +99,8 @@ ImageMaterialObject::ImageMaterialObject(rpr_image_format const in_format, rpr_i
             }
         }
     }
-    m_tex = Texture::Create(data, tex_size, data_format);
+    //identical images share a single texture
+    m_tex = TextureRegistry::GetInstance().Register(Texture::Create(data, tex_size, data_format));
 }
 
 ImageMaterialObject::ImageMaterialObject(const std::string& in_path)
@@ -109,7 +117,7 @@ ImageMaterialObject::ImageMaterialObject(const std::string& in_path)
         throw Exception(RPR_ERROR_IO_ERROR, "TextureObject: failed to load image.");
     }
 
-    m_tex = texture;
+    m_tex = TextureRegistry::GetInstance().Register(texture);
 }
 
 Baikal::Texture::Ptr ImageMaterialObject::GetTexture()
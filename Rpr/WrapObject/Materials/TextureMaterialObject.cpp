@@ -89,19 +89,22 @@ rpr_image_format TextureMaterialObject::GetImageFormat() const
     switch (m_tex->GetFormat())
     {
     case Baikal::Texture::Format::kRgba8:
+    case Baikal::Texture::Format::kR8:
+    case Baikal::Texture::Format::kRG8:
         type = RPR_COMPONENT_TYPE_UINT8;
         break;
     case Baikal::Texture::Format::kRgba16:
+    case Baikal::Texture::Format::kR16F:
         type = RPR_COMPONENT_TYPE_FLOAT16;
         break;
     case Baikal::Texture::Format::kRgba32:
+    case Baikal::Texture::Format::kR32F:
         type = RPR_COMPONENT_TYPE_FLOAT32;
         break;
     default:
         throw Exception(RPR_ERROR_INTERNAL_ERROR, "MaterialObject: invalid image format.");
     }
-    //only 4component textures used
-    return{ 4, type };
+    return{ Baikal::Texture::GetChannelCount(m_tex->GetFormat()), type };
 }
 
 Baikal::Texture::Ptr TextureMaterialObject::GetTexture() 
@@ -22,6 +22,8 @@ THE SOFTWARE.
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include "WrapObject/ShapeObject.h"
 #include "WrapObject/Exception.h"
@@ -32,42 +34,115 @@ using namespace Baikal;
 
 namespace
 {
-    template<typename T, int size = 3> std::vector<T> merge(const T* in_data, size_t in_data_num, rpr_int in_data_stride,
-        rpr_int const * in_data_indices, rpr_int in_didx_stride,
-        rpr_int const * in_num_face_vertices, size_t in_num_faces)
+    // Strided view of one multi-indexed Rpr vertex attribute
+    template <int size>
+    struct AttributeStream
     {
-        std::vector<T> result;
-        if (!in_data || !in_data_indices)
+        AttributeStream(rpr_float const* data, std::size_t count, rpr_int stride, rpr_int const* indices, rpr_int idx_stride)
+            : data(reinterpret_cast<char const*>(data))
+            , count(count)
+            , stride(stride)
+            , indices(reinterpret_cast<char const*>(indices))
+            , idx_stride(idx_stride)
         {
-            std::cout << "Warning: missing mesh data, fill it with NULL.\n";
-            int count = 0;
-            for (std::size_t i = 0; i < in_num_faces; ++i)
+            if (!data || !indices)
             {
-                count += in_num_face_vertices[i];
+                std::cout << "Warning: missing mesh data, fill it with NULL.\n";
+                this->data = nullptr;
             }
-            result.resize(count * size);
-            std::fill(result.begin(), result.end(), 0.f);
+        }
+
+        // Attribute index of the face corner, -1 if the attribute is missing
+        rpr_int Index(std::size_t corner) const
+        {
+            return data ? *reinterpret_cast<rpr_int const*>(indices + corner * idx_stride) : -1;
+        }
+
+        // Copies the attribute to out, zeros for a missing attribute
+        void Fetch(rpr_int index, float* out) const
+        {
+            if (index < 0)
+            {
+                std::fill(out, out + size, 0.f);
+                return;
+            }
+
+            if (static_cast<std::size_t>(index) >= count)
+            {
+                throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: vertex attribute index out of range.");
+            }
+
+            std::memcpy(out, data + static_cast<std::size_t>(index) * stride, size * sizeof(float));
+        }
+
+        char const* data;
+        std::size_t count;
+        std::size_t stride;
+        char const* indices;
+        std::size_t idx_stride;
+    };
+
+    // Maps (position, normal, uv) index tuples to welded vertex indices.
+    // Tuples are hashed by position index and chained per position, DCC meshes
+    // keep neighbouring faces close in the position array so lookups stay in cache.
+    class VertexWelder
+    {
+    public:
+        struct Key
+        {
+            rpr_int p;
+            rpr_int n;
+            rpr_int t;
+        };
 
-            return result;
+        VertexWelder(std::size_t num_positions, std::size_t expected_size)
+            : m_first(num_positions + 1, kNone)
+        {
+            m_chains.reserve(expected_size);
         }
 
-        int indent = 0;
-        for (std::size_t i = 0; i < in_num_faces; ++i)
+        // Returns the welded index of the tuple and whether it was seen for the first time
+        std::pair<std::uint32_t, bool> Insert(Key const& key)
         {
-            int face = in_num_face_vertices[i];
-            for (int f = indent; f < face + indent; ++f)
+            // Missing positions go to the first bucket
+            auto bucket = static_cast<std::size_t>(key.p + 1);
+
+            if (bucket >= m_first.size())
+            {
+                throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: vertex index out of range.");
+            }
+
+            auto& first = m_first[bucket];
+
+            for (auto i = first; i != kNone; i = m_chains[i].next)
             {
-                int index = in_data_stride / sizeof(T) * in_data_indices[f*in_didx_stride / sizeof(rpr_int)];
-                for (int s = 0; s < size; ++s)
+                if (m_chains[i].n == key.n && m_chains[i].t == key.t)
                 {
-                    result.push_back(in_data[index + s]);
+                    return std::make_pair(i, false);
                 }
             }
 
-            indent += face;
+            auto index = static_cast<std::uint32_t>(m_chains.size());
+            m_chains.push_back(Link{ key.n, key.t, first });
+            first = index;
+            return std::make_pair(index, true);
         }
-        return result;
-    }
+
+    private:
+        static std::uint32_t const kNone = 0xffffffffu;
+
+        struct Link
+        {
+            rpr_int n;
+            rpr_int t;
+            std::uint32_t next;
+        };
+
+        std::vector<std::uint32_t> m_first;
+        std::vector<Link> m_chains;
+    };
+
+    std::uint32_t const VertexWelder::kNone;
 }
 
 ShapeObject::ShapeObject(Baikal::Shape::Ptr shape, ShapeObject* base_shape_obj)
@@ -107,50 +182,86 @@ ShapeObject* ShapeObject::CreateMesh(rpr_float const * in_vertices, size_t in_nu
                         rpr_int const * in_texcoord_indices, rpr_int in_tidx_stride,
                         rpr_int const * in_num_face_vertices, size_t in_num_faces)
 {
-    //merge data
-    std::vector<float> verts = merge(in_vertices, in_num_vertices, in_vertex_stride,
-        in_vertex_indices, in_vidx_stride,
-        in_num_face_vertices, in_num_faces);
-    std::vector<float> normals = merge(in_normals, in_num_normals, in_normal_stride,
-        in_normal_indices, in_nidx_stride,
-        in_num_face_vertices, in_num_faces);
-    std::vector<float> uvs = merge<float, 2>(in_texcoords, in_num_texcoords, in_texcoord_stride,
-        in_texcoord_indices, in_tidx_stride,
-        in_num_face_vertices, in_num_faces);
+    std::size_t num_corners = 0;
+    for (std::size_t i = 0; i < in_num_faces; ++i)
+    {
+        num_corners += in_num_face_vertices[i];
+    }
+
+    AttributeStream<3> positions(in_vertices, in_num_vertices, in_vertex_stride, in_vertex_indices, in_vidx_stride);
+    AttributeStream<3> normals(in_normals, in_num_normals, in_normal_stride, in_normal_indices, in_nidx_stride);
+    AttributeStream<2> uvs(in_texcoords, in_num_texcoords, in_texcoord_stride, in_texcoord_indices, in_tidx_stride);
+
+    //weld face corners sharing the same attributes into one vertex,
+    //seams make the welded mesh slightly larger than the biggest attribute array
+    auto expected_size = std::max({ in_num_vertices, in_num_normals, in_num_texcoords });
+    expected_size = std::min(num_corners, expected_size + expected_size / 8);
+
+    VertexWelder welder(in_vertices ? in_num_vertices : 0, expected_size);
+
+    std::vector<RadeonRays::float3> verts;
+    std::vector<RadeonRays::float3> norms;
+    std::vector<RadeonRays::float2> texcoords;
+    verts.reserve(expected_size);
+    norms.reserve(expected_size);
+    texcoords.reserve(expected_size);
+
+    std::vector<std::uint32_t> corners(num_corners);
+
+    for (std::size_t i = 0; i < num_corners; ++i)
+    {
+        VertexWelder::Key key = { positions.Index(i), normals.Index(i), uvs.Index(i) };
+        auto result = welder.Insert(key);
+
+        if (result.second)
+        {
+            float v[3], n[3], t[2];
+            positions.Fetch(key.p, v);
+            normals.Fetch(key.n, n);
+            uvs.Fetch(key.t, t);
+            verts.emplace_back(v[0], v[1], v[2]);
+            norms.emplace_back(n[0], n[1], n[2]);
+            texcoords.emplace_back(t[0], t[1]);
+        }
+
+        corners[i] = result.first;
+    }
 
     //generate indices
     std::vector<std::uint32_t> inds;
-    std::uint32_t indent = 0;
-    for (std::uint32_t i = 0; i < in_num_faces; ++i)
+    inds.reserve(3 * num_corners / 2 + 3);
+    std::size_t indent = 0;
+    for (std::size_t i = 0; i < in_num_faces; ++i)
     {
-        inds.push_back(indent);
-        inds.push_back(indent + 1);
-        inds.push_back(indent + 2);
-
         int face = in_num_face_vertices[i];
 
-        //triangulation
-        if (face == 4)
-        {
-            inds.push_back(indent + 0);
-            inds.push_back(indent + 2);
-            inds.push_back(indent + 3);
-
-        }
         //only triangles and quads supported
-        else if (face != 3)
+        if (face != 3 && face != 4)
         {
             throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: invalid face value.");
         }
+
+        inds.push_back(corners[indent]);
+        inds.push_back(corners[indent + 1]);
+        inds.push_back(corners[indent + 2]);
+
+        //triangulation
+        if (face == 4)
+        {
+            inds.push_back(corners[indent]);
+            inds.push_back(corners[indent + 2]);
+            inds.push_back(corners[indent + 3]);
+        }
+
         indent += face;
     }
 
     //create mesh
     auto mesh = Baikal::Mesh::Create();
-    mesh->SetVertices(verts.data(), verts.size() / 3);
-    mesh->SetNormals(normals.data(), normals.size() / 3);
-    mesh->SetUVs(uvs.data(), uvs.size() / 2);
-    mesh->SetIndices(inds.data(), inds.size());
+    mesh->SetVertices(std::move(verts));
+    mesh->SetNormals(std::move(norms));
+    mesh->SetUVs(std::move(texcoords));
+    mesh->SetIndices(std::move(inds));
 
     return new ShapeObject(mesh, nullptr);
 }
@@ -841,3 +841,80 @@ TEST_F(BasicTest, Basic_MultiUV)
         texcoord_indices, tidx_stride,
         num_face_vertices, num_faces, &mesh), RPR_ERROR_UNIMPLEMENTED);
 }
+
+// Face corners sharing position, normal and uv indices are welded into one vertex
+TEST_F(BasicTest, Basic_MeshWelding)
+{
+    int const kSize = 4;
+    int const kNumPositions = (kSize + 1) * (kSize + 1);
+
+    std::vector<float3> positions;
+    std::vector<float2> uvs;
+    for (int y = 0; y <= kSize; ++y)
+    {
+        for (int x = 0; x <= kSize; ++x)
+        {
+            positions.push_back(float3((float)x, (float)y, 0.0f));
+            uvs.push_back(float2((float)x / kSize, (float)y / kSize));
+        }
+    }
+
+    float3 normal(0.0f, 0.0f, 1.0f);
+
+    // Quad grid, inner corners are shared by 4 faces, all corners share a single normal
+    std::vector<rpr_int> indices;
+    for (int y = 0; y < kSize; ++y)
+    {
+        for (int x = 0; x < kSize; ++x)
+        {
+            rpr_int i = y * (kSize + 1) + x;
+            indices.insert(indices.end(), { i, i + 1, i + kSize + 2, i + kSize + 1 });
+        }
+    }
+
+    std::vector<rpr_int> normal_indices(indices.size(), 0);
+    std::vector<rpr_int> num_face_vertices(kSize * kSize, 4);
+
+    rpr_shape mesh = nullptr;
+    ASSERT_EQ(rprContextCreateMesh(m_context,
+        (rpr_float const*)positions.data(), positions.size(), sizeof(float3),
+        (rpr_float const*)&normal, 1, sizeof(float3),
+        (rpr_float const*)uvs.data(), uvs.size(), sizeof(float2),
+        indices.data(), sizeof(rpr_int),
+        normal_indices.data(), sizeof(rpr_int),
+        indices.data(), sizeof(rpr_int),
+        num_face_vertices.data(), num_face_vertices.size(), &mesh), RPR_SUCCESS);
+
+    std::uint64_t num_vertices = 0;
+    ASSERT_EQ(rprMeshGetInfo(mesh, RPR_MESH_VERTEX_COUNT, sizeof(num_vertices), &num_vertices, nullptr), RPR_SUCCESS);
+    ASSERT_EQ(num_vertices, (std::uint64_t)kNumPositions);
+
+    std::vector<float> vertex_data(3 * num_vertices);
+    std::vector<float> normal_data(3 * num_vertices);
+    std::vector<float2> uv_data(num_vertices);
+    ASSERT_EQ(rprMeshGetInfo(mesh, RPR_MESH_VERTEX_ARRAY, vertex_data.size() * sizeof(float), vertex_data.data(), nullptr), RPR_SUCCESS);
+    ASSERT_EQ(rprMeshGetInfo(mesh, RPR_MESH_NORMAL_ARRAY, normal_data.size() * sizeof(float), normal_data.data(), nullptr), RPR_SUCCESS);
+    ASSERT_EQ(rprMeshGetInfo(mesh, RPR_MESH_UV_ARRAY, uv_data.size() * sizeof(float2), uv_data.data(), nullptr), RPR_SUCCESS);
+
+    // Welded vertices keep the attributes of the corners they replace
+    for (std::size_t i = 0; i < num_vertices; ++i)
+    {
+        ASSERT_EQ(uv_data[i].x * kSize, vertex_data[3 * i]);
+        ASSERT_EQ(uv_data[i].y * kSize, vertex_data[3 * i + 1]);
+        ASSERT_EQ(normal_data[3 * i + 2], 1.0f);
+    }
+
+    ASSERT_EQ(rprObjectDelete(mesh), RPR_SUCCESS);
+
+    // Attribute indices are range checked
+    normal_indices.back() = 1;
+    mesh = nullptr;
+    ASSERT_EQ(rprContextCreateMesh(m_context,
+        (rpr_float const*)positions.data(), positions.size(), sizeof(float3),
+        (rpr_float const*)&normal, 1, sizeof(float3),
+        (rpr_float const*)uvs.data(), uvs.size(), sizeof(float2),
+        indices.data(), sizeof(rpr_int),
+        normal_indices.data(), sizeof(rpr_int),
+        indices.data(), sizeof(rpr_int),
+        num_face_vertices.data(), num_face_vertices.size(), &mesh), RPR_ERROR_INVALID_PARAMETER);
+}
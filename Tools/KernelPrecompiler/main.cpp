@@ -0,0 +1,278 @@
+/**********************************************************************
+ Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+#include "Controllers/clw_scene_controller.h"
+#include "SceneGraph/camera.h"
+#include "SceneGraph/clwscene.h"
+#include "Utils/cl_program_manager.h"
+#include "Utils/clw_class.h"
+#include "BaikalIO/scene_io.h"
+#include "CLW.h"
+#include "radeon_rays_cl.h"
+
+#ifdef BAIKAL_EMBED_KERNELS
+#include "embed_kernels.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    char const* kHelpMessage =
+        "KernelPrecompiler -o <bundle folder> [-platform <index>] [-device <index>] [-scene <scene file>]...\n"
+        "Run from the folder the renderer is started from, kernel sources are read from ../Baikal/Kernels/CL/.\n"
+        "Programs depending on materials or scene features are only built for given scenes.\n"
+        "Options recorded in <bundle folder>/options.txt, e.g. copied from a render cache, are built as well.";
+
+    // Options below have to match the ones kernel owners build with
+    // PathTracingEstimator::Estimate
+    char const* kAtomicResolveOptions = " -D BAIKAL_ATOMIC_RESOLVE ";
+    // MonteCarloRenderer::GeneratePrimaryRays
+    char const* kPixelCenterOptions = "-D BAIKAL_GENERATE_SAMPLE_AT_PIXEL_CENTER ";
+
+    struct ProgramDesc
+    {
+        char const* name;
+#ifdef BAIKAL_EMBED_KERNELS
+        char const* source;
+        std::unordered_map<char const*, char const*> const* headers;
+#endif
+        std::set<std::string> options;
+        // Programs built with ClwScene::GetFeatureBuildOptions are built for the feature mask
+        // of each given scene as well, with each of these options appended after the features
+        std::vector<std::string> feature_suffixes;
+    };
+
+#ifdef BAIKAL_EMBED_KERNELS
+#define BAIKAL_PROGRAM(name, ...) { #name, g_##name##_opencl, &g_##name##_opencl_headers, __VA_ARGS__ }
+#else
+#define BAIKAL_PROGRAM(name, ...) { #name, __VA_ARGS__ }
+#endif
+
+    // Programs created by ClwRenderFactory objects with all options they can be built with
+    std::vector<ProgramDesc> GetPrograms()
+    {
+        std::string buffer = Baikal::ClwScene::GetTextureBuildOptions(Baikal::TextureBackend::kBuffer);
+        std::string images = Baikal::ClwScene::GetTextureBuildOptions(Baikal::TextureBackend::kImages);
+
+        return
+        {
+            BAIKAL_PROGRAM(monte_carlo_renderer, { "", kPixelCenterOptions, buffer, images }),
+            BAIKAL_PROGRAM(fill_aovs_uberv2, { buffer, images }),
+            BAIKAL_PROGRAM(path_tracing_estimator, { buffer, buffer + kAtomicResolveOptions, images, images + kAtomicResolveOptions }, { "", kAtomicResolveOptions }),
+            BAIKAL_PROGRAM(path_tracing_estimator_uberv2, { buffer, images }, { "" }),
+            BAIKAL_PROGRAM(denoise, { "" }),
+            BAIKAL_PROGRAM(wavelet_denoise, { "" })
+        };
+    }
+
+#undef BAIKAL_PROGRAM
+
+    char* GetCmdOption(char** begin, char** end, const std::string& option)
+    {
+        char** itr = std::find(begin, end, option);
+        if (itr != end && ++itr != end)
+        {
+            return *itr;
+        }
+        return 0;
+    }
+
+    std::vector<std::string> GetCmdOptions(char** begin, char** end, const std::string& option)
+    {
+        std::vector<std::string> values;
+        for (auto itr = std::find(begin, end, option); itr != end && itr + 1 != end; itr = std::find(itr + 2, end, option))
+        {
+            values.push_back(*(itr + 1));
+        }
+        return values;
+    }
+
+    CLWDevice GetDevice(int platform_index, int device_index)
+    {
+        std::vector<CLWPlatform> platforms;
+        CLWPlatform::CreateAllPlatforms(platforms);
+
+        if (platform_index < 0 || platform_index >= (int)platforms.size())
+        {
+            throw std::runtime_error("There is no such platform index");
+        }
+
+        if (device_index < 0 || device_index >= (int)platforms[platform_index].GetDeviceCount())
+        {
+            throw std::runtime_error("There is no such device index");
+        }
+
+        return platforms[platform_index].GetDevice(device_index);
+    }
+
+    // Waits for builds, returns number of failed ones
+    int Wait(std::vector<std::shared_future<CLWProgram>> const& builds)
+    {
+        int num_failed = 0;
+
+        for (auto const& build : builds)
+        {
+            try
+            {
+                build.get();
+            }
+            catch (std::exception& ex)
+            {
+                std::cerr << "Build failed: " << ex.what() << std::endl;
+                ++num_failed;
+            }
+        }
+
+        return num_failed;
+    }
+
+    Baikal::Scene1::Ptr LoadScene(std::string const& filename)
+    {
+        auto separator = filename.find_last_of("/\\");
+        auto basepath = separator == std::string::npos ? std::string() : filename.substr(0, separator + 1);
+
+        auto scene = Baikal::SceneIo::LoadScene(filename, basepath);
+        if (!scene)
+        {
+            throw std::runtime_error("Cannot load scene " + filename);
+        }
+
+        // Camera doesn't affect kernels, but scene can't be compiled without it
+        if (!scene->GetCamera())
+        {
+            scene->SetCamera(Baikal::PerspectiveCamera::Create(RadeonRays::float3(0.f, 0.f, 1.f),
+                RadeonRays::float3(0.f, 0.f, 0.f), RadeonRays::float3(0.f, 1.f, 0.f)));
+        }
+
+        return scene;
+    }
+}
+
+void Process(int argc, char** argv)
+{
+    char* output = GetCmdOption(argv, argv + argc, "-o");
+    char* platform = GetCmdOption(argv, argv + argc, "-platform");
+    char* device = GetCmdOption(argv, argv + argc, "-device");
+    auto scenes = GetCmdOptions(argv, argv + argc, "-scene");
+
+    if (!output)
+    {
+        std::cout << kHelpMessage << std::endl;
+        return;
+    }
+
+    auto context = CLWContext::Create(GetDevice(platform ? std::stoi(platform) : 0, device ? std::stoi(device) : 0));
+    std::cout << "Building kernels for " << context.GetDevice(0).GetName() << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Bundle is written as a regular program cache which is never evicted
+    Baikal::CLProgramManager program_manager(output, std::numeric_limits<std::uint64_t>::max());
+
+    auto const descs = GetPrograms();
+    std::vector<std::unique_ptr<Baikal::ClwClass>> programs;
+
+    for (auto const& desc : descs)
+    {
+#ifdef BAIKAL_EMBED_KERNELS
+        programs.emplace_back(new Baikal::ClwClass(context, &program_manager, desc.name, desc.source, *desc.headers));
+#else
+        programs.emplace_back(new Baikal::ClwClass(context, &program_manager, std::string("../Baikal/Kernels/CL/") + desc.name + ".cl"));
+#endif
+
+        // Registers the options for background compilation like kernel owners do
+        for (auto const& options : desc.options)
+        {
+            programs.back()->SetDefaultBuildOptions(options);
+        }
+    }
+
+    int num_failed = Wait(program_manager.CompileAllAsync());
+
+    if (!scenes.empty())
+    {
+        std::shared_ptr<RadeonRays::IntersectionApi> intersector(
+            CreateFromOpenClContext(context, context.GetDevice(0).GetID(), context.GetCommandQueue(0)),
+            RadeonRays::IntersectionApi::Delete);
+
+        Baikal::ClwSceneController controller(context, intersector.get(), &program_manager);
+
+        for (auto const& filename : scenes)
+        {
+            std::cout << "Building material kernels for " << filename << std::endl;
+
+            // Generates material and input map headers
+            auto scene = LoadScene(filename);
+            controller.CompileScene(scene);
+
+            // Estimator kernels are specialized for features the scene uses, register the
+            // options they are built with at runtime for both texture backends
+            auto features = controller.GetCachedScene(scene).GetFeatureBuildOptions();
+
+            for (std::size_t i = 0; i < descs.size(); ++i)
+            {
+                for (auto const& suffix : descs[i].feature_suffixes)
+                {
+                    for (auto backend : { Baikal::TextureBackend::kBuffer, Baikal::TextureBackend::kImages })
+                    {
+                        programs[i]->SetDefaultBuildOptions(Baikal::ClwScene::GetTextureBuildOptions(backend) + features + suffix);
+                    }
+                }
+            }
+
+            num_failed += Wait(program_manager.CompileAllAsync());
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Done in " << elapsed << " s, " << program_manager.GetProgramCache()->GetEntryCount()
+        << " programs in " << output << std::endl;
+
+    if (num_failed > 0)
+    {
+        throw std::runtime_error(std::to_string(num_failed) + " builds failed");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Process(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Caught exception: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}